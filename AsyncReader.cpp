@@ -0,0 +1,401 @@
+/**
+ * @file AsyncReader.cpp
+ *
+ * Implementation for the AsyncReader class
+ */
+#include "AsyncReader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define CAMPSITE_IO_URING 1
+#endif
+
+namespace {
+
+const unsigned pool_threads = 16;  /// preads in flight at once without io_uring
+const unsigned task_threads = 4;   /// threads for posted work when io_uring does the reads
+
+/**
+ * Reads all length bytes at offset, retrying short reads.
+ *
+ * @return  true if every byte was read
+ */
+bool pread_fully( int fd, const ReadRequest& request ){
+    std::size_t done = 0;
+    while ( done < request.length ){
+        ssize_t got = pread( fd, request.out + done, request.length - done, request.offset + done );
+        if ( got < 0 && errno == EINTR )
+            continue;
+        if ( got <= 0 )
+            return false;
+        done += got;
+    }
+    return true;
+}
+
+}
+
+
+/**
+ * The mapped submission and completion queues of one io_uring.
+ */
+struct AsyncReader::Ring {
+    int       fd = -1;
+    unsigned  entries = 0;
+    void*     sq_map = MAP_FAILED;
+    void*     cq_map = MAP_FAILED;
+    void*     sqe_map = MAP_FAILED;
+    std::size_t sq_bytes = 0, cq_bytes = 0, sqe_bytes = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+#ifdef CAMPSITE_IO_URING
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+#endif
+
+    ~Ring( ){
+        if ( sqe_map != MAP_FAILED )
+            munmap( sqe_map, sqe_bytes );
+        if ( cq_map != MAP_FAILED && cq_map != sq_map )
+            munmap( cq_map, cq_bytes );
+        if ( sq_map != MAP_FAILED )
+            munmap( sq_map, sq_bytes );
+        if ( fd >= 0 )
+            ::close( fd );
+    }
+};
+
+
+/**
+ * One call to read() being worked on by the pread pool.
+ */
+struct AsyncReader::Batch {
+    std::vector<ReadRequest>* requests;
+    std::atomic<std::size_t>  next{0};        /// first request nobody has claimed
+    std::atomic<bool>         failed{false};
+    int                       helpers = 0;    /// pool threads working on it, under _pool_mutex
+};
+
+
+
+/**
+ * Opens the file and sets up an io_uring for it, or starts the pread
+ * pool if io_uring is unavailable (old kernel, seccomp, or not asked for).
+ *
+ * @param filename      file to read from
+ * @param use_io_uring  false to always use the pread pool
+ * @param queue_depth   most reads in flight at once through io_uring
+ */
+AsyncReader::AsyncReader( const std::string& filename, bool use_io_uring, unsigned queue_depth ){
+    _fd = ::open( filename.c_str(), O_RDONLY );
+    if ( _fd < 0 )
+        throw std::runtime_error{"Unable to open " + filename + " for batched reads."};
+
+#ifdef CAMPSITE_IO_URING
+    if ( use_io_uring ){
+        std::unique_ptr<Ring> ring{ new Ring };
+        io_uring_params params;
+        std::memset( &params, 0, sizeof(params) );
+        ring->fd = static_cast<int>( syscall(__NR_io_uring_setup, std::max(queue_depth, 1u), &params) );
+        //IORING_OP_READ arrived in the same release as this feature flag
+        if ( ring->fd >= 0 && (params.features & IORING_FEAT_RW_CUR_POS) ){
+            ring->entries = params.sq_entries;
+            ring->sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            ring->cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+            if ( single )
+                ring->sq_bytes = ring->cq_bytes = std::max( ring->sq_bytes, ring->cq_bytes );
+            ring->sq_map = mmap( nullptr, ring->sq_bytes, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING );
+            ring->cq_map = single ? ring->sq_map
+                                  : mmap( nullptr, ring->cq_bytes, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING );
+            ring->sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+            ring->sqe_map = mmap( nullptr, ring->sqe_bytes, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES );
+            if ( ring->sq_map != MAP_FAILED && ring->cq_map != MAP_FAILED && ring->sqe_map != MAP_FAILED ){
+                char* sq = static_cast<char*>( ring->sq_map );
+                char* cq = static_cast<char*>( ring->cq_map );
+                ring->sq_head  = reinterpret_cast<unsigned*>( sq + params.sq_off.head );
+                ring->sq_tail  = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+                ring->sq_mask  = reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+                ring->sq_array = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+                ring->cq_head  = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+                ring->cq_tail  = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+                ring->cq_mask  = reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+                ring->cqes     = reinterpret_cast<io_uring_cqe*>( cq + params.cq_off.cqes );
+                ring->sqes     = static_cast<io_uring_sqe*>( ring->sqe_map );
+                _ring = std::move( ring );
+            }
+        }
+    }
+#else
+    (void)use_io_uring;
+    (void)queue_depth;
+#endif
+
+    if ( !_ring )
+        for ( unsigned i = 0; i < pool_threads; i++ )
+            _threads.emplace_back( &AsyncReader::_worker, this );
+}
+
+
+
+/**
+ * Runs posted tasks still waiting, then stops the pool threads and
+ * releases the ring and the descriptor.
+ */
+AsyncReader::~AsyncReader( ){
+    {
+        std::lock_guard<std::mutex> guard( _pool_mutex );
+        _stopping = true;
+    }
+    _pool_wake.notify_all();
+    for ( std::thread& thread : _threads )
+        thread.join();
+    _ring.reset();
+    ::close( _fd );
+}
+
+
+
+/**
+ * Fills every request's buffer, with all the reads in flight together.
+ *
+ * @param requests  ranges to read; the vector itself is left unchanged
+ */
+void AsyncReader::read( std::vector<ReadRequest>& requests ){
+    if ( requests.empty() )
+        return;
+    if ( _ring )
+        _read_ring( requests );
+    else
+        _read_pool( requests );
+}
+
+
+
+/**
+ * Runs a task on one of the reader's threads, in the order posted.
+ * With io_uring the reads need no pool, so a few threads are started
+ * for posted work the first time some is posted.
+ *
+ * @param task  work to run; it must catch its own exceptions
+ */
+void AsyncReader::post( std::function<void( )> task ){
+    {
+        std::lock_guard<std::mutex> guard( _pool_mutex );
+        if ( _threads.empty() )
+            for ( unsigned i = 0; i < task_threads; i++ )
+                _threads.emplace_back( &AsyncReader::_worker, this );
+        _tasks.push_back( std::move(task) );
+    }
+    _pool_wake.notify_all();
+}
+
+
+
+/**
+ * Waits until every posted task has run, so that what the tasks use
+ * can safely go away.
+ */
+void AsyncReader::drain( ){
+    std::unique_lock<std::mutex> guard( _pool_mutex );
+    _pool_wake.wait( guard, [this]( ){ return _tasks.empty() && _running == 0; } );
+}
+
+
+
+/**
+ * @return  true if reads go through io_uring rather than the pread pool
+ */
+bool AsyncReader::uses_io_uring( ) const {
+    return _ring != nullptr;
+}
+
+
+
+/**
+ * Queues every read on the io_uring (as many at a time as the ring
+ * holds), and reaps completions until all are done.  Short reads are
+ * queued again for the remainder.
+ *
+ * @param requests  ranges to read
+ */
+void AsyncReader::_read_ring( std::vector<ReadRequest>& requests ){
+#ifdef CAMPSITE_IO_URING
+    std::lock_guard<std::mutex> guard( _ring_mutex );
+    Ring& ring = *_ring;
+    std::vector<std::size_t> progress( requests.size(), 0 );  /// bytes read so far
+    std::vector<std::size_t> todo( requests.size() );         /// requests to submit, last first
+    for ( std::size_t i = 0; i < todo.size(); i++ )
+        todo[i] = todo.size() - 1 - i;
+
+    std::size_t completed = 0;
+    unsigned in_flight = 0, unsubmitted = 0;
+    bool failed = false;
+    while ( completed < requests.size() ){
+        unsigned tail = *ring.sq_tail;
+        while ( !todo.empty() && in_flight < ring.entries ){
+            std::size_t i = todo.back();
+            todo.pop_back();
+            unsigned slot = tail & *ring.sq_mask;
+            io_uring_sqe& sqe = ring.sqes[slot];
+            std::memset( &sqe, 0, sizeof(sqe) );
+            sqe.opcode    = IORING_OP_READ;
+            sqe.fd        = _fd;
+            sqe.off       = requests[i].offset + progress[i];
+            sqe.addr      = reinterpret_cast<std::uint64_t>( requests[i].out + progress[i] );
+            sqe.len       = static_cast<std::uint32_t>( requests[i].length - progress[i] );
+            sqe.user_data = i;
+            ring.sq_array[slot] = slot;
+            tail++;
+            in_flight++;
+            unsubmitted++;
+        }
+        __atomic_store_n( ring.sq_tail, tail, __ATOMIC_RELEASE );
+
+        long entered = syscall( __NR_io_uring_enter, ring.fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0 );
+        if ( entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY ){
+            //the caller frees the buffers once we throw: take back the entries
+            //the kernel has not consumed, and wait out the reads it has
+            unsigned consumed = __atomic_load_n( ring.sq_head, __ATOMIC_ACQUIRE );
+            __atomic_store_n( ring.sq_tail, consumed, __ATOMIC_RELEASE );
+            in_flight -= tail - consumed;
+            while ( in_flight > 0 ){
+                unsigned head = *ring.cq_head;
+                unsigned ready = __atomic_load_n( ring.cq_tail, __ATOMIC_ACQUIRE );
+                if ( head == ready ){
+                    syscall( __NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0 );
+                    continue;
+                }
+                in_flight -= ready - head;
+                __atomic_store_n( ring.cq_head, ready, __ATOMIC_RELEASE );
+            }
+            throw std::runtime_error{"Unable to submit batched reads."};
+        }
+        if ( entered > 0 )
+            unsubmitted -= static_cast<unsigned>( entered );
+
+        unsigned head = *ring.cq_head;
+        unsigned ready = __atomic_load_n( ring.cq_tail, __ATOMIC_ACQUIRE );
+        for ( ; head != ready; head++ ){
+            const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+            std::size_t i = static_cast<std::size_t>( cqe.user_data );
+            in_flight--;
+            if ( cqe.res == -EINTR || cqe.res == -EAGAIN ){
+                todo.push_back( i );
+            }
+            else if ( cqe.res <= 0 ){
+                failed = true;
+                completed++;
+            }
+            else{
+                progress[i] += cqe.res;
+                if ( progress[i] < requests[i].length )
+                    todo.push_back( i );
+                else
+                    completed++;
+            }
+        }
+        __atomic_store_n( ring.cq_head, head, __ATOMIC_RELEASE );
+    }
+    if ( failed )
+        throw std::runtime_error{"Unable to read records from the database."};
+#else
+    _read_pool( requests );
+#endif
+}
+
+
+
+/**
+ * Hands the batch to the pread pool and works on it alongside the
+ * pool until every request is done.
+ *
+ * @param requests  ranges to read
+ */
+void AsyncReader::_read_pool( std::vector<ReadRequest>& requests ){
+    Batch batch;
+    batch.requests = &requests;
+    {
+        std::lock_guard<std::mutex> guard( _pool_mutex );
+        _pending.push_back( &batch );
+    }
+    _pool_wake.notify_all();
+    _work( batch );
+
+    //everything is claimed; wait for the helpers to finish their reads
+    std::unique_lock<std::mutex> guard( _pool_mutex );
+    _pending.erase( std::remove(_pending.begin(), _pending.end(), &batch), _pending.end() );
+    _pool_wake.wait( guard, [&batch]( ){ return batch.helpers == 0; } );
+    if ( batch.failed )
+        throw std::runtime_error{"Unable to read records from the database."};
+}
+
+
+
+/**
+ * Claims and performs requests of a batch until none are left.
+ *
+ * @param batch     the batch to help with
+ */
+void AsyncReader::_work( Batch& batch ){
+    std::vector<ReadRequest>& requests = *batch.requests;
+    for ( std::size_t i = batch.next++; i < requests.size(); i = batch.next++ )
+        if ( !pread_fully(_fd, requests[i]) )
+            batch.failed = true;
+}
+
+
+
+/**
+ * Body of a pool thread: helps with pending batches, or else runs
+ * posted tasks, until stopped with no tasks left.
+ */
+void AsyncReader::_worker( ){
+    std::unique_lock<std::mutex> guard( _pool_mutex );
+    while ( true ){
+        _pool_wake.wait( guard, [this]( ){ return _stopping || !_pending.empty() || !_tasks.empty(); } );
+        if ( _pending.empty() && _tasks.empty() )
+            return;
+
+        if ( _pending.empty() ){
+            std::function<void( )> task = std::move( _tasks.front() );
+            _tasks.pop_front();
+            _running++;
+            guard.unlock();
+            task();
+            guard.lock();
+            _running--;
+            _pool_wake.notify_all();
+            continue;
+        }
+
+        Batch* batch = _pending.front();
+        batch->helpers++;
+        guard.unlock();
+        _work( *batch );
+        guard.lock();
+        batch->helpers--;
+        //fully claimed, so no one else needs to pick it up
+        _pending.erase( std::remove(_pending.begin(), _pending.end(), batch), _pending.end() );
+        _pool_wake.notify_all();
+    }
+}
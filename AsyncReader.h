@@ -0,0 +1,83 @@
+/**
+ * @file AsyncReader.h
+ *
+ * Batched positional reads, issued all at once.
+ *
+ * @remarks
+ *     Used by CampsiteDB::get_many so that a batch of record lookups
+ *     costs about one storage round-trip instead of one per record;
+ *     get_many_async runs on the reader's own threads.
+ */
+#ifndef ASYNCREADER_H
+#define ASYNCREADER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * One read of length bytes at a file offset.
+ */
+struct ReadRequest {
+    std::uint64_t offset;
+    std::size_t   length;
+    char*         out;     /// buffer of at least length bytes
+};
+
+/**
+ * Reads a batch of byte ranges from a file with every read in flight
+ * at once.  Where the kernel allows it the batch goes through an
+ * io_uring submission queue; otherwise a small pool of threads issues
+ * pread calls in parallel.  Either way read() returns when every
+ * range has been filled.  Work that ends in a read can be posted to
+ * the same threads, so callers that want the reads done in the
+ * background need no thread of their own.  Safe to call from many
+ * threads at once.
+ */
+class AsyncReader {
+public:
+    static const unsigned default_queue_depth = 256;
+
+    AsyncReader( const std::string& filename, bool use_io_uring = true,
+                 unsigned queue_depth = default_queue_depth );
+    ~AsyncReader( );
+
+    void read( std::vector<ReadRequest>& requests );
+    // runs task on one of the reader's threads; the task must not throw
+    void post( std::function<void( )> task );
+    // waits until every task posted so far has run
+    void drain( );
+    bool uses_io_uring( ) const;
+
+    // This object is non-copyable
+    AsyncReader(const AsyncReader&)            = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+private:
+    struct Ring;
+    struct Batch;
+
+    void _read_ring( std::vector<ReadRequest>& requests );
+    void _read_pool( std::vector<ReadRequest>& requests );
+    void _work( Batch& batch );
+    void _worker( );
+
+    int                      _fd;
+    std::unique_ptr<Ring>    _ring;         /// io_uring, when available
+    std::mutex               _ring_mutex;   /// one submitter at a time
+    std::vector<std::thread> _threads;      /// pread pool, when no ring
+    std::mutex               _pool_mutex;
+    std::condition_variable  _pool_wake;
+    std::vector<Batch*>      _pending;      /// batches the pool may help with
+    std::deque<std::function<void( )>> _tasks;  /// posted work, run by the pool threads
+    int                      _running = 0;  /// posted tasks being run
+    bool                     _stopping = false;
+};
+
+#endif
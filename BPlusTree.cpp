@@ -0,0 +1,469 @@
+/**
+ * @file BPlusTree.cpp
+ *
+ * Implementation for the BPlusTree class
+ */
+#include "BPlusTree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    const char          tree_magic[8]  = { 'C', 'A', 'M', 'P', 'B', 'T', 'R', 'E' };
+    const std::int32_t  no_page        = -1;
+    const int           header_bytes   = 16;
+    const int           leaf_capacity  = ( BPlusTree::page_size - header_bytes ) / sizeof(BPlusTreeEntry);
+    const int           inner_capacity = ( BPlusTree::page_size - header_bytes - sizeof(std::int32_t) )
+                                         / ( sizeof(BPlusTreeEntry) + sizeof(std::int32_t) );
+}
+
+
+/**
+ * Orders entries by key, then by value.
+ */
+bool operator<( const BPlusTreeEntry& a, const BPlusTreeEntry& b ){
+    return a.key < b.key || ( a.key == b.key && a.value < b.value );
+}
+
+/**
+ * Entries are equal when both key and value match.
+ */
+bool operator==( const BPlusTreeEntry& a, const BPlusTreeEntry& b ){
+    return a.key == b.key && a.value == b.value;
+}
+
+
+/**
+ * Layout of one tree page.  Leaves hold sorted entries; inner nodes
+ * hold count separators and count + 1 children, where child i covers
+ * entries in [keys[i-1], keys[i]).
+ */
+struct BPlusTree::Node {
+    std::uint32_t is_leaf;
+    std::uint32_t count;
+    std::int32_t  next;     /// next leaf in key order (leaves only)
+    std::uint32_t unused;
+    union {
+        BPlusTreeEntry entries[leaf_capacity];
+        struct {
+            BPlusTreeEntry keys[inner_capacity];
+            std::int32_t   children[inner_capacity + 1];
+        } inner;
+    };
+};
+
+/**
+ * Layout of page 0.
+ */
+struct BPlusTree::Meta {
+    char          magic[8];
+    std::int32_t  root;
+    std::int32_t  page_count;
+    std::uint64_t entry_count;
+    std::uint64_t tag;    /// opaque value kept for the owner
+    std::uint32_t clean;  /// 1 when the file was flushed after the last change
+    std::uint8_t  unused[page_size - 36];
+};
+
+static_assert( sizeof(BPlusTreeEntry) == 16, "entries must be 16 bytes" );
+
+
+/**
+ * Opens (or creates) a tree stored in the given file.
+ *
+ * @param filename      file holding the tree pages
+ * @param cache_pages   most tree pages kept in memory
+ */
+BPlusTree::BPlusTree( const std::string& filename, int cache_pages )
+: _filename{filename}, _meta{new Meta} {
+    static_assert( sizeof(Node) == page_size, "tree node must fill a page" );
+    static_assert( sizeof(Meta) == page_size, "tree meta must fill a page" );
+
+    std::fstream probe( _filename, std::ios::in | std::ios::binary );
+    bool exists = probe.good();
+    probe.close();
+    if ( !exists ){
+        probe.open( _filename, std::ios::out | std::ios::binary );
+        probe.close();
+    }
+
+    _pages.reset( new PageCache{_filename, 0, page_size, 1,
+                                static_cast<std::size_t>(cache_pages)} );
+    _pages->read( 0, reinterpret_cast<char*>(_meta.get()) );
+
+    if ( std::memcmp(_meta->magic, tree_magic, sizeof(tree_magic)) != 0 ){
+        if ( exists && _meta->magic[0] != '\0' )
+            throw std::runtime_error{"Not an index file: " + _filename};
+        rebuild( {} );  //lay out an empty tree
+        _clean_on_open = !exists;
+    }
+    else{
+        _clean_on_open = _meta->clean == 1;
+    }
+}
+
+
+
+/**
+ * Writes the tree back and marks the file clean.
+ */
+BPlusTree::~BPlusTree( ){
+    try {
+        flush();
+    } catch ( ... ) {
+        // nothing sensible to do from a destructor
+    }
+}
+
+
+
+/**
+ * Adds an entry to the tree.
+ *
+ * @param entry   the (key, value) pair to add
+ *
+ * @return  true if the entry was added, false if it was already present
+ */
+bool BPlusTree::insert( BPlusTreeEntry entry ){
+    _touch();
+    BPlusTreeEntry separator;
+    std::int32_t   new_page;
+    bool           split = false;
+    bool added = _insert( _meta->root, entry, separator, new_page, split );
+
+    if ( split ){  //the root split: grow the tree by one level
+        Node root;
+        std::memset( &root, 0, sizeof(Node) );
+        root.is_leaf = 0;
+        root.count = 1;
+        root.next = no_page;
+        root.inner.keys[0] = separator;
+        root.inner.children[0] = _meta->root;
+        root.inner.children[1] = new_page;
+        std::int32_t page = _new_page();
+        _write_node( page, root );
+        _meta->root = page;
+    }
+    if ( added )
+        _meta->entry_count++;
+    return added;
+}
+
+
+
+/**
+ * Removes an entry from the tree.  Leaves are not merged.
+ *
+ * @param entry   the (key, value) pair to remove
+ *
+ * @return  true if the entry was found and removed
+ */
+bool BPlusTree::erase( BPlusTreeEntry entry ){
+    _touch();
+    Node node;
+    std::int32_t page = _meta->root;
+    _read_node( page, node );
+    while ( !node.is_leaf ){
+        int i = std::upper_bound( node.inner.keys, node.inner.keys + node.count, entry ) - node.inner.keys;
+        page = node.inner.children[i];
+        _read_node( page, node );
+    }
+
+    BPlusTreeEntry* end = node.entries + node.count;
+    BPlusTreeEntry* pos = std::lower_bound( node.entries, end, entry );
+    if ( pos == end || !(*pos == entry) )
+        return false;
+    std::copy( pos + 1, end, pos );
+    node.count--;
+    _write_node( page, node );
+    _meta->entry_count--;
+    return true;
+}
+
+
+
+/**
+ * Visits entries in order, starting with the first entry not less
+ * than from, until the visitor returns false or the tree runs out.
+ *
+ * @param from    where to start
+ * @param visit   called once per entry
+ */
+void BPlusTree::scan( BPlusTreeEntry from, const Visitor& visit ){
+    Node node;
+    _read_node( _meta->root, node );
+    while ( !node.is_leaf ){
+        int i = std::upper_bound( node.inner.keys, node.inner.keys + node.count, from ) - node.inner.keys;
+        _read_node( node.inner.children[i], node );
+    }
+
+    int i = std::lower_bound( node.entries, node.entries + node.count, from ) - node.entries;
+    while ( true ){
+        for ( ; i < static_cast<int>(node.count); i++ )
+            if ( !visit(node.entries[i]) )
+                return;
+        if ( node.next == no_page )
+            return;
+        _read_node( node.next, node );
+        i = 0;
+    }
+}
+
+
+
+/**
+ * Throws away the current tree and bulk loads the given entries,
+ * packing leaves full.  Much faster than inserting one at a time.
+ *
+ * @param entries   entries to load, in any order
+ */
+void BPlusTree::rebuild( std::vector<BPlusTreeEntry> entries ){
+    std::sort( entries.begin(), entries.end() );
+    entries.erase( std::unique(entries.begin(), entries.end()), entries.end() );
+
+    std::memset( _meta.get(), 0, sizeof(Meta) );
+    std::memcpy( _meta->magic, tree_magic, sizeof(tree_magic) );
+    _meta->page_count = 1;
+    _meta->clean = 0;
+    _pages->write( 0, reinterpret_cast<char*>(_meta.get()) );
+
+    //build the leaf level, remembering each leaf's first entry
+    std::vector<BPlusTreeEntry> firsts;
+    std::vector<std::int32_t>   level;
+    Node node;
+    std::size_t done = 0;
+    do {
+        std::memset( &node, 0, sizeof(Node) );
+        node.is_leaf = 1;
+        node.count = std::min<std::size_t>( leaf_capacity, entries.size() - done );
+        std::copy( entries.begin() + done, entries.begin() + done + node.count, node.entries );
+        std::int32_t page = _new_page();
+        node.next = done + node.count < entries.size() ? page + 1 : no_page;
+        _write_node( page, node );
+        if ( node.count > 0 )
+            firsts.push_back( node.entries[0] );
+        else
+            firsts.push_back( BPlusTreeEntry{0, 0} );
+        level.push_back( page );
+        done += node.count;
+    } while ( done < entries.size() );
+
+    //build inner levels until a single root remains
+    while ( level.size() > 1 ){
+        std::vector<BPlusTreeEntry> next_firsts;
+        std::vector<std::int32_t>   next_level;
+        for ( std::size_t start = 0; start < level.size(); start += inner_capacity + 1 ){
+            std::size_t n = std::min<std::size_t>( inner_capacity + 1, level.size() - start );
+            std::memset( &node, 0, sizeof(Node) );
+            node.is_leaf = 0;
+            node.next = no_page;
+            node.count = n - 1;
+            for ( std::size_t c = 0; c < n; c++ ){
+                node.inner.children[c] = level[start + c];
+                if ( c > 0 )
+                    node.inner.keys[c - 1] = firsts[start + c];
+            }
+            std::int32_t page = _new_page();
+            _write_node( page, node );
+            next_firsts.push_back( firsts[start] );
+            next_level.push_back( page );
+        }
+        firsts.swap( next_firsts );
+        level.swap( next_level );
+    }
+
+    _meta->root = level[0];
+    _meta->entry_count = entries.size();
+}
+
+
+
+/**
+ * Writes all modified pages and marks the file clean.
+ */
+void BPlusTree::flush( ){
+    _meta->clean = 1;
+    _pages->write( 0, reinterpret_cast<char*>(_meta.get()) );
+    _pages->flush();
+}
+
+
+
+/**
+ * @return  false if the file was not closed cleanly after its last
+ *          change, meaning it may be missing updates
+ */
+bool BPlusTree::is_clean( ) const {
+    return _clean_on_open;
+}
+
+
+
+/**
+ * @return  number of entries in the tree
+ */
+std::uint64_t BPlusTree::size( ) const {
+    return _meta->entry_count;
+}
+
+
+
+/**
+ * @return  the value last stored with set_tag
+ */
+std::uint64_t BPlusTree::tag( ) const {
+    return _meta->tag;
+}
+
+
+
+/**
+ * Stores an opaque value in the tree's meta page, persisted on flush.
+ *
+ * @param tag   value to store
+ */
+void BPlusTree::set_tag( std::uint64_t tag ){
+    _meta->tag = tag;
+}
+
+
+
+/**
+ * Copies a tree page out of the page cache.
+ */
+void BPlusTree::_read_node( std::int32_t page, Node& node ){
+    _pages->read( page, reinterpret_cast<char*>(&node) );
+}
+
+
+
+/**
+ * Copies a tree page into the page cache.
+ */
+void BPlusTree::_write_node( std::int32_t page, const Node& node ){
+    _pages->write( page, reinterpret_cast<const char*>(&node) );
+}
+
+
+
+/**
+ * @return  number of a fresh page at the end of the file
+ */
+std::int32_t BPlusTree::_new_page( ){
+    return _meta->page_count++;
+}
+
+
+
+/**
+ * Marks the file as not clean, on disk, before its first change.
+ */
+void BPlusTree::_touch( ){
+    if ( _meta->clean == 0 )
+        return;
+    _meta->clean = 0;
+    _pages->write( 0, reinterpret_cast<char*>(_meta.get()) );
+    _pages->flush();
+}
+
+
+
+/**
+ * Inserts below the given page, splitting it if it overflows.
+ *
+ * @param        page        page of the subtree to insert into
+ * @param        entry       entry to insert
+ * @param[out]   separator   first entry of the new right sibling, if split
+ * @param[out]   new_page    page of the new right sibling, if split
+ * @param[out]   split       set to true if the page was split
+ *
+ * @return  true if the entry was added, false if already present
+ */
+bool BPlusTree::_insert( std::int32_t page, const BPlusTreeEntry& entry,
+                         BPlusTreeEntry& separator, std::int32_t& new_page, bool& split ){
+    Node node;
+    _read_node( page, node );
+    split = false;
+
+    if ( node.is_leaf ){
+        BPlusTreeEntry* end = node.entries + node.count;
+        BPlusTreeEntry* pos = std::lower_bound( node.entries, end, entry );
+        if ( pos != end && *pos == entry )
+            return false;
+        if ( static_cast<int>(node.count) < leaf_capacity ){  //room to spare
+            std::copy_backward( pos, end, end + 1 );
+            *pos = entry;
+            node.count++;
+            _write_node( page, node );
+            return true;
+        }
+
+        std::vector<BPlusTreeEntry> all( node.entries, pos );
+        all.push_back( entry );
+        all.insert( all.end(), pos, end );
+
+        //split the leaf in half
+        Node right;
+        std::memset( &right, 0, sizeof(Node) );
+        right.is_leaf = 1;
+        std::size_t half = all.size() / 2;
+        node.count = half;
+        right.count = all.size() - half;
+        std::copy( all.begin(), all.begin() + half, node.entries );
+        std::copy( all.begin() + half, all.end(), right.entries );
+        new_page = _new_page();
+        right.next = node.next;
+        node.next = new_page;
+        _write_node( page, node );
+        _write_node( new_page, right );
+        separator = right.entries[0];
+        split = true;
+        return true;
+    }
+
+    int i = std::upper_bound( node.inner.keys, node.inner.keys + node.count, entry ) - node.inner.keys;
+    BPlusTreeEntry child_separator;
+    std::int32_t   child_page;
+    bool           child_split;
+    bool added = _insert( node.inner.children[i], entry, child_separator, child_page, child_split );
+    if ( !child_split )
+        return added;
+    if ( static_cast<int>(node.count) < inner_capacity ){  //room to spare
+        std::copy_backward( node.inner.keys + i, node.inner.keys + node.count,
+                            node.inner.keys + node.count + 1 );
+        std::copy_backward( node.inner.children + i + 1, node.inner.children + node.count + 1,
+                            node.inner.children + node.count + 2 );
+        node.inner.keys[i] = child_separator;
+        node.inner.children[i + 1] = child_page;
+        node.count++;
+        _write_node( page, node );
+        return added;
+    }
+
+    std::vector<BPlusTreeEntry> keys( node.inner.keys, node.inner.keys + node.count );
+    std::vector<std::int32_t>   children( node.inner.children, node.inner.children + node.count + 1 );
+    keys.insert( keys.begin() + i, child_separator );
+    children.insert( children.begin() + i + 1, child_page );
+
+    //split the inner node; the middle key moves up
+    std::size_t mid = keys.size() / 2;
+    Node right;
+    std::memset( &right, 0, sizeof(Node) );
+    right.is_leaf = 0;
+    right.next = no_page;
+    node.count = mid;
+    std::copy( keys.begin(), keys.begin() + mid, node.inner.keys );
+    std::copy( children.begin(), children.begin() + mid + 1, node.inner.children );
+    right.count = keys.size() - mid - 1;
+    std::copy( keys.begin() + mid + 1, keys.end(), right.inner.keys );
+    std::copy( children.begin() + mid + 1, children.end(), right.inner.children );
+    new_page = _new_page();
+    _write_node( page, node );
+    _write_node( new_page, right );
+    separator = keys[mid];
+    split = true;
+    return added;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file BPlusTree.h
+ *
+ * Disk-resident B+tree mapping 64-bit keys to 64-bit values.
+ *
+ * @remarks
+ *     Used by CampsiteDB for its secondary indexes.  Entries are
+ *     (key, value) pairs ordered by key and then by value, so one key
+ *     may map to many values.
+ */
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PageCache.h"
+
+/**
+ * One (key, value) pair stored in a BPlusTree.
+ */
+struct BPlusTreeEntry {
+    std::int64_t key;
+    std::int64_t value;
+};
+
+bool operator<( const BPlusTreeEntry& a, const BPlusTreeEntry& b );
+bool operator==( const BPlusTreeEntry& a, const BPlusTreeEntry& b );
+
+/**
+ * A B+tree stored in fixed 4 KiB pages of its own file.  Nodes are
+ * read and written through a PageCache, so only the hot part of the
+ * tree stays in memory.  Leaves are chained for ordered range scans.
+ *
+ * Deletion removes entries from their leaf without rebalancing;
+ * leaves may become sparse or empty, which only costs space.
+ *
+ * The file records whether it was closed cleanly.  An index that was
+ * being modified when the process died reports is_clean() == false
+ * when reopened so the owner can rebuild it.
+ */
+class BPlusTree {
+public:
+    // return false to stop a scan early
+    using Visitor = std::function<bool( const BPlusTreeEntry& entry )>;
+
+    static const int page_size = 4096;
+
+    BPlusTree( const std::string& filename, int cache_pages = 256 );
+    ~BPlusTree( );
+
+    bool insert( BPlusTreeEntry entry );
+    bool erase( BPlusTreeEntry entry );
+    void scan( BPlusTreeEntry from, const Visitor& visit );
+    void rebuild( std::vector<BPlusTreeEntry> entries );
+    void flush( );
+
+    bool          is_clean( ) const;
+    std::uint64_t size( ) const;
+    std::uint64_t tag( ) const;
+    void          set_tag( std::uint64_t tag );
+
+    // This object is non-copyable
+    BPlusTree(const BPlusTree&)            = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+private:
+    struct Node;
+    struct Meta;
+
+    void _read_node( std::int32_t page, Node& node );
+    void _write_node( std::int32_t page, const Node& node );
+    std::int32_t _new_page( );
+    void _touch( );
+    bool _insert( std::int32_t page, const BPlusTreeEntry& entry,
+                  BPlusTreeEntry& separator, std::int32_t& new_page, bool& split );
+
+    std::string                _filename;
+    std::unique_ptr<PageCache> _pages;
+    std::unique_ptr<Meta>      _meta;
+    bool                       _clean_on_open;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file BulkLoad.cpp
+ *
+ * Hand-written parser for "number|description|true/false|rate" lines.
+ */
+#include "BulkLoad.h"
+
+#include <charconv>
+
+
+namespace {
+
+/**
+ * @return  p advanced past spaces, tabs and carriage returns
+ */
+const char* skip_blanks( const char* p, const char* end ){
+    while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' ) )
+        ++p;
+    return p;
+}
+
+/**
+ * Parses one line into a record.
+ *
+ * @return  nullptr on success, otherwise a description of the problem
+ */
+const char* parse_line( const char* p, const char* end, CampsiteRecord& site ){
+    p = skip_blanks( p, end );
+    std::from_chars_result number = std::from_chars( p, end, site.number );
+    if ( number.ec != std::errc() )
+        return "bad site number";
+    p = skip_blanks( number.ptr, end );
+    if ( p == end || *p++ != '|' )
+        return "missing '|' after site number";
+
+    const char* bar = static_cast<const char*>( std::memchr(p, '|', end - p) );
+    if ( bar == nullptr )
+        return "missing '|' after description";
+    std::size_t length = bar - p;
+    if ( length > CampsiteRecord::desc_size - 1 )
+        length = CampsiteRecord::desc_size - 1;  //truncate, like Campsite::set_description
+    std::memcpy( site.description, p, length );
+    p = bar + 1;
+
+    bar = static_cast<const char*>( std::memchr(p, '|', end - p) );
+    if ( bar == nullptr )
+        return "missing '|' after electric flag";
+    p = skip_blanks( p, bar );
+    site.has_electric = p < bar && tolower( *p ) == 't';
+    p = skip_blanks( bar + 1, end );
+
+    std::from_chars_result rate = std::from_chars( p, end, site.rate );
+    if ( rate.ec != std::errc() )
+        return "bad rate";
+    if ( skip_blanks(rate.ptr, end) != end )
+        return "unexpected text after rate";
+    return nullptr;
+}
+
+}
+
+
+/**
+ * @return  records appended per second of wall time
+ */
+double BulkLoadReport::records_per_second( ) const {
+    return seconds > 0 ? records / seconds : 0;
+}
+
+
+
+/**
+ * @return  megabytes of input consumed per second of wall time
+ */
+double BulkLoadReport::megabytes_per_second( ) const {
+    return seconds > 0 ? bytes / seconds / ( 1024.0 * 1024.0 ) : 0;
+}
+
+
+
+/**
+ * Parses every line in [begin, end) into records.  Blank lines are
+ * skipped.  Rejected lines are reported with their line number
+ * relative to begin (the first line is line 1).
+ *
+ * @param        begin      first character of the text
+ * @param        end        one past the last character
+ * @param[out]   records    parsed records are appended here
+ * @param[out]   errors     rejected lines are appended here
+ *
+ * @return  number of lines in the text, blank ones included
+ */
+std::size_t parse_site_lines( const char* begin, const char* end,
+                              std::vector<CampsiteRecord>& records,
+                              std::vector<BulkLoadError>& errors ){
+    std::size_t line = 0;
+    for ( const char* p = begin; p < end; ){
+        const char* newline = static_cast<const char*>( std::memchr(p, '\n', end - p) );
+        const char* stop = newline != nullptr ? newline : end;
+        ++line;
+
+        if ( skip_blanks(p, stop) != stop ){
+            CampsiteRecord site;
+            const char* problem = parse_line( p, stop, site );
+            if ( problem == nullptr )
+                records.push_back( site );
+            else
+                errors.push_back( BulkLoadError{line, problem} );
+        }
+        p = stop + 1;
+    }
+    return line;
+}
+
+
+
+/**
+ * Prints a one-line summary of a bulk load followed by its errors.
+ *
+ * @param strm     output stream
+ * @param report   the report to print
+ */
+std::ostream& operator<<( std::ostream& strm, const BulkLoadReport& report ){
+    strm << report.records << " records from " << report.lines << " lines in "
+         << std::fixed << std::setprecision( 3 ) << report.seconds << "s ("
+         << std::setprecision( 0 ) << report.records_per_second() << " records/s, "
+         << std::setprecision( 1 ) << report.megabytes_per_second() << " MiB/s), "
+         << report.error_count << " rejected"
+         << std::resetiosflags( std::ios::fixed | std::ios::showpoint );
+    for ( const BulkLoadError& error : report.errors )
+        strm << "\n  line " << error.line << ": " << error.message;
+    return strm;
+}
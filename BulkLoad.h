@@ -0,0 +1,46 @@
+/**
+ * @file BulkLoad.h
+ *
+ * Fast parsing of pipe-delimited site files for CampsiteDB::bulk_load.
+ */
+#ifndef BULKLOAD_H
+#define BULKLOAD_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "CampsiteRecord.h"
+
+/**
+ * A line of the input that could not be turned into a record.
+ */
+struct BulkLoadError {
+    std::size_t line;     /// 1-based line number in the input file
+    std::string message;  /// what was wrong with it
+};
+
+/**
+ * What a bulk load did and how fast it did it.
+ */
+struct BulkLoadReport {
+    static const std::size_t max_errors = 1000;  /// errors kept in detail
+
+    std::size_t                lines       = 0;  /// lines in the input, blank ones included
+    std::size_t                records     = 0;  /// records appended
+    std::size_t                error_count = 0;  /// lines rejected
+    std::vector<BulkLoadError> errors;           /// the first max_errors rejections
+    double                     seconds     = 0;  /// wall time of the whole load
+    std::size_t                bytes       = 0;  /// size of the input file
+
+    double records_per_second( ) const;
+    double megabytes_per_second( ) const;
+};
+
+std::size_t parse_site_lines( const char* begin, const char* end,
+                              std::vector<CampsiteRecord>& records,
+                              std::vector<BulkLoadError>& errors );
+
+std::ostream& operator<<( std::ostream& strm, const BulkLoadReport& report );
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file CampsiteCursor.cpp
+ *
+ * Implementation for the CampsiteCursor class
+ */
+#include "CampsiteCursor.h"
+#include "CampsiteDB.h"
+
+
+/**
+ * Construct a cursor with both markers at the given index.
+ *
+ * @param db      database to walk
+ * @param index   starting position of both markers
+ */
+CampsiteCursor::CampsiteCursor( CampsiteDB& db, int index )
+: _db{&db}, _read_index{0}, _write_index{0} {
+    move_to_index( index );
+}
+
+
+
+/**
+ * Gets the current index of either the read or the write marker.
+ *
+ * @param   write  true for the write marker, false for the read marker
+ *
+ * @return  the marker's current index
+ */
+int CampsiteCursor::get_current_index( bool write ) const {
+    return write ? _write_index : _read_index;
+}
+
+
+
+/**
+ * Moves both markers to the given index.
+ *
+ * @param        index   a position where the markers are moved to
+ */
+void CampsiteCursor::move_to_index( int index ){
+    if ( !_db->bounds_check(index, true) )
+        throw std::length_error{"Index out of bounds."};
+    _read_index = index;
+    _write_index = index;
+}
+
+
+
+/**
+ * Reads the record at the read marker and advances it, skipping over
+ * deleted records.
+ *
+ * @return the record to be read
+ */
+Campsite CampsiteCursor::get_next_sequential( ){
+    if ( _db->get_live_count() < _db->get_record_count() )
+        while ( _db->bounds_check(_read_index) && _db->is_deleted(_read_index) )
+            _read_index++;
+    Campsite site = _db->get_at_index( _read_index );
+    _read_index++;
+    return site;
+}
+
+
+
+/**
+ * Writes a record at the write marker and advances it.
+ *
+ * @param site  a record to be written in the file
+ */
+void CampsiteCursor::write_next_sequential( const Campsite& site ){
+    _db->write_at_index( _write_index, site );
+    _write_index++;
+}
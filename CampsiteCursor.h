@@ -0,0 +1,34 @@
+/**
+ * @file CampsiteCursor.h
+ *
+ * Private read and write markers over a shared CampsiteDB.
+ */
+#ifndef CAMPSITECURSOR_H
+#define CAMPSITECURSOR_H
+
+#include "Campsite.h"
+
+class CampsiteDB;
+
+/**
+ * The sequential-access half of CampsiteDB (get/put markers) as a
+ * separate object, so each thread using a concurrent database can
+ * walk it without disturbing anyone else's position.
+ */
+class CampsiteCursor {
+public:
+    explicit CampsiteCursor( CampsiteDB& db, int index = 0 );
+
+    int  get_current_index( bool write = false ) const;
+    void move_to_index( int index );
+
+    Campsite get_next_sequential( );
+    void     write_next_sequential( const Campsite& site );
+
+private:
+    CampsiteDB* _db;
+    int         _read_index;   /// next index get_next_sequential reads
+    int         _write_index;  /// next index write_next_sequential writes
+};
+
+#endif
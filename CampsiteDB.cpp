@@ -1,19 +1,195 @@
 #include "CampsiteDB.h"
+#include "PackedCampsiteRecord.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * Forces everything written to a file out to stable storage.
+ *
+ * @param filename  file to sync
+ */
+void sync_file( const std::string& filename ){
+    int fd = ::open( filename.c_str(), O_RDONLY );
+    bool ok = fd >= 0 && fsync( fd ) == 0;
+    stats_sync();
+    if ( fd >= 0 )
+        ::close( fd );
+    if ( !ok )
+        throw std::runtime_error{"Unable to sync " + filename + "."};
+}
+
+
+
+/**
+ * Continues a packed record's checksum over its description, so damage
+ * to the heap fails the record just as damage to its slot does.
+ * Tombstones, whose reference fields hold free-list links, add nothing;
+ * neither does a reference that cannot be read, which leaves the sum
+ * short of what was stored.
+ *
+ * @param        stored     a packed record
+ * @param        crc        the checksum of its slot
+ * @param        read_text  reads (offset, length, out) from a heap; false if it cannot
+ *
+ * @return  the record's checksum
+ */
+template <typename ReadText>
+std::uint32_t checksum_description( const char* stored, std::uint32_t crc, ReadText read_text ){
+    PackedCampsiteRecord packed;
+    std::memcpy( &packed, stored, sizeof(packed) );
+    if ( ( packed.flags & PackedCampsiteRecord::tombstone_flag ) || packed.desc_length == 0 )
+        return crc;
+    char text[256];
+    if ( !read_text(packed.desc_offset, packed.desc_length, text) )
+        return crc;
+    return crc32c( text, packed.desc_length, crc );
+}
+
+
+
+/**
+ * @param rate      a rate that is not NaN
+ *
+ * @return  a key that orders as the rate does
+ */
+std::int64_t rate_key( double rate ){
+    if ( rate == 0 )  //-0.0 and 0.0 are the same rate
+        rate = 0;
+    std::int64_t bits;
+    std::memcpy( &bits, &rate, sizeof(bits) );
+    return bits < 0 ? bits ^ std::numeric_limits<std::int64_t>::max() : bits;
+}
+
+
+
+/**
+ * Makes a record's rate index entry: its rate as the key, and its
+ * index and whether it has electricity packed into the value, so the
+ * electricity filter never needs the record itself.
+ *
+ * @param        index      the record's index
+ * @param        record     the record
+ * @param[out]   entry      its entry
+ *
+ * @return  false if the record is not indexed (its rate is NaN)
+ */
+bool rate_entry( int index, const CampsiteRecord& record, BPlusTreeEntry& entry ){
+    if ( std::isnan(record.rate) )
+        return false;
+    entry = BPlusTreeEntry{ rate_key(record.rate), std::int64_t{index} * 2 + ( record.has_electric ? 1 : 0 ) };
+    return true;
+}
+
+}
 
 /**
  * Construct a CampsiteDB given a filename and open
  * the file with bainary mode.
  *
  * @param filename  file's name
+ * @param options   how the file should be accessed
  */
-CampsiteDB::CampsiteDB( std::string filename ){
+CampsiteDB::CampsiteDB( std::string filename, CampsiteDBOptions options ){
     _filename = filename;
     if ( !_open_file() ){  //if the file doesn't exist...
         _create_file();
         if ( !_open_file() )  //still couldn't open the file
             throw std::runtime_error{"Unable to create the database."};
     }
+    bool found = _load_header( options.packed_format );
+    if ( options.memory_mapped && options.cache_pages > 0 )
+        throw std::invalid_argument{"A memory mapped database cannot also be cached."};
+    if ( options.concurrent && ( options.memory_mapped || options.cache_pages > 0 || _heap ) )
+        throw std::invalid_argument{"Concurrent mode needs an unmapped, uncached, raw-format database."};
+    if ( options.concurrent && options.append_buffer_records > 0 )
+        throw std::invalid_argument{"Concurrent mode cannot buffer appends."};
+    if ( options.concurrent ){
+        _fd = ::open( _filename.c_str(), O_RDWR );
+        if ( _fd < 0 )
+            throw std::runtime_error{"Unable to open the database for positional I/O."};
+        _slots = RecordSlots<CampsiteRecord>{ _fd, _data_offset };  //concurrent files are raw
+        _locks.reset( new StripedLock );
+        _write_index = get_record_count();
+    }
+    if ( options.memory_mapped )
+        _map.open( _filename );
+    if ( options.cache_pages > 0 )
+        _cache.reset( new PageCache{_filename, _data_offset, _record_size,
+                                    static_cast<std::size_t>(options.cache_page_records),
+                                    static_cast<std::size_t>(options.cache_pages)} );
+    if ( options.checksums ){  //before replaying, so replayed writes are checksummed too
+        _open_checksums();
+    }
+    else if ( _header.flags & CampsiteFileHeader::checksum_flag ){  //writes from here on go unchecksummed
+        _header.flags &= ~CampsiteFileHeader::checksum_flag;
+        _store_header();
+    }
+    if ( options.write_ahead_log ){  //replay before anything reads records a crash may have torn
+        _wal.reset( new WriteAheadLog{_filename + ".wal"} );
+        _checkpoint_bytes = options.checkpoint_bytes;
+        _recover();
+    }
+    //a crash may have left deleted slots off the list, and older builds
+    //could store a free-list head and count that do not go together
+    bool torn = ( _header.free_head == 0 ) != ( _dead == 0 ) || _header.free_head > _header.record_count
+             || _dead > get_record_count();
+    if ( torn || ( found && ( _header.flags & CampsiteFileHeader::tombstone_flag ) ) ){
+        _rebuild_free_list();
+        _file.clear();
+        _file.seekp( _offset(get_record_count()), std::ios::beg );
+    }
+    _open_indexes( options );
+    _use_io_uring = options.io_uring;
+    _reuse_free_slots = options.reuse_free_slots;
+    _buffer_limit = std::max( options.append_buffer_records, 0 );
+    _preallocate_bytes = options.preallocate_bytes;
+    if ( _buffer_limit > 0 ){  //the markers move to members, as in concurrent mode
+        _read_index = 0;
+        _write_index = get_record_count();
+        _pending.reserve( _buffer_limit );
+    }
+    _check_reads = options.checksums;  //a crash may have torn what replaying and rebuilding read
+    _stats.set_enabled( options.collect_stats );
+    if ( options.collect_stats && !options.stats_dump_file.empty() && options.stats_dump_seconds > 0 )
+        _stats.start_dump( options.stats_dump_file, std::chrono::seconds(options.stats_dump_seconds) );
+}
+
+
+/**
+ * Flushes the header and any buffered or cached records before
+ * closing, and empties the write-ahead log if there is one.  Slots
+ * compaction kept for snapshots are cut off, so reopening does not
+ * take them for records appended before a crash.
+ */
+CampsiteDB::~CampsiteDB( ){
+    if ( _reader )
+        _reader->drain();  //queued get_many_async calls still need the database
+    try {
+        if ( _wal )
+            checkpoint();
+        else
+            flush();
+        if ( _trim_pending )
+            ::truncate( _filename.c_str(), _offset(get_record_count()) );
+    } catch ( ... ) {
+        // nothing sensible to do from a destructor
+    }
+    if ( _fd >= 0 )
+        ::close( _fd );
+    if ( _reserve_fd >= 0 )
+        ::close( _reserve_fd );
 }
 
 
@@ -40,33 +216,337 @@ bool CampsiteDB::_open_file( ){
 }
 
 
+/**
+ * Reads and validates the file header, or writes a fresh one if the
+ * file is empty.  Files written before the header existed (no magic)
+ * are still accepted; their records start at offset 0 and their
+ * count is taken from the file size.  The stored count only moves on
+ * flush(), so one that disagrees with the file size is corrected, as
+ * RecordFile corrects its own (see CampsiteFileHeader::fit_count).
+ * Packed files also open their description heap.  Leaves the put
+ * marker after the last record.
+ *
+ * @param        packed     format for a brand new file
+ *
+ * @return  true if records were found past the stored count
+ */
+bool CampsiteDB::_load_header( bool packed ){
+    bool found = false;
+    std::streamoff file_size = _file.tellp();
+    _file.seekg(0, std::ios::beg);
+
+    if ( file_size == 0 ){  //brand new database
+        if ( packed )
+            _header = CampsiteFileHeader{ CampsiteFileHeader::packed_version, sizeof(PackedCampsiteRecord),
+                                          PackedCampsiteRecord::record_type };
+        else
+            _header = CampsiteFileHeader{ CampsiteFileHeader::raw_version, sizeof(CampsiteRecord),
+                                          CampsiteRecord::record_type };
+        _record_size = _header.record_size;
+        _data_offset = sizeof(CampsiteFileHeader);
+        _store_header();
+    }
+    else if ( read_header(_file, _header) && _header.has_magic() ){
+        if ( _header.version > CampsiteFileHeader::current_version )
+            throw std::runtime_error{"Database was written by a newer format version."};
+        bool holds = _header.version == CampsiteFileHeader::packed_version
+                   ? _header.holds( PackedCampsiteRecord::record_type, sizeof(PackedCampsiteRecord) )
+                   : _header.holds( CampsiteRecord::record_type, sizeof(CampsiteRecord) );
+        if ( !holds )
+            throw std::runtime_error{"Database records do not match CampsiteRecord."};
+        _record_size = _header.record_size;
+        _data_offset = sizeof(CampsiteFileHeader);
+        std::int64_t gained = _header.fit_count( file_size, _data_offset );
+        if ( gained != 0 ){
+            found = gained > 0;
+            _header_dirty = true;
+        }
+        _count = static_cast<int>( _header.record_count );
+        _dead = static_cast<int>( _header.free_count );
+    }
+    else{  //headerless file from before the header existed
+        _header = CampsiteFileHeader{ CampsiteFileHeader::raw_version, sizeof(CampsiteRecord), 0 };
+        _header.record_count = file_size / sizeof(CampsiteRecord);
+        _count = static_cast<int>( _header.record_count );
+        _data_offset = 0;
+    }
+
+    if ( _header.version == CampsiteFileHeader::packed_version )
+        _heap.reset( new DescriptionHeap{_filename + ".heap"} );
+
+    _file.clear();
+    _file.seekp( _offset(get_record_count()), std::ios::beg );
+    return found;
+}
+
+
+/**
+ * Writes the in-memory header to the front of the file, leaving the
+ * stream markers where they were.  Headerless files are left alone.
+ */
+void CampsiteDB::_store_header( ){
+    if ( _data_offset == 0 )
+        return;
+
+    _header.record_count = get_record_count();
+    _header.free_count = _dead;
+    if ( _fd >= 0 ){  //concurrent mode: never touch the shared stream
+        stats_write( sizeof(CampsiteFileHeader) );
+        if ( pwrite(_fd, &_header, sizeof(CampsiteFileHeader), 0) != sizeof(CampsiteFileHeader) )
+            throw std::runtime_error{"Unable to write the database header."};
+        _header_dirty = false;
+        return;
+    }
+
+    _file.clear();
+    std::streamoff put = _file.tellp();
+    _file.seekp(0, std::ios::beg);
+    write_header(_file, _header);
+    _file.seekp( put < 0 ? 0 : put, std::ios::beg );
+    stats_seek();
+    stats_seek();
+    stats_seek();
+    stats_write( sizeof(CampsiteFileHeader) );
+    if ( !_file.good() )
+        throw std::runtime_error{"Unable to write the database header."};
+    _header_dirty = false;
+}
+
+
+/**
+ * @param        index      logical record index
+ *
+ * @return  file position where the record at index starts
+ */
+std::streamoff CampsiteDB::_offset( int index ) const {
+    return _data_offset + static_cast<std::streamoff>(index) * _record_size;
+}
+
+
 
 
 /**
- * Writes the given record in the file at the current location.
+ * Writes the given record in the file at the current location.  At the
+ * end of the file the record is appended there; only append() fills
+ * deleted slots.  With append buffering, a record written at the end is only kept in
+ * memory until enough have gathered for one large write (or flush()).
  *
  * @param site  a record to be written in the file
  */
 void CampsiteDB::write_next_sequential( const Campsite& site ){
-    if ( get_current_index(true) > get_record_count() )
+    OperationTimer timer{ _stats, Operation::write_next_sequential };
+    int index = get_current_index(true);
+    if ( index > get_record_count() )
         throw std::length_error{"Index out of bounds."};
 
     CampsiteRecord record = site.get_record();
-    _file.write( reinterpret_cast<char*>(&record), sizeof(CampsiteRecord));
+    if ( _locks ){
+        _write_concurrent( index, record );
+        _write_index++;
+        return;
+    }
+    if ( _buffer_limit > 0 ){
+        if ( index == get_record_count() ){  //write-behind; logged when written
+            _pending.push_back( record );
+            _count.store( index + 1, std::memory_order_release );
+            _header_dirty = true;
+            _update_indexes( index, nullptr, record );
+            _write_index++;
+            if ( _pending.size() >= _buffer_limit ){
+                _drain();
+                _checkpoint( true );
+            }
+            return;
+        }
+        if ( !_pending.empty() && index >= get_record_count() - static_cast<int>(_pending.size()) )
+            _drain();
+        _file.clear();
+        _file.seekp( _offset(index), std::ios::beg );
+        stats_seek();
+        _write_index = index + 1;
+    }
+
+    WalEntry entry{ index, 0, record };
+    _log( &entry, 1 );
+
+    CampsiteRecord before;
+    bool replacing = index < get_record_count();
+    if ( replacing && ( _has_indexes() || _dead > 0 || _snapshots > 0 ) ){  //indexes, the free list and snapshots need the old record
+        before = _read_record( index );
+        if ( is_tombstone(before) )  //filling a deleted slot takes it off the free list
+            _free_unlink( index, tombstone_links(before) );
+        _preserve( index, before );
+        _file.clear();
+        _file.seekp( _offset(index), std::ios::beg );
+        stats_seek();
+    }
+
+    const char* bytes = reinterpret_cast<const char*>( &record );
+    PackedCampsiteRecord packed;
+    if ( _heap ){  //store the packed form instead
+        packed = _pack( index, record );
+        bytes = reinterpret_cast<const char*>( &packed );
+        if ( replacing ){  //reading the old slot moved the markers
+            _file.clear();
+            _file.seekp( _offset(index), std::ios::beg );
+            stats_seek();
+        }
+    }
+
+    if ( _cache ){  //the cache owns the data; just advance the put marker
+        _cache->write( index, bytes );
+        _file.seekp( _offset(index + 1), std::ios::beg );
+        stats_seek();
+    }
+    else{
+        _file.write( bytes, _record_size );
+        stats_write( _record_size );
+    }
+    _stamp( index, 1, bytes );
+
+    if ( index == get_record_count() ){  //appended a new record
+        _count++;
+        _header_dirty = true;
+    }
+    _update_indexes( index, replacing ? &before : nullptr, record );
+    if ( _map.is_open() )
+        _grow_mapping( index );
+    _checkpoint( true );
+}
+
+
+/**
+ * Adds a record after the last one, wherever the put marker is.  In
+ * concurrent mode this is the safe way for many threads to append,
+ * since the end of the file is claimed under the append lock.  With
+ * reuse_free_slots set, a deleted slot is filled instead if there is one.
+ *
+ * @param site  a record to be added
+ *
+ * @return  the index the record was written at
+ */
+int CampsiteDB::append( const Campsite& site ){
+    OperationTimer timer{ _stats, Operation::append };
+    CampsiteRecord record = site.get_record();
+    int index = _reuse_free_slots ? _fill_free_slot( record ) : -1;
+    return index >= 0 ? index : _append_records( &record, 1 );
+}
+
+
+
+/**
+ * Appends every site in a pipe-delimited text file (the format read by
+ * Campsite::from_ascii_file) to the end of the database.  The file is
+ * memory mapped, cut into chunks on line boundaries, and the chunks
+ * are parsed in parallel; parsed chunks are appended in input order
+ * with one large write each.  Lines that do not parse are skipped and
+ * reported.  Leaves the put marker after the last record.
+ *
+ * @param        text_file  file of "number|description|true/false|rate" lines
+ * @param        threads    parser threads to use (0 means one per core)
+ *
+ * @return  counts, timing and the rejected lines
+ */
+BulkLoadReport CampsiteDB::bulk_load( const std::string& text_file, int threads ){
+    OperationTimer timer{ _stats, Operation::bulk_load };
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if ( threads <= 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    MappedFile text;
+    text.open( text_file );
+    const char* end = text.data() + text.size();
+
+    //cut the text into several chunks per thread, ending each on a newline
+    std::size_t chunk_bytes = std::max<std::size_t>( text.size() / (threads * 4), 1 << 20 );
+    std::vector<const char*> cuts{ text.data() };
+    while ( cuts.back() < end ){
+        const char* cut = cuts.back() + std::min<std::size_t>( chunk_bytes, end - cuts.back() );
+        if ( cut < end ){
+            const char* newline = static_cast<const char*>( std::memchr(cut, '\n', end - cut) );
+            cut = newline != nullptr ? newline + 1 : end;
+        }
+        cuts.push_back( cut );
+    }
+
+    struct Parsed {
+        std::vector<CampsiteRecord> records;
+        std::vector<BulkLoadError>  errors;
+        std::size_t                 lines = 0;
+    };
+
+    BulkLoadReport report;
+    report.bytes = text.size();
+    int chunks = static_cast<int>( cuts.size() ) - 1;
+    //parse a wave of chunks in parallel, then append the wave in order
+    for ( int wave = 0; wave < chunks; wave += threads ){
+        int n = std::min( threads, chunks - wave );
+        std::vector<Parsed> parsed( n );
+        auto parse = [&parsed, &cuts, wave]( int i ){
+            parsed[i].lines = parse_site_lines( cuts[wave + i], cuts[wave + i + 1],
+                                                parsed[i].records, parsed[i].errors );
+        };
+        std::vector<std::thread> workers;
+        for ( int i = 1; i < n; i++ )
+            workers.emplace_back( parse, i );
+        parse( 0 );
+        for ( std::thread& worker : workers )
+            worker.join();
+
+        for ( Parsed& chunk : parsed ){
+            if ( !chunk.records.empty() )
+                _append_records( chunk.records.data(), static_cast<int>(chunk.records.size()) );
+            for ( BulkLoadError& error : chunk.errors ){
+                error.line += report.lines;
+                if ( report.errors.size() < BulkLoadReport::max_errors )
+                    report.errors.push_back( std::move(error) );
+            }
+            report.records     += chunk.records.size();
+            report.error_count += chunk.errors.size();
+            report.lines       += chunk.lines;
+        }
+    }
+
+    report.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    return report;
 }
 
 
 /**
- * Reads a record in the file at the current location.
+ * Reads a record in the file at the current location, skipping over
+ * deleted records.
  *
  * @return the record to be read
  */
 Campsite CampsiteDB::get_next_sequential( ){
-    if ( get_current_index() >= get_record_count() )
-        throw std::length_error{"Index out of bounds."};
-
+    OperationTimer timer{ _stats, Operation::get_next_sequential };
     CampsiteRecord record;
-    _file.read( reinterpret_cast<char*>(&record), sizeof(CampsiteRecord));
+    do {
+        if ( get_current_index() >= get_record_count() )
+            throw std::length_error{"Index out of bounds."};
+
+        if ( _map.is_open() || _cache || _buffer_limit > 0 ){
+            _read_live( _read_index, record );  //moves the read marker past it
+        }
+        else if ( _locks ){
+            _read_live( _read_index, record );
+            _read_index++;
+        }
+        else if ( _heap ){
+            int index = get_current_index();
+            PackedCampsiteRecord packed;
+            _file.read( reinterpret_cast<char*>(&packed), sizeof(PackedCampsiteRecord) );
+            stats_read( sizeof(PackedCampsiteRecord) );
+            _check( index, 1, reinterpret_cast<const char*>(&packed) );
+            record = unpack( packed, *_heap );
+        }
+        else{
+            int index = get_current_index();
+            _file.read( reinterpret_cast<char*>(&record), sizeof(CampsiteRecord));
+            stats_read( sizeof(CampsiteRecord) );
+            _check( index, 1, reinterpret_cast<const char*>(&record) );
+        }
+    } while ( is_tombstone(record) );
     Campsite site{record};
     return site;
 }
@@ -78,11 +558,17 @@ Campsite CampsiteDB::get_next_sequential( ){
  * @return  the number of records in the file
  */
 int CampsiteDB::get_record_count( ){
-    int current = _file.tellg();    //save current location
-    _file.seekg(0, std::ios::end);  //move the marker at the end
-    int size_file = _file.tellg();  //save the size of the file
-    _file.seekg(current, std::ios::beg);  //move back the marker
-    return size_file / sizeof(CampsiteRecord);
+    OperationTimer timer{ _stats, Operation::get_record_count };
+    return _count.load( std::memory_order_acquire );  //kept current by every append
+}
+
+
+
+/**
+ * @return  the number of records that have not been deleted
+ */
+int CampsiteDB::get_live_count( ){
+    return get_record_count() - _dead;
 }
 
 
@@ -96,11 +582,21 @@ int CampsiteDB::get_record_count( ){
  * @return  the current index of either write or read marker
  */
 int CampsiteDB::get_current_index( bool write ){
+    OperationTimer timer{ _stats, Operation::get_current_index };
     int index;
-    if ( write )
-        index = _file.tellp() / sizeof(CampsiteRecord);
-    else
-        index = _file.tellg() / sizeof(CampsiteRecord);
+    if ( _locks || _buffer_limit > 0 )
+        index = write ? _write_index : _read_index;
+    else if ( write ){
+        index = ( _file.tellp() - _data_offset ) / _record_size;
+        stats_seek();
+    }
+    else if ( _map.is_open() || _cache ){
+        index = _read_index;
+    }
+    else{
+        index = ( _file.tellg() - _data_offset ) / _record_size;
+        stats_seek();
+    }
     return index;
 }
 
@@ -113,18 +609,63 @@ int CampsiteDB::get_current_index( bool write ){
  *                       are sent.
  */
 void CampsiteDB::list_records( std::ostream& strm ){
-    int count = 0, num_of_elem = get_record_count();
-    _file.clear();
-    _file.seekg(0, std::ios::beg);
-    while ( _file.good() && count < num_of_elem ){
-        count++;
-        Campsite site = get_next_sequential();
-        if ( _file.good() )
-            site.write(strm);
-        cout << endl;
-    }
-    _file.clear();
-    _file.seekg(0, std::ios::beg);
+    export_text( strm, TextFormat::listing );
+}
+
+
+
+/**
+ * Writes each live record to the given stream as a line of text,
+ * formatted into a large buffer that is written in big chunks.
+ *
+ * @param[out]   strm    the stream the text is written to
+ * @param        format  layout of each line
+ *
+ * @return  the number of records written
+ */
+std::size_t CampsiteDB::export_text( std::ostream& strm, TextFormat format ){
+    OperationTimer timer{ _stats, Operation::export_text };
+    TextWriter writer{strm, format};
+    return _export_text( writer );
+}
+
+
+
+/**
+ * Writes each live record to the given file descriptor as a line of
+ * text, formatted into a large buffer that is written in big chunks.
+ *
+ * @param   fd      an open descriptor, left open
+ * @param   format  layout of each line
+ *
+ * @return  the number of records written
+ */
+std::size_t CampsiteDB::export_text( int fd, TextFormat format ){
+    OperationTimer timer{ _stats, Operation::export_text };
+    TextWriter writer{fd, format};
+    return _export_text( writer );
+}
+
+
+
+/**
+ * Feeds every live record to the writer and flushes it.
+ *
+ * @param   writer  where the text goes
+ *
+ * @return  the number of records written
+ */
+std::size_t CampsiteDB::_export_text( TextWriter& writer ){
+    for_each_block( 0, get_record_count(),
+        [&writer]( int, const CampsiteRecord* records, int count ){
+            for ( int i = 0; i < count; i++ ){
+                if ( !is_tombstone(records[i]) )
+                    writer.write( records[i] );
+            }
+        } );
+    writer.flush();
+    _set_read_marker( 0 );
+    return writer.records();
 }
 
 
@@ -137,13 +678,29 @@ void CampsiteDB::list_records( std::ostream& strm ){
  * @return  a record at the given index
  */
 Campsite CampsiteDB::get_at_index( int index ){
+    OperationTimer timer{ _stats, Operation::get_at_index };
     if ( !bounds_check(index) )
         throw std::length_error{"Index out of bounds"};
 
-    _file.clear();
-    int offset = index * sizeof(CampsiteRecord);
-    _file.seekg(offset, std::ios::beg);
-    return get_next_sequential();
+    CampsiteRecord record;
+    if ( !_read_live(index, record) )
+        throw std::out_of_range{"Record was deleted."};
+    return Campsite{record};
+}
+
+
+
+/**
+ * @param   index  a index of a record
+ *
+ * @return  true if the record at index has been deleted
+ */
+bool CampsiteDB::is_deleted( int index ){
+    if ( !bounds_check(index) )
+        throw std::length_error{"Index out of bounds."};
+
+    CampsiteRecord record;
+    return !_read_live( index, record );
 }
 
 
@@ -156,12 +713,19 @@ Campsite CampsiteDB::get_at_index( int index ){
  * @param[out]   site    a record to be written
  */
 void CampsiteDB::write_at_index( int index, const Campsite& site ){
+    OperationTimer timer{ _stats, Operation::write_at_index };
     if ( !bounds_check(index, true) )
         throw std::length_error{"Index out of bounds."};
 
+    if ( _locks ){  //concurrent mode leaves the shared markers alone
+        _write_concurrent( index, site.get_record() );
+        return;
+    }
     _file.clear();
-    int offset = index * sizeof(CampsiteRecord);
-    _file.seekp(offset, std::ios::beg);
+    _file.seekp( _offset(index), std::ios::beg );
+    stats_seek();
+    if ( _buffer_limit > 0 )
+        _write_index = index;
     write_next_sequential(site);
 }
 
@@ -188,12 +752,16 @@ void CampsiteDB::print_record( int index, std::ostream& strm ){
  * @param        index   a position where the markers are moved to
  */
 void CampsiteDB::move_to_index( int index ){
+    OperationTimer timer{ _stats, Operation::move_to_index };
     if ( !bounds_check(index, true) )
         throw std::length_error{"Index out of bounds."};
 
-    int offset = index * sizeof(CampsiteRecord);
-    _file.seekg( offset, std::ios::beg );
-    _file.seekp( offset, std::ios::beg );
+    _file.seekg( _offset(index), std::ios::beg );
+    _file.seekp( _offset(index), std::ios::beg );
+    stats_seek();
+    stats_seek();
+    _read_index = index;
+    _write_index = index;
 }
 
 
@@ -205,12 +773,207 @@ void CampsiteDB::move_to_index( int index ){
  * @param        index_2     another index of value to be swapped
  */
 void CampsiteDB::swap_records( int index_1, int index_2 ){
+    OperationTimer timer{ _stats, Operation::swap_records };
+    if ( _locks ){  //swap under both records' locks so readers see all or nothing
+        if ( !bounds_check(index_1) || !bounds_check(index_2) )
+            throw std::length_error{"Index out of bounds."};
+        _locks->lock_pair( index_1, index_2 );
+        try {
+            CampsiteRecord record1 = _read_record( index_1 );
+            CampsiteRecord record2 = _read_record( index_2 );
+            if ( is_tombstone(record1) || is_tombstone(record2) )
+                throw std::out_of_range{"Record was deleted."};
+            WalEntry entries[2] = { { index_1, 0, record2 }, { index_2, 0, record1 } };
+            _log( entries, 2 );
+            _preserve( index_1, record1 );
+            _preserve( index_2, record2 );
+            _write_slots( index_1, 1, reinterpret_cast<const char*>(&record2) );
+            _stamp( index_1, 1, reinterpret_cast<const char*>(&record2) );
+            _write_slots( index_2, 1, reinterpret_cast<const char*>(&record1) );
+            _stamp( index_2, 1, reinterpret_cast<const char*>(&record1) );
+            _update_indexes( index_1, &record1, record2 );
+            _update_indexes( index_2, &record2, record1 );
+        } catch ( ... ) {
+            _locks->unlock_pair( index_1, index_2 );
+            throw;
+        }
+        _locks->unlock_pair( index_1, index_2 );
+        _checkpoint( true );
+        return;
+    }
+
     //get each site
     Campsite site1 = get_at_index( index_1 );
     Campsite site2 = get_at_index( index_2 );
-    //swap the position
-    write_at_index( index_1, site2 );
-    write_at_index( index_2, site1 );
+    //log both halves as one transaction, so a crash cannot split them
+    WalEntry entries[2] = { { index_1, 0, site2.get_record() }, { index_2, 0, site1.get_record() } };
+    _log( entries, 2 );
+    _unlogged++;
+    try {
+        //swap the position
+        write_at_index( index_1, site2 );
+        write_at_index( index_2, site1 );
+    } catch ( ... ) {
+        _unlogged--;
+        throw;
+    }
+    _unlogged--;
+    _checkpoint( true );
+}
+
+
+
+/**
+ * Applies a group of writes, in order, as one transaction: after a
+ * crash either all of them are in the database or none are.  Each
+ * index may be at most the record count as it stands when that write
+ * is reached, so a batch can also append.
+ *
+ * @param        writes     (index, site) pairs to write
+ */
+void CampsiteDB::write_batch( const std::vector<std::pair<int, Campsite>>& writes ){
+    OperationTimer timer{ _stats, Operation::write_batch };
+    std::vector<WalEntry> entries;
+    entries.reserve( writes.size() );
+    for ( const std::pair<int, Campsite>& write : writes )
+        entries.push_back( WalEntry{ write.first, 0, write.second.get_record() } );
+
+    std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+    if ( _locks ){  //a batch may touch any record, so shut everyone else out
+        append.lock();
+        _locks->lock_all();
+    }
+    try {
+        int count = get_record_count();
+        for ( const WalEntry& entry : entries ){
+            if ( entry.index < 0 || entry.index > count )
+                throw std::length_error{"Index out of bounds."};
+            if ( entry.index == count )
+                count++;
+        }
+
+        _log( entries.data(), static_cast<int>(entries.size()) );
+        if ( _locks ){
+            for ( const WalEntry& entry : entries )
+                _put_concurrent( entry.index, entry.record );
+        }
+        else{
+            _unlogged++;
+            try {
+                for ( const WalEntry& entry : entries )
+                    write_at_index( entry.index, Campsite{entry.record} );
+            } catch ( ... ) {
+                _unlogged--;
+                throw;
+            }
+            _unlogged--;
+        }
+    } catch ( ... ) {
+        if ( _locks )
+            _locks->unlock_all();
+        throw;
+    }
+    if ( _locks ){
+        _locks->unlock_all();
+        append.unlock();
+    }
+    _checkpoint( true );
+}
+
+
+
+/**
+ * Deletes the record at the given index.  The slot keeps its place, so
+ * no other record moves; it holds a tombstone, threaded onto the free
+ * list kept in the file header, until a write fills it or compaction
+ * trims it away.  Deleting a deleted record does nothing.
+ *
+ * @param        index   a index of the record to delete
+ */
+void CampsiteDB::erase_at_index( int index ){
+    OperationTimer timer{ _stats, Operation::erase_at_index };
+    {
+        std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+        std::unique_lock<std::shared_mutex> guard;
+        if ( _locks ){  //the free list is guarded by the append lock
+            append.lock();
+            if ( !bounds_check(index) )
+                throw std::length_error{"Index out of bounds."};
+            guard = std::unique_lock<std::shared_mutex>( _locks->stripe(index) );
+        }
+        else if ( !bounds_check(index) ){
+            throw std::length_error{"Index out of bounds."};
+        }
+
+        _file.clear();
+        std::streamoff mark = _locks ? 0 : static_cast<std::streamoff>( _file.tellp() );
+        if ( !_locks )
+            stats_seek();
+        CampsiteRecord before = _read_record( index );
+        if ( !is_tombstone(before) ){
+            WalEntry entry{ index, 0, make_tombstone(_free_head(), -1) };
+            _log( &entry, 1 );
+            _free_push( index );
+            _update_indexes( index, &before, entry.record );
+            _header.flags |= CampsiteFileHeader::tombstone_flag;
+        }
+        if ( !_locks ){
+            _file.clear();
+            _file.seekp( mark, std::ios::beg );
+            stats_seek();
+        }
+    }
+    _checkpoint( true );
+}
+
+
+
+/**
+ * Compacts the file a little at a time.  Each move takes the last
+ * record and writes it into a free slot (trailing deleted slots are
+ * simply dropped), under the locks of just those two records, so
+ * readers are held up for one move at most, never the whole pass.
+ * The file is then cut down to the records that remain.  Moved
+ * records change index; the number index follows them.
+ *
+ * @param        max_moves  most records to move or drop in this step
+ *
+ * @return  true if deleted slots remain
+ */
+bool CampsiteDB::compact_step( int max_moves ){
+    OperationTimer timer{ _stats, Operation::compact_step };
+    for ( int moves = 0; moves < max_moves; moves++ ){
+        std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+        if ( _locks )
+            append.lock();
+        if ( _dead == 0 || get_record_count() == 0 )
+            break;
+        _compact_one();
+    }
+    _shrink_file();
+    return _dead > 0;
+}
+
+
+
+/**
+ * Compacts the file until no deleted slots remain.
+ */
+void CampsiteDB::compact( ){
+    while ( compact_step() )
+        ;
+}
+
+
+
+/**
+ * Runs compact on another thread.  Unless the database is concurrent,
+ * the caller must leave the database alone until the future is ready.
+ *
+ * @return  a future that is ready when compaction is done
+ */
+std::future<void> CampsiteDB::compact_async( ){
+    return std::async( std::launch::async, [this]( ){ compact(); } );
 }
 
 
@@ -218,76 +981,2367 @@ void CampsiteDB::swap_records( int index_1, int index_2 ){
 
 /**
  * Reads the value ranged between given indices and makes a vector.
+ * The whole span is fetched with a few large reads rather than one
+ * read per record.  Deleted records are left out.
  *
  * @param        first_index     a index to bgin reading
- * @param        last_index      a index to stop reading
+ * @param        last_index      one past the last index to read
  *
  * @return  a vector conataing read value
  */
 std::vector<Campsite> CampsiteDB::get_range( int first_index, int last_index ){
-    last_index--;  //a user is expected to enter the physical number of records
-    //check index
-    if ( first_index >= last_index
-            && !bounds_check(first_index) && !bounds_check(last_index) )
+    OperationTimer timer{ _stats, Operation::get_range };
+    std::vector<Campsite> sites;
+    if ( last_index > first_index )
+        sites.reserve( last_index - first_index );
+
+    for_each_block( first_index, last_index,
+        [&sites]( int, const CampsiteRecord* records, int count ){
+            for ( int i = 0; i < count; i++ )
+                if ( !is_tombstone(records[i]) )
+                    sites.emplace_back( records[i] );
+        } );
+    return sites;
+}
+
+
+
+/**
+ * Streams the records in [first_index, last_index) to a visitor in
+ * blocks of at most chunk_records, so ranges larger than memory can
+ * be scanned with a bounded buffer.  Leaves the read marker at
+ * last_index.  Deleted slots are visited as their tombstones.
+ *
+ * @param        first_index     a index to begin reading
+ * @param        last_index      one past the last index to read
+ * @param        visit           called once per block, in index order
+ * @param        chunk_records   most records handed to one visit call
+ */
+void CampsiteDB::for_each_block( int first_index, int last_index, const BlockVisitor& visit,
+                                 int chunk_records ){
+    OperationTimer timer{ _stats, Operation::for_each_block };
+    if ( first_index < 0 || first_index > last_index || last_index > get_record_count() )
         throw std::length_error{"Index out of bounds."};
+    if ( chunk_records <= 0 )
+        chunk_records = default_chunk_records;
+    _drain();
 
-    std::vector<Campsite> sites;
-    //calculate the offset
-    int offset = first_index * sizeof(CampsiteRecord);
-    //set the get marker at the start point
-    _file.seekg( offset, std::ios::beg );
-    while ( first_index <= last_index ){
-        //put the value into vector
-        sites.push_back( get_next_sequential() );
-        first_index++;
-        offset = first_index * sizeof(CampsiteRecord);
-        //set the marker at the next point
-        _file.seekg( offset, std::ios::beg );
+    if ( _map.is_open() && !_heap ){  //raw records can be visited in place
+        for ( int i = first_index; i < last_index; i += chunk_records ){
+            int count = std::min( chunk_records, last_index - i );
+            _check( i, count, _map.data() + _offset(i) );
+            visit( i, reinterpret_cast<const CampsiteRecord*>(_map.data() + _offset(i)), count );
+        }
+    }
+    else{
+        std::vector<CampsiteRecord> buffer( std::min(chunk_records, last_index - first_index) );
+        for ( int i = first_index; i < last_index; i += chunk_records ){
+            int count = std::min( chunk_records, last_index - i );
+            if ( _locks ){  //read the chunk with no write half applied
+                StripedLock::StripeSet stripes = StripedLock::stripes_of_range( i, count );
+                _locks->lock_shared( stripes );
+                try {
+                    count = std::min( count, get_record_count() - i );  //compaction may have shrunk the file
+                    if ( count > 0 )
+                        _read_records( i, count, buffer.data() );
+                } catch ( ... ) {
+                    _locks->unlock_shared( stripes );
+                    throw;
+                }
+                _locks->unlock_shared( stripes );
+                if ( count <= 0 )
+                    break;
+            }
+            else{
+                _read_records( i, count, buffer.data() );
+            }
+            visit( i, buffer.data(), count );
+        }
     }
+    _set_read_marker( last_index );
+}
 
-    return sites;
+
+
+/**
+ * @return  every live record, as an iterator range
+ */
+CampsiteRange CampsiteDB::records( ){
+    return records( 0, get_record_count() );
 }
 
 
 
 /**
- * @brief   returns a pseudo-random integer in the interval [low, high]
- * @details Sets up an mt19937 Mersenne Twister random number generator
- *          using a random seed obtained from the best entropy source
- *          available to the <random> library.
- *          Notice:  first call incurs additional setup time.
+ * The live records in [first_index, last_index) as an input range, for
+ * range-for loops and the standard algorithms.  Each pass reads the
+ * records a block at a time, reading the next block on another thread
+ * while the loop works through the current one.
  *
- * @remarks This is a stand alone function and cited from Dr. Jason L Causey's
- *          slides used in Object Oriented Programming in Spring 2018.
- *          URL https://gitpitch.com/jcausey-astate/CS2124_lecture_notes?p=easy_rand#/
+ * @param        first_index     a index to begin reading
+ * @param        last_index      one past the last index to read
+ * @param        chunk_records   records per block
  *
- * @param low  lower-bound of interval for random value (included in interval)
- * @param high upper-bound of interval for random value (included in interval)
+ * @return  the range
+ */
+CampsiteRange CampsiteDB::records( int first_index, int last_index, int chunk_records ){
+    if ( first_index < 0 || first_index > last_index || last_index > get_record_count() )
+        throw std::length_error{"Index out of bounds."};
+    return CampsiteRange{ *this, first_index, last_index, chunk_records };
+}
+
+
+
+/**
+ * Streams the whole file in large blocks and hands every record that
+ * satisfies the query to a visitor, in index order.  Predicates are
+ * evaluated a block at a time by filter_records (with AVX2 where the
+ * processor has it), so no Campsite is built for a record that does
+ * not match.  Deleted records never match.  Leaves the read marker
+ * after the last record.
  *
- * @return pseudo-random integer in the range [low, high]
+ * @param        query      predicates the records must satisfy
+ * @param        visit      called once per matching record
  */
-int rand_between(int low, int high){
-    // used to seed with system entropy
-    static std::random_device            seeder;
-    // set up (and seed) the PRNG
-    static std::mt19937                  generator{seeder()};
-    // set up distribution for requested range
-    std::uniform_int_distribution<int>   distribution{low, high};
-    // generate and return result
-    return distribution(generator);
+void CampsiteDB::scan( const CampsiteQuery& query, const MatchVisitor& visit ){
+    OperationTimer timer{ _stats, Operation::scan };
+    std::vector<int> matches( default_chunk_records );
+    for_each_block( 0, get_record_count(),
+        [&query, &visit, &matches]( int first_index, const CampsiteRecord* records, int count ){
+            int found = filter_records( query, records, count, matches.data() );
+            for ( int i = 0; i < found; i++ )
+                if ( !is_tombstone(records[matches[i]]) )
+                    visit( first_index + matches[i], records[matches[i]] );
+        } );
 }
 
 
 
 /**
- * Gets a record randomly in the file.
+ * @param        query      predicates the records must satisfy
  *
- * @return  a record gotten randomly
+ * @return  the indices of every matching record, ascending
  */
-Campsite CampsiteDB::get_random(){
-    //gets a random index betwenn [0, N-1]
-    int random_index = rand_between(0, get_record_count()-1);
-    return get_at_index( random_index );
+std::vector<int> CampsiteDB::find_indices( const CampsiteQuery& query ){
+    std::vector<int> indices;
+    scan( query, [&indices]( int index, const CampsiteRecord& ){
+        indices.push_back( index );
+    } );
+    return indices;
+}
+
+
+
+/**
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  every matching site, in index order
+ */
+std::vector<Campsite> CampsiteDB::find( const CampsiteQuery& query ){
+    std::vector<Campsite> sites;
+    scan( query, [&sites]( int, const CampsiteRecord& record ){
+        sites.push_back( Campsite{record} );
+    } );
+    return sites;
+}
+
+
+
+/**
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  count, minimum, maximum and mean rate of the matching records
+ */
+RateSummary CampsiteDB::summarize_rate( const CampsiteQuery& query ){
+    RateSummary summary;
+    scan( query, [&summary]( int, const CampsiteRecord& record ){
+        if ( summary.count == 0 || record.rate < summary.min )
+            summary.min = record.rate;
+        if ( summary.count == 0 || record.rate > summary.max )
+            summary.max = record.rate;
+        summary.sum += record.rate;
+        summary.count++;
+    } );
+    return summary;
+}
+
+
+
+/**
+ * Looks a site up by its site number through the number index.  If
+ * several records share the number, the one at the lowest index wins.
+ *
+ * @param        number     site number to find
+ *
+ * @return  the matching site
+ */
+Campsite CampsiteDB::get_by_number( int number ){
+    OperationTimer timer{ _stats, Operation::get_by_number };
+    int found = -1;
+    std::unique_lock<std::mutex> guard( _index_mutex );
+    _require_number_index().scan( BPlusTreeEntry{number, std::numeric_limits<std::int64_t>::min()},
+        [&found, number]( const BPlusTreeEntry& entry ){
+            if ( entry.key == number )
+                found = static_cast<int>( entry.value );
+            return false;
+        } );
+    guard.unlock();
+    if ( found < 0 )
+        throw std::out_of_range{"No campsite with that number."};
+    return get_at_index( found );
+}
+
+
+
+/**
+ * Gets every site whose number is in [low, high], ordered by number
+ * (and by index among equal numbers).
+ *
+ * @param        low        smallest site number wanted
+ * @param        high       largest site number wanted
+ *
+ * @return  the matching sites
+ */
+std::vector<Campsite> CampsiteDB::range_by_number( int low, int high ){
+    OperationTimer timer{ _stats, Operation::range_by_number };
+    std::vector<int> indices;
+    std::unique_lock<std::mutex> guard( _index_mutex );
+    _require_number_index().scan( BPlusTreeEntry{low, std::numeric_limits<std::int64_t>::min()},
+        [&indices, high]( const BPlusTreeEntry& entry ){
+            if ( entry.key > high )
+                return false;
+            indices.push_back( static_cast<int>(entry.value) );
+            return true;
+        } );
+    guard.unlock();
+
+    std::vector<Campsite> sites;
+    sites.reserve( indices.size() );
+    for ( int index : indices )
+        sites.push_back( get_at_index(index) );
+    return sites;
+}
+
+
+
+/**
+ * Gets the records whose rate is between low and high, inclusive,
+ * cheapest first, using the rate index.  Only the matching records
+ * are read; the electricity filter is answered by the index.
+ *
+ * @param        low        smallest rate wanted
+ * @param        high       largest rate wanted
+ * @param        electric   1 for only electric sites, 0 for only
+ *                          non-electric ones, -1 for either
+ *
+ * @return  the matching sites, by ascending rate
+ */
+std::vector<Campsite> CampsiteDB::range_by_rate( double low, double high, int electric ){
+    OperationTimer timer{ _stats, Operation::range_by_rate };
+    std::vector<int> indices;
+    if ( !( low <= high ) )
+        return {};
+    std::int64_t last = rate_key( high );
+    std::unique_lock<std::mutex> guard( _index_mutex );
+    _require_rate_index().scan( BPlusTreeEntry{rate_key(low), std::numeric_limits<std::int64_t>::min()},
+        [&indices, last, electric]( const BPlusTreeEntry& entry ){
+            if ( entry.key > last )
+                return false;
+            if ( electric < 0 || ( entry.value & 1 ) == electric )
+                indices.push_back( static_cast<int>(entry.value / 2) );
+            return true;
+        } );
+    guard.unlock();
+    return get_many( indices );
+}
+
+
+
+/**
+ * Gets the k cheapest records satisfying a query, walking the rate
+ * index from the query's lowest rate.  The rate bounds and the
+ * electricity predicate are answered by the index, so with only those
+ * set just the k results are read; other predicates are checked on
+ * the candidates, read in batches.
+ *
+ * @param        k          most records wanted
+ * @param        filter     predicates the records must satisfy
+ *
+ * @return  up to k matching sites, by ascending rate
+ */
+std::vector<Campsite> CampsiteDB::top_k_by_rate( int k, const CampsiteQuery& filter ){
+    OperationTimer timer{ _stats, Operation::top_k_by_rate };
+    std::vector<Campsite> sites;
+    if ( k <= 0 || !( filter.rate_min <= filter.rate_max ) )
+        return sites;
+    bool index_only = filter.number_min == std::numeric_limits<int>::min()
+                   && filter.number_max == std::numeric_limits<int>::max()
+                   && filter.description_contains.empty();
+    std::int64_t last = rate_key( filter.rate_max );
+    BPlusTreeEntry from{ rate_key(filter.rate_min), std::numeric_limits<std::int64_t>::min() };
+    bool more = true;
+    while ( more && static_cast<int>(sites.size()) < k ){
+        int wanted = k - static_cast<int>( sites.size() );
+        int batch = index_only ? wanted : std::max( wanted, 64 );
+        std::vector<int> indices;
+        more = false;
+        {
+            std::lock_guard<std::mutex> guard( _index_mutex );
+            _require_rate_index().scan( from,
+                [&]( const BPlusTreeEntry& entry ){
+                    if ( entry.key > last )
+                        return false;
+                    if ( static_cast<int>(indices.size()) == batch ){  //resume here next time
+                        from = entry;
+                        more = true;
+                        return false;
+                    }
+                    if ( filter.electric < 0 || ( entry.value & 1 ) == filter.electric )
+                        indices.push_back( static_cast<int>(entry.value / 2) );
+                    return true;
+                } );
+        }
+        for ( Campsite& site : get_many(indices) )
+            if ( static_cast<int>(sites.size()) < k && ( index_only || matches(filter, site.get_record()) ) )
+                sites.push_back( std::move(site) );
+    }
+    return sites;
+}
+
+
+
+/**
+ * Finds the records whose description contains every one of the words,
+ * in any order and any case, without reading the database file.
+ *
+ * @param        words      text holding the words, such as "riverfront cabin"
+ *
+ * @return  ascending indices of the matching records
+ */
+std::vector<int> CampsiteDB::search_all( const std::string& words ){
+    OperationTimer timer{ _stats, Operation::search };
+    std::lock_guard<std::mutex> guard( _index_mutex );
+    return _require_keyword_index().all_of( words );
+}
+
+
+
+/**
+ * Finds the records whose description contains at least one of the
+ * words, without reading the database file.
+ *
+ * @param        words      text holding the words
+ *
+ * @return  ascending indices of the matching records
+ */
+std::vector<int> CampsiteDB::search_any( const std::string& words ){
+    OperationTimer timer{ _stats, Operation::search };
+    std::lock_guard<std::mutex> guard( _index_mutex );
+    return _require_keyword_index().any_of( words );
+}
+
+
+
+/**
+ * Finds the records whose description contains a word starting with
+ * the prefix, without reading the database file.
+ *
+ * @param        prefix     the start of a word, such as "river"
+ *
+ * @return  ascending indices of the matching records
+ */
+std::vector<int> CampsiteDB::search_prefix( const std::string& prefix ){
+    OperationTimer timer{ _stats, Operation::search };
+    std::lock_guard<std::mutex> guard( _index_mutex );
+    return _require_keyword_index().with_prefix( prefix );
+}
+
+
+
+/**
+ * @return  this thread's Mersenne Twister, seeded from the best entropy
+ *          source available to the <random> library on first use
+ */
+std::mt19937& random_generator(){
+    // used to seed with system entropy
+    thread_local std::random_device      seeder;
+    // set up (and seed) the PRNG; one per thread, so concurrent callers are safe
+    thread_local std::mt19937            generator{seeder()};
+    return generator;
+}
+
+
+
+/**
+ * @brief   returns a pseudo-random integer in the interval [low, high]
+ * @details Sets up an mt19937 Mersenne Twister random number generator
+ *          using a random seed obtained from the best entropy source
+ *          available to the <random> library.
+ *          Notice:  first call incurs additional setup time.
+ *
+ * @remarks This is a stand alone function and cited from Dr. Jason L Causey's
+ *          slides used in Object Oriented Programming in Spring 2018.
+ *          URL https://gitpitch.com/jcausey-astate/CS2124_lecture_notes?p=easy_rand#/
+ *
+ * @param low  lower-bound of interval for random value (included in interval)
+ * @param high upper-bound of interval for random value (included in interval)
+ *
+ * @return pseudo-random integer in the range [low, high]
+ */
+int rand_between(int low, int high){
+    // set up distribution for requested range
+    std::uniform_int_distribution<int>   distribution{low, high};
+    // generate and return result
+    return distribution(random_generator());
+}
+
+
+
+/**
+ * Gets a record randomly in the file.  Deleted slots are redrawn.
+ *
+ * @return  a record gotten randomly
+ */
+Campsite CampsiteDB::get_random(){
+    OperationTimer timer{ _stats, Operation::get_random };
+    if ( get_live_count() <= 0 )
+        throw std::length_error{"Cannot draw from an empty database."};
+    CampsiteRecord record;
+    int random_index;
+    do {
+        //gets a random index betwenn [0, N-1]
+        random_index = rand_between(0, get_record_count()-1);
+    } while ( !_read_live(random_index, record) );
+    return Campsite{record};
+}
+
+
+
+/**
+ * Draws k records at random.  All k indices are drawn first, then
+ * read in index order, with indices close enough together sharing
+ * one block read, so a large sample costs far fewer reads than k
+ * calls to get_random.
+ *
+ * @param   k                   number of records to draw
+ * @param   with_replacement    false to never draw a record twice
+ *
+ * @return  the records, in the order they were drawn
+ */
+std::vector<Campsite> CampsiteDB::get_random_sample( int k, bool with_replacement ){
+    OperationTimer timer{ _stats, Operation::get_random_sample };
+    return _sample( k, with_replacement, random_generator() );
+}
+
+
+
+/**
+ * Draws k records at random, reproducibly: the same seed over the
+ * same database always gives the same sample.
+ *
+ * @param   k                   number of records to draw
+ * @param   with_replacement    false to never draw a record twice
+ * @param   seed                seed for the random number generator
+ *
+ * @return  the records, in the order they were drawn
+ */
+std::vector<Campsite> CampsiteDB::get_random_sample( int k, bool with_replacement, std::uint32_t seed ){
+    OperationTimer timer{ _stats, Operation::get_random_sample };
+    std::mt19937 generator{ seed };
+    return _sample( k, with_replacement, generator );
+}
+
+
+
+/**
+ * Gets the records at many indices at once.  Instead of one blocking
+ * read per record, every read is submitted together (through io_uring
+ * where available, else a pool of pread threads), so the batch costs
+ * about one storage round-trip.  Mapped and cached databases already
+ * hold the records in memory and simply copy them.  Leaves the read
+ * and write markers alone.
+ *
+ * @param   indices  indices to read, in any order; may repeat
+ *
+ * @return  the record at each index, in the order asked for
+ */
+std::vector<Campsite> CampsiteDB::get_many( const std::vector<int>& indices ){
+    OperationTimer timer{ _stats, Operation::get_many };
+    for ( int index : indices )
+        if ( !bounds_check(index) )
+            throw std::length_error{"Index out of bounds."};
+    if ( indices.empty() )
+        return std::vector<Campsite>{};
+
+    _drain();  //the batched reader only sees the file
+    std::size_t n = indices.size();
+    std::vector<CampsiteRecord> records( n );
+    if ( _map.is_open() || _cache ){  //nothing to wait for
+        for ( std::size_t i = 0; i < n; i++ )
+            _read_records( indices[i], 1, &records[i] );
+    }
+    else{
+        std::vector<char> slots( n * _record_size );
+        std::vector<ReadRequest> requests( n );
+        for ( std::size_t i = 0; i < n; i++ )
+            requests[i] = ReadRequest{ static_cast<std::uint64_t>(_offset(indices[i])), _record_size,
+                                       slots.data() + i * _record_size };
+        if ( _locks ){  //read the batch with no write half applied to its records
+            StripedLock::StripeSet stripes = StripedLock::stripes_of( indices.data(), n );
+            _locks->lock_shared( stripes );
+            try {
+                for ( int index : indices )  //compaction may have shrunk the file
+                    if ( !bounds_check(index) )
+                        throw std::length_error{"Index out of bounds."};
+                _async_reader().read( requests );
+                for ( std::size_t i = 0; i < n; i++ )
+                    _check( indices[i], 1, slots.data() + i * _record_size );
+            } catch ( ... ) {
+                _locks->unlock_shared( stripes );
+                throw;
+            }
+            _locks->unlock_shared( stripes );
+        }
+        else{
+            _file.flush();  //the reader has its own descriptor
+            _async_reader().read( requests );
+            for ( std::size_t i = 0; i < n; i++ )
+                _check( indices[i], 1, slots.data() + i * _record_size );
+        }
+
+        for ( std::size_t i = 0; i < n; i++ )  //issued from the reader's own threads
+            stats_read( _record_size );
+
+        if ( _heap ){
+            const PackedCampsiteRecord* packed = reinterpret_cast<const PackedCampsiteRecord*>( slots.data() );
+            for ( std::size_t i = 0; i < n; i++ )
+                records[i] = unpack( packed[i], *_heap );
+        }
+        else{
+            std::memcpy( records.data(), slots.data(), slots.size() );
+        }
+    }
+    for ( const CampsiteRecord& record : records )
+        if ( is_tombstone(record) )
+            throw std::out_of_range{"Record was deleted."};
+    return std::vector<Campsite>( records.begin(), records.end() );
+}
+
+
+
+/**
+ * Runs get_many on the batched reader's threads rather than a thread
+ * of its own, so many outstanding calls share one pool.  Unless the
+ * database is concurrent, the caller must leave the database alone
+ * until the future is ready.
+ *
+ * @param   indices  indices to read, in any order; may repeat
+ *
+ * @return  a future holding the records in the order asked for
+ */
+std::future<std::vector<Campsite>> CampsiteDB::get_many_async( std::vector<int> indices ){
+    auto task = std::make_shared<std::packaged_task<std::vector<Campsite>( )>>(
+        [this, wanted = std::move(indices)]( ){ return get_many( wanted ); } );
+    std::future<std::vector<Campsite>> records = task->get_future();
+    _async_reader().post( [task]( ){ (*task)(); } );
+    return records;
+}
+
+
+
+/**
+ * Makes an independent pair of read and write markers over this
+ * database.  In concurrent mode each thread should walk the database
+ * through its own cursor instead of the database's shared markers.
+ *
+ * @param   index  starting position of both markers
+ *
+ * @return  the new cursor
+ */
+CampsiteCursor CampsiteDB::cursor( int index ){
+    return CampsiteCursor{ *this, index };
+}
+
+
+
+/**
+ * @return  true if the database was opened for use by many threads
+ */
+bool CampsiteDB::is_concurrent( ) const {
+    return _locks != nullptr;
+}
+
+
+
+/**
+ * Takes a snapshot of the database as it stands: every write that has
+ * finished is in it, and none made later will be.  In concurrent mode
+ * this waits for writes in progress to finish, but afterwards neither
+ * the snapshot's reads nor anyone's writes wait for each other.
+ *
+ * @return  the snapshot; release it promptly, since writes made while
+ *          it is open keep the records they overwrite in memory
+ */
+CampsiteSnapshot CampsiteDB::snapshot( ){
+    std::uint64_t version;
+    int count;
+    if ( _locks )  //no write half applied
+        _locks->lock_all_shared();
+    try {
+        std::lock_guard<std::mutex> guard( _versions_mutex );
+        version = _version;
+        count = get_record_count();
+        _snapshot_versions.insert( version );
+        _snapshots++;
+    } catch ( ... ) {
+        if ( _locks )
+            _locks->unlock_all_shared();
+        throw;
+    }
+    if ( _locks )
+        _locks->unlock_all_shared();
+    return CampsiteSnapshot{ *this, version, count };
+}
+
+
+
+/**
+ * Gets a read-only view of the record at the given index, pointing
+ * straight into the file's memory mapping.  The view is invalidated
+ * by any later write that grows the file.
+ *
+ * @param   index  a index of a value to be viewed
+ *
+ * @return  the record at the given index, without copying it
+ */
+const CampsiteRecord& CampsiteDB::view_at_index( int index ){
+    if ( !_map.is_open() )
+        throw std::logic_error{"Database is not memory mapped."};
+    if ( _heap )
+        throw std::logic_error{"Packed records cannot be viewed in place."};
+    if ( !bounds_check(index) )
+        throw std::length_error{"Index out of bounds."};
+    _drain();
+
+    const char* base = _map.data() + _offset(index);
+    _check( index, 1, base );
+    const CampsiteRecord& record = *reinterpret_cast<const CampsiteRecord*>( base );
+    if ( is_tombstone(record) )
+        throw std::out_of_range{"Record was deleted."};
+    return record;
+}
+
+
+
+/**
+ * @return  true if reads are served from a memory mapping
+ */
+bool CampsiteDB::is_memory_mapped( ) const {
+    return _map.is_open();
+}
+
+
+
+/**
+ * @return  true if the file stores packed records with a description heap
+ */
+bool CampsiteDB::is_packed( ) const {
+    return _heap != nullptr;
+}
+
+
+
+/**
+ * @return  true if records are checksummed and reads checked
+ */
+bool CampsiteDB::has_checksums( ) const {
+    return _checksums != nullptr;
+}
+
+
+
+/**
+ * Copies every record of an existing database, in index order, into
+ * a new database.  This is how legacy raw (or headerless) files are
+ * converted to the packed format; migrating a packed file to a new
+ * packed file also drops descriptions that are no longer referenced.
+ * Deleted records are not copied.
+ *
+ * @param        source         database to read
+ * @param        destination    database to create; must not exist yet
+ * @param        packed         true to write the packed format, false for raw
+ */
+void CampsiteDB::migrate( const std::string& source, const std::string& destination, bool packed ){
+    if ( std::ifstream(destination).good() )
+        throw std::runtime_error{"Migration target " + destination + " already exists."};
+
+    CampsiteDB from{ source };
+    CampsiteDBOptions options;
+    options.packed_format = packed;
+    CampsiteDB to{ destination, options };
+
+    from.for_each_block( 0, from.get_record_count(),
+        [&to]( int, const CampsiteRecord* records, int count ){
+            for ( int i = 0; i < count; i++ )
+                if ( !is_tombstone(records[i]) )
+                    to.write_next_sequential( Campsite{records[i]} );
+        } );
+    to.flush();
+}
+
+
+
+/**
+ * Sorts the records of a database file that no one has open, using
+ * bounded memory however large the file is.  Batches of about
+ * memory_bytes are read, sorted in parallel and written out as sorted
+ * runs; the runs are then merged into a new file, which is synced and
+ * renamed over the original, so a crash leaves either the old file or
+ * the sorted one.  A packed file keeps its description heap as it is.
+ * Deleted records are dropped.
+ * The number index, whose positions no longer hold, is removed and
+ * gets rebuilt the next time it is asked for.  The sort is stable.
+ *
+ * @param        filename       database to sort
+ * @param        less           ordering of the records
+ * @param        memory_bytes   budget for sort and merge buffers
+ * @param        threads        sorting threads (0 means one per core)
+ */
+void CampsiteDB::sort_file( const std::string& filename, const RecordLess& less,
+                            std::size_t memory_bytes, int threads ){
+    if ( threads <= 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    std::string sorted = filename + ".sorting";
+    std::vector<std::string> runs;
+    auto remove_temporaries = [&runs, &sorted]( ){
+        for ( const std::string& run : runs )
+            std::remove( run.c_str() );
+        std::remove( sorted.c_str() );
+    };
+
+    try {
+        CampsiteFileHeader header;
+        {
+            CampsiteDBOptions options;
+            options.write_ahead_log = std::ifstream( filename + ".wal" ).good();  //replay a crash's leftovers
+            CampsiteDB from{ filename, options };
+            header = from._header;
+            header.record_count = 0;  //deleted records are dropped, so the free list goes too
+            header.free_head = 0;
+            header.free_count = 0;
+            header.flags &= ~CampsiteFileHeader::tombstone_flag;
+
+            int total = from.get_record_count();
+            int batch = static_cast<int>( std::min<std::size_t>( std::numeric_limits<int>::max(),
+                            std::max<std::size_t>(threads, memory_bytes / sizeof(SortItem)) ) );
+            std::vector<SortItem> items;
+            std::vector<CampsiteRecord> records( default_chunk_records );
+            std::vector<PackedCampsiteRecord> slots( from._heap ? default_chunk_records : 0 );
+            for ( int first = 0, end; first < total; first = end ){
+                end = first + std::min( batch, total - first );
+                items.clear();
+                for ( int index = first; index < end; index += default_chunk_records ){
+                    int count = std::min( default_chunk_records, end - index );
+                    from._read_records( index, count, records.data() );
+                    if ( from._heap )  //keep the stored form, whose heap references stay valid
+                        from._read_slots( index, count, reinterpret_cast<char*>(slots.data()) );
+                    for ( int i = 0; i < count; i++ )
+                        if ( !is_tombstone(records[i]) )
+                            items.push_back( SortItem{ records[i], from._heap ? slots[i] : PackedCampsiteRecord{} } );
+                }
+                header.record_count += items.size();
+                write_sorted_run( items, less, threads, filename + ".run.", runs );
+            }
+        }
+
+        std::ofstream out{ sorted, std::ios::out | std::ios::trunc | std::ios::binary };
+        write_header( out, header );
+        bool packed = header.version == CampsiteFileHeader::packed_version;
+        std::vector<char> bytes;
+        merge_runs( runs, less, memory_bytes, [&out, &bytes, &header, packed]( const SortItem* items, std::size_t count ){
+            bytes.resize( count * header.record_size );
+            for ( std::size_t i = 0; i < count; i++ ){
+                const void* stored = packed ? static_cast<const void*>( &items[i].packed )
+                                            : static_cast<const void*>( &items[i].record );
+                std::memcpy( bytes.data() + i * header.record_size, stored, header.record_size );
+            }
+            out.write( bytes.data(), bytes.size() );
+        } );
+        out.close();
+        if ( !out )
+            throw std::runtime_error{"Unable to write the sorted database."};
+
+        sync_file( sorted );
+        std::remove( (filename + ".number.idx").c_str() );
+        std::remove( (filename + ".terms.idx").c_str() );
+        std::remove( (filename + ".rate.idx").c_str() );
+        std::remove( (filename + ".crc").c_str() );
+        if ( std::rename(sorted.c_str(), filename.c_str()) != 0 )
+            throw std::runtime_error{"Unable to replace " + filename + " with its sorted copy."};
+        std::string::size_type slash = filename.rfind( '/' );
+        sync_file( slash == std::string::npos ? "." : filename.substr(0, slash + 1) );  //make the rename durable
+    } catch ( ... ) {
+        remove_temporaries();
+        throw;
+    }
+    remove_temporaries();
+}
+
+
+
+/**
+ * Sorts a database file by one of the built-in keys.
+ *
+ * @param        filename       database to sort
+ * @param        key            field to order by
+ * @param        memory_bytes   budget for sort and merge buffers
+ * @param        threads        sorting threads (0 means one per core)
+ */
+void CampsiteDB::sort_file( const std::string& filename, SortKey key, std::size_t memory_bytes, int threads ){
+    sort_file( filename, record_less(key), memory_bytes, threads );
+}
+
+
+
+/**
+ * Writes any records held back by the append buffer or the page cache,
+ * then flushes the file stream and the checksums.  In concurrent mode
+ * appends and deletions change the header under the append lock, so
+ * it is held while the header is stored and the indexes tagged; no
+ * half-made change is written and the count matches the indexes.
+ */
+void CampsiteDB::flush( ){
+    OperationTimer timer{ _stats, Operation::flush };
+    std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+    if ( _locks )
+        append.lock();
+    _flush();
+}
+
+
+
+/**
+ * Does the work of flush().  Callers hold the append lock in
+ * concurrent mode.
+ */
+void CampsiteDB::_flush( ){
+    _drain();
+    if ( _cache )
+        _cache->flush();
+    if ( _heap )
+        _heap->flush();
+    if ( _header_dirty )
+        _store_header();
+    _file.flush();
+    if ( _checksums )
+        _checksums->flush();
+    if ( _has_indexes() ){
+        std::lock_guard<std::mutex> guard( _index_mutex );
+        if ( _number_index ){
+            _number_index->set_tag( get_record_count() );
+            _number_index->flush();
+        }
+        if ( _rate_index ){
+            _rate_index->set_tag( get_record_count() );
+            _rate_index->flush();
+        }
+        if ( _keyword_index ){
+            _keyword_index->set_tag( get_record_count() );
+            _keyword_index->flush();
+        }
+    }
+}
+
+
+
+/**
+ * @return  hit, miss and eviction counts of the page cache (all zero
+ *          when the cache is disabled)
+ */
+PageCacheStats CampsiteDB::cache_stats( ) const {
+    return _cache ? _cache->stats() : PageCacheStats{};
+}
+
+
+
+/**
+ * Flushes everything, forces the database file (and description heap)
+ * to stable storage, and empties the write-ahead log, whose writes are
+ * now all in the file.
+ */
+void CampsiteDB::checkpoint( ){
+    OperationTimer timer{ _stats, Operation::checkpoint };
+    _checkpoint( false );
+}
+
+
+
+/**
+ * @return  transaction and sync counts of the write-ahead log (all
+ *          zero when logging is disabled)
+ */
+WalStats CampsiteDB::wal_stats( ){
+    return _wal ? _wal->stats() : WalStats{};
+}
+
+
+
+/**
+ * @return  a snapshot of the per-operation counters; all zero unless
+ *          the database was opened with collect_stats (or enable_stats
+ *          was called)
+ */
+CampsiteDBStats CampsiteDB::stats( ) const {
+    return _stats.snapshot();
+}
+
+
+
+/**
+ * Starts or stops counting operations.  Counts gathered so far are kept.
+ *
+ * @param   enabled     true to count from now on
+ */
+void CampsiteDB::enable_stats( bool enabled ){
+    _stats.set_enabled( enabled );
+}
+
+
+
+/**
+ * Checks every record in the file against its checksum.  The file is
+ * read on its own descriptor in large blocks spread over the threads,
+ * so the check runs at about the speed the disk delivers data.
+ * Anything held back is written out first.  In concurrent mode other
+ * threads may go on writing meanwhile; records that fail are checked
+ * again under their locks, so a write caught halfway is not reported.
+ *
+ * @param   threads  threads to check with (0 means one per core)
+ *
+ * @return  the indices of the records that fail, ascending
+ */
+std::vector<int> CampsiteDB::verify( int threads ){
+    OperationTimer timer{ _stats, Operation::verify };
+    ChecksumTable& checksums = _require_checksums();
+    if ( threads <= 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    flush();
+
+    int fd = ::open( _filename.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        throw std::runtime_error{"Unable to open the database for verifying."};
+    std::vector<int> failed;
+    try {
+        failed = checksums.verify( fd, _data_offset, get_record_count(), threads );
+    } catch ( ... ) {
+        ::close( fd );
+        throw;
+    }
+    ::close( fd );
+    if ( !_locks )
+        return failed;
+
+    std::vector<int> confirmed;
+    std::vector<char> stored( _record_size );
+    for ( int index : failed ){
+        std::shared_lock<std::shared_mutex> guard( _locks->stripe(index) );
+        if ( index >= get_record_count() )  //compaction may have shrunk the file
+            continue;
+        _read_slots( index, 1, stored.data() );
+        if ( checksums.mismatch(index, 1, stored.data()) >= 0 )
+            confirmed.push_back( index );
+    }
+    return confirmed;
+}
+
+
+
+/**
+ * Repairs damaged records from a copy of the database file, such as a
+ * backup, by copying their stored bytes back from it.  A record is
+ * only restored if the copy holds exactly what its checksum expects,
+ * so a copy taken before the record last changed never overwrites it
+ * with older data.  Packed records point into the description heap,
+ * so a packed database can only be repaired from a copy of its own
+ * file; a description that is damaged is restored from the copy's
+ * heap, <copy>.heap, along with its slot.  Leaves the stream markers
+ * where they were.
+ *
+ * @param        copy       a copy of the database file
+ * @param        indices    records to restore, as verify() reports them
+ *
+ * @return  the number of records restored
+ */
+int CampsiteDB::restore_from_copy( const std::string& copy, const std::vector<int>& indices ){
+    OperationTimer timer{ _stats, Operation::verify };
+    ChecksumTable& checksums = _require_checksums();
+    int fd = ::open( copy.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        throw std::runtime_error{"Unable to open " + copy + "."};
+
+    int heap_fd = _heap ? ::open( (copy + ".heap").c_str(), O_RDONLY ) : -1;
+    int restored = 0;
+    _file.clear();
+    std::streamoff mark = _file.tellp();
+    try {
+        CampsiteFileHeader header;
+        if ( _data_offset > 0 && ( pread(fd, &header, sizeof(header), 0) != sizeof(header) || !header.has_magic()
+                                   || header.version != _header.version || header.record_size != _record_size ) )
+            throw std::runtime_error{copy + " is not a copy of this database."};
+        _drain();
+        std::vector<char> stored( _record_size );
+        for ( int index : indices ){
+            if ( !bounds_check(index)
+                 || pread(fd, stored.data(), _record_size, _offset(index)) != static_cast<ssize_t>(_record_size) )
+                continue;  //not in the copy
+            stats_read( _record_size );
+            std::unique_lock<std::shared_mutex> guard;
+            if ( _locks )
+                guard = std::unique_lock<std::shared_mutex>( _locks->stripe(index) );
+            if ( !bounds_check(index) || index >= checksums.size() )
+                continue;
+            if ( checksums.checksum(stored.data()) != checksums.get(index) ){
+                //perhaps it is the description that is damaged: try the copy's
+                char text[256];
+                auto read_copy = [heap_fd, &text]( std::uint64_t offset, std::size_t length, char* out ){
+                    if ( heap_fd < 0 || pread(heap_fd, out, length, offset) != static_cast<ssize_t>(length) )
+                        return false;
+                    std::memcpy( text, out, length );  //kept to write back
+                    return true;
+                };
+                PackedCampsiteRecord packed;
+                std::memcpy( &packed, stored.data(), sizeof(packed) );
+                if ( !_heap || packed.desc_offset + packed.desc_length > _heap->size()
+                     || checksum_description(stored.data(), crc32c(stored.data(), _record_size), read_copy)
+                        != checksums.get(index) )
+                    continue;
+                _heap->overwrite( packed.desc_offset, packed.desc_length, text, packed.desc_length );
+            }
+            _write_stored( index, stored.data() );
+            restored++;
+        }
+    } catch ( ... ) {
+        ::close( fd );
+        if ( heap_fd >= 0 )
+            ::close( heap_fd );
+        throw;
+    }
+    ::close( fd );
+    if ( heap_fd >= 0 )
+        ::close( heap_fd );
+    flush();
+    if ( !_locks ){
+        _file.clear();
+        _file.seekp( mark < 0 ? _offset(get_record_count()) : mark, std::ios::beg );
+        stats_seek();
+    }
+    return restored;
+}
+
+
+
+/**
+ * Takes records as they now stand, checksumming them again so reads
+ * of them stop failing.  For records known to be right though they
+ * fail, such as ones a crash left written without their checksums, or
+ * damaged ones that are about to be overwritten or erased.  Leaves
+ * the stream markers where they were.
+ *
+ * @param        indices    records to checksum again
+ */
+void CampsiteDB::accept_records( const std::vector<int>& indices ){
+    OperationTimer timer{ _stats, Operation::verify };
+    ChecksumTable& checksums = _require_checksums();
+    _drain();
+    _file.clear();
+    std::streamoff mark = _file.tellp();
+    std::vector<char> stored( _record_size );
+    for ( int index : indices ){
+        std::unique_lock<std::shared_mutex> guard;
+        if ( _locks && bounds_check(index) )
+            guard = std::unique_lock<std::shared_mutex>( _locks->stripe(index) );
+        if ( !bounds_check(index) )  //compaction may have shrunk the file
+            throw std::length_error{"Index out of bounds."};
+        _read_slots( index, 1, stored.data() );
+        checksums.set( index, 1, stored.data() );
+    }
+    if ( !_locks ){
+        _file.clear();
+        _file.seekp( mark < 0 ? _offset(get_record_count()) : mark, std::ios::beg );
+        stats_seek();
+    }
+}
+
+
+
+/**
+ * Copies a record out of the mapping, the page cache or the file,
+ * whichever is serving reads.  In stream mode this moves the markers.
+ *
+ * @param        index      index of the record, already bounds checked
+ *
+ * @return  a copy of the record
+ */
+CampsiteRecord CampsiteDB::_read_record( int index ){
+    CampsiteRecord record;
+    _read_records( index, 1, &record );
+    return record;
+}
+
+
+
+/**
+ * Reads a record the way get_at_index does: under its stripe lock in
+ * concurrent mode, otherwise leaving the read marker after it.
+ *
+ * @param        index      index of the record, already bounds checked
+ * @param[out]   out        the record, or its tombstone
+ *
+ * @return  false if the record has been deleted
+ */
+bool CampsiteDB::_read_live( int index, CampsiteRecord& out ){
+    if ( _locks ){  //concurrent mode leaves the shared markers alone
+        std::shared_lock<std::shared_mutex> guard( _locks->stripe(index) );
+        if ( index >= get_record_count() )  //compaction may have shrunk the file
+            throw std::length_error{"Index out of bounds."};
+        out = _read_record( index );
+    }
+    else{
+        if ( _map.is_open() || _cache || _buffer_limit > 0 )
+            _read_index = index + 1;
+        int written = get_record_count() - static_cast<int>( _pending.size() );
+        if ( index >= written )  //still in the append buffer
+            out = _pending[index - written];
+        else
+            out = _read_record( index );  //in stream mode the read leaves the marker after it
+    }
+    return !is_tombstone( out );
+}
+
+
+
+/**
+ * Copies count consecutive records into out, unpacking them if the
+ * file is in the packed format.  Buffered appends in the range are
+ * written out first.
+ *
+ * @param        first_index    index of the first record, already bounds checked
+ * @param        count          number of records to copy
+ * @param[out]   out            buffer of at least count records
+ */
+void CampsiteDB::_read_records( int first_index, int count, CampsiteRecord* out ){
+    if ( !_pending.empty() && first_index + count > get_record_count() - static_cast<int>(_pending.size()) )
+        _drain();
+    if ( !_heap ){  //stored bytes are the records themselves
+        _read_slots( first_index, count, reinterpret_cast<char*>(out) );
+        _check( first_index, count, reinterpret_cast<const char*>(out) );
+        return;
+    }
+
+    _scratch.resize( count * _record_size );
+    _read_slots( first_index, count, _scratch.data() );
+    _check( first_index, count, _scratch.data() );
+    const PackedCampsiteRecord* packed = reinterpret_cast<const PackedCampsiteRecord*>( _scratch.data() );
+    for ( int i = 0; i < count; i++ )
+        out[i] = unpack( packed[i], *_heap );
+}
+
+
+
+/**
+ * Copies the stored bytes of count consecutive records into out with
+ * a single read (or a single pass over the mapping or cache).
+ *
+ * @param        first_index    index of the first record, already bounds checked
+ * @param        count          number of records to copy
+ * @param[out]   out            buffer of at least count stored records
+ */
+void CampsiteDB::_read_slots( int first_index, int count, char* out ){
+    std::size_t bytes = count * _record_size;
+    if ( _map.is_open() ){
+        std::memcpy( out, _map.data() + _offset(first_index), bytes );
+    }
+    else if ( _cache ){
+        _cache->read( first_index, count, out );
+    }
+    else if ( _slots.is_open() ){  //positional read; no shared file position involved
+        _slots.read( first_index, count, reinterpret_cast<CampsiteRecord*>(out) );
+    }
+    else{
+        _file.clear();
+        _file.seekg( _offset(first_index), std::ios::beg );
+        _file.read( out, bytes );
+        stats_seek();
+        stats_read( bytes );
+        if ( _file.gcount() != static_cast<std::streamsize>(bytes) )
+            throw std::runtime_error{"Unable to read records from the database."};
+    }
+}
+
+
+
+/**
+ * Appends records to the end of the file with a single write (or a
+ * single pass through the cache), then updates the count, indexes and
+ * mapping and leaves the put marker after them.
+ *
+ * @param        records    records to append, in order
+ * @param        count      number of records
+ *
+ * @return  index of the first appended record
+ */
+int CampsiteDB::_append_records( const CampsiteRecord* records, int count ){
+    std::unique_lock<std::mutex> guard( _append_mutex, std::defer_lock );
+    if ( _locks )
+        guard.lock();
+    _drain();  //buffered appends come first
+    int first_index = get_record_count();
+    _write_appended( first_index, records, count );
+
+    _count.store( first_index + count, std::memory_order_release );
+    _header_dirty = true;
+    for ( int i = 0; i < count; i++ )
+        _update_indexes( first_index + i, nullptr, records[i] );
+    if ( !_locks ){
+        _file.seekp( _offset(first_index + count), std::ios::beg );
+        stats_seek();
+    }
+    if ( _buffer_limit > 0 )
+        _write_index = first_index + count;
+    if ( guard.owns_lock() )
+        guard.unlock();
+    _checkpoint( true );
+    return first_index;
+}
+
+
+
+/**
+ * Overwrites one record in place wherever writes are going (positional
+ * I/O, the page cache or the stream), without touching the count, the
+ * indexes or the free list, though the old record is kept for any open
+ * snapshot.  Moves the stream markers.  Callers hold the record's
+ * stripe lock in concurrent mode.
+ *
+ * @param        index      index of an existing record
+ * @param        record     the record to write
+ */
+void CampsiteDB::_store_record( int index, const CampsiteRecord& record ){
+    if ( !_pending.empty() && index >= get_record_count() - static_cast<int>(_pending.size()) )
+        _drain();
+    if ( _snapshots > 0 && index < get_record_count() ){
+        CampsiteRecord before = _read_record( index );
+        if ( !is_tombstone(before) || !is_tombstone(record) )  //relinking the free list changes nothing a snapshot shows
+            _preserve( index, before );
+    }
+    const char* bytes = reinterpret_cast<const char*>( &record );
+    PackedCampsiteRecord packed;
+    if ( _heap ){  //store the packed form instead
+        packed = _pack( index, record );
+        bytes = reinterpret_cast<const char*>( &packed );
+    }
+    _write_stored( index, bytes );
+}
+
+
+
+/**
+ * Packs a record about to be stored at index.  A record written over
+ * a live one takes over its description's room in the heap when the
+ * new description fits, so overwrites and swaps do not grow the heap.
+ * A slot that fails its checksum is not trusted to point at its own
+ * room.  Moves the stream markers.
+ *
+ * @param        index      index the record is going to
+ * @param        record     the record to store
+ *
+ * @return  the packed record
+ */
+PackedCampsiteRecord CampsiteDB::_pack( int index, const CampsiteRecord& record ){
+    if ( index >= get_record_count() || is_tombstone(record) )
+        return pack( record, *_heap );
+    PackedCampsiteRecord old;
+    _read_slots( index, 1, reinterpret_cast<char*>(&old) );
+    if ( _checksums && _checksums->mismatch(index, 1, reinterpret_cast<const char*>(&old)) >= 0 )
+        return pack( record, *_heap );
+    return pack( record, *_heap, &old );
+}
+
+
+
+/**
+ * Overwrites the stored bytes of one record in place, and its
+ * checksum.  Moves the stream markers.  Callers hold the record's
+ * stripe lock in concurrent mode.
+ *
+ * @param        index      index of an existing record
+ * @param        stored     the stored (raw or packed) record
+ */
+void CampsiteDB::_write_stored( int index, const char* stored ){
+    if ( _locks ){
+        _write_slots( index, 1, stored );
+    }
+    else if ( _cache ){
+        _cache->write( index, stored );
+    }
+    else{
+        _file.clear();
+        _file.seekp( _offset(index), std::ios::beg );
+        _file.write( stored, _record_size );
+        stats_seek();
+        stats_write( _record_size );
+        if ( !_file.good() )
+            throw std::runtime_error{"Unable to write records to the database."};
+        if ( _map.is_open() )  //let the mapping see it
+            _file.flush();
+    }
+    _stamp( index, 1, stored );
+}
+
+
+
+/**
+ * Logs and writes records past the last one written to the file, with
+ * a single write (or a single pass through the cache), and extends the
+ * mapping over them.  Leaves the count and the indexes to the caller.
+ *
+ * @param        first_index    index of the first record
+ * @param        records        records to write, in order
+ * @param        count          number of records
+ */
+void CampsiteDB::_write_appended( int first_index, const CampsiteRecord* records, int count ){
+    if ( _wal ){
+        std::vector<WalEntry> entries( count );
+        for ( int i = 0; i < count; i++ )
+            entries[i] = WalEntry{ first_index + i, 0, records[i] };
+        _log( entries.data(), count );
+    }
+
+    const char* bytes = reinterpret_cast<const char*>( records );
+    if ( _heap ){  //store the packed form instead
+        _scratch.resize( count * _record_size );
+        PackedCampsiteRecord* packed = reinterpret_cast<PackedCampsiteRecord*>( _scratch.data() );
+        for ( int i = 0; i < count; i++ )
+            packed[i] = pack( records[i], *_heap );
+        bytes = _scratch.data();
+    }
+
+    _reserve( _offset(first_index + count) );
+    _file.clear();
+    if ( _locks ){  //nobody can read past the count, so no stripe locks needed
+        _write_slots( first_index, count, bytes );
+    }
+    else if ( _cache ){
+        for ( int i = 0; i < count; i++ )
+            _cache->write( first_index + i, bytes + i * _record_size );
+    }
+    else{
+        _file.seekp( _offset(first_index), std::ios::beg );
+        _file.write( bytes, count * _record_size );
+        stats_seek();
+        stats_write( count * _record_size );
+        if ( !_file.good() )
+            throw std::runtime_error{"Unable to append records to the database."};
+    }
+    _stamp( first_index, count, bytes );
+    if ( _map.is_open() )
+        _grow_mapping( first_index + count - 1 );
+}
+
+
+
+/**
+ * Writes the buffered appends to the file in one go.  Their count and
+ * index entries were taken care of when they were buffered.
+ */
+void CampsiteDB::_drain( ){
+    if ( _pending.empty() )
+        return;
+    int count = static_cast<int>( _pending.size() );
+    _write_appended( get_record_count() - count, _pending.data(), count );
+    _pending.clear();
+}
+
+
+
+/**
+ * Reserves disk space for the file up to end, and preallocate_bytes
+ * beyond it, so appends do not have to allocate as they go.  The file
+ * size itself is left alone.  Without fallocate support this does
+ * nothing.
+ *
+ * @param        end        file size about to be written
+ */
+void CampsiteDB::_reserve( std::streamoff end ){
+    if ( _preallocate_bytes == 0 || end <= _reserved )
+        return;
+    std::streamoff want = end + static_cast<std::streamoff>( _preallocate_bytes );
+#ifdef FALLOC_FL_KEEP_SIZE
+    if ( _reserve_fd < 0 )
+        _reserve_fd = ::open( _filename.c_str(), O_RDWR );
+    if ( _reserve_fd >= 0 )  //only advice; a failure just means allocating as we go
+        fallocate( _reserve_fd, FALLOC_FL_KEEP_SIZE, _reserved, want - _reserved );
+#endif
+    _reserved = want;
+}
+
+
+
+/**
+ * Writes the stored bytes of count consecutive records with positional
+ * I/O.  Only used in concurrent mode; callers hold the needed locks.
+ *
+ * @param        first_index    index of the first record
+ * @param        count          number of records to write
+ * @param        in             count stored records
+ */
+void CampsiteDB::_write_slots( int first_index, int count, const char* in ){
+    _slots.write( first_index, count, reinterpret_cast<const CampsiteRecord*>(in) );
+}
+
+
+
+/**
+ * Writes one record in concurrent mode: under its stripe lock for an
+ * overwrite, and additionally under the append lock for an append or
+ * while any slot is free (the write may fill one).  The write is
+ * logged under the same locks, so the log orders writes to a record
+ * the same way the file does.
+ *
+ * @param        index      where to write; at most the record count
+ * @param        record     the record to write
+ */
+void CampsiteDB::_write_concurrent( int index, const CampsiteRecord& record ){
+    {
+        std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+        if ( index >= get_record_count() )
+            append.lock();
+        if ( !bounds_check(index, true) )  //the count may have moved while waiting
+            throw std::length_error{"Index out of bounds."};
+
+        std::unique_lock<std::shared_mutex> guard( _locks->stripe(index) );
+        if ( !append.owns_lock() && ( _dead > 0 || index >= get_record_count() ) ){
+            guard.unlock();  //respect the lock order: append lock first
+            append.lock();
+            guard.lock();
+            if ( !bounds_check(index, true) )  //compaction may have shrunk the file
+                throw std::length_error{"Index out of bounds."};
+        }
+        WalEntry entry{ index, 0, record };
+        _log( &entry, 1 );
+        _put_concurrent( index, record );
+    }
+    _checkpoint( true );
+}
+
+
+
+/**
+ * Writes one record with positional I/O and updates the count and
+ * indexes.  Callers hold the record's stripe lock, and the append
+ * lock if index is the record count or any slot is free.
+ *
+ * @param        index      where to write; at most the record count
+ * @param        record     the record to write
+ */
+void CampsiteDB::_put_concurrent( int index, const CampsiteRecord& record ){
+    bool replacing = index < get_record_count();
+    CampsiteRecord before;
+    if ( replacing && ( _has_indexes() || _dead > 0 || _snapshots > 0 ) ){
+        before = _read_record( index );
+        if ( is_tombstone(before) )  //filling a deleted slot takes it off the free list
+            _free_unlink( index, tombstone_links(before) );
+        _preserve( index, before );
+    }
+    _write_slots( index, 1, reinterpret_cast<const char*>(&record) );
+    _stamp( index, 1, reinterpret_cast<const char*>(&record) );
+    if ( !replacing ){
+        _count.store( index + 1, std::memory_order_release );
+        _header_dirty = true;
+    }
+    _update_indexes( index, replacing ? &before : nullptr, record );
+}
+
+
+
+/**
+ * Puts the read marker at the given index, wherever the read marker
+ * is being kept.
+ *
+ * @param        index      new position of the read marker
+ */
+void CampsiteDB::_set_read_marker( int index ){
+    if ( _locks )  //concurrent scans must not race on the shared marker
+        return;
+    _read_index = index;
+    if ( !_map.is_open() && !_cache ){
+        _file.clear();
+        _file.seekg( _offset(index), std::ios::beg );
+        stats_seek();
+    }
+}
+
+
+
+/**
+ * Writes a record into a free slot, if there is one.
+ *
+ * @param        record     the record to write
+ *
+ * @return  the index it was written at, or -1 if no slot was free
+ */
+int CampsiteDB::_fill_free_slot( const CampsiteRecord& record ){
+    int index = -1;
+    {
+        std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+        if ( _locks )
+            append.lock();
+        if ( _dead == 0 )
+            return -1;
+
+        _file.clear();
+        std::streamoff mark = _locks ? 0 : static_cast<std::streamoff>( _file.tellp() );
+        if ( !_locks )
+            stats_seek();
+        index = _free_pop();
+        if ( index >= 0 ){
+            std::unique_lock<std::shared_mutex> guard;
+            if ( _locks )
+                guard = std::unique_lock<std::shared_mutex>( _locks->stripe(index) );
+            WalEntry entry{ index, 0, record };
+            _log( &entry, 1 );
+            _store_record( index, record );
+            _update_indexes( index, nullptr, record );
+        }
+        if ( !_locks ){
+            _file.clear();
+            _file.seekp( mark, std::ios::beg );
+            stats_seek();
+        }
+    }
+    _checkpoint( true );
+    return index;
+}
+
+
+
+/**
+ * @return  the first slot on the free list, or -1 if it is empty
+ */
+std::int64_t CampsiteDB::_free_head( ) const {
+    return static_cast<std::int64_t>( _header.free_head ) - 1;
+}
+
+
+
+/**
+ * Reads a slot the free list points at, checking that it really is a
+ * free slot.
+ *
+ * @param        index      slot the list points at
+ * @param[out]   out        its tombstone
+ *
+ * @return  false if index is out of bounds or not deleted
+ */
+bool CampsiteDB::_load_free( std::int64_t index, CampsiteRecord& out ){
+    if ( index < 0 || index >= get_record_count() )
+        return false;
+    out = _read_record( static_cast<int>(index) );
+    return is_tombstone( out );
+}
+
+
+
+/**
+ * Writes a tombstone at index and puts it at the head of the free
+ * list.  Callers hold the append lock and the slot's stripe lock in
+ * concurrent mode.  Moves the stream markers.
+ *
+ * @param        index      slot being deleted
+ */
+void CampsiteDB::_free_push( int index ){
+    std::int64_t head = _free_head();
+    CampsiteRecord first;
+    if ( head >= 0 ){
+        if ( !_load_free(head, first) || tombstone_links(first).prev != -1 ){
+            _store_record( index, make_tombstone(-1, -1) );
+            _rebuild_free_list();  //the list was damaged; this picks index up too
+            return;
+        }
+        _store_record( static_cast<int>(head), make_tombstone(tombstone_links(first).next, index) );
+    }
+    _store_record( index, make_tombstone(head, -1) );
+    _header.free_head = index + 1;
+    _dead++;
+    _header_dirty = true;
+}
+
+
+
+/**
+ * Takes a free slot off the free list by joining its neighbours.  The
+ * slot itself is left as it is, for the caller to overwrite.  Callers
+ * hold the append lock in concurrent mode.  Moves the stream markers.
+ *
+ * @param        index      a free slot
+ * @param        links      the links its tombstone carries
+ */
+void CampsiteDB::_free_unlink( int index, const TombstoneLinks& links ){
+    CampsiteRecord prev, next;
+    bool linked = ( links.prev < 0 ? _free_head() == index
+                                   : _load_free(links.prev, prev) && tombstone_links(prev).next == index )
+               && ( links.next < 0 || ( _load_free(links.next, next) && tombstone_links(next).prev == index ) );
+    if ( !linked ){  //the list was damaged, or index was never on it
+        _rebuild_free_list( index );
+        return;
+    }
+
+    if ( links.prev < 0 )
+        _header.free_head = links.next + 1;
+    else
+        _store_record( static_cast<int>(links.prev), make_tombstone(links.next, tombstone_links(prev).prev) );
+    if ( links.next >= 0 )
+        _store_record( static_cast<int>(links.next), make_tombstone(tombstone_links(next).next, links.prev) );
+    _dead--;
+    _header_dirty = true;
+    if ( ( _header.free_head == 0 ) != ( _dead == 0 ) )  //the count was off the list; recount
+        _rebuild_free_list( index );
+}
+
+
+
+/**
+ * Takes the slot at the head of the free list off the list.  A list
+ * that is damaged, or empty while slots are still counted as free, is
+ * rebuilt first, so compaction never waits on slots it cannot find.
+ * Callers hold the append lock in concurrent mode.  Moves the stream
+ * markers.
+ *
+ * @return  the slot, or -1 if the list is empty
+ */
+int CampsiteDB::_free_pop( ){
+    std::int64_t index = _free_head();
+    CampsiteRecord head;
+    if ( index >= 0 ? !_load_free(index, head) : _dead > 0 ){  //damaged, or the count says there is more
+        _rebuild_free_list();
+        index = _free_head();
+        if ( index >= 0 )
+            head = _read_record( static_cast<int>(index) );
+    }
+    if ( index < 0 )
+        return -1;
+    _free_unlink( static_cast<int>(index), tombstone_links(head) );
+    return static_cast<int>( index );
+}
+
+
+
+/**
+ * Rebuilds the free list from a scan of the file, linking every
+ * tombstone in index order.  Used after crash recovery, and whenever
+ * the list turns out not to match the file.  Callers hold the append
+ * lock in concurrent mode.  Moves the stream markers.
+ *
+ * @param        skip       a tombstone to leave off the list, or -1
+ */
+void CampsiteDB::_rebuild_free_list( int skip ){
+    std::vector<int> free;
+    std::vector<CampsiteRecord> block( default_chunk_records );
+    int count = get_record_count();
+    for ( int i = 0; i < count; i += default_chunk_records ){
+        int n = std::min( default_chunk_records, count - i );
+        _read_records( i, n, block.data() );
+        for ( int j = 0; j < n; j++ )
+            if ( is_tombstone(block[j]) && i + j != skip )
+                free.push_back( i + j );
+    }
+
+    for ( std::size_t j = 0; j < free.size(); j++ ){
+        std::int64_t next = j + 1 < free.size() ? free[j + 1] : -1;
+        std::int64_t prev = j > 0 ? free[j - 1] : -1;
+        _store_record( free[j], make_tombstone(next, prev) );
+    }
+    _header.free_head = free.empty() ? 0 : free.front() + 1;
+    _dead = static_cast<int>( free.size() );
+    _header_dirty = true;
+}
+
+
+
+/**
+ * Shortens the file by one record: a deleted last record is dropped,
+ * a live one is moved into a free slot and its old slot dropped.  The
+ * move is logged as one transaction (the record in its new slot, a
+ * tombstone in its old one).  Callers hold the append lock in
+ * concurrent mode; the stripe locks of the slots involved are taken
+ * here, for this move only.
+ */
+void CampsiteDB::_compact_one( ){
+    int last = get_record_count() - 1;
+    _file.clear();
+    std::streamoff mark = _locks ? 0 : static_cast<std::streamoff>( _file.tellp() );
+    if ( !_locks )
+        stats_seek();
+
+    //under the append lock nobody can delete or fill a slot, so the
+    //last record stays live or dead while the locks are sorted out
+    CampsiteRecord tail = _read_record( last );
+    int hole = is_tombstone( tail ) ? last : _free_pop();
+    if ( hole == last ){
+        std::unique_lock<std::shared_mutex> guard;
+        if ( _locks )
+            guard = std::unique_lock<std::shared_mutex>( _locks->stripe(last) );
+        _free_unlink( last, tombstone_links(tail) );
+        _preserve( last, tail );  //appends will refill the slot
+        _count.store( last, std::memory_order_release );
+    }
+    else if ( hole >= 0 ){
+        if ( _locks )
+            _locks->lock_pair( hole, last );
+        try {
+            tail = _read_record( last );  //may have been overwritten meanwhile
+            WalEntry entries[2] = { { hole, 0, tail }, { last, 0, make_tombstone(-1, -1) } };
+            _log( entries, 2 );
+            _store_record( hole, tail );
+            _store_record( last, entries[1].record );
+            _update_indexes( last, &tail, entries[1].record );
+            _update_indexes( hole, nullptr, tail );
+            _count.store( last, std::memory_order_release );
+        } catch ( ... ) {
+            if ( _locks )
+                _locks->unlock_pair( hole, last );
+            throw;
+        }
+        if ( _locks )
+            _locks->unlock_pair( hole, last );
+    }
+    _header_dirty = true;
+
+    if ( !_locks ){
+        _file.clear();
+        _file.seekp( std::min(mark, _offset(get_record_count())), std::ios::beg );
+        stats_seek();
+    }
+}
+
+
+
+/**
+ * Makes compacted records durable, then cuts the file off after the
+ * last record and pulls in any marker left past the end.  While a
+ * snapshot is open the file keeps its length; the next compaction
+ * after the last one is released trims it.
+ */
+void CampsiteDB::_shrink_file( ){
+    if ( _wal )  //the log must not replay moves into slots that are gone
+        checkpoint();
+    else
+        flush();
+
+    std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+    if ( _locks )
+        append.lock();
+    int count = get_record_count();
+    _file.flush();
+    if ( _snapshots == 0 ){  //open snapshots may still read the slots past the end
+        if ( _cache )
+            _cache->truncate( count );
+        if ( _checksums )
+            _checksums->truncate( count );
+        if ( ::truncate(_filename.c_str(), _offset(count)) != 0 )
+            throw std::runtime_error{"Unable to shrink the database file."};
+        _reserved = 0;  //space reserved past the end went with it
+        _trim_pending = false;
+    }
+    else{
+        _trim_pending = true;
+    }
+    _read_index = std::min( _read_index, count );
+    _write_index = std::min( _write_index, count );
+    if ( !_locks && _file.tellp() > _offset(count) ){
+        _file.clear();
+        _file.seekp( _offset(count), std::ios::beg );
+        stats_seek();
+    }
+}
+
+
+
+/**
+ * Keeps the record about to be overwritten at index for the open
+ * snapshots, if any of them could still need it.  A snapshot only ever
+ * reads the oldest record kept after it was taken, so a record already
+ * kept since the newest snapshot is not kept again.  Callers hold the
+ * record's stripe lock in concurrent mode.
+ *
+ * @param        index      slot about to be overwritten
+ * @param        before     what it holds now
+ */
+void CampsiteDB::_preserve( int index, const CampsiteRecord& before ){
+    if ( _snapshots == 0 )
+        return;
+    std::lock_guard<std::mutex> guard( _versions_mutex );
+    if ( _snapshot_versions.empty() )
+        return;
+    std::vector<RecordVersion>& chain = _versions[index];
+    if ( !chain.empty() && chain.back().version > *_snapshot_versions.rbegin() )
+        return;
+    chain.push_back( RecordVersion{ ++_version, before } );
+}
+
+
+
+/**
+ * Reads count consecutive records as a snapshot sees them: each one as
+ * the file holds it, unless it has been overwritten since the snapshot
+ * was taken, in which case as it was kept.  In concurrent mode the file
+ * is read without record locks; a record a writer is halfway through
+ * was kept before the write began, so the kept copy replaces it.
+ * Leaves the stream markers where they were.
+ *
+ * @param        version        the snapshot's version
+ * @param        first_index    index of the first record, below the snapshot's count
+ * @param        count          number of records to read
+ * @param[out]   out            buffer of at least count records
+ */
+void CampsiteDB::_read_snapshot( std::uint64_t version, int first_index, int count, CampsiteRecord* out ){
+    if ( _locks ){
+        _read_slots( first_index, count, reinterpret_cast<char*>(out) );
+    }
+    else{
+        _file.clear();
+        std::streamoff mark = _file.tellg();
+        stats_seek();
+        _read_records( first_index, count, out );
+        _file.clear();
+        _file.seekg( mark, std::ios::beg );
+        stats_seek();
+    }
+
+    std::lock_guard<std::mutex> guard( _versions_mutex );
+    std::vector<char> kept_copy( _locks && _check_reads ? count : 0 );
+    auto end = _versions.lower_bound( first_index + count );
+    for ( auto it = _versions.lower_bound(first_index); it != end; ++it ){
+        const std::vector<RecordVersion>& chain = it->second;
+        auto kept = std::upper_bound( chain.begin(), chain.end(), version,
+            []( std::uint64_t v, const RecordVersion& entry ){ return v < entry.version; } );
+        if ( kept != chain.end() ){
+            out[it->first - first_index] = kept->before;
+            if ( !kept_copy.empty() )
+                kept_copy[it->first - first_index] = 1;
+        }
+    }
+    //a record with no kept copy has not been written since the snapshot, nor its checksum
+    for ( int i = 0; i < static_cast<int>( kept_copy.size() ); i++ )
+        if ( !kept_copy[i] )
+            _check( first_index + i, 1, reinterpret_cast<const char*>(out + i) );
+}
+
+
+
+/**
+ * Forgets a snapshot, and with it every kept record that only it
+ * could still read.
+ *
+ * @param        version    the snapshot's version
+ */
+void CampsiteDB::_release_snapshot( std::uint64_t version ){
+    std::lock_guard<std::mutex> guard( _versions_mutex );
+    auto it = _snapshot_versions.find( version );
+    if ( it == _snapshot_versions.end() )
+        return;
+    _snapshot_versions.erase( it );
+    _snapshots--;
+    if ( _snapshot_versions.empty() ){
+        _versions.clear();
+        return;
+    }
+
+    std::uint64_t oldest = *_snapshot_versions.begin();
+    for ( auto chain = _versions.begin(); chain != _versions.end(); ){
+        auto unread = std::upper_bound( chain->second.begin(), chain->second.end(), oldest,
+            []( std::uint64_t v, const RecordVersion& entry ){ return v < entry.version; } );
+        chain->second.erase( chain->second.begin(), unread );
+        if ( chain->second.empty() )
+            chain = _versions.erase( chain );
+        else
+            ++chain;
+    }
+}
+
+
+
+/**
+ * Opens the checksum file and brings it level with the database.
+ * Checksums of slots the file no longer holds are dropped, and slots
+ * with no checksum (written before checksums were turned on, or
+ * after a crash cut the checksum file short) are checksummed as they
+ * stand.  If the database has been opened without checksums since
+ * they were last kept, every slot is checksummed again.
+ */
+void CampsiteDB::_open_checksums( ){
+    ChecksumTable::Extension extension;
+    if ( _heap )  //a packed record's description is part of it
+        extension = [this]( const char* stored, std::uint32_t crc ){
+            return checksum_description( stored, crc, [this]( std::uint64_t offset, std::size_t length, char* out ){
+                if ( offset + length > _heap->size() )
+                    return false;
+                _heap->read( offset, length, out );
+                return true;
+            } );
+        };
+    _checksums.reset( new ChecksumTable{_filename + ".crc", _record_size, extension} );
+    bool current = _data_offset == 0 || ( _header.flags & CampsiteFileHeader::checksum_flag );
+    int count = get_record_count();
+    _checksums->truncate( current ? count : 0 );
+
+    std::vector<char> stored;
+    for ( int i = _checksums->size(); i < count; i += default_chunk_records ){
+        int n = std::min( default_chunk_records, count - i );
+        stored.resize( n * _record_size );
+        _read_slots( i, n, stored.data() );
+        _checksums->set( i, n, stored.data() );
+    }
+    if ( !current ){
+        _header.flags |= CampsiteFileHeader::checksum_flag;
+        _store_header();
+    }
+
+    //reading moved the markers; put them back where opening left them
+    _file.clear();
+    _file.seekp( _offset(count), std::ios::beg );
+    stats_seek();
+}
+
+
+
+/**
+ * @return  the checksums, if the database was opened with them
+ */
+ChecksumTable& CampsiteDB::_require_checksums( ){
+    if ( !_checksums )
+        throw std::logic_error{"Database was opened without checksums."};
+    return *_checksums;
+}
+
+
+
+/**
+ * Keeps the checksums of records just written, if checksums are on.
+ *
+ * @param        first_index    index of the first record written
+ * @param        count          number of records
+ * @param        stored         the stored (raw or packed) records
+ */
+void CampsiteDB::_stamp( int first_index, int count, const char* stored ){
+    if ( _checksums )
+        _checksums->set( first_index, count, stored );
+}
+
+
+
+/**
+ * Checks records just read against their checksums, if checksums are
+ * on and the database is done opening.
+ *
+ * @param        first_index    index of the first record read
+ * @param        count          number of records
+ * @param        stored         the stored (raw or packed) records
+ */
+void CampsiteDB::_check( int first_index, int count, const char* stored ){
+    if ( !_check_reads )
+        return;
+    int failed = _checksums->mismatch( first_index, count, stored );
+    if ( failed >= 0 )
+        throw std::runtime_error{"Record " + std::to_string(failed) + " failed its checksum."};
+}
+
+
+
+/**
+ * Opens the secondary indexes asked for in the options.  An index
+ * that is missing, was not closed cleanly, or was last flushed with a
+ * different record count than the database is rebuilt from a scan.
+ * So is one whose flag in the header is clear: writes made while the
+ * database was open without an index never reached it, so opening
+ * without one clears its flag, and opening with it sets the flag again.
+ *
+ * @param        options    options the database was opened with
+ */
+void CampsiteDB::_open_indexes( const CampsiteDBOptions& options ){
+    if ( options.number_index )
+        _number_index.reset( new BPlusTree{_filename + ".number.idx"} );
+    if ( options.keyword_index )
+        _keyword_index.reset( new KeywordIndex{_filename + ".terms.idx"} );
+    if ( options.rate_index )
+        _rate_index.reset( new BPlusTree{_filename + ".rate.idx"} );
+    bool rebuild_numbers = _number_index
+                        && !( ( _header.flags & CampsiteFileHeader::number_index_flag )
+                              && _number_index->is_clean() && _number_index->tag() == _header.record_count );
+    bool rebuild_keywords = _keyword_index
+                         && !( ( _header.flags & CampsiteFileHeader::keyword_index_flag )
+                               && _keyword_index->is_clean() && _keyword_index->tag() == _header.record_count );
+    bool rebuild_rates = _rate_index
+                      && !( ( _header.flags & CampsiteFileHeader::rate_index_flag )
+                            && _rate_index->is_clean() && _rate_index->tag() == _header.record_count );
+    std::uint32_t flags = _header.flags & ~( CampsiteFileHeader::number_index_flag
+                                           | CampsiteFileHeader::keyword_index_flag
+                                           | CampsiteFileHeader::rate_index_flag );
+    if ( _number_index )
+        flags |= CampsiteFileHeader::number_index_flag;
+    if ( _keyword_index )
+        flags |= CampsiteFileHeader::keyword_index_flag;
+    if ( _rate_index )
+        flags |= CampsiteFileHeader::rate_index_flag;
+    if ( flags != _header.flags ){  //stored now: a crash must not leave a skipped index flagged
+        _header.flags = flags;
+        _store_header();
+    }
+    if ( !rebuild_numbers && !rebuild_keywords && !rebuild_rates )
+        return;
+
+    std::vector<BPlusTreeEntry> entries, rates;
+    if ( rebuild_numbers )
+        entries.reserve( get_record_count() );
+    if ( rebuild_rates )
+        rates.reserve( get_record_count() );
+    if ( rebuild_keywords )
+        _keyword_index->clear();
+    for_each_block( 0, get_record_count(),
+        [&]( int first_index, const CampsiteRecord* records, int count ){
+            for ( int i = 0; i < count; i++ ){
+                if ( is_tombstone(records[i]) )
+                    continue;
+                BPlusTreeEntry rate;
+                if ( rebuild_numbers )
+                    entries.push_back( BPlusTreeEntry{records[i].number, first_index + i} );
+                if ( rebuild_keywords )
+                    _keyword_index->update( first_index + i, nullptr, records[i].description );
+                if ( rebuild_rates && rate_entry(first_index + i, records[i], rate) )
+                    rates.push_back( rate );
+            }
+        } );
+    if ( rebuild_numbers )
+        _number_index->rebuild( std::move(entries) );
+    if ( rebuild_rates )
+        _rate_index->rebuild( std::move(rates) );
+
+    //scanning moved the markers; put them back where opening left them
+    _read_index = 0;
+    _file.clear();
+    _file.seekp( _offset(get_record_count()), std::ios::beg );
+}
+
+
+
+/**
+ * Brings the secondary indexes up to date after a record is written.
+ * Tombstones are not indexed.
+ *
+ * @param        index      index of the record that was written
+ * @param        before     the record previously at index, or nullptr
+ *                          if the write appended a new record
+ * @param        after      the record now at index
+ */
+void CampsiteDB::_update_indexes( int index, const CampsiteRecord* before, const CampsiteRecord& after ){
+    if ( !_has_indexes() )
+        return;
+    if ( before != nullptr && is_tombstone(*before) )
+        before = nullptr;
+    bool live = !is_tombstone( after );
+
+    std::lock_guard<std::mutex> guard( _index_mutex );
+    if ( _keyword_index )
+        _keyword_index->update( index, before ? before->description : nullptr, live ? after.description : nullptr );
+    if ( _number_index && !( before != nullptr && live && before->number == after.number ) ){
+        if ( before != nullptr )
+            _number_index->erase( BPlusTreeEntry{before->number, index} );
+        if ( live )
+            _number_index->insert( BPlusTreeEntry{after.number, index} );
+    }
+    if ( _rate_index ){
+        BPlusTreeEntry old_rate, new_rate;
+        bool had = before != nullptr && rate_entry( index, *before, old_rate );
+        bool has = live && rate_entry( index, after, new_rate );
+        if ( had && has && old_rate == new_rate )
+            return;
+        if ( had )
+            _rate_index->erase( old_rate );
+        if ( has )
+            _rate_index->insert( new_rate );
+    }
+}
+
+
+
+/**
+ * @return  true if any secondary index is being maintained
+ */
+bool CampsiteDB::_has_indexes( ) const {
+    return _number_index || _keyword_index || _rate_index;
+}
+
+
+
+/**
+ * @return  the number index, if the database was opened with one
+ */
+BPlusTree& CampsiteDB::_require_number_index( ){
+    if ( !_number_index )
+        throw std::logic_error{"Database was opened without a number index."};
+    return *_number_index;
+}
+
+
+
+/**
+ * @return  the keyword index, if the database was opened with one
+ */
+KeywordIndex& CampsiteDB::_require_keyword_index( ){
+    if ( !_keyword_index )
+        throw std::logic_error{"Database was opened without a keyword index."};
+    return *_keyword_index;
+}
+
+
+
+/**
+ * @return  the rate index, if the database was opened with one
+ */
+BPlusTree& CampsiteDB::_require_rate_index( ){
+    if ( !_rate_index )
+        throw std::logic_error{"Database was opened without a rate index."};
+    return *_rate_index;
+}
+
+
+
+/**
+ * Draws k indices, then reads them in ascending order.  Sorted
+ * indices less than about 4 KiB of records apart are read together
+ * as one block.  Draws that land on deleted slots are redrawn one by
+ * one afterwards.
+ *
+ * @param        k                  number of records to draw
+ * @param        with_replacement   false to never draw a record twice
+ * @param        generator          source of randomness
+ *
+ * @return  the records, in the order they were drawn
+ */
+std::vector<Campsite> CampsiteDB::_sample( int k, bool with_replacement, std::mt19937& generator ){
+    int count = get_record_count();
+    if ( k <= 0 )
+        return {};
+    if ( get_live_count() <= 0 )
+        throw std::length_error{"Cannot sample an empty database."};
+    if ( !with_replacement && k > get_live_count() )
+        throw std::invalid_argument{"Sample is larger than the database."};
+
+    std::vector<int> drawn;
+    drawn.reserve( k );
+    if ( with_replacement ){
+        std::uniform_int_distribution<int> any{ 0, count - 1 };
+        for ( int i = 0; i < k; i++ )
+            drawn.push_back( any(generator) );
+    }
+    else{  //Floyd's algorithm: k distinct indices in k draws, then a random order
+        std::unordered_set<int> chosen;
+        chosen.reserve( k );
+        for ( int j = count - k; j < count; j++ ){
+            int t = std::uniform_int_distribution<int>{ 0, j }( generator );
+            int pick = chosen.insert( t ).second ? t : j;
+            if ( pick == j )
+                chosen.insert( j );
+            drawn.push_back( pick );
+        }
+        std::shuffle( drawn.begin(), drawn.end(), generator );
+    }
+
+    std::vector<int> order( k );  /// positions in drawn, by ascending index
+    for ( int i = 0; i < k; i++ )
+        order[i] = i;
+    std::sort( order.begin(), order.end(), [&drawn]( int a, int b ){ return drawn[a] < drawn[b]; } );
+
+    //group the indices into runs close enough to read in one go, up to one chunk each
+    int gap = std::max<int>( 1, 4096 / _record_size );  /// records worth skipping over instead of seeking
+    std::vector<int> run_ends;  /// one past the last position in order of each run
+    StripedLock::StripeSet stripes = 0;
+    for ( int run = 0; run < k; ){
+        int first = drawn[order[run]], end = run + 1;
+        while ( end < k && drawn[order[end]] - drawn[order[end - 1]] <= gap
+                && drawn[order[end]] - first < default_chunk_records )
+            end++;
+        run_ends.push_back( end );
+        if ( _locks )  //every record read is checked, not just the ones drawn
+            stripes |= StripedLock::stripes_of_range( first, drawn[order[end - 1]] - first + 1 );
+        run = end;
+    }
+
+    std::vector<CampsiteRecord> records( k );
+    std::vector<CampsiteRecord> block;
+    if ( _locks )
+        _locks->lock_shared( stripes );
+    try {
+        if ( drawn[order[k - 1]] >= get_record_count() )  //compaction may have shrunk the file
+            throw std::length_error{"Index out of bounds."};
+        int run = 0;
+        for ( int end : run_ends ){
+            int first = drawn[order[run]];
+            int span = drawn[order[end - 1]] - first + 1;
+            block.resize( span );
+            _read_records( first, span, block.data() );
+            for ( int i = run; i < end; i++ )
+                records[order[i]] = block[drawn[order[i]] - first];
+            run = end;
+        }
+    } catch ( ... ) {
+        if ( _locks )
+            _locks->unlock_shared( stripes );
+        throw;
+    }
+    if ( _locks )
+        _locks->unlock_shared( stripes );
+
+    if ( _dead > 0 ){
+        std::unordered_set<int> taken( drawn.begin(), drawn.end() );
+        std::uniform_int_distribution<int> any{ 0, count - 1 };
+        for ( CampsiteRecord& record : records ){
+            while ( is_tombstone(record) ){
+                int index = any( generator );
+                if ( !with_replacement && !taken.insert(index).second ){
+                    if ( taken.size() >= static_cast<std::size_t>(count) )  //deleted meanwhile
+                        throw std::invalid_argument{"Sample is larger than the database."};
+                    continue;
+                }
+                _read_live( index, record );
+            }
+        }
+    }
+    return std::vector<Campsite>( records.begin(), records.end() );
+}
+
+
+
+/**
+ * @return  the batched reader used by get_many, made on first use
+ */
+AsyncReader& CampsiteDB::_async_reader( ){
+    std::lock_guard<std::mutex> guard( _reader_mutex );
+    if ( !_reader )
+        _reader.reset( new AsyncReader{_filename, _use_io_uring} );
+    return *_reader;
+}
+
+
+
+/**
+ * Makes a transaction durable in the write-ahead log before it is
+ * applied.  Does nothing when logging is disabled, or while applying
+ * writes whose transaction was already logged (or is being replayed).
+ *
+ * @param        entries    after-images of the records about to be written
+ * @param        count      number of entries
+ */
+void CampsiteDB::_log( const WalEntry* entries, int count ){
+    if ( !_wal || _unlogged > 0 || count == 0 )
+        return;
+    _wal->commit( entries, count );
+}
+
+
+
+/**
+ * Replays the transactions left in the write-ahead log by a crash,
+ * then checkpoints so the log starts out empty.  A transaction that
+ * never finished reaching the log was never applied or acknowledged,
+ * so recover() drops it.
+ */
+void CampsiteDB::_recover( ){
+    std::vector<std::vector<WalEntry>> transactions = _wal->recover();
+    bool deleted = ( _header.flags & CampsiteFileHeader::tombstone_flag ) != 0;
+    _unlogged++;
+    try {
+        for ( const std::vector<WalEntry>& transaction : transactions ){
+            for ( const WalEntry& entry : transaction ){
+                if ( !bounds_check(entry.index, true) )
+                    throw std::runtime_error{"Write-ahead log does not match the database."};
+                write_at_index( entry.index, Campsite{entry.record} );
+                deleted = deleted || is_tombstone( entry.record );
+            }
+        }
+        //free-list links are not logged; relink the tombstones now in the file
+        if ( !transactions.empty() && deleted ){
+            _rebuild_free_list();
+            _header.flags |= CampsiteFileHeader::tombstone_flag;
+        }
+    } catch ( ... ) {
+        _unlogged--;
+        throw;
+    }
+    _unlogged--;
+    checkpoint();
+
+    //replaying moved the markers; put them back where opening left them
+    _read_index = 0;
+    _write_index = get_record_count();
+    _file.clear();
+    _file.seekp( _offset(get_record_count()), std::ios::beg );
+}
+
+
+
+/**
+ * Writes everything back to the database file, syncs it, and empties
+ * the write-ahead log.  In concurrent mode every writer is shut out
+ * meanwhile, so no logged write can be left unapplied when the log is
+ * emptied.  Does nothing while logged writes are still being applied.
+ *
+ * @param        when_due   only checkpoint if the log has outgrown
+ *                          the checkpoint size
+ */
+void CampsiteDB::_checkpoint( bool when_due ){
+    auto due = [this]( ){ return _wal && _wal->size() >= _checkpoint_bytes; };
+    if ( _unlogged > 0 || ( when_due && !due() ) )
+        return;
+
+    std::unique_lock<std::mutex> append( _append_mutex, std::defer_lock );
+    if ( _locks ){
+        append.lock();
+        _locks->lock_all();
+    }
+    try {
+        if ( !when_due || due() ){  //another thread may have beaten us to it
+            _flush();
+            sync_file( _filename );
+            if ( _heap )
+                sync_file( _filename + ".heap" );
+            if ( _checksums )
+                _checksums->sync();
+            if ( _wal )
+                _wal->truncate();
+        }
+    } catch ( ... ) {
+        if ( _locks )
+            _locks->unlock_all();
+        throw;
+    }
+    if ( _locks )
+        _locks->unlock_all();
+}
+
+
+
+/**
+ * Pushes a just-written record out of the stream buffer so the
+ * mapping sees it, and extends the mapping if the record grew the file.
+ *
+ * @param        index      index of the record that was written
+ */
+void CampsiteDB::_grow_mapping( int index ){
+    _file.flush();
+    std::size_t end = _offset( index + 1 );
+    if ( end > _map.size() )
+        _map.remap( end );
 }
 
 
@@ -301,6 +3355,7 @@ Campsite CampsiteDB::get_random(){
  * @return  true if the index is in the bounds, and otherwise false.
  */
 bool CampsiteDB::bounds_check( int index, bool write ) {
+    OperationTimer timer{ _stats, Operation::bounds_check };
     bool result;
     if ( write ){  //domain of index for write: [0, N]
         result = ( index >= 0 && index <= get_record_count() );
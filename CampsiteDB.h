@@ -2,29 +2,177 @@
 #define CampsiteDB_h
 
 
+#include "AsyncReader.h"
+#include "BPlusTree.h"
+#include "BulkLoad.h"
 #include "Campsite.h"
+#include "CampsiteCursor.h"
+#include "CampsiteFileHeader.h"
+#include "CampsiteQuery.h"
+#include "CampsiteRange.h"
+#include "CampsiteSnapshot.h"
+#include "ChecksumTable.h"
+#include "DescriptionHeap.h"
+#include "ExternalSort.h"
+#include "KeywordIndex.h"
+#include "MappedFile.h"
+#include "OperationStats.h"
+#include "PackedCampsiteRecord.h"
+#include "PageCache.h"
+#include "RecordFile.h"
+#include "StripedLock.h"
+#include "TextExport.h"
+#include "Tombstone.h"
+#include "WriteAheadLog.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * Settings chosen when a CampsiteDB is opened.
+ */
+struct CampsiteDBOptions {
+    bool memory_mapped      = false;  /// serve reads from a shared mapping of the file
+    int  cache_pages        = 0;      /// pages held by the page cache (0 disables it)
+    int  cache_page_records = 64;     /// records per cache page
+    bool number_index       = false;  /// maintain a B+tree index on site number
+    bool keyword_index      = false;  /// maintain an inverted index of description words
+    bool rate_index         = false;  /// maintain a B+tree index on rate and electricity
+    bool packed_format      = false;  /// create new files in the packed format
+    bool concurrent         = false;  /// positional I/O, safe for many threads
+    bool write_ahead_log    = false;  /// log every write to <db>.wal before applying it
+    bool checksums          = false;  /// keep a CRC32C of every record in <db>.crc and check reads
+    std::size_t checkpoint_bytes = 16 << 20;  /// log size that triggers a checkpoint
+    bool io_uring           = true;   /// let get_many use io_uring when the kernel allows it
+    bool reuse_free_slots   = false;  /// append() fills deleted slots before growing the file
+    int  append_buffer_records = 0;   /// appends held in memory for one large write (0 disables)
+    std::size_t preallocate_bytes = 0;  /// file space reserved ahead of appends (0 disables)
+    bool collect_stats      = false;  /// count calls, I/O and latency per operation
+    std::string stats_dump_file;      /// file a JSON snapshot is appended to periodically
+    int  stats_dump_seconds = 0;      /// time between snapshots (0 disables the dump)
+};
 
 class CampsiteDB {
 public:
+    // receives consecutive records [first_index, first_index + count)
+    using BlockVisitor = std::function<void( int first_index, const CampsiteRecord* records, int count )>;
+    // receives one record that matched a scan
+    using MatchVisitor = std::function<void( int index, const CampsiteRecord& record )>;
+
+    static constexpr int default_chunk_records = 8192;  /// records per bulk read
+    static constexpr std::size_t default_sort_memory = 256 << 20;  /// sort buffer budget
+
     //constructor
-    CampsiteDB( std::string filename );
+    CampsiteDB( std::string filename, CampsiteDBOptions options = CampsiteDBOptions{} );
+    ~CampsiteDB( );
 
     //member methods
-    int get_record_count( );
+    int get_record_count( );  // slots, deleted ones included
+    int get_live_count( );
     int get_current_index( bool write = false );
 
     Campsite get_next_sequential( );
     Campsite get_at_index( int index );
     Campsite get_random();
+    // k random records in draw order; the seeded form always draws the same sample
+    std::vector<Campsite> get_random_sample( int k, bool with_replacement = true );
+    std::vector<Campsite> get_random_sample( int k, bool with_replacement, std::uint32_t seed );
+    // reads many records with all the reads in flight at once; results in request order
+    std::vector<Campsite> get_many( const std::vector<int>& indices );
+    std::future<std::vector<Campsite>> get_many_async( std::vector<int> indices );
+
+    // a private pair of markers; use one per thread in concurrent mode
+    CampsiteCursor cursor( int index = 0 );
+    bool is_concurrent( ) const;
+    // a read-only, point-in-time view that writers never disturb
+    CampsiteSnapshot snapshot( );
+
+    // zero-copy access; only available when memory mapped
+    const CampsiteRecord& view_at_index( int index );
+    bool is_memory_mapped( ) const;
+    bool is_packed( ) const;
+    bool has_checksums( ) const;
+
+    // copies every record of source into a new database at destination
+    static void migrate( const std::string& source, const std::string& destination,
+                         bool packed = true );
+    // physically reorders a closed database file; replaces it atomically
+    static void sort_file( const std::string& filename, const RecordLess& less,
+                           std::size_t memory_bytes = default_sort_memory, int threads = 0 );
+    static void sort_file( const std::string& filename, SortKey key,
+                           std::size_t memory_bytes = default_sort_memory, int threads = 0 );
+
+    // persist the header and anything the page cache is holding back
+    void           flush( );
+    PageCacheStats cache_stats( ) const;
+    // make the file durable on its own and empty the write-ahead log
+    void           checkpoint( );
+    WalStats       wal_stats( );
+    // per-operation calls, I/O and latency; see collect_stats
+    CampsiteDBStats stats( ) const;
+    void            enable_stats( bool enabled = true );
+    // ascending indices of the records that fail their checksums; see checksums
+    std::vector<int> verify( int threads = 0 );
+    // copies records back from a copy of the database file, where the copy still
+    // holds what the checksum expects; returns how many were restored
+    int  restore_from_copy( const std::string& copy, const std::vector<int>& indices );
+    // takes the records as they now stand, checksumming them again
+    void accept_records( const std::vector<int>& indices );
 
     void write_next_sequential( const Campsite& site );
+    int  append( const Campsite& site );
+    BulkLoadReport bulk_load( const std::string& text_file, int threads = 0 );
     void write_at_index( int index, const Campsite& site );
     void print_record( int index, std::ostream& strm = std::cout );
     void list_records( std::ostream& strm = std::cout );
+    // bulk text output of the live records; returns how many were written
+    std::size_t export_text( std::ostream& strm, TextFormat format = TextFormat::listing );
+    std::size_t export_text( int fd, TextFormat format = TextFormat::listing );
     void move_to_index( int index );
     void swap_records( int index_1, int index_2 );
+    // applies every (index, site) write, in order, as one transaction
+    void write_batch( const std::vector<std::pair<int, Campsite>>& writes );
 
     std::vector<Campsite> get_range( int first_index, int last_index );
+    Campsite get_by_number( int number );
+    std::vector<Campsite> range_by_number( int low, int high );
+    // by ascending rate from the rate index; electric is 1, 0 or -1 (either), as in CampsiteQuery
+    std::vector<Campsite> range_by_rate( double low, double high, int electric = -1 );
+    std::vector<Campsite> top_k_by_rate( int k, const CampsiteQuery& filter = CampsiteQuery{} );
+    // ascending indices of records whose description has every word, any word,
+    // or a word starting with prefix; answered from the keyword index alone
+    std::vector<int> search_all( const std::string& words );
+    std::vector<int> search_any( const std::string& words );
+    std::vector<int> search_prefix( const std::string& prefix );
+    void for_each_block( int first_index, int last_index, const BlockVisitor& visit,
+                         int chunk_records = default_chunk_records );
+    // the live records as an iterator range, read ahead a block at a time
+    CampsiteRange records( );
+    CampsiteRange records( int first_index, int last_index, int chunk_records = default_chunk_records );
+
+    // deletion leaves a tombstone until the slot is reused or compacted away
+    void erase_at_index( int index );
+    bool is_deleted( int index );
+    // moves up to max_moves records into free slots, then shrinks the file;
+    // true if free slots remain
+    bool compact_step( int max_moves = default_chunk_records );
+    void compact( );
+    std::future<void> compact_async( );
+
+    // full scans filtered by field predicates
+    void scan( const CampsiteQuery& query, const MatchVisitor& visit );
+    std::vector<int> find_indices( const CampsiteQuery& query );
+    std::vector<Campsite> find( const CampsiteQuery& query );
+    RateSummary summarize_rate( const CampsiteQuery& query );
 
     bool bounds_check( int index, bool write = false );  //helper method
 
@@ -33,12 +181,104 @@ public:
     CampsiteDB& operator=(const CampsiteDB&) = delete;
 
 private:
+    friend class CampsiteSnapshot;
+    friend class CampsiteRange;
+
     // private methods:
     void _create_file( );
     bool _open_file( );
+    bool _load_header( bool packed );
+    void _store_header( );
+    std::streamoff _offset( int index ) const;
+    void _grow_mapping( int index );
+    CampsiteRecord _read_record( int index );
+    void _read_records( int first_index, int count, CampsiteRecord* out );
+    void _read_slots( int first_index, int count, char* out );
+    void _write_slots( int first_index, int count, const char* in );
+    void _store_record( int index, const CampsiteRecord& record );
+    void _write_stored( int index, const char* stored );
+    PackedCampsiteRecord _pack( int index, const CampsiteRecord& record );
+    bool _read_live( int index, CampsiteRecord& out );
+    void _write_concurrent( int index, const CampsiteRecord& record );
+    void _put_concurrent( int index, const CampsiteRecord& record );
+    int  _append_records( const CampsiteRecord* records, int count );
+    void _write_appended( int first_index, const CampsiteRecord* records, int count );
+    void _drain( );
+    void _reserve( std::streamoff end );
+    void _set_read_marker( int index );
+    std::size_t _export_text( TextWriter& writer );
+    int  _fill_free_slot( const CampsiteRecord& record );
+    std::int64_t _free_head( ) const;
+    bool _load_free( std::int64_t index, CampsiteRecord& out );
+    void _free_push( int index );
+    void _free_unlink( int index, const TombstoneLinks& links );
+    int  _free_pop( );
+    void _rebuild_free_list( int skip = -1 );
+    void _compact_one( );
+    void _shrink_file( );
+    void _preserve( int index, const CampsiteRecord& before );
+    void _read_snapshot( std::uint64_t version, int first_index, int count, CampsiteRecord* out );
+    void _release_snapshot( std::uint64_t version );
+    void _open_checksums( );
+    ChecksumTable& _require_checksums( );
+    void _stamp( int first_index, int count, const char* stored );
+    void _check( int first_index, int count, const char* stored );
+    void _open_indexes( const CampsiteDBOptions& options );
+    void _update_indexes( int index, const CampsiteRecord* before, const CampsiteRecord& after );
+    BPlusTree& _require_number_index( );
+    KeywordIndex& _require_keyword_index( );
+    BPlusTree& _require_rate_index( );
+    bool _has_indexes( ) const;
+    AsyncReader& _async_reader( );
+    std::vector<Campsite> _sample( int k, bool with_replacement, std::mt19937& generator );
+    void _log( const WalEntry* entries, int count );
+    void _recover( );
+    void _flush( );
+    void _checkpoint( bool when_due );
     // attributes
     std::string  _filename;
     std::fstream _file;
+    CampsiteFileHeader _header;             /// in-memory copy of the file header
+    std::streamoff     _data_offset = 0;    /// file position of record 0
+    std::size_t        _record_size = sizeof(CampsiteRecord);  /// bytes per stored record
+    bool               _header_dirty = false;
+    MappedFile   _map;             /// read mapping, when memory mapped
+    std::unique_ptr<PageCache> _cache;  /// page cache, when enabled
+    std::unique_ptr<BPlusTree> _number_index;  /// number -> index, when enabled
+    std::unique_ptr<KeywordIndex> _keyword_index;  /// description word -> indices, when enabled
+    std::unique_ptr<BPlusTree> _rate_index;    /// rate -> index and electricity, when enabled
+    std::unique_ptr<DescriptionHeap> _heap;    /// descriptions, when packed
+    std::unique_ptr<ChecksumTable> _checksums; /// stored record checksums, when enabled
+    bool         _check_reads = false;     /// reads are checked against _checksums (not while opening)
+    std::vector<char>          _scratch;       /// packed records awaiting unpacking
+    int          _read_index = 0;  /// read marker, when mapped, cached, buffered or concurrent
+    int          _write_index = 0; /// write marker, when buffered or concurrent
+    std::atomic<int> _count{0};    /// record count, deleted slots included
+    std::atomic<int> _dead{0};     /// slots on the free list
+    bool         _reuse_free_slots = false;
+    std::vector<CampsiteRecord> _pending;  /// appended records not yet written, when buffering
+    std::size_t  _buffer_limit = 0;        /// pending appends that trigger a write
+    std::size_t  _preallocate_bytes = 0;
+    std::streamoff _reserved = 0;  /// file space reserved so far
+    bool           _trim_pending = false;  /// compaction left slots past the end for snapshots
+    int          _reserve_fd = -1; /// descriptor for fallocate, made on first use
+    int          _fd = -1;         /// descriptor for positional I/O, when concurrent
+    RecordSlots<CampsiteRecord> _slots;  /// the records through _fd, when concurrent
+    std::unique_ptr<StripedLock> _locks;  /// per-record locks, when concurrent
+    std::mutex   _append_mutex;    /// serializes appends and the free list, when concurrent
+    std::mutex   _index_mutex;     /// guards the secondary indexes
+    std::unique_ptr<WriteAheadLog> _wal;  /// redo log, when enabled
+    std::unique_ptr<AsyncReader> _reader; /// batched reads for get_many, made on first use
+    std::mutex   _reader_mutex;    /// guards making _reader
+    bool         _use_io_uring = true;
+    std::size_t  _checkpoint_bytes = 0;   /// log size that triggers a checkpoint
+    int          _unlogged = 0;    /// >0 while applying writes that are already logged
+    std::atomic<int> _snapshots{0};  /// open snapshots; while any are, overwrites are preserved
+    std::uint64_t _version = 0;      /// last version handed out
+    std::mutex   _versions_mutex;    /// guards the snapshot versions and the preserved records
+    std::multiset<std::uint64_t> _snapshot_versions;     /// versions of the open snapshots
+    std::map<int, std::vector<RecordVersion>> _versions; /// overwritten records, oldest first
+    StatsRecorder _stats;          /// per-operation counters, when collecting stats
 };
 
 
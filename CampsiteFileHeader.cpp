@@ -0,0 +1,105 @@
+/**
+ * @file CampsiteFileHeader.cpp
+ *
+ * Implementation for the CampsiteFileHeader struct
+ */
+#include "CampsiteFileHeader.h"
+
+#include <cstring>
+
+const char CampsiteFileHeader::magic_value[CampsiteFileHeader::magic_size] =
+    { 'C', 'A', 'M', 'P', 'S', 'I', 'T', 'E' };
+
+
+/**
+ * Constructs an all-zero header (no magic), ready to be read into.
+ */
+CampsiteFileHeader::CampsiteFileHeader( ){
+    std::memset( this, 0, sizeof(CampsiteFileHeader) );
+}
+
+
+
+/**
+ * Constructs the header of a new, empty file.
+ *
+ * @param version       format version the file will be written in
+ * @param record_size   bytes per stored record
+ * @param record_type   tag of the stored record type
+ */
+CampsiteFileHeader::CampsiteFileHeader( std::uint32_t version, std::uint32_t record_size,
+                                        std::uint32_t record_type )
+: CampsiteFileHeader() {
+    std::memcpy( magic, magic_value, magic_size );
+    this -> version = version;
+    this -> record_size = record_size;
+    this -> record_type = record_type;
+}
+
+
+
+/**
+ * @return true if the header starts with the CampsiteDB magic bytes
+ */
+bool CampsiteFileHeader::has_magic( ) const {
+    return std::memcmp( magic, magic_value, magic_size ) == 0;
+}
+
+
+
+/**
+ * @param record_type   tag of a record type
+ * @param record_size   bytes per record of that type
+ *
+ * @return true if the file's records can be read as that type: they
+ *         have its size, and its tag unless the file is untagged
+ */
+bool CampsiteFileHeader::holds( std::uint32_t record_type, std::uint32_t record_size ) const {
+    return this -> record_size == record_size && ( this -> record_type == 0 || this -> record_type == record_type );
+}
+
+
+
+/**
+ * Brings the record count level with the whole records in a file of
+ * the given size.  The stored count only moves when the header is
+ * stored, so it can disagree with the file: a truncated file cannot
+ * hold more records than fit in it, and records appended before a
+ * crash are still in the file past the stored count.
+ *
+ * @param file_size     bytes in the file
+ * @param data_offset   file position of the first record
+ *
+ * @return  records found past the stored count, or minus those lost
+ *          from its end; 0 if the count was right
+ */
+std::int64_t CampsiteFileHeader::fit_count( std::uint64_t file_size, std::uint64_t data_offset ){
+    std::uint64_t fits = file_size > data_offset ? ( file_size - data_offset ) / record_size : 0;
+    std::int64_t gained = static_cast<std::int64_t>( fits ) - static_cast<std::int64_t>( record_count );
+    record_count = fits;
+    return gained;
+}
+
+
+
+/**
+ * Reads a header from the current position of a binary stream.
+ *
+ * @param        strm     input stream
+ * @param[out]   header   header to fill in
+ */
+std::istream& read_header( std::istream& strm, CampsiteFileHeader& header ){
+    return strm.read( reinterpret_cast<char*>(&header), sizeof(CampsiteFileHeader) );
+}
+
+
+
+/**
+ * Writes a header at the current position of a binary stream.
+ *
+ * @param        strm     output stream
+ * @param        header   header to write
+ */
+std::ostream& write_header( std::ostream& strm, const CampsiteFileHeader& header ){
+    return strm.write( reinterpret_cast<const char*>(&header), sizeof(CampsiteFileHeader) );
+}
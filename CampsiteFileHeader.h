@@ -0,0 +1,57 @@
+/**
+ * @file CampsiteFileHeader.h
+ *
+ * On-disk header at the start of a CampsiteDB file.
+ */
+#ifndef CAMPSITEFILEHEADER_H
+#define CAMPSITEFILEHEADER_H
+
+#include <cstdint>
+#include <iostream>
+
+/**
+ * A fixed 64-byte header stored in front of the records of a
+ * CampsiteDB file.  The record count is kept here so that the
+ * database never has to measure the file to know how many records
+ * it holds.  So is the head of the free list of deleted slots, which
+ * files from before deletion existed leave zeroed (an empty list),
+ * and a tag naming the type of the records, which files from before
+ * the tag existed leave zeroed (any type of the stored size).
+ */
+struct CampsiteFileHeader {
+    static constexpr std::uint32_t raw_version        = 1;   /// records stored as raw CampsiteRecord
+    static constexpr std::uint32_t packed_version     = 2;   /// PackedCampsiteRecord plus a description heap
+    static constexpr std::uint32_t current_version    = packed_version;  /// newest format this code knows
+    static constexpr std::uint32_t tombstone_flag     = 0x1; /// some records have been deleted
+    static constexpr std::uint32_t checksum_flag      = 0x2; /// <db>.crc holds the checksum of every record
+    static constexpr std::uint32_t number_index_flag  = 0x4; /// <db>.number.idx has seen every write
+    static constexpr std::uint32_t keyword_index_flag = 0x8; /// <db>.terms.idx has seen every write
+    static constexpr std::uint32_t rate_index_flag    = 0x10; /// <db>.rate.idx has seen every write
+    static constexpr int           magic_size         = 8;
+    static const char              magic_value[magic_size];
+
+    CampsiteFileHeader( );
+    CampsiteFileHeader( std::uint32_t version, std::uint32_t record_size, std::uint32_t record_type );
+
+    bool         has_magic( ) const;
+    bool         holds( std::uint32_t record_type, std::uint32_t record_size ) const;
+    std::int64_t fit_count( std::uint64_t file_size, std::uint64_t data_offset );
+
+    char          magic[magic_size];  /// identifies the file as a CampsiteDB
+    std::uint32_t version;            /// format version the file was written with
+    std::uint32_t record_size;        /// bytes per stored record
+    std::uint64_t record_count;       /// records stored after the header
+    std::uint32_t flags;              /// format feature bits
+    std::uint32_t spare;              /// zero; keeps the next fields aligned
+    std::uint64_t free_head;          /// first free slot plus one; 0 if none
+    std::uint64_t free_count;         /// slots on the free list
+    std::uint32_t record_type;        /// tag of the stored record type; 0 if untagged
+    std::uint8_t  reserved[12];       /// zero; room for later fields
+};
+
+static_assert( sizeof(CampsiteFileHeader) == 64, "CampsiteFileHeader must stay 64 bytes" );
+
+std::istream& read_header( std::istream& strm, CampsiteFileHeader& header );
+std::ostream& write_header( std::ostream& strm, const CampsiteFileHeader& header );
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file CampsiteQuery.cpp
+ *
+ * Scalar and AVX2 evaluation of CampsiteQuery predicates
+ */
+#include "CampsiteQuery.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+#include <immintrin.h>
+#define CAMPSITE_AVX2_FILTER 1
+#endif
+
+namespace {
+
+/**
+ * @return  true if the record's description contains the query's substring
+ */
+bool description_matches( const CampsiteQuery& query, const CampsiteRecord& record ){
+    if ( query.description_contains.empty() )
+        return true;
+    std::string_view description{ record.description, strnlen(record.description, CampsiteRecord::desc_size) };
+    return description.find( query.description_contains ) != std::string_view::npos;
+}
+
+/**
+ * @return  true if the record passes every predicate except the description
+ */
+bool fields_match( const CampsiteQuery& query, const CampsiteRecord& record ){
+    return record.number >= query.number_min && record.number <= query.number_max
+        && record.rate >= query.rate_min && record.rate <= query.rate_max
+        && ( query.electric < 0 || record.has_electric == (query.electric != 0) );
+}
+
+/**
+ * Field predicates one record at a time.
+ */
+int filter_fields_scalar( const CampsiteQuery& query, const CampsiteRecord* records, int first, int count,
+                          int* matches ){
+    int found = 0;
+    for ( int i = first; i < count; i++ )
+        if ( fields_match(query, records[i]) )
+            matches[found++] = i;
+    return found;
+}
+
+#ifdef CAMPSITE_AVX2_FILTER
+/**
+ * Field predicates eight records at a time.  The fields sit at fixed
+ * offsets in each record, so each is fetched for eight records with
+ * one gather and compared with one instruction; predicates left at
+ * their defaults are skipped entirely.
+ */
+__attribute__(( target("avx2") ))
+int filter_fields_avx2( const CampsiteQuery& query, const CampsiteRecord* records, int count, int* matches ){
+    const char* base = reinterpret_cast<const char*>( records );
+    const int stride = sizeof(CampsiteRecord);
+    const __m256i offsets = _mm256_mullo_epi32( _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                                _mm256_set1_epi32(stride) );
+    const __m128i offsets_low  = _mm256_castsi256_si128( offsets );
+    const __m128i offsets_high = _mm256_extracti128_si256( offsets, 1 );
+
+    const bool by_number   = query.number_min != std::numeric_limits<int>::min()
+                          || query.number_max != std::numeric_limits<int>::max();
+    const bool by_electric = query.electric >= 0;
+    const __m256i number_min = _mm256_set1_epi32( query.number_min );
+    const __m256i number_max = _mm256_set1_epi32( query.number_max );
+    const __m256d rate_min   = _mm256_set1_pd( query.rate_min );
+    const __m256d rate_max   = _mm256_set1_pd( query.rate_max );
+    const __m256i byte_mask  = _mm256_set1_epi32( 0xff );
+    const __m256d all_lanes  = _mm256_castsi256_pd( _mm256_set1_epi32(-1) );
+
+    int found = 0, i = 0;
+    for ( ; i + 8 <= count; i += 8 ){
+        const char* block = base + static_cast<std::ptrdiff_t>( i ) * stride;
+        int keep = 0xff;
+        if ( by_number ){
+            __m256i numbers = _mm256_i32gather_epi32(
+                reinterpret_cast<const int*>(block + offsetof(CampsiteRecord, number)), offsets, 1 );
+            __m256i outside = _mm256_or_si256( _mm256_cmpgt_epi32(number_min, numbers),
+                                               _mm256_cmpgt_epi32(numbers, number_max) );
+            keep &= ~_mm256_movemask_ps( _mm256_castsi256_ps(outside) );
+        }
+        if ( by_electric ){
+            //the bool and the padding after it make a whole int; only the bool byte counts
+            __m256i flags = _mm256_i32gather_epi32(
+                reinterpret_cast<const int*>(block + offsetof(CampsiteRecord, has_electric)), offsets, 1 );
+            __m256i off = _mm256_cmpeq_epi32( _mm256_and_si256(flags, byte_mask), _mm256_setzero_si256() );
+            int without = _mm256_movemask_ps( _mm256_castsi256_ps(off) );
+            keep &= query.electric ? ~without : without;
+        }
+        //rates are always compared, so NaN rates never match (as in the scalar path)
+        const double* rates = reinterpret_cast<const double*>( block + offsetof(CampsiteRecord, rate) );
+        __m256d low  = _mm256_mask_i32gather_pd( _mm256_setzero_pd(), rates, offsets_low, all_lanes, 1 );
+        __m256d high = _mm256_mask_i32gather_pd( _mm256_setzero_pd(), rates, offsets_high, all_lanes, 1 );
+        __m256d low_ok  = _mm256_and_pd( _mm256_cmp_pd(low, rate_min, _CMP_GE_OQ),
+                                         _mm256_cmp_pd(low, rate_max, _CMP_LE_OQ) );
+        __m256d high_ok = _mm256_and_pd( _mm256_cmp_pd(high, rate_min, _CMP_GE_OQ),
+                                         _mm256_cmp_pd(high, rate_max, _CMP_LE_OQ) );
+        keep &= _mm256_movemask_pd( low_ok ) | ( _mm256_movemask_pd(high_ok) << 4 );
+
+        while ( keep != 0 ){
+            matches[found++] = i + __builtin_ctz( keep );
+            keep &= keep - 1;
+        }
+    }
+    return found + filter_fields_scalar( query, records, i, count, matches + found );
+}
+#endif
+
+}
+
+
+
+/**
+ * @return  the mean matched rate, or 0 if nothing matched
+ */
+double RateSummary::average( ) const {
+    return count > 0 ? sum / count : 0;
+}
+
+
+
+/**
+ * @param   query   predicates to test
+ * @param   record  record to test them on
+ *
+ * @return  true if the record satisfies every predicate of the query
+ */
+bool matches( const CampsiteQuery& query, const CampsiteRecord& record ){
+    return fields_match( query, record ) && description_matches( query, record );
+}
+
+
+
+/**
+ * Finds the records of a block that satisfy a query.  The numeric and
+ * electric predicates run with AVX2 when the processor has it; the
+ * description test only runs on records that pass them.
+ *
+ * @param        query      predicates to test
+ * @param        records    block of records
+ * @param        count      records in the block
+ * @param[out]   matches    receives the positions in the block of the
+ *                          matching records, ascending; room for count
+ *
+ * @return  number of matching records
+ */
+int filter_records( const CampsiteQuery& query, const CampsiteRecord* records, int count, int* matches ){
+    int found;
+#ifdef CAMPSITE_AVX2_FILTER
+    if ( filter_uses_avx2() )
+        found = filter_fields_avx2( query, records, count, matches );
+    else
+#endif
+        found = filter_fields_scalar( query, records, 0, count, matches );
+
+    if ( query.description_contains.empty() )
+        return found;
+    int kept = 0;
+    for ( int i = 0; i < found; i++ )
+        if ( description_matches(query, records[matches[i]]) )
+            matches[kept++] = matches[i];
+    return kept;
+}
+
+
+
+/**
+ * @return  true if filter_records evaluates predicates with AVX2
+ */
+bool filter_uses_avx2( ){
+#ifdef CAMPSITE_AVX2_FILTER
+    static const bool avx2 = __builtin_cpu_supports( "avx2" );
+    return avx2;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,45 @@
+/**
+ * @file CampsiteQuery.h
+ *
+ * Field predicates evaluated over blocks of records for CampsiteDB::scan.
+ */
+#ifndef CAMPSITEQUERY_H
+#define CAMPSITEQUERY_H
+
+#include <cstddef>
+#include <limits>
+#include <string>
+
+#include "CampsiteRecord.h"
+
+/**
+ * A conjunction of predicates on the fields of a CampsiteRecord.  Every
+ * bound is inclusive, and a default-constructed query matches every
+ * record (except ones whose rate is NaN).
+ */
+struct CampsiteQuery {
+    int         number_min = std::numeric_limits<int>::min();
+    int         number_max = std::numeric_limits<int>::max();
+    double      rate_min   = -std::numeric_limits<double>::infinity();
+    double      rate_max   = std::numeric_limits<double>::infinity();
+    int         electric   = -1;    /// 1 for only electric sites, 0 for only non-electric, -1 for either
+    std::string description_contains;  /// substring the description must contain; empty for any
+};
+
+/**
+ * Count, extremes and mean of the rates of the records a scan matched.
+ */
+struct RateSummary {
+    std::size_t count = 0;
+    double      min   = 0;  /// meaningful only when count > 0
+    double      max   = 0;  /// meaningful only when count > 0
+    double      sum   = 0;
+
+    double average( ) const;
+};
+
+bool matches( const CampsiteQuery& query, const CampsiteRecord& record );
+int  filter_records( const CampsiteQuery& query, const CampsiteRecord* records, int count, int* matches );
+bool filter_uses_avx2( );
+
+#endif
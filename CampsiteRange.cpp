@@ -0,0 +1,241 @@
+/**
+ * @file CampsiteRange.cpp
+ *
+ * Implementation for the CampsiteRange class
+ */
+#include "CampsiteRange.h"
+#include "CampsiteDB.h"
+#include "PackedCampsiteRecord.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ * Starts a pass over the records in [first_index, last_index).
+ * Records held back by the database are written out first, since
+ * blocks are read from the file on their own descriptor; cached
+ * records are read through the cache instead, without reading ahead.
+ *
+ * @param db                database to read
+ * @param first_index       a index to begin reading, already bounds checked
+ * @param last_index        one past the last index to read
+ * @param chunk_records     records per block
+ */
+CampsiteRange::Reader::Reader( CampsiteDB& db, int first_index, int last_index, int chunk_records )
+: _db{db}, _last{last_index}, _chunk{chunk_records} {
+    _db._drain();
+    if ( !_db._cache ){
+        _db._file.flush();
+        _fd = ::open( _db._filename.c_str(), O_RDONLY );
+        if ( _fd < 0 )
+            throw std::runtime_error{"Unable to open the database for reading ahead."};
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise( _fd, _db._offset(first_index), 0, POSIX_FADV_SEQUENTIAL );  //a larger readahead window
+#endif
+    }
+}
+
+
+
+/**
+ * Waits for any block still being read, then closes the descriptor.
+ */
+CampsiteRange::Reader::~Reader( ){
+    for ( Block& block : _blocks )
+        if ( block.loading.valid() )
+            block.loading.wait();
+    if ( _fd >= 0 )
+        ::close( _fd );
+}
+
+
+
+/**
+ * Makes the block starting at first_index the one being visited,
+ * waiting for it if it is still being read, and starts reading the
+ * block after it.
+ *
+ * @param        first_index    index just past the block being left
+ * @param[out]   begin          its first record
+ * @param[out]   end            one past its last record
+ *
+ * @return  false at the end of the range
+ */
+bool CampsiteRange::Reader::next_block( int first_index, const CampsiteRecord*& begin, const CampsiteRecord*& end ){
+    if ( first_index >= _last )
+        return false;
+    Block& next = _blocks[1 - _current];
+    if ( next.first != first_index || !next.started )  //the first block is not read ahead
+        _start( next, first_index );
+    _finish( next );
+    if ( next.count == 0 )
+        return false;
+
+    _current = 1 - _current;
+    begin = next.records.data();
+    end = begin + next.count;
+    _start( _blocks[1 - _current], first_index + next.count );
+    return true;
+}
+
+
+
+/**
+ * Begins reading a block on another thread, and asks the kernel to
+ * start on the block after it.
+ *
+ * @param        block          block to fill
+ * @param        first_index    index of its first record
+ */
+void CampsiteRange::Reader::_start( Block& block, int first_index ){
+    int count = std::max( 0, std::min(_chunk, _last - first_index) );
+    block.first = first_index;
+    block.count = count;
+    block.started = true;
+    if ( count == 0 )
+        return;
+    block.records.resize( count );
+    if ( _db._heap )
+        block.stored.resize( count * _db._record_size );
+    if ( _fd < 0 )
+        return;
+    //the load may cut block.count short, so it is not read again here
+    block.loading = std::async( std::launch::async, [this, &block]( ){ _load( block ); } );
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise( _fd, _db._offset(first_index + count), count * _db._record_size, POSIX_FADV_WILLNEED );
+#endif
+}
+
+
+
+/**
+ * Reads a block's stored records and checks them against their
+ * checksums.  Runs on its own thread; in concurrent mode it reads with
+ * no write half applied, as for_each_block does.
+ *
+ * @param        block      block to fill
+ */
+void CampsiteRange::Reader::_load( Block& block ){
+    char* out = _db._heap ? block.stored.data() : reinterpret_cast<char*>( block.records.data() );
+    StripedLock::StripeSet stripes = StripedLock::stripes_of_range( block.first, block.count );
+    if ( _db._locks )
+        _db._locks->lock_shared( stripes );
+    try {
+        if ( _db._locks )  //compaction may have shrunk the file
+            block.count = std::max( 0, std::min(block.count, _db._count.load() - block.first) );
+        std::size_t size = block.count * _db._record_size, done = 0;
+        while ( done < size ){
+            ssize_t got = pread( _fd, out + done, size - done, _db._offset(block.first) + done );
+            if ( got <= 0 )
+                throw std::runtime_error{"Unable to read records from the database."};
+            stats_read( got );
+            done += got;
+        }
+        _db._check( block.first, block.count, out );
+    } catch ( ... ) {
+        if ( _db._locks )
+            _db._locks->unlock_shared( stripes );
+        throw;
+    }
+    if ( _db._locks )
+        _db._locks->unlock_shared( stripes );
+}
+
+
+
+/**
+ * Waits for a block to be ready to visit, reading it now if it is
+ * cached, and unpacks it if the file is packed.  A block cut
+ * short by compaction ends the pass after it.
+ *
+ * @param        block      block started by _start
+ */
+void CampsiteRange::Reader::_finish( Block& block ){
+    if ( _fd < 0 ){
+        if ( block.count > 0 )
+            _db._read_records( block.first, block.count, block.records.data() );
+        return;
+    }
+    if ( !block.loading.valid() )  //empty; nothing was started
+        return;
+    block.loading.get();  //only now is block.count settled
+    int planned = static_cast<int>( block.records.size() );
+    if ( _db._heap ){
+        const PackedCampsiteRecord* packed = reinterpret_cast<const PackedCampsiteRecord*>( block.stored.data() );
+        for ( int i = 0; i < block.count; i++ )
+            block.records[i] = unpack( packed[i], *_db._heap );
+    }
+    if ( block.count < planned )
+        _last = block.first + block.count;
+}
+
+
+
+/**
+ * Construct an iterator at the first live record from first_index on.
+ *
+ * @param reader            the pass to walk
+ * @param first_index       index the pass starts at
+ */
+CampsiteRange::iterator::iterator( std::shared_ptr<Reader> reader, int first_index )
+: _reader{std::move(reader)}, _index{first_index} {
+    if ( !_reader->next_block(_index, _record, _block_end) )
+        _record = nullptr;
+    else if ( is_tombstone(*_record) )
+        ++*this;
+}
+
+
+
+/**
+ * Construct a range; see CampsiteDB::records.
+ *
+ * @param db                database to read
+ * @param first_index       a index to begin reading, already bounds checked
+ * @param last_index        one past the last index to read
+ * @param chunk_records     records per block
+ */
+CampsiteRange::CampsiteRange( CampsiteDB& db, int first_index, int last_index, int chunk_records )
+: _db{&db}, _first{first_index}, _last{last_index},
+  _chunk{chunk_records > 0 ? chunk_records : CampsiteDB::default_chunk_records} {
+}
+
+
+
+/**
+ * @return  an iterator at the first live record of a new pass
+ */
+CampsiteRange::iterator CampsiteRange::begin( ) const {
+    return iterator{ std::make_shared<Reader>(*_db, _first, _last, _chunk), _first };
+}
+
+
+
+/**
+ * @return  the end of every pass
+ */
+CampsiteRange::iterator CampsiteRange::end( ) const {
+    return iterator{};
+}
+
+
+
+/**
+ * @return  the first index in the range
+ */
+int CampsiteRange::first_index( ) const {
+    return _first;
+}
+
+
+
+/**
+ * @return  one past the last index in the range
+ */
+int CampsiteRange::last_index( ) const {
+    return _last;
+}
@@ -0,0 +1,175 @@
+/**
+ * @file CampsiteRange.h
+ *
+ * The records of a CampsiteDB as an iterator range.
+ */
+#ifndef CAMPSITERANGE_H
+#define CAMPSITERANGE_H
+
+#include <cstddef>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "CampsiteRecord.h"
+#include "Tombstone.h"
+
+class CampsiteDB;
+
+/**
+ * The live records of [first_index, last_index) of a database, for
+ * range-for loops and the standard algorithms:
+ *
+ *     for ( const CampsiteRecord& record : db.records() ) ...
+ *
+ * Iterating reads the records a large block at a time.  While one
+ * block is being visited the next is already being read on another
+ * thread, and the kernel is asked to start on the one after, so a
+ * scan overlaps its I/O with whatever the loop does.  Iterators yield
+ * references into the block instead of copies, valid until the
+ * iterator moves on.  Deleted slots are skipped.
+ *
+ * The iterators are input iterators: copies share one pass, and each
+ * begin() starts a new one.  Writes made while iterating may be missed
+ * by blocks already read.  A range must not outlive its database.
+ */
+class CampsiteRange {
+public:
+    class iterator;
+
+    /**
+     * One pass over the range: the block being visited and the one
+     * being read ahead.
+     */
+    class Reader {
+    public:
+        Reader( CampsiteDB& db, int first_index, int last_index, int chunk_records );
+        ~Reader( );
+
+        // makes the block starting at first_index current; false at the end
+        bool next_block( int first_index, const CampsiteRecord*& begin, const CampsiteRecord*& end );
+
+        // This object is non-copyable
+        Reader(const Reader&)            = delete;
+        Reader& operator=(const Reader&) = delete;
+
+    private:
+        /**
+         * Records read, or being read, in one go.
+         */
+        struct Block {
+            int first = 0;                        /// index of its first record
+            int count = 0;                        /// records in it
+            std::vector<CampsiteRecord> records;  /// the records
+            std::vector<char>  stored;            /// packed records awaiting unpacking
+            std::future<void>  loading;           /// the read, when on another thread
+            bool started = false;                 /// _start has been called on it
+        };
+
+        void _start( Block& block, int first_index );
+        void _load( Block& block );
+        void _finish( Block& block );
+
+        CampsiteDB&       _db;
+        int               _fd = -1;      /// descriptor for reading ahead, unless cached
+        int               _last;         /// one past the last index
+        int               _chunk;        /// records per block
+        Block             _blocks[2];    /// the current block and the next one
+        int               _current = 1;  /// which of _blocks is being visited
+    };
+
+    /**
+     * Walks a Reader a block at a time.  Copies share the pass; the
+     * default-constructed iterator is the end.
+     */
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = CampsiteRecord;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const CampsiteRecord*;
+        using reference         = const CampsiteRecord&;
+
+        /**
+         * The record an iterator was at before it was incremented, kept so
+         * *it++ works.
+         */
+        class Postfix {
+        public:
+            explicit Postfix( const CampsiteRecord& record ) : _record{record} {}
+            const CampsiteRecord& operator*( ) const { return _record; }
+        private:
+            CampsiteRecord _record;
+        };
+
+        iterator( ) = default;
+
+        reference operator*( ) const {
+            return *_record;
+        }
+
+        pointer operator->( ) const {
+            return _record;
+        }
+
+        // on to the next live record, or the end
+        iterator& operator++( ){
+            do {
+                _index++;
+                if ( ++_record == _block_end && !_reader->next_block(_index, _record, _block_end) ){
+                    _record = nullptr;
+                    break;
+                }
+            } while ( is_tombstone(*_record) );
+            return *this;
+        }
+
+        Postfix operator++( int ){
+            Postfix before{ *_record };
+            ++*this;
+            return before;
+        }
+
+        // index of the current record in the database
+        int index( ) const {
+            return _index;
+        }
+
+        bool operator==( const iterator& other ) const {
+            return _record == other._record;
+        }
+
+        bool operator!=( const iterator& other ) const {
+            return _record != other._record;
+        }
+
+    private:
+        friend class CampsiteRange;
+        explicit iterator( std::shared_ptr<Reader> reader, int first_index );
+
+        std::shared_ptr<Reader> _reader;
+        const CampsiteRecord*   _record = nullptr;     /// the current record, null at the end
+        const CampsiteRecord*   _block_end = nullptr;  /// one past the current block
+        int                     _index = 0;            /// index of the current record
+    };
+
+    using const_iterator = iterator;
+
+    iterator begin( ) const;
+    iterator end( ) const;
+
+    int first_index( ) const;
+    int last_index( ) const;
+
+private:
+    friend class CampsiteDB;
+    CampsiteRange( CampsiteDB& db, int first_index, int last_index, int chunk_records );
+
+    CampsiteDB* _db;
+    int         _first;   /// first index in the range
+    int         _last;    /// one past the last index
+    int         _chunk;   /// records per block
+};
+
+#endif
@@ -16,8 +16,8 @@ CampsiteRecord::CampsiteRecord(int number, const char description[], bool has_el
     this -> number = number;
     this -> has_electric = has_electric;
     this -> rate = rate;
-    //copy c-string
-    strncpy( this -> description, description, strlen(description) );
+    //copy c-string, leaving room for its terminator
+    strncpy( this -> description, description, desc_size - 1 );
 }
 
 
@@ -16,6 +16,7 @@ using std::cin;
 using std::endl;
 #include <fstream>
 using std::fstream;
+#include <cstdint>
 #include <cstring>
 #include <iomanip>
 #include <exception>
@@ -32,6 +33,7 @@ struct CampsiteRecord {
     CampsiteRecord() { memset(this, 0, sizeof(CampsiteRecord)); }
     CampsiteRecord(int number, const char description[], bool has_electric, double rate);
     static const int desc_size = 128;         /// max storage size of description
+    static constexpr std::uint32_t record_type = 1;  /// tag in the header of raw files
     int              number;                  /// site number
     char             description[desc_size];  /// a short description
     bool             has_electric;            /// is power available?
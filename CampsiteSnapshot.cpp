@@ -0,0 +1,221 @@
+/**
+ * @file CampsiteSnapshot.cpp
+ *
+ * Implementation for the CampsiteSnapshot class
+ */
+#include "CampsiteSnapshot.h"
+#include "CampsiteDB.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+/**
+ * Construct a snapshot the database has already registered.
+ *
+ * @param db        database viewed
+ * @param version   last version the snapshot sees
+ * @param count     record count when it was taken
+ */
+CampsiteSnapshot::CampsiteSnapshot( CampsiteDB& db, std::uint64_t version, int count )
+: _db{&db}, _version{version}, _count{count} {
+}
+
+
+
+/**
+ * Takes over another snapshot, leaving it released.
+ *
+ * @param other     snapshot to take over
+ */
+CampsiteSnapshot::CampsiteSnapshot( CampsiteSnapshot&& other ) noexcept
+: _db{other._db}, _version{other._version}, _count{other._count} {
+    other._db = nullptr;
+}
+
+
+
+/**
+ * Releases this snapshot and takes over another, leaving it released.
+ *
+ * @param other     snapshot to take over
+ *
+ * @return  this snapshot
+ */
+CampsiteSnapshot& CampsiteSnapshot::operator=( CampsiteSnapshot&& other ) noexcept {
+    if ( this != &other ){
+        release();
+        _db = other._db;
+        _version = other._version;
+        _count = other._count;
+        other._db = nullptr;
+    }
+    return *this;
+}
+
+
+
+/**
+ * Releases the snapshot.
+ */
+CampsiteSnapshot::~CampsiteSnapshot( ){
+    release();
+}
+
+
+
+/**
+ * @return  the number of records when the snapshot was taken, deleted
+ *          ones included
+ */
+int CampsiteSnapshot::get_record_count( ) const {
+    return _count;
+}
+
+
+
+/**
+ * Gets a record as it was when the snapshot was taken.
+ *
+ * @param   index  a index of a value to be read
+ *
+ * @return  a record at the given index
+ */
+Campsite CampsiteSnapshot::get_at_index( int index ){
+    if ( !_db )
+        throw std::logic_error{"The snapshot has been released."};
+    OperationTimer timer{ _db->_stats, Operation::get_at_index };
+    if ( index < 0 || index >= _count )
+        throw std::length_error{"Index out of bounds."};
+
+    CampsiteRecord record;
+    _db->_read_snapshot( _version, index, 1, &record );
+    if ( is_tombstone(record) )
+        throw std::out_of_range{"Record was deleted."};
+    return Campsite{record};
+}
+
+
+
+/**
+ * Reads the records between the given indices as they were when the
+ * snapshot was taken.  Deleted records are left out.
+ *
+ * @param        first_index     a index to begin reading
+ * @param        last_index      one past the last index to read
+ *
+ * @return  a vector containing the records
+ */
+std::vector<Campsite> CampsiteSnapshot::get_range( int first_index, int last_index ){
+    if ( !_db )
+        throw std::logic_error{"The snapshot has been released."};
+    OperationTimer timer{ _db->_stats, Operation::get_range };
+    std::vector<Campsite> sites;
+    if ( last_index > first_index )
+        sites.reserve( last_index - first_index );
+
+    for_each_block( first_index, last_index,
+        [&sites]( int, const CampsiteRecord* records, int count ){
+            for ( int i = 0; i < count; i++ )
+                if ( !is_tombstone(records[i]) )
+                    sites.emplace_back( records[i] );
+        } );
+    return sites;
+}
+
+
+
+/**
+ * Streams the records in [first_index, last_index), as they were when
+ * the snapshot was taken, to a visitor in blocks of at most
+ * chunk_records.  Deleted slots are visited as their tombstones.
+ *
+ * @param        first_index     a index to begin reading
+ * @param        last_index      one past the last index to read
+ * @param        visit           called once per block, in index order
+ * @param        chunk_records   most records handed to one visit call
+ */
+void CampsiteSnapshot::for_each_block( int first_index, int last_index, const BlockVisitor& visit,
+                                       int chunk_records ){
+    if ( !_db )
+        throw std::logic_error{"The snapshot has been released."};
+    OperationTimer timer{ _db->_stats, Operation::for_each_block };
+    if ( first_index < 0 || first_index > last_index || last_index > _count )
+        throw std::length_error{"Index out of bounds."};
+    if ( chunk_records <= 0 )
+        chunk_records = CampsiteDB::default_chunk_records;
+
+    std::vector<CampsiteRecord> buffer( std::min(chunk_records, last_index - first_index) );
+    for ( int i = first_index; i < last_index; i += chunk_records ){
+        int count = std::min( chunk_records, last_index - i );
+        _db->_read_snapshot( _version, i, count, buffer.data() );
+        visit( i, buffer.data(), count );
+    }
+}
+
+
+
+/**
+ * Hands every record that satisfied the query when the snapshot was
+ * taken to a visitor, in index order.  Deleted records never match.
+ *
+ * @param        query      predicates the records must satisfy
+ * @param        visit      called once per matching record
+ */
+void CampsiteSnapshot::scan( const CampsiteQuery& query, const MatchVisitor& visit ){
+    if ( !_db )
+        throw std::logic_error{"The snapshot has been released."};
+    OperationTimer timer{ _db->_stats, Operation::scan };
+    std::vector<int> matches( CampsiteDB::default_chunk_records );
+    for_each_block( 0, _count,
+        [&query, &visit, &matches]( int first_index, const CampsiteRecord* records, int count ){
+            int found = filter_records( query, records, count, matches.data() );
+            for ( int i = 0; i < found; i++ )
+                if ( !is_tombstone(records[matches[i]]) )
+                    visit( first_index + matches[i], records[matches[i]] );
+        } );
+}
+
+
+
+/**
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  the indices of every matching record, ascending
+ */
+std::vector<int> CampsiteSnapshot::find_indices( const CampsiteQuery& query ){
+    std::vector<int> indices;
+    scan( query, [&indices]( int index, const CampsiteRecord& ){
+        indices.push_back( index );
+    } );
+    return indices;
+}
+
+
+
+/**
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  every matching site, in index order
+ */
+std::vector<Campsite> CampsiteSnapshot::find( const CampsiteQuery& query ){
+    std::vector<Campsite> sites;
+    scan( query, [&sites]( int, const CampsiteRecord& record ){
+        sites.emplace_back( record );
+    } );
+    return sites;
+}
+
+
+
+/**
+ * Tells the database this snapshot is done with, so the records kept
+ * for it can be freed.  Releasing twice does nothing; reading after
+ * release throws.
+ */
+void CampsiteSnapshot::release( ){
+    if ( !_db )
+        return;
+    _db->_release_snapshot( _version );
+    _db = nullptr;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file CampsiteSnapshot.h
+ *
+ * Point-in-time, read-only views of a CampsiteDB.
+ */
+#ifndef CAMPSITESNAPSHOT_H
+#define CAMPSITESNAPSHOT_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Campsite.h"
+#include "CampsiteQuery.h"
+
+class CampsiteDB;
+
+/**
+ * A record as it was before the write made at version.
+ */
+struct RecordVersion {
+    std::uint64_t  version;
+    CampsiteRecord before;
+};
+
+/**
+ * The database as it stood when the snapshot was taken.  Writes made
+ * afterwards save the records they overwrite, and the snapshot reads
+ * those saved records in place of the file's, so a report sees every
+ * write made before it and none made after, whole.  Snapshot reads
+ * take no record locks in concurrent mode, so they never wait for
+ * writers, nor writers for them.  Saved records are freed once no
+ * snapshot needs them, so release snapshots promptly; each one keeps
+ * every record overwritten after it in memory.  A snapshot must not
+ * outlive its database.
+ */
+class CampsiteSnapshot {
+public:
+    // receives consecutive records [first_index, first_index + count)
+    using BlockVisitor = std::function<void( int first_index, const CampsiteRecord* records, int count )>;
+    // receives one record that matched a scan
+    using MatchVisitor = std::function<void( int index, const CampsiteRecord& record )>;
+
+    CampsiteSnapshot( CampsiteSnapshot&& other ) noexcept;
+    CampsiteSnapshot& operator=( CampsiteSnapshot&& other ) noexcept;
+    ~CampsiteSnapshot( );
+
+    int get_record_count( ) const;  // slots when taken, deleted ones included
+
+    Campsite get_at_index( int index );
+    std::vector<Campsite> get_range( int first_index, int last_index );
+    void for_each_block( int first_index, int last_index, const BlockVisitor& visit,
+                         int chunk_records = 8192 );
+
+    void scan( const CampsiteQuery& query, const MatchVisitor& visit );
+    std::vector<int> find_indices( const CampsiteQuery& query );
+    std::vector<Campsite> find( const CampsiteQuery& query );
+
+    // lets the database free what this snapshot was keeping; done by the destructor too
+    void release( );
+
+    // This object is non-copyable
+    CampsiteSnapshot(const CampsiteSnapshot&)            = delete;
+    CampsiteSnapshot& operator=(const CampsiteSnapshot&) = delete;
+
+private:
+    friend class CampsiteDB;
+    CampsiteSnapshot( CampsiteDB& db, std::uint64_t version, int count );
+
+    CampsiteDB*   _db;       /// database viewed; null once released
+    std::uint64_t _version;  /// writes after this version are not seen
+    int           _count;    /// record count when taken
+};
+
+#endif
@@ -0,0 +1,549 @@
+/**
+ * @file ChecksumTable.cpp
+ *
+ * CRC32C with SSE4.2 and table-driven paths, and the ChecksumTable class
+ */
+#include "ChecksumTable.h"
+#include "OperationStats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+#include <immintrin.h>
+#define CAMPSITE_SSE42_CRC 1
+#endif
+
+namespace {
+
+const char          crc_magic[8] = { 'C', 'A', 'M', 'P', 'C', 'R', 'C', '1' };
+const std::uint32_t crc_polynomial = 0x82f63b78;  /// Castagnoli, bit-reversed
+const int           page_count = ( 0x7fffffff / ChecksumTable::page_slots ) + 1;
+const std::size_t   verify_bytes = 4 << 20;  /// bytes per read when verifying
+const int           batch_records = 96;       /// records checksummed per batch when checking
+
+/**
+ * Front of a checksum file; one 32-bit checksum per slot follows it.
+ */
+struct ChecksumFileHeader {
+    static constexpr std::uint32_t extended_flag = 0x1;  /// checksums cover bytes outside the slots
+
+    char          magic[8];
+    std::uint32_t record_size;  /// stored record size of the database
+    std::uint32_t flags;
+};
+
+/**
+ * Lookup tables for eight bytes at a time (slicing-by-8): entry [k][b]
+ * is the remainder of byte b followed by k zero bytes.
+ */
+struct CrcTables {
+    std::uint32_t entries[8][256];
+
+    CrcTables( ){
+        for ( std::uint32_t b = 0; b < 256; b++ ){
+            std::uint32_t crc = b;
+            for ( int bit = 0; bit < 8; bit++ )
+                crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? crc_polynomial : 0 );
+            entries[0][b] = crc;
+        }
+        for ( int k = 1; k < 8; k++ )
+            for ( int b = 0; b < 256; b++ )
+                entries[k][b] = ( entries[k - 1][b] >> 8 ) ^ entries[0][entries[k - 1][b] & 0xff];
+    }
+};
+
+/**
+ * CRC32C without special instructions, eight bytes per step.  The
+ * register is taken and returned without the final inversion.
+ */
+std::uint32_t crc32c_table( const unsigned char* p, std::size_t size, std::uint32_t crc ){
+    static const CrcTables tables;
+    const std::uint32_t (*t)[256] = tables.entries;
+    while ( size >= 8 ){
+        std::uint32_t low  = crc ^ ( p[0] | p[1] << 8 | p[2] << 16 | static_cast<std::uint32_t>(p[3]) << 24 );
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+            ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        p += 8;
+        size -= 8;
+    }
+    while ( size-- > 0 )
+        crc = t[0][( crc ^ *p++ ) & 0xff] ^ ( crc >> 8 );
+    return crc;
+}
+
+#ifdef CAMPSITE_SSE42_CRC
+/**
+ * CRC32C with the SSE4.2 crc32 instruction, eight bytes per
+ * instruction.  The register is taken and returned without the final
+ * inversion.
+ */
+__attribute__(( target("sse4.2") ))
+std::uint32_t crc32c_sse42( const unsigned char* p, std::size_t size, std::uint32_t crc ){
+    std::uint64_t wide = crc;
+    while ( size >= 8 ){
+        std::uint64_t word;
+        std::memcpy( &word, p, sizeof(word) );
+        wide = _mm_crc32_u64( wide, word );
+        p += 8;
+        size -= 8;
+    }
+    crc = static_cast<std::uint32_t>( wide );
+    while ( size-- > 0 )
+        crc = _mm_crc32_u8( crc, *p++ );
+    return crc;
+}
+
+
+
+/**
+ * CRC32C of three records at once.  Each crc32 instruction waits a
+ * few cycles for the one before it on the same record; running three
+ * records side by side fills those cycles with the other two, for
+ * about three times the speed of one record at a time.
+ */
+__attribute__(( target("sse4.2") ))
+void crc32c_sse42_x3( const unsigned char* a, const unsigned char* b, const unsigned char* c,
+                      std::size_t size, std::uint32_t* out ){
+    std::uint64_t crc_a = 0xffffffff, crc_b = 0xffffffff, crc_c = 0xffffffff;
+    std::size_t i = 0;
+    for ( ; i + 8 <= size; i += 8 ){
+        std::uint64_t word_a, word_b, word_c;
+        std::memcpy( &word_a, a + i, sizeof(word_a) );
+        std::memcpy( &word_b, b + i, sizeof(word_b) );
+        std::memcpy( &word_c, c + i, sizeof(word_c) );
+        crc_a = _mm_crc32_u64( crc_a, word_a );
+        crc_b = _mm_crc32_u64( crc_b, word_b );
+        crc_c = _mm_crc32_u64( crc_c, word_c );
+    }
+    std::uint32_t tail_a = static_cast<std::uint32_t>( crc_a ), tail_b = static_cast<std::uint32_t>( crc_b ),
+                  tail_c = static_cast<std::uint32_t>( crc_c );
+    for ( ; i < size; i++ ){
+        tail_a = _mm_crc32_u8( tail_a, a[i] );
+        tail_b = _mm_crc32_u8( tail_b, b[i] );
+        tail_c = _mm_crc32_u8( tail_c, c[i] );
+    }
+    out[0] = ~tail_a;
+    out[1] = ~tail_b;
+    out[2] = ~tail_c;
+}
+#endif
+
+
+
+/**
+ * Checksums count consecutive records, three at a time where the
+ * processor allows.
+ *
+ * @param        stored         count records
+ * @param        record_size    bytes per record
+ * @param        count          number of records
+ * @param[out]   out            the checksum of each record
+ */
+void checksum_records( const char* stored, std::size_t record_size, int count, std::uint32_t* out ){
+    const unsigned char* p = reinterpret_cast<const unsigned char*>( stored );
+    int i = 0;
+#ifdef CAMPSITE_SSE42_CRC
+    if ( crc32c_uses_sse42() )
+        for ( ; i + 3 <= count; i += 3 )
+            crc32c_sse42_x3( p + i * record_size, p + ( i + 1 ) * record_size, p + ( i + 2 ) * record_size,
+                             record_size, out + i );
+#endif
+    for ( ; i < count; i++ )
+        out[i] = crc32c( p + i * record_size, record_size );
+}
+
+/**
+ * Reads size bytes at offset, stopping short only at the end of the file.
+ *
+ * @return  bytes read
+ */
+std::size_t read_fully( int fd, char* out, std::size_t size, std::streamoff offset ){
+    std::size_t done = 0;
+    while ( done < size ){
+        ssize_t got = pread( fd, out + done, size - done, offset + done );
+        if ( got < 0 )
+            throw std::runtime_error{"Unable to read records from the database."};
+        if ( got == 0 )
+            break;
+        stats_read( got );
+        done += got;
+    }
+    return done;
+}
+
+}
+
+
+/**
+ * @param        data   bytes to checksum
+ * @param        size   number of bytes
+ * @param        crc    checksum of the bytes before these, or 0
+ *
+ * @return  the CRC32C of the bytes, as iSCSI and ext4 compute it
+ */
+std::uint32_t crc32c( const void* data, std::size_t size, std::uint32_t crc ){
+    const unsigned char* p = static_cast<const unsigned char*>( data );
+#ifdef CAMPSITE_SSE42_CRC
+    if ( crc32c_uses_sse42() )
+        return ~crc32c_sse42( p, size, ~crc );
+#endif
+    return ~crc32c_table( p, size, ~crc );
+}
+
+
+
+/**
+ * @return  true if crc32c runs on the SSE4.2 crc32 instruction
+ */
+bool crc32c_uses_sse42( ){
+#ifdef CAMPSITE_SSE42_CRC
+    static const bool sse42 = __builtin_cpu_supports( "sse4.2" );
+    return sse42;
+#else
+    return false;
+#endif
+}
+
+
+
+/**
+ * Opens (or creates) a checksum file and loads every checksum in it.
+ *
+ * @param filename      file holding the checksums
+ * @param record_size   stored record size of the database
+ */
+ChecksumTable::ChecksumTable( const std::string& filename, std::size_t record_size, Extension extension )
+: _record_size{record_size}, _extension{std::move(extension)}, _pages{new std::atomic<std::atomic<std::uint32_t>*>[page_count]},
+  _dirty{new std::atomic<bool>[page_count]} {
+    for ( int i = 0; i < page_count; i++ ){
+        _pages[i].store( nullptr, std::memory_order_relaxed );
+        _dirty[i].store( false, std::memory_order_relaxed );
+    }
+    _fd = ::open( filename.c_str(), O_RDWR | O_CREAT, 0644 );
+    if ( _fd < 0 )
+        throw std::runtime_error{"Unable to open checksum file " + filename + "."};
+    try {
+        struct stat info;
+        if ( fstat(_fd, &info) != 0 )
+            throw std::runtime_error{"Unable to read checksum file " + filename + "."};
+        ChecksumFileHeader header;
+        std::uint32_t flags = _extension ? ChecksumFileHeader::extended_flag : 0;
+        if ( info.st_size > 0 ){
+            if ( pread(_fd, &header, sizeof(header), 0) != sizeof(header)
+                 || std::memcmp(header.magic, crc_magic, sizeof(crc_magic)) != 0 )
+                throw std::runtime_error{filename + " is not a checksum file."};
+            stats_read( sizeof(header) );
+            if ( header.record_size != record_size )
+                throw std::runtime_error{"Checksum file " + filename + " does not match the database."};
+        }
+        if ( info.st_size == 0 || header.flags != flags ){  //brand new, or checksummed some other way
+            std::memcpy( header.magic, crc_magic, sizeof(crc_magic) );
+            header.record_size = static_cast<std::uint32_t>( record_size );
+            header.flags = flags;
+            stats_write( sizeof(header) );
+            if ( ftruncate(_fd, 0) != 0 || pwrite(_fd, &header, sizeof(header), 0) != sizeof(header) )
+                throw std::runtime_error{"Unable to write checksum file " + filename + "."};
+            return;
+        }
+
+        //a torn last checksum is dropped; its slot is checksummed again by the owner
+        int count = static_cast<int>( ( info.st_size - sizeof(header) ) / sizeof(std::uint32_t) );
+        std::vector<std::uint32_t> sums( std::min(count, page_slots) );
+        for ( int first = 0; first < count; first += page_slots ){
+            int n = std::min( page_slots, count - first );
+            std::size_t bytes = n * sizeof(std::uint32_t);
+            if ( read_fully(_fd, reinterpret_cast<char*>(sums.data()), bytes,
+                            sizeof(header) + first * sizeof(std::uint32_t)) != bytes )
+                throw std::runtime_error{"Unable to read checksum file " + filename + "."};
+            std::atomic<std::uint32_t>* page = _page( first / page_slots );
+            for ( int i = 0; i < n; i++ )
+                page[i].store( sums[i], std::memory_order_relaxed );
+        }
+        _size = count;
+    } catch ( ... ) {
+        ::close( _fd );
+        for ( int i = 0; i < page_count; i++ )
+            delete[] _pages[i].load();
+        throw;
+    }
+}
+
+
+
+/**
+ * Writes any checksums held back, then frees the pages and closes
+ * the file.
+ */
+ChecksumTable::~ChecksumTable( ){
+    try {
+        flush();
+    } catch ( ... ) {
+        // nothing sensible to do from a destructor
+    }
+    ::close( _fd );
+    for ( int i = 0; i < page_count; i++ )
+        delete[] _pages[i].load();
+}
+
+
+
+/**
+ * @return  the number of slots with a checksum
+ */
+int ChecksumTable::size( ) const {
+    return _size.load( std::memory_order_acquire );
+}
+
+
+
+/**
+ * @param   stored  a stored record
+ *
+ * @return  the checksum it should have, its outside bytes included
+ */
+std::uint32_t ChecksumTable::checksum( const char* stored ) const {
+    std::uint32_t sum;
+    _checksum( stored, 1, &sum );
+    return sum;
+}
+
+
+
+/**
+ * @param   index  a slot below size()
+ *
+ * @return  the checksum stored for it
+ */
+std::uint32_t ChecksumTable::get( int index ) const {
+    return _slot( index ).load( std::memory_order_relaxed );
+}
+
+
+
+/**
+ * Checksums count consecutive stored records and keeps the checksums.
+ * Their pages are written to the file by the next flush().  Slots past
+ * size() extend the table; callers serialize those, as appends are.
+ *
+ * @param        first_index    index of the first record, at most size()
+ * @param        count          number of records
+ * @param        stored         count stored records
+ */
+void ChecksumTable::set( int first_index, int count, const char* stored ){
+    std::uint32_t sums[batch_records];
+    for ( int done = 0; done < count; done += batch_records ){
+        int n = std::min( batch_records, count - done );
+        _checksum( stored + done * _record_size, n, sums );
+        for ( int i = 0; i < n; i++ ){
+            int index = first_index + done + i;
+            if ( index % page_slots == 0 || i == 0 )
+                _page( index / page_slots );
+            _slot( index ).store( sums[i], std::memory_order_relaxed );
+            _dirty[index / page_slots].store( true, std::memory_order_relaxed );
+        }
+    }
+    if ( first_index + count > size() )
+        _size.store( first_index + count, std::memory_order_release );
+}
+
+
+
+/**
+ * @param        first_index    index of the first record, already bounds checked
+ * @param        count          number of records
+ * @param        stored         count stored records
+ *
+ * @return  index of the first record whose checksum differs, or -1
+ *          if they all match
+ */
+int ChecksumTable::mismatch( int first_index, int count, const char* stored ) const {
+    std::uint32_t sums[batch_records];
+    for ( int done = 0; done < count; done += batch_records ){
+        int n = std::min( batch_records, count - done );
+        _checksum( stored + done * _record_size, n, sums );
+        for ( int i = 0; i < n; i++ ){
+            int index = first_index + done + i;
+            if ( index >= size() || sums[i] != get(index) )
+                return index;
+        }
+    }
+    return -1;
+}
+
+
+
+/**
+ * Writes the pages of checksums set since the last flush to the file,
+ * one write per page.
+ */
+void ChecksumTable::flush( ){
+    int count = size();
+    std::vector<std::uint32_t> sums;
+    for ( int page = 0; page * page_slots < count; page++ ){
+        if ( !_dirty[page].load(std::memory_order_relaxed) || !_dirty[page].exchange(false) )
+            continue;
+        int first = page * page_slots, n = std::min( page_slots, count - first );
+        sums.resize( n );
+        for ( int i = 0; i < n; i++ )
+            sums[i] = get( first + i );
+
+        std::size_t length = n * sizeof(std::uint32_t), done = 0;
+        std::streamoff offset = sizeof(ChecksumFileHeader) + static_cast<std::streamoff>( first ) * sizeof(std::uint32_t);
+        const char* bytes = reinterpret_cast<const char*>( sums.data() );
+        while ( done < length ){
+            ssize_t put = pwrite( _fd, bytes + done, length - done, offset + done );
+            if ( put <= 0 ){
+                _dirty[page].store( true );
+                throw std::runtime_error{"Unable to write the checksum file."};
+            }
+            stats_write( put );
+            done += put;
+        }
+    }
+}
+
+
+
+/**
+ * Forgets the checksums of every slot from count on, in memory and in
+ * the file.
+ *
+ * @param        count      slots to keep
+ */
+void ChecksumTable::truncate( int count ){
+    if ( count >= size() )
+        return;
+    _size.store( count, std::memory_order_release );
+    if ( ftruncate(_fd, sizeof(ChecksumFileHeader) + static_cast<off_t>( count ) * sizeof(std::uint32_t)) != 0 )
+        throw std::runtime_error{"Unable to shrink the checksum file."};
+}
+
+
+
+/**
+ * Writes the checksums held back and forces them to stable storage.
+ */
+void ChecksumTable::sync( ){
+    flush();
+    bool ok = fdatasync( _fd ) == 0;
+    stats_sync();
+    if ( !ok )
+        throw std::runtime_error{"Unable to sync the checksum file."};
+}
+
+
+
+/**
+ * Checks every record of a database file against its checksum.  The
+ * file is cut into large blocks that the threads claim in turn, each
+ * read with one positional read, so the scan keeps every core and the
+ * disk busy.  Records past the end of a file that was cut short are
+ * not checked.
+ *
+ * @param        fd             descriptor of the database file
+ * @param        data_offset    file position of record 0
+ * @param        count          records to check
+ * @param        threads        threads to check with
+ *
+ * @return  the indices of the records that differ, ascending
+ */
+std::vector<int> ChecksumTable::verify( int fd, std::streamoff data_offset, int count, int threads ) const {
+    int block = static_cast<int>( std::max<std::size_t>(1, verify_bytes / _record_size) );
+    threads = std::max( 1, std::min(threads, ( count + block - 1 ) / block) );
+    std::atomic<int> next{0};
+    std::vector<std::vector<int>> bad( threads );
+    std::vector<std::exception_ptr> errors( threads );
+
+    auto check = [&]( int t ){
+        try {
+            std::vector<char> buffer( block * _record_size );
+            for ( int first = next.fetch_add(block); first < count; first = next.fetch_add(block) ){
+                int n = std::min( block, count - first );
+                std::size_t got = read_fully( fd, buffer.data(), n * _record_size,
+                                              data_offset + static_cast<std::streamoff>( first ) * _record_size );
+                n = static_cast<int>( got / _record_size );
+                for ( int done = 0; done < n; ){
+                    int failed = mismatch( first + done, n - done, buffer.data() + done * _record_size );
+                    if ( failed < 0 )
+                        break;
+                    bad[t].push_back( failed );
+                    done = failed - first + 1;
+                }
+            }
+        } catch ( ... ) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    for ( int t = 1; t < threads; t++ )
+        workers.emplace_back( check, t );
+    check( 0 );
+    for ( std::thread& worker : workers )
+        worker.join();
+
+    std::vector<int> indices;
+    for ( int t = 0; t < threads; t++ ){
+        if ( errors[t] )
+            std::rethrow_exception( errors[t] );
+        indices.insert( indices.end(), bad[t].begin(), bad[t].end() );
+    }
+    std::sort( indices.begin(), indices.end() );
+    return indices;
+}
+
+
+
+/**
+ * @param   index  a slot whose page exists
+ *
+ * @return  where its checksum is kept
+ */
+std::atomic<std::uint32_t>& ChecksumTable::_slot( int index ) const {
+    return _pages[index / page_slots].load( std::memory_order_acquire )[index % page_slots];
+}
+
+
+
+/**
+ * @param   page  a page number
+ *
+ * @return  the page, made now if it did not exist
+ */
+std::atomic<std::uint32_t>* ChecksumTable::_page( int page ){
+    std::atomic<std::uint32_t>* slots = _pages[page].load( std::memory_order_acquire );
+    if ( slots )
+        return slots;
+    std::lock_guard<std::mutex> guard( _page_mutex );
+    slots = _pages[page].load( std::memory_order_relaxed );
+    if ( !slots ){
+        slots = new std::atomic<std::uint32_t>[page_slots]();
+        _pages[page].store( slots, std::memory_order_release );
+    }
+    return slots;
+}
+
+
+
+/**
+ * Checksums count consecutive stored records, continuing each over
+ * its outside bytes if the table has an extension.
+ *
+ * @param        stored     count stored records
+ * @param        count      number of records
+ * @param[out]   out        the checksum of each record
+ */
+void ChecksumTable::_checksum( const char* stored, int count, std::uint32_t* out ) const {
+    checksum_records( stored, _record_size, count, out );
+    if ( _extension )
+        for ( int i = 0; i < count; i++ )
+            out[i] = _extension( stored + i * _record_size, out[i] );
+}
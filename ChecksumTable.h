@@ -0,0 +1,84 @@
+/**
+ * @file ChecksumTable.h
+ *
+ * CRC32C checksums of stored records, kept in a file beside the database.
+ *
+ * @remarks
+ *     Used by CampsiteDB to catch records damaged on disk.  A record
+ *     slot has no spare bytes, so the checksums live in <db>.crc, one
+ *     per slot, in slot order.
+ */
+#ifndef CHECKSUMTABLE_H
+#define CHECKSUMTABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// CRC32C (Castagnoli) of size bytes, continuing from crc; 0 starts a new one
+std::uint32_t crc32c( const void* data, std::size_t size, std::uint32_t crc = 0 );
+// true if crc32c uses the SSE4.2 crc32 instruction
+bool crc32c_uses_sse42( );
+
+/**
+ * The checksum of every stored record, held in memory for reads to
+ * check against.  A record that keeps part of itself elsewhere, as a
+ * packed record keeps its description in the heap, has those bytes
+ * covered by its checksum too, through the table's extension.  Memory is taken a page of slots at a time and pages
+ * never move, so in concurrent mode readers look checksums up while
+ * appends extend the table; each slot's own checksum is read and
+ * written under its record's lock.  Pages with new checksums are
+ * written to the file by flush(), as the page cache writes back
+ * records.
+ */
+class ChecksumTable {
+public:
+    static constexpr int page_slots = 1 << 16;  /// checksums per page of memory
+
+    // continues a stored record's checksum over bytes it refers to outside its slot
+    using Extension = std::function<std::uint32_t( const char* stored, std::uint32_t crc )>;
+
+    ChecksumTable( const std::string& filename, std::size_t record_size, Extension extension = nullptr );
+    ~ChecksumTable( );
+
+    int  size( ) const;  // slots with a checksum
+    std::uint32_t get( int index ) const;
+    // the checksum one stored record should have
+    std::uint32_t checksum( const char* stored ) const;
+    // stores the checksums of count consecutive stored records
+    void set( int first_index, int count, const char* stored );
+    // index of the first record that does not match its checksum, or -1
+    int  mismatch( int first_index, int count, const char* stored ) const;
+    void truncate( int count );
+    void flush( );
+    void sync( );
+
+    // ascending indices of the records in [0, count) of a database file that
+    // do not match, read with large positional reads on threads threads
+    std::vector<int> verify( int fd, std::streamoff data_offset, int count, int threads ) const;
+
+    // This object is non-copyable
+    ChecksumTable(const ChecksumTable&)            = delete;
+    ChecksumTable& operator=(const ChecksumTable&) = delete;
+
+private:
+    std::atomic<std::uint32_t>& _slot( int index ) const;
+    std::atomic<std::uint32_t>* _page( int page );
+    void _checksum( const char* stored, int count, std::uint32_t* out ) const;
+
+    int              _fd;
+    std::size_t      _record_size;
+    Extension        _extension;      /// covers bytes outside the slot, if set
+    std::unique_ptr<std::atomic<std::atomic<std::uint32_t>*>[]> _pages;  /// page_slots checksums each, made on first use
+    std::unique_ptr<std::atomic<bool>[]> _dirty;  /// pages set since the last flush
+    std::atomic<int> _size{0};        /// slots with a checksum
+    std::mutex       _page_mutex;     /// serializes making pages
+};
+
+#endif
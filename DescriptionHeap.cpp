@@ -0,0 +1,121 @@
+/**
+ * @file DescriptionHeap.cpp
+ *
+ * Implementation for the DescriptionHeap class
+ */
+#include "DescriptionHeap.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ * Opens (or creates) the heap file.
+ *
+ * @param filename  file holding the strings
+ */
+DescriptionHeap::DescriptionHeap( const std::string& filename )
+: _filename{filename} {
+    _out.open( _filename, std::ios::out | std::ios::app | std::ios::binary );
+    if ( !_out.good() )
+        throw std::runtime_error{"Unable to open description heap " + _filename + "."};
+    _map.open( _filename );
+    _size = _map.size();
+}
+
+
+
+/**
+ * Closes the descriptor used for in-place writes.
+ */
+DescriptionHeap::~DescriptionHeap( ){
+    if ( _fd >= 0 )
+        ::close( _fd );
+}
+
+
+
+/**
+ * Adds a string to the end of the heap.
+ *
+ * @param text      characters to store (need not be null terminated)
+ * @param length    number of characters to store
+ *
+ * @return  offset of the stored string
+ */
+std::uint64_t DescriptionHeap::append( const char* text, std::size_t length ){
+    std::uint64_t offset = _size;
+    _out.write( text, length );
+    if ( !_out.good() )
+        throw std::runtime_error{"Unable to append to the description heap."};
+    _size += length;
+    return offset;
+}
+
+
+
+/**
+ * Replaces a stored string with another that fits in its room, padding
+ * the rest of the room with zeros so the new string reads back the
+ * same whether its own length or the whole room is read.
+ *
+ * @param offset    where the room starts
+ * @param room      bytes available, at least length
+ * @param text      characters to store (need not be null terminated)
+ * @param length    number of characters to store
+ */
+void DescriptionHeap::overwrite( std::uint64_t offset, std::size_t room, const char* text, std::size_t length ){
+    char buffer[256];
+    if ( offset + room > _size || length > room || room > sizeof(buffer) )
+        throw std::runtime_error{"Description reference is past the end of the heap."};
+    if ( _fd < 0 )
+        _fd = ::open( _filename.c_str(), O_WRONLY );
+    if ( _fd < 0 )
+        throw std::runtime_error{"Unable to open description heap " + _filename + "."};
+    _out.flush();  //the room may still be in the append buffer
+
+    std::memcpy( buffer, text, length );
+    std::memset( buffer + length, 0, room - length );
+    if ( pwrite(_fd, buffer, room, offset) != static_cast<ssize_t>(room) )
+        throw std::runtime_error{"Unable to write to the description heap."};
+}
+
+
+
+/**
+ * Copies a stored string out of the heap.  Strings appended since the
+ * last read are flushed and mapped first.
+ *
+ * @param        offset     where the string starts
+ * @param        length     number of characters to copy
+ * @param[out]   out        buffer of at least length characters
+ */
+void DescriptionHeap::read( std::uint64_t offset, std::size_t length, char* out ){
+    if ( offset + length > _size )
+        throw std::runtime_error{"Description reference is past the end of the heap."};
+    if ( offset + length > _map.size() )
+        flush();
+    std::memcpy( out, _map.data() + offset, length );
+}
+
+
+
+/**
+ * Pushes appended strings to the file and makes them readable.
+ */
+void DescriptionHeap::flush( ){
+    _out.flush();
+    _map.remap( _size );
+}
+
+
+
+/**
+ * @return  number of bytes in the heap
+ */
+std::uint64_t DescriptionHeap::size( ) const {
+    return _size;
+}
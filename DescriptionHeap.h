@@ -0,0 +1,48 @@
+/**
+ * @file DescriptionHeap.h
+ *
+ * Append-only file of variable-length description strings.
+ *
+ * @remarks
+ *     Used by the packed CampsiteDB format, whose fixed-size records
+ *     only hold an (offset, length) reference into this heap.
+ */
+#ifndef DESCRIPTIONHEAP_H
+#define DESCRIPTIONHEAP_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "MappedFile.h"
+
+/**
+ * Strings are appended to the end of the heap file and never moved,
+ * so an offset stays valid for the life of the file.  A string may be
+ * replaced in place by one no longer than it, padded out with zeros.
+ * Reads are served from a memory mapping of the heap.
+ */
+class DescriptionHeap {
+public:
+    DescriptionHeap( const std::string& filename );
+    ~DescriptionHeap( );
+
+    std::uint64_t append( const char* text, std::size_t length );
+    void          overwrite( std::uint64_t offset, std::size_t room, const char* text, std::size_t length );
+    void          read( std::uint64_t offset, std::size_t length, char* out );
+    void          flush( );
+    std::uint64_t size( ) const;
+
+    // This object is non-copyable
+    DescriptionHeap(const DescriptionHeap&)            = delete;
+    DescriptionHeap& operator=(const DescriptionHeap&) = delete;
+
+private:
+    std::string   _filename;
+    std::ofstream _out;       /// appends go here
+    int           _fd = -1;   /// in-place writes go here, opened on first use
+    MappedFile    _map;       /// reads come from here
+    std::uint64_t _size;      /// bytes appended so far
+};
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * @file ExternalSort.cpp
+ *
+ * Run generation and k-way merge for the external sort
+ */
+#include "ExternalSort.h"
+
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+
+/**
+ * @param key   field to order by
+ *
+ * @return  a comparator ordering records by that field
+ */
+RecordLess record_less( SortKey key ){
+    if ( key == SortKey::rate )
+        return []( const CampsiteRecord& a, const CampsiteRecord& b ){ return a.rate < b.rate; };
+    return []( const CampsiteRecord& a, const CampsiteRecord& b ){ return a.number < b.number; };
+}
+
+
+
+/**
+ * Sorts a memory-sized batch of items and writes it out as one sorted
+ * run file.  The batch is cut into one slice per thread, the slices
+ * are sorted in parallel, and neighbouring slices are then merged in
+ * place, pairs in parallel, until one sorted batch is left.  Sorting
+ * is stable.
+ *
+ * @param        items      the batch; left sorted
+ * @param        less       ordering of the records
+ * @param        threads    slices to sort at once
+ * @param        prefix     run files are named prefix + run number
+ * @param[out]   runs       the name of the new run file is appended here
+ */
+void write_sorted_run( std::vector<SortItem>& items, const RecordLess& less, int threads,
+                       const std::string& prefix, std::vector<std::string>& runs ){
+    if ( items.empty() )
+        return;
+    std::size_t slices = std::max<std::size_t>( 1, std::min<std::size_t>(threads, items.size()) );
+    std::size_t width = ( items.size() + slices - 1 ) / slices;
+    auto by_record = [&less]( const SortItem& a, const SortItem& b ){ return less( a.record, b.record ); };
+
+    //runs every job, one per thread, the last on this thread
+    auto run_all = []( std::vector<std::function<void( )>>& jobs ){
+        std::vector<std::thread> workers;
+        for ( std::size_t i = 0; i + 1 < jobs.size(); i++ )
+            workers.emplace_back( jobs[i] );
+        if ( !jobs.empty() )
+            jobs.back()();
+        for ( std::thread& worker : workers )
+            worker.join();
+    };
+
+    std::vector<std::function<void( )>> jobs;
+    for ( std::size_t first = 0; first < items.size(); first += width ){
+        auto begin = items.begin() + first;
+        auto end   = items.begin() + std::min( first + width, items.size() );
+        jobs.push_back( [begin, end, &by_record]( ){ std::stable_sort( begin, end, by_record ); } );
+    }
+    run_all( jobs );
+
+    //merge neighbouring sorted slices, doubling their width each round
+    for ( ; width < items.size(); width *= 2 ){
+        jobs.clear();
+        for ( std::size_t first = 0; first + width < items.size(); first += 2 * width ){
+            auto begin  = items.begin() + first;
+            auto middle = begin + width;
+            auto end    = items.begin() + std::min( first + 2 * width, items.size() );
+            jobs.push_back( [begin, middle, end, &by_record]( ){
+                std::inplace_merge( begin, middle, end, by_record );
+            } );
+        }
+        run_all( jobs );
+    }
+
+    std::string name = prefix + std::to_string( runs.size() );
+    std::ofstream out{ name, std::ios::out | std::ios::trunc | std::ios::binary };
+    out.write( reinterpret_cast<const char*>(items.data()), items.size() * sizeof(SortItem) );
+    if ( !out.good() )
+        throw std::runtime_error{"Unable to write sort run " + name + "."};
+    runs.push_back( name );
+}
+
+
+
+/**
+ * Merges sorted run files into one ordered stream.  Each run is read
+ * through its own buffer, together using about memory_bytes.  Equal
+ * records come out in run order, so a stable run order gives a stable
+ * sort overall.
+ *
+ * @param        runs           sorted run files, in original order
+ * @param        less           ordering the runs were sorted with
+ * @param        memory_bytes   budget for the read and write buffers
+ * @param        emit           receives the merged items in order
+ */
+void merge_runs( const std::vector<std::string>& runs, const RecordLess& less,
+                 std::size_t memory_bytes, const SortItemSink& emit ){
+    struct Run {
+        std::ifstream         in;
+        std::vector<SortItem> buffer;
+        std::size_t           next = 0;  /// position in buffer
+        std::size_t           size = 0;  /// items in buffer
+
+        bool refill( ){
+            in.read( reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(SortItem) );
+            size = in.gcount() / sizeof(SortItem);
+            next = 0;
+            return size > 0;
+        }
+    };
+
+    std::size_t per_buffer = std::max<std::size_t>( 1, memory_bytes / (runs.size() + 1) / sizeof(SortItem) );
+    std::vector<Run> sources( runs.size() );
+    //the heap holds run numbers; ties go to the earlier run
+    auto later = [&sources, &less]( std::size_t a, std::size_t b ){
+        const CampsiteRecord& ra = sources[a].buffer[sources[a].next].record;
+        const CampsiteRecord& rb = sources[b].buffer[sources[b].next].record;
+        if ( less(rb, ra) )
+            return true;
+        return !less( ra, rb ) && b < a;
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap{ later };
+
+    for ( std::size_t i = 0; i < runs.size(); i++ ){
+        sources[i].in.open( runs[i], std::ios::in | std::ios::binary );
+        if ( !sources[i].in.good() )
+            throw std::runtime_error{"Unable to read sort run " + runs[i] + "."};
+        sources[i].buffer.resize( per_buffer );
+        if ( sources[i].refill() )
+            heap.push( i );
+    }
+
+    std::vector<SortItem> out;
+    out.reserve( per_buffer );
+    while ( !heap.empty() ){
+        std::size_t i = heap.top();
+        heap.pop();
+        Run& run = sources[i];
+        out.push_back( run.buffer[run.next++] );
+        if ( out.size() == per_buffer ){
+            emit( out.data(), out.size() );
+            out.clear();
+        }
+        if ( run.next < run.size || run.refill() )
+            heap.push( i );
+    }
+    if ( !out.empty() )
+        emit( out.data(), out.size() );
+}
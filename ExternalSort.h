@@ -0,0 +1,48 @@
+/**
+ * @file ExternalSort.h
+ *
+ * Sorted runs and k-way merging for CampsiteDB::sort_file.
+ */
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CampsiteRecord.h"
+#include "PackedCampsiteRecord.h"
+
+// strict weak ordering on records
+using RecordLess = std::function<bool( const CampsiteRecord& a, const CampsiteRecord& b )>;
+
+/**
+ * Built-in sort keys.
+ */
+enum class SortKey {
+    number,  /// ascending site number
+    rate     /// ascending per-night rate
+};
+
+RecordLess record_less( SortKey key );
+
+/**
+ * A record being sorted.  The comparator sees the full record; the
+ * stored form goes along with it so a packed file's description
+ * references survive the sort without touching its heap.
+ */
+struct SortItem {
+    CampsiteRecord       record;
+    PackedCampsiteRecord packed;  /// stored form, for packed files only
+};
+
+// receives consecutive items of the merged output
+using SortItemSink = std::function<void( const SortItem* items, std::size_t count )>;
+
+void write_sorted_run( std::vector<SortItem>& items, const RecordLess& less, int threads,
+                       const std::string& prefix, std::vector<std::string>& runs );
+void merge_runs( const std::vector<std::string>& runs, const RecordLess& less,
+                 std::size_t memory_bytes, const SortItemSink& emit );
+
+#endif
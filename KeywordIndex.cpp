@@ -0,0 +1,490 @@
+/**
+ * @file KeywordIndex.cpp
+ *
+ * Implementation for the KeywordIndex class
+ */
+#include "KeywordIndex.h"
+#include "CampsiteRecord.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+    const char          index_magic[8] = { 'C', 'A', 'M', 'P', 'T', 'E', 'R', 'M' };
+    const std::uint32_t index_version  = 1;
+    const std::size_t   max_term_size  = 0xFFFF;
+    const std::size_t   merge_minimum  = 64;  /// pending changes a list always tolerates
+
+    /**
+     * Layout of the front of the file.  Terms follow, in order, each as
+     * a 16-bit length, its characters, then count, last and the size
+     * and bytes of its coded list.
+     */
+    struct IndexHeader {
+        char          magic[8];
+        std::uint32_t version;
+        std::uint32_t clean;       /// 1 when the file was written after the last change
+        std::uint64_t tag;
+        std::uint64_t term_count;
+    };
+
+    const std::streamoff clean_offset = offsetof( IndexHeader, clean );
+
+    /**
+     * @param        coded      coded list to append to
+     * @param        value      value to append
+     */
+    void put_varint( std::vector<std::uint8_t>& coded, std::uint32_t value ){
+        while ( value >= 0x80 ){
+            coded.push_back( static_cast<std::uint8_t>(value | 0x80) );
+            value >>= 7;
+        }
+        coded.push_back( static_cast<std::uint8_t>(value) );
+    }
+
+    /**
+     * @param        a      ascending indices
+     * @param        b      ascending indices
+     *
+     * @return  the ascending indices in either
+     */
+    std::vector<int> unite( const std::vector<int>& a, const std::vector<int>& b ){
+        std::vector<int> out;
+        out.reserve( a.size() + b.size() );
+        std::set_union( a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out) );
+        return out;
+    }
+}
+
+
+/**
+ * Opens (or creates) an index stored in the given file.
+ *
+ * @param filename      file holding the index
+ */
+KeywordIndex::KeywordIndex( const std::string& filename )
+: _filename{filename} {
+    _load();
+}
+
+
+
+/**
+ * Writes the index out and marks the file clean.
+ */
+KeywordIndex::~KeywordIndex( ){
+    try {
+        flush();
+    } catch ( ... ) {
+        // nothing sensible to do from a destructor
+    }
+}
+
+
+
+/**
+ * Splits text into words: runs of ASCII letters and digits, lower
+ * cased.  Text ends at its first NUL, if it has one before length.
+ *
+ * @param text      characters to split
+ * @param length    most characters to look at
+ *
+ * @return  each distinct word once, in order of first appearance
+ */
+std::vector<std::string> KeywordIndex::tokenize( const char* text, std::size_t length ){
+    std::vector<std::string> terms;
+    std::string term;
+    for ( std::size_t i = 0; i <= length; i++ ){
+        unsigned char c = i < length ? static_cast<unsigned char>( text[i] ) : '\0';
+        if ( c < 0x80 && std::isalnum(c) ){
+            if ( term.size() < max_term_size )
+                term += static_cast<char>( std::tolower(c) );
+            continue;
+        }
+        if ( !term.empty() && std::find(terms.begin(), terms.end(), term) == terms.end() )
+            terms.push_back( term );
+        term.clear();
+        if ( c == '\0' )
+            break;
+    }
+    return terms;
+}
+
+
+
+/**
+ * Moves a record's words from its old description to its new one.
+ * Words in both are left alone.
+ *
+ * @param index     the record's index
+ * @param before    its old description (NUL-terminated or
+ *                  CampsiteRecord::desc_size long), or nullptr if it had none
+ * @param after     its new description, or nullptr if it has none
+ */
+void KeywordIndex::update( int index, const char* before, const char* after ){
+    std::vector<std::string> old_terms, new_terms;
+    if ( before != nullptr )
+        old_terms = tokenize( before, CampsiteRecord::desc_size );
+    if ( after != nullptr )
+        new_terms = tokenize( after, CampsiteRecord::desc_size );
+
+    for ( const std::string& term : old_terms )
+        if ( std::find(new_terms.begin(), new_terms.end(), term) == new_terms.end() )
+            _remove( term, index );
+    for ( const std::string& term : new_terms )
+        if ( std::find(old_terms.begin(), old_terms.end(), term) == old_terms.end() )
+            _add( term, index );
+}
+
+
+
+/**
+ * Empties the index, ready for it to be rebuilt in ascending index
+ * order (which codes every list as it goes).
+ */
+void KeywordIndex::clear( ){
+    _touch();
+    _terms.clear();
+}
+
+
+
+/**
+ * Writes the whole index to a new file, marked clean, and renames it
+ * over the old one.  Does nothing if the index has not changed.
+ */
+void KeywordIndex::flush( ){
+    if ( !_dirty )
+        return;
+    for ( auto term = _terms.begin(); term != _terms.end(); ){
+        auto next = std::next( term );
+        _merge( term, true );
+        term = next;
+    }
+
+    std::string temporary = _filename + ".tmp";
+    std::ofstream out( temporary, std::ios::out | std::ios::trunc | std::ios::binary );
+    IndexHeader header;
+    std::memset( &header, 0, sizeof(IndexHeader) );
+    std::memcpy( header.magic, index_magic, sizeof(index_magic) );
+    header.version = index_version;
+    header.clean = 1;
+    header.tag = _tag;
+    header.term_count = _terms.size();
+    out.write( reinterpret_cast<const char*>(&header), sizeof(IndexHeader) );
+    for ( const auto& term : _terms ){
+        std::uint16_t size = static_cast<std::uint16_t>( term.first.size() );
+        std::uint32_t bytes = static_cast<std::uint32_t>( term.second.coded.size() );
+        out.write( reinterpret_cast<const char*>(&size), sizeof(size) );
+        out.write( term.first.data(), size );
+        out.write( reinterpret_cast<const char*>(&term.second.count), sizeof(term.second.count) );
+        out.write( reinterpret_cast<const char*>(&term.second.last), sizeof(term.second.last) );
+        out.write( reinterpret_cast<const char*>(&bytes), sizeof(bytes) );
+        out.write( reinterpret_cast<const char*>(term.second.coded.data()), bytes );
+    }
+    out.close();
+    if ( !out || std::rename(temporary.c_str(), _filename.c_str()) != 0 ){
+        std::remove( temporary.c_str() );
+        throw std::runtime_error{"Unable to write the index file " + _filename + "."};
+    }
+    _dirty = false;
+}
+
+
+
+/**
+ * @param words     text holding the words to look for
+ *
+ * @return  ascending indices of the records whose description contains
+ *          every word; none if words holds no word
+ */
+std::vector<int> KeywordIndex::all_of( const std::string& words ) const {
+    std::vector<std::vector<int>> lists;
+    for ( const std::string& term : tokenize(words.data(), words.size()) ){
+        auto found = _terms.find( term );
+        if ( found == _terms.end() )
+            return {};
+        lists.push_back( _decode(found->second) );
+    }
+    if ( lists.empty() )
+        return {};
+
+    //intersect the shortest lists first, so the result shrinks fastest
+    std::sort( lists.begin(), lists.end(),
+        []( const std::vector<int>& a, const std::vector<int>& b ){ return a.size() < b.size(); } );
+    std::vector<int> result = std::move( lists.front() );
+    for ( std::size_t i = 1; i < lists.size() && !result.empty(); i++ ){
+        std::vector<int> both;
+        std::set_intersection( result.begin(), result.end(), lists[i].begin(), lists[i].end(),
+                               std::back_inserter(both) );
+        result.swap( both );
+    }
+    return result;
+}
+
+
+
+/**
+ * @param words     text holding the words to look for
+ *
+ * @return  ascending indices of the records whose description contains
+ *          at least one of the words
+ */
+std::vector<int> KeywordIndex::any_of( const std::string& words ) const {
+    std::vector<int> result;
+    for ( const std::string& term : tokenize(words.data(), words.size()) ){
+        auto found = _terms.find( term );
+        if ( found != _terms.end() )
+            result = unite( result, _decode(found->second) );
+    }
+    return result;
+}
+
+
+
+/**
+ * @param prefix    the start of a word
+ *
+ * @return  ascending indices of the records whose description contains
+ *          a word starting with prefix
+ */
+std::vector<int> KeywordIndex::with_prefix( const std::string& prefix ) const {
+    std::vector<std::string> terms = tokenize( prefix.data(), prefix.size() );
+    if ( terms.size() != 1 )
+        throw std::invalid_argument{"A prefix must be a single word."};
+
+    const std::string& start = terms.front();
+    std::vector<int> result;
+    for ( auto term = _terms.lower_bound(start);
+          term != _terms.end() && term->first.compare(0, start.size(), start) == 0; ++term )
+        result = unite( result, _decode(term->second) );
+    return result;
+}
+
+
+
+/**
+ * @return  true if the file was cleanly closed before it was opened
+ */
+bool KeywordIndex::is_clean( ) const {
+    return _clean_on_open;
+}
+
+
+
+/**
+ * @return  the number of distinct words indexed
+ */
+std::size_t KeywordIndex::term_count( ) const {
+    return _terms.size();
+}
+
+
+
+/**
+ * @return  the value last given to set_tag, as of the last flush
+ */
+std::uint64_t KeywordIndex::tag( ) const {
+    return _tag;
+}
+
+
+
+/**
+ * Stores an opaque value with the index, written out by the next flush.
+ *
+ * @param tag   the value to keep
+ */
+void KeywordIndex::set_tag( std::uint64_t tag ){
+    if ( tag != _tag ){
+        _touch();
+        _tag = tag;
+    }
+}
+
+
+
+/**
+ * @param postings  a word's records
+ *
+ * @return  their ascending indices, pending changes applied
+ */
+std::vector<int> KeywordIndex::_decode( const Postings& postings ){
+    std::vector<int> indices;
+    indices.reserve( postings.count );
+    std::int64_t index = -1;
+    std::uint32_t gap = 0;
+    int shift = 0;
+    for ( std::uint8_t byte : postings.coded ){
+        gap |= static_cast<std::uint32_t>( byte & 0x7F ) << shift;
+        shift += 7;
+        if ( byte & 0x80 )
+            continue;
+        index += gap;
+        indices.push_back( static_cast<int>(index) );
+        gap = 0;
+        shift = 0;
+    }
+
+    if ( !postings.removed.empty() ){
+        std::vector<int> kept;
+        kept.reserve( indices.size() );
+        std::set_difference( indices.begin(), indices.end(), postings.removed.begin(), postings.removed.end(),
+                             std::back_inserter(kept) );
+        indices.swap( kept );
+    }
+    if ( !postings.added.empty() )
+        indices = unite( indices, postings.added );
+    return indices;
+}
+
+
+
+/**
+ * Codes ascending indices as a word's list, with nothing pending.
+ *
+ * @param        indices    ascending indices
+ * @param[out]   postings   the word's records
+ */
+void KeywordIndex::_encode( const std::vector<int>& indices, Postings& postings ){
+    postings.coded.clear();
+    postings.added.clear();
+    postings.removed.clear();
+    std::int64_t previous = -1;
+    for ( int index : indices ){
+        put_varint( postings.coded, static_cast<std::uint32_t>(index - previous) );
+        previous = index;
+    }
+    postings.coded.shrink_to_fit();
+    postings.count = static_cast<std::uint32_t>( indices.size() );
+    postings.last = static_cast<std::int32_t>( previous );
+}
+
+
+
+/**
+ * @param term      a word
+ * @param index     a record now containing it
+ */
+void KeywordIndex::_add( const std::string& term, int index ){
+    _touch();
+    auto found = _terms.emplace( term, Postings{} ).first;
+    Postings& postings = found->second;
+    if ( postings.added.empty() && postings.removed.empty() && index > postings.last ){  //code it straight on
+        put_varint( postings.coded, static_cast<std::uint32_t>(index - postings.last) );
+        postings.count++;
+        postings.last = index;
+        return;
+    }
+
+    auto removed = std::lower_bound( postings.removed.begin(), postings.removed.end(), index );
+    if ( removed != postings.removed.end() && *removed == index )
+        postings.removed.erase( removed );
+    else
+        postings.added.insert( std::lower_bound(postings.added.begin(), postings.added.end(), index), index );
+    _merge( found );
+}
+
+
+
+/**
+ * @param term      a word
+ * @param index     a record that no longer contains it
+ */
+void KeywordIndex::_remove( const std::string& term, int index ){
+    auto found = _terms.find( term );
+    if ( found == _terms.end() )
+        return;
+    _touch();
+    Postings& postings = found->second;
+    auto added = std::lower_bound( postings.added.begin(), postings.added.end(), index );
+    if ( added != postings.added.end() && *added == index )
+        postings.added.erase( added );
+    else
+        postings.removed.insert( std::lower_bound(postings.removed.begin(), postings.removed.end(), index), index );
+    _merge( found );
+}
+
+
+
+/**
+ * Codes a word's pending changes into its list once there are enough
+ * of them, and forgets the word if no record contains it any more.
+ *
+ * @param term      the word
+ * @param all       true to code any pending change at all
+ */
+void KeywordIndex::_merge( std::map<std::string, Postings>::iterator term, bool all ){
+    Postings& postings = term->second;
+    std::size_t pending = postings.added.size() + postings.removed.size();
+    if ( pending > std::max<std::size_t>(merge_minimum, postings.count / 8) || ( all && pending > 0 ) ){
+        _encode( _decode(postings), postings );
+        pending = 0;
+    }
+    if ( pending == 0 && postings.count == 0 )
+        _terms.erase( term );
+}
+
+
+
+/**
+ * Reads the index file, if there is one.  A file that was not closed
+ * cleanly is still read; the owner decides whether to rebuild it.
+ */
+void KeywordIndex::_load( ){
+    std::ifstream in( _filename, std::ios::in | std::ios::binary );
+    if ( !in )
+        return;  //a new index is empty and clean
+    IndexHeader header;
+    in.read( reinterpret_cast<char*>(&header), sizeof(IndexHeader) );
+    if ( in.gcount() == 0 )
+        return;
+    if ( !in || std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 || header.version != index_version )
+        throw std::runtime_error{"Not an index file: " + _filename};
+
+    for ( std::uint64_t t = 0; t < header.term_count; t++ ){
+        std::uint16_t size = 0;
+        std::uint32_t bytes = 0;
+        Postings postings;
+        in.read( reinterpret_cast<char*>(&size), sizeof(size) );
+        std::string term( size, '\0' );
+        in.read( &term[0], size );
+        in.read( reinterpret_cast<char*>(&postings.count), sizeof(postings.count) );
+        in.read( reinterpret_cast<char*>(&postings.last), sizeof(postings.last) );
+        in.read( reinterpret_cast<char*>(&bytes), sizeof(bytes) );
+        if ( !in )
+            break;
+        postings.coded.resize( bytes );
+        in.read( reinterpret_cast<char*>(postings.coded.data()), bytes );
+        if ( !in )
+            break;
+        _terms.emplace_hint( _terms.end(), std::move(term), std::move(postings) );
+    }
+    _tag = header.tag;
+    _clean_on_open = header.clean == 1 && in.good();
+}
+
+
+
+/**
+ * Marks the file unclean before the first change since it was written,
+ * so a crash before the next flush is noticed on reopening.
+ */
+void KeywordIndex::_touch( ){
+    if ( _dirty )
+        return;
+    _dirty = true;
+    std::fstream file( _filename, std::ios::in | std::ios::out | std::ios::binary );
+    if ( !file )
+        return;  //nothing written yet, so nothing to mislead anyone
+    std::uint32_t clean = 0;
+    file.seekp( clean_offset, std::ios::beg );
+    file.write( reinterpret_cast<const char*>(&clean), sizeof(clean) );
+    file.flush();
+}
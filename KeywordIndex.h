@@ -0,0 +1,87 @@
+/**
+ * @file KeywordIndex.h
+ *
+ * Inverted index from description words to record indices.
+ *
+ * @remarks
+ *     Used by CampsiteDB for keyword search.  Each word keeps the
+ *     ascending indices of the records whose description contains it,
+ *     stored as varint-coded gaps.
+ */
+#ifndef KEYWORDINDEX_H
+#define KEYWORDINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Words are runs of ASCII letters and digits, compared without case.
+ * The whole index is held in memory and written to its file by
+ * flush(), as a new file renamed over the old one.
+ *
+ * Changes go into small sorted lists of added and removed indices
+ * beside each word's coded list, and are merged into it once there
+ * are enough of them, so a write costs a few list insertions rather
+ * than re-coding a long list.  Appending past the largest index is
+ * coded straight away.
+ *
+ * The file records whether it was closed cleanly, as BPlusTree does.
+ */
+class KeywordIndex {
+public:
+    explicit KeywordIndex( const std::string& filename );
+    ~KeywordIndex( );
+
+    // the distinct words of text, lower case, in order of first appearance
+    static std::vector<std::string> tokenize( const char* text, std::size_t length );
+
+    // before and after are descriptions, or nullptr for no record
+    void update( int index, const char* before, const char* after );
+    void clear( );
+    void flush( );
+
+    // ascending indices of records containing every word, any word, or a word with the prefix
+    std::vector<int> all_of( const std::string& words ) const;
+    std::vector<int> any_of( const std::string& words ) const;
+    std::vector<int> with_prefix( const std::string& prefix ) const;
+
+    bool          is_clean( ) const;
+    std::size_t   term_count( ) const;
+    std::uint64_t tag( ) const;
+    void          set_tag( std::uint64_t tag );
+
+    // This object is non-copyable
+    KeywordIndex(const KeywordIndex&)            = delete;
+    KeywordIndex& operator=(const KeywordIndex&) = delete;
+
+private:
+    /**
+     * The records containing one word.
+     */
+    struct Postings {
+        std::vector<std::uint8_t> coded;  /// ascending indices as varint gaps
+        std::uint32_t    count = 0;       /// indices in coded
+        std::int32_t     last  = -1;      /// largest index in coded
+        std::vector<int> added;           /// sorted; not in coded
+        std::vector<int> removed;         /// sorted; in coded
+    };
+
+    static std::vector<int> _decode( const Postings& postings );
+    static void _encode( const std::vector<int>& indices, Postings& postings );
+    void _add( const std::string& term, int index );
+    void _remove( const std::string& term, int index );
+    void _merge( std::map<std::string, Postings>::iterator term, bool all = false );
+    void _load( );
+    void _touch( );
+
+    std::string   _filename;
+    std::map<std::string, Postings> _terms;
+    std::uint64_t _tag = 0;             /// opaque value kept for the owner
+    bool          _clean_on_open = true;
+    bool          _dirty = false;       /// changed since the file was written
+};
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * @file MappedFile.cpp
+ *
+ * Implementation for the MappedFile class
+ */
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const std::size_t min_reservation = 1 << 20;  /// never reserve less than 1 MiB
+}
+
+
+/**
+ * Release the mapping and the descriptor.
+ */
+MappedFile::~MappedFile( ){
+    close();
+}
+
+
+
+/**
+ * Opens the given file read-only and maps its current contents.
+ *
+ * @param filename  name of the file to map
+ */
+void MappedFile::open( const std::string& filename ){
+    close();
+    _fd = ::open( filename.c_str(), O_RDONLY );
+    if ( _fd < 0 )
+        throw std::runtime_error{"Unable to open " + filename + " for mapping."};
+
+    struct stat info;
+    if ( fstat(_fd, &info) != 0 ){
+        close();
+        throw std::runtime_error{"Unable to stat " + filename + "."};
+    }
+    remap( static_cast<std::size_t>(info.st_size) );
+}
+
+
+
+/**
+ * Unmaps the file and closes the descriptor.
+ */
+void MappedFile::close( ){
+    _unmap();
+    if ( _fd >= 0 )
+        ::close( _fd );
+    _fd = -1;
+    _size = 0;
+}
+
+
+
+/**
+ * Tells the mapping that the file is now file_size bytes long.  The
+ * existing mapping is kept while the reservation is large enough;
+ * otherwise the file is mapped again with twice the needed room.
+ *
+ * @param file_size  current length of the file in bytes
+ */
+void MappedFile::remap( std::size_t file_size ){
+    if ( file_size > _capacity ){
+        std::size_t page = static_cast<std::size_t>( sysconf(_SC_PAGESIZE) );
+        std::size_t capacity = file_size * 2 < min_reservation ? min_reservation : file_size * 2;
+        capacity = ( capacity + page - 1 ) / page * page;
+
+        _unmap();
+        void* addr = mmap( nullptr, capacity, PROT_READ, MAP_SHARED, _fd, 0 );
+        if ( addr == MAP_FAILED )
+            throw std::runtime_error{"Unable to map the database file."};
+        madvise( addr, capacity, MADV_RANDOM );
+        _data = static_cast<char*>( addr );
+        _capacity = capacity;
+    }
+    _size = file_size;
+}
+
+
+
+/**
+ * @return true if a file is mapped, or false otherwise
+ */
+bool MappedFile::is_open( ) const {
+    return _fd >= 0;
+}
+
+
+
+/**
+ * @return start of the mapped file contents
+ */
+const char* MappedFile::data( ) const {
+    return _data;
+}
+
+
+
+/**
+ * @return number of bytes of the file that may be read through data()
+ */
+std::size_t MappedFile::size( ) const {
+    return _size;
+}
+
+
+
+/**
+ * Drops the current mapping, if any.
+ */
+void MappedFile::_unmap( ){
+    if ( _data != nullptr )
+        munmap( _data, _capacity );
+    _data = nullptr;
+    _capacity = 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file MappedFile.h
+ *
+ * Read-only shared memory mapping of a file that can grow.
+ *
+ * @remarks
+ *     Used by CampsiteDB to serve record reads straight out of
+ *     the operating system's page cache.
+ */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A read-only, shared mapping of a file.  The mapping reserves more
+ * address space than the file currently needs, so appends to the
+ * file only force a new mapping when the reservation is exhausted.
+ *
+ * Pointers obtained from data() are invalidated by any call to
+ * remap() that has to grow the reservation.
+ */
+class MappedFile {
+public:
+    MappedFile( ) = default;
+    ~MappedFile( );
+
+    void open( const std::string& filename );
+    void close( );
+    void remap( std::size_t file_size );
+
+    bool        is_open( ) const;
+    const char* data( ) const;
+    std::size_t size( ) const;
+
+    // This object is non-copyable
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+    void _unmap( );
+
+    int         _fd       = -1;       /// descriptor backing the mapping
+    char*       _data     = nullptr;  /// start of the mapping
+    std::size_t _capacity = 0;        /// bytes of address space reserved
+    std::size_t _size     = 0;        /// bytes of the file known to be valid
+};
+
+#endif
@@ -0,0 +1,309 @@
+/**
+ * @file OperationStats.cpp
+ *
+ * Histogram arithmetic, snapshots and JSON output for the operation
+ * counters.
+ */
+#include "OperationStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+
+namespace {
+
+const char* const operation_names[operation_count] = {
+    "get_record_count", "bounds_check", "get_current_index", "get_next_sequential",
+    "get_at_index", "get_random", "get_random_sample", "get_many", "get_range",
+    "get_by_number", "range_by_number", "range_by_rate", "top_k_by_rate", "search",
+    "for_each_block", "scan", "export_text", "move_to_index", "write_next_sequential",
+    "append", "bulk_load", "write_at_index", "write_batch", "swap_records",
+    "erase_at_index", "compact_step", "verify", "flush", "checkpoint"
+};
+
+std::atomic<std::uint64_t> next_recorder_id{1};
+
+/**
+ * The counter blocks this thread used last, so finding its own block
+ * rarely needs the recorder's lock.
+ */
+struct CachedCounters {
+    std::uint64_t                 recorder = 0;
+    stats_detail::ThreadCounters* counters = nullptr;
+};
+
+const int cached_recorders = 4;
+thread_local CachedCounters cache[cached_recorders];
+thread_local int cache_next = 0;
+
+}
+
+
+/**
+ * @param operation     a counted operation
+ *
+ * @return  its name, as the method is called
+ */
+const char* operation_name( Operation operation ){
+    return operation_names[static_cast<int>( operation )];
+}
+
+
+
+/**
+ * @param ns    a latency
+ *
+ * @return  the bucket it is counted in
+ */
+int LatencyHistogram::bucket( std::uint64_t ns ){
+    if ( ns < sub_buckets )
+        return static_cast<int>( ns );
+    int magnitude = 63 - __builtin_clzll( ns );
+    int index = ( magnitude - 2 ) * sub_buckets + static_cast<int>( ( ns >> (magnitude - 3) ) & (sub_buckets - 1) );
+    return std::min( index, bucket_count - 1 );
+}
+
+
+
+/**
+ * @param bucket    a bucket number
+ *
+ * @return  the largest latency counted in that bucket
+ */
+std::uint64_t LatencyHistogram::bucket_ceiling( int bucket ){
+    if ( bucket < sub_buckets )
+        return bucket;
+    int magnitude = bucket / sub_buckets + 2;
+    std::uint64_t width = std::uint64_t{1} << ( magnitude - 3 );
+    return ( sub_buckets + bucket % sub_buckets ) * width + width - 1;
+}
+
+
+
+/**
+ * @return  the mean latency in nanoseconds, or 0 if none was recorded
+ */
+double LatencyHistogram::mean( ) const {
+    return total == 0 ? 0 : static_cast<double>( sum_ns ) / total;
+}
+
+
+
+/**
+ * @param fraction  0.5 for the median, 0.99 for the 99th percentile...
+ *
+ * @return  a latency at least as large as that fraction of the recorded
+ *          ones, accurate to the width of its bucket
+ */
+std::uint64_t LatencyHistogram::percentile( double fraction ) const {
+    if ( total == 0 )
+        return 0;
+    std::uint64_t wanted = std::max<std::uint64_t>( 1, static_cast<std::uint64_t>(std::ceil(fraction * total)) );
+    std::uint64_t seen = 0;
+    for ( int b = 0; b < bucket_count; b++ ){
+        seen += counts[b];
+        if ( seen >= wanted )
+            return std::min( bucket_ceiling(b), max_ns );
+    }
+    return max_ns;
+}
+
+
+
+/**
+ * @param operation     a counted operation
+ *
+ * @return  its counters
+ */
+const OperationCounters& CampsiteDBStats::operator[]( Operation operation ) const {
+    return operations[static_cast<int>( operation )];
+}
+
+
+
+/**
+ * @return  the snapshot as one line of JSON; operations never called
+ *          are left out
+ */
+std::string CampsiteDBStats::to_json( ) const {
+    std::ostringstream out;
+    out << "{\"enabled\": " << ( enabled ? "true" : "false" ) << ", \"operations\": {";
+    bool first = true;
+    for ( int i = 0; i < operation_count; i++ ){
+        const OperationCounters& c = operations[i];
+        if ( c.calls == 0 )
+            continue;
+        out << ( first ? "" : ", " ) << '"' << operation_name( static_cast<Operation>(i) ) << "\": {"
+            << "\"calls\": " << c.calls << ", \"seeks\": " << c.seeks
+            << ", \"reads\": " << c.reads << ", \"read_bytes\": " << c.read_bytes
+            << ", \"writes\": " << c.writes << ", \"write_bytes\": " << c.write_bytes
+            << ", \"syncs\": " << c.syncs
+            << ", \"latency_ns\": {\"mean\": " << static_cast<std::uint64_t>( c.latency.mean() )
+            << ", \"p50\": " << c.latency.percentile( 0.5 )
+            << ", \"p90\": " << c.latency.percentile( 0.9 )
+            << ", \"p99\": " << c.latency.percentile( 0.99 )
+            << ", \"p999\": " << c.latency.percentile( 0.999 )
+            << ", \"max\": " << c.latency.max_ns << "}}";
+        first = false;
+    }
+    out << "}}";
+    return out.str();
+}
+
+
+
+/**
+ * @param enabled   false to count nothing until set_enabled(true)
+ */
+StatsRecorder::StatsRecorder( bool enabled )
+: _enabled{enabled}, _id{next_recorder_id++} {
+}
+
+
+
+/**
+ * Stops the periodic dump, writing one last snapshot.
+ */
+StatsRecorder::~StatsRecorder( ){
+    stop_dump();
+}
+
+
+
+/**
+ * @return  true if operations are being counted
+ */
+bool StatsRecorder::enabled( ) const {
+    return _enabled.load( std::memory_order_relaxed );
+}
+
+
+
+/**
+ * Starts or stops counting.  Counts gathered so far are kept.
+ *
+ * @param enabled   true to count operations from now on
+ */
+void StatsRecorder::set_enabled( bool enabled ){
+    _enabled.store( enabled, std::memory_order_relaxed );
+}
+
+
+
+/**
+ * Sums every thread's counters.  Operations still running on other
+ * threads may be partly counted.
+ *
+ * @return  the counters as they are now
+ */
+CampsiteDBStats StatsRecorder::snapshot( ) const {
+    CampsiteDBStats stats;
+    stats.enabled = enabled();
+    std::lock_guard<std::mutex> guard( _threads_mutex );
+    for ( const auto& thread : _threads ){
+        for ( int i = 0; i < operation_count; i++ ){
+            const stats_detail::LiveCounters& live = ( *thread.second )[i];
+            OperationCounters& c = stats.operations[i];
+            c.calls       += live.calls.load( std::memory_order_relaxed );
+            c.seeks       += live.seeks.load( std::memory_order_relaxed );
+            c.reads       += live.reads.load( std::memory_order_relaxed );
+            c.read_bytes  += live.read_bytes.load( std::memory_order_relaxed );
+            c.writes      += live.writes.load( std::memory_order_relaxed );
+            c.write_bytes += live.write_bytes.load( std::memory_order_relaxed );
+            c.syncs       += live.syncs.load( std::memory_order_relaxed );
+            c.latency.sum_ns += live.sum_ns.load( std::memory_order_relaxed );
+            c.latency.max_ns = std::max( c.latency.max_ns, live.max_ns.load(std::memory_order_relaxed) );
+            for ( int b = 0; b < LatencyHistogram::bucket_count; b++ ){
+                std::uint64_t n = live.buckets[b].load( std::memory_order_relaxed );
+                c.latency.counts[b] += n;
+                c.latency.total += n;
+            }
+        }
+    }
+    return stats;
+}
+
+
+
+/**
+ * Appends a snapshot, as one line of JSON with the time it was taken,
+ * to a file every interval until stop_dump() or destruction.  A dump
+ * already running is replaced.
+ *
+ * @param filename  file the lines are appended to
+ * @param interval  time between snapshots
+ */
+void StatsRecorder::start_dump( const std::string& filename, std::chrono::milliseconds interval ){
+    stop_dump();
+    _dump_file = filename;
+    _dump_interval = interval;
+    _dump_stop = false;
+    _dumper = std::thread{ [this]( ){
+        std::unique_lock<std::mutex> lock( _dump_mutex );
+        while ( !_dump_stop ){
+            _dump_wake.wait_for( lock, _dump_interval, [this]( ){ return _dump_stop; } );
+            lock.unlock();
+            _dump();
+            lock.lock();
+        }
+    } };
+}
+
+
+
+/**
+ * Stops the periodic dump, if one is running, after a last snapshot.
+ */
+void StatsRecorder::stop_dump( ){
+    if ( !_dumper.joinable() )
+        return;
+    {
+        std::lock_guard<std::mutex> guard( _dump_mutex );
+        _dump_stop = true;
+    }
+    _dump_wake.notify_all();
+    _dumper.join();
+}
+
+
+
+/**
+ * Finds (creating on first use) the calling thread's counters for an
+ * operation.
+ *
+ * @param operation     a counted operation
+ *
+ * @return  counters only the calling thread writes
+ */
+stats_detail::LiveCounters& StatsRecorder::counters( Operation operation ){
+    for ( CachedCounters& cached : cache )
+        if ( cached.recorder == _id )
+            return ( *cached.counters )[static_cast<int>( operation )];
+
+    stats_detail::ThreadCounters* counters;
+    {
+        std::lock_guard<std::mutex> guard( _threads_mutex );
+        std::unique_ptr<stats_detail::ThreadCounters>& slot = _threads[std::this_thread::get_id()];
+        if ( !slot )
+            slot.reset( new stats_detail::ThreadCounters() );
+        counters = slot.get();
+    }
+    cache[cache_next] = CachedCounters{ _id, counters };
+    cache_next = ( cache_next + 1 ) % cached_recorders;
+    return ( *counters )[static_cast<int>( operation )];
+}
+
+
+
+/**
+ * Appends one snapshot line to the dump file.  Failures are ignored;
+ * there is no caller to report them to.
+ */
+void StatsRecorder::_dump( ){
+    std::ofstream out{ _dump_file, std::ios::app };
+    std::int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch() ).count();
+    out << "{\"time_ms\": " << now << ", \"stats\": " << snapshot().to_json() << "}\n";
+}
@@ -0,0 +1,268 @@
+/**
+ * @file OperationStats.h
+ *
+ * Per-operation call, I/O and latency counters for CampsiteDB.
+ *
+ * @remarks
+ *     Every thread counts into a block of its own, so recording costs
+ *     a few uncontended relaxed stores; the blocks are summed only when
+ *     a snapshot is taken.  I/O is charged to the outermost operation
+ *     running on the thread.  Building with CAMPSITE_NO_STATS defined
+ *     compiles the timers and the I/O hooks away entirely.
+ */
+#ifndef OPERATIONSTATS_H
+#define OPERATIONSTATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The public CampsiteDB operations that are counted.
+ */
+enum class Operation {
+    get_record_count,
+    bounds_check,
+    get_current_index,
+    get_next_sequential,
+    get_at_index,
+    get_random,
+    get_random_sample,
+    get_many,
+    get_range,
+    get_by_number,
+    range_by_number,
+    range_by_rate,
+    top_k_by_rate,
+    search,
+    for_each_block,
+    scan,
+    export_text,
+    move_to_index,
+    write_next_sequential,
+    append,
+    bulk_load,
+    write_at_index,
+    write_batch,
+    swap_records,
+    erase_at_index,
+    compact_step,
+    verify,
+    flush,
+    checkpoint
+};
+
+const int operation_count = static_cast<int>( Operation::checkpoint ) + 1;
+
+const char* operation_name( Operation operation );
+
+/**
+ * Latencies in log-linear buckets, as HDR histograms keep them: values
+ * below 8 ns are exact, and every doubling above is split into 8
+ * buckets, so a bucket is never wider than 1/8 of its values.
+ */
+struct LatencyHistogram {
+    static const int sub_buckets  = 8;
+    static const int bucket_count = 43 * sub_buckets;  /// up to 2^45 ns, about 9.8 hours
+
+    std::array<std::uint64_t, bucket_count> counts{};
+    std::uint64_t total  = 0;  /// latencies recorded
+    std::uint64_t sum_ns = 0;
+    std::uint64_t max_ns = 0;
+
+    static int           bucket( std::uint64_t ns );
+    static std::uint64_t bucket_ceiling( int bucket );
+
+    double        mean( ) const;
+    std::uint64_t percentile( double fraction ) const;
+};
+
+/**
+ * What one operation cost, summed over every thread.  Reads and writes
+ * are the calls issued to the file (memory mapped access issues none).
+ */
+struct OperationCounters {
+    std::uint64_t calls       = 0;
+    std::uint64_t seeks       = 0;  /// stream seeks and position queries
+    std::uint64_t reads       = 0;
+    std::uint64_t read_bytes  = 0;
+    std::uint64_t writes      = 0;
+    std::uint64_t write_bytes = 0;
+    std::uint64_t syncs       = 0;  /// fsync and fdatasync calls
+    LatencyHistogram latency;
+};
+
+/**
+ * A snapshot of every operation's counters.
+ */
+struct CampsiteDBStats {
+    bool enabled = false;  /// false if nothing was being counted
+    std::array<OperationCounters, operation_count> operations;
+
+    const OperationCounters& operator[]( Operation operation ) const;
+    std::string to_json( ) const;
+};
+
+
+namespace stats_detail {
+
+/**
+ * The live counters one thread keeps for one operation.  Only their
+ * thread writes them; snapshots read them concurrently.
+ */
+struct LiveCounters {
+    std::atomic<std::uint64_t> calls{0}, seeks{0}, reads{0}, read_bytes{0},
+                               writes{0}, write_bytes{0}, syncs{0}, sum_ns{0}, max_ns{0};
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::bucket_count> buckets{};
+};
+
+using ThreadCounters = std::array<LiveCounters, operation_count>;
+
+/**
+ * Adds to a counter only its own thread writes, without a locked
+ * read-modify-write.
+ */
+inline void bump( std::atomic<std::uint64_t>& counter, std::uint64_t amount ){
+    counter.store( counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed );
+}
+
+inline thread_local LiveCounters* active = nullptr;  /// the outermost operation on this thread
+
+}
+
+
+/**
+ * Counts I/O against the operation running on this thread, if it is
+ * being counted.
+ */
+inline void stats_seek( ){
+#ifndef CAMPSITE_NO_STATS
+    if ( stats_detail::active )
+        stats_detail::bump( stats_detail::active->seeks, 1 );
+#endif
+}
+
+inline void stats_read( std::size_t bytes ){
+#ifndef CAMPSITE_NO_STATS
+    if ( stats_detail::active ){
+        stats_detail::bump( stats_detail::active->reads, 1 );
+        stats_detail::bump( stats_detail::active->read_bytes, bytes );
+    }
+#else
+    (void)bytes;
+#endif
+}
+
+inline void stats_write( std::size_t bytes ){
+#ifndef CAMPSITE_NO_STATS
+    if ( stats_detail::active ){
+        stats_detail::bump( stats_detail::active->writes, 1 );
+        stats_detail::bump( stats_detail::active->write_bytes, bytes );
+    }
+#else
+    (void)bytes;
+#endif
+}
+
+inline void stats_sync( ){
+#ifndef CAMPSITE_NO_STATS
+    if ( stats_detail::active )
+        stats_detail::bump( stats_detail::active->syncs, 1 );
+#endif
+}
+
+
+/**
+ * Owns the per-thread counters of one database, takes snapshots of
+ * them, and can append a JSON snapshot to a file periodically.
+ */
+class StatsRecorder {
+public:
+    explicit StatsRecorder( bool enabled = false );
+    ~StatsRecorder( );
+
+    bool            enabled( ) const;
+    void            set_enabled( bool enabled );
+    CampsiteDBStats snapshot( ) const;
+    // appends one JSON line to filename every interval, and once more when stopped
+    void            start_dump( const std::string& filename, std::chrono::milliseconds interval );
+    void            stop_dump( );
+
+    stats_detail::LiveCounters& counters( Operation operation );
+
+    // This object is non-copyable
+    StatsRecorder(const StatsRecorder&)            = delete;
+    StatsRecorder& operator=(const StatsRecorder&) = delete;
+
+private:
+    void _dump( );
+
+    std::atomic<bool> _enabled;
+    std::uint64_t     _id;  /// tells this recorder apart in the threads' caches
+    mutable std::mutex _threads_mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<stats_detail::ThreadCounters>> _threads;
+
+    std::string             _dump_file;
+    std::chrono::milliseconds _dump_interval{0};
+    std::thread             _dumper;
+    std::mutex              _dump_mutex;
+    std::condition_variable _dump_wake;
+    bool                    _dump_stop = false;
+};
+
+
+/**
+ * Times one public operation and counts it, along with the I/O it
+ * causes, unless an outer operation on the same thread already is.
+ */
+class OperationTimer {
+public:
+    OperationTimer( StatsRecorder& stats, Operation operation ){
+#ifndef CAMPSITE_NO_STATS
+        if ( !stats.enabled() || stats_detail::active )
+            return;
+        _counters = &stats.counters( operation );
+        stats_detail::active = _counters;
+        _start = std::chrono::steady_clock::now();
+#else
+        (void)stats;
+        (void)operation;
+#endif
+    }
+
+    ~OperationTimer( ){
+#ifndef CAMPSITE_NO_STATS
+        if ( !_counters )
+            return;
+        std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - _start ).count();
+        stats_detail::bump( _counters->calls, 1 );
+        stats_detail::bump( _counters->sum_ns, ns );
+        stats_detail::bump( _counters->buckets[LatencyHistogram::bucket(ns)], 1 );
+        if ( ns > _counters->max_ns.load(std::memory_order_relaxed) )
+            _counters->max_ns.store( ns, std::memory_order_relaxed );
+        stats_detail::active = nullptr;
+#endif
+    }
+
+    // This object is non-copyable
+    OperationTimer(const OperationTimer&)            = delete;
+    OperationTimer& operator=(const OperationTimer&) = delete;
+
+private:
+#ifndef CAMPSITE_NO_STATS
+    stats_detail::LiveCounters*           _counters = nullptr;
+    std::chrono::steady_clock::time_point _start;
+#endif
+};
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file PackedCampsiteRecord.cpp
+ *
+ * Conversions between CampsiteRecord and PackedCampsiteRecord
+ */
+#include "PackedCampsiteRecord.h"
+#include "Tombstone.h"
+
+
+/**
+ * Packs a record, appending its description to the heap.  When the
+ * record replaces a live one whose description had at least as much
+ * room, the description is written over the old one instead, and the
+ * record keeps the whole room (desc_length), so later overwrites fit
+ * too; the unused tail is zeros.  A tombstone keeps its links in place
+ * of a description.
+ *
+ * @param site        record to pack
+ * @param heap        heap that receives the description
+ * @param replacing   the stored record being overwritten, or nullptr
+ *
+ * @return  the packed record
+ */
+PackedCampsiteRecord pack( const CampsiteRecord& site, DescriptionHeap& heap,
+                           const PackedCampsiteRecord* replacing ){
+    PackedCampsiteRecord packed;
+    if ( is_tombstone(site) ){
+        TombstoneLinks links = tombstone_links( site );
+        packed.number      = site.number;
+        std::memcpy( &packed.rate, &links.prev, sizeof(packed.rate) );
+        packed.desc_offset = static_cast<std::uint64_t>( links.next );
+        packed.desc_length = 0;
+        packed.flags       = PackedCampsiteRecord::tombstone_flag;
+        return packed;
+    }
+    std::size_t length = strnlen( site.description, CampsiteRecord::desc_size - 1 );
+    packed.number      = site.number;
+    packed.rate        = site.rate;
+    if ( replacing && !( replacing->flags & PackedCampsiteRecord::tombstone_flag )
+         && length <= replacing->desc_length && replacing->desc_offset + replacing->desc_length <= heap.size() ){
+        heap.overwrite( replacing->desc_offset, replacing->desc_length, site.description, length );
+        packed.desc_offset = replacing->desc_offset;
+        packed.desc_length = replacing->desc_length;
+    }
+    else{
+        packed.desc_offset = heap.append( site.description, length );
+        packed.desc_length = static_cast<std::uint8_t>( length );
+    }
+    packed.flags       = site.has_electric ? PackedCampsiteRecord::electric_flag : 0;
+    return packed;
+}
+
+
+
+/**
+ * Rebuilds a full record from its packed form.
+ *
+ * @param packed  record to unpack
+ * @param heap    heap holding the description
+ *
+ * @return  the record, zero padded like one built by its constructor
+ */
+CampsiteRecord unpack( const PackedCampsiteRecord& packed, DescriptionHeap& heap ){
+    if ( packed.flags & PackedCampsiteRecord::tombstone_flag ){
+        std::int64_t prev;
+        std::memcpy( &prev, &packed.rate, sizeof(prev) );
+        return make_tombstone( static_cast<std::int64_t>(packed.desc_offset), prev );
+    }
+    CampsiteRecord site;
+    site.number       = packed.number;
+    site.rate         = packed.rate;
+    site.has_electric = ( packed.flags & PackedCampsiteRecord::electric_flag ) != 0;
+    heap.read( packed.desc_offset, packed.desc_length, site.description );
+    return site;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file PackedCampsiteRecord.h
+ *
+ * Dense on-disk form of a CampsiteRecord.
+ */
+#ifndef PACKEDCAMPSITERECORD_H
+#define PACKEDCAMPSITERECORD_H
+
+#include <cstdint>
+
+#include "CampsiteRecord.h"
+#include "DescriptionHeap.h"
+
+/**
+ * The fixed fields of a CampsiteRecord with no padding, plus a
+ * reference to the description in a DescriptionHeap.  22 bytes,
+ * against 144 for the raw record.
+ */
+#pragma pack(push, 1)
+struct PackedCampsiteRecord {
+    static const std::uint8_t electric_flag  = 0x01;
+    static const std::uint8_t tombstone_flag = 0x80;  /// deleted; desc_offset and rate hold the links
+    static constexpr std::uint32_t record_type = 2;   /// tag in the header of packed files
+
+    std::int32_t  number;       /// site number
+    double        rate;         /// per-night rate
+    std::uint64_t desc_offset;  /// where the description starts in the heap
+    std::uint8_t  desc_length;  /// description length, without terminator
+    std::uint8_t  flags;        /// electric_flag if power is available, or tombstone_flag
+};
+#pragma pack(pop)
+
+// replacing, if given, is the live record being overwritten, whose room
+// in the heap is reused when the new description fits
+PackedCampsiteRecord pack( const CampsiteRecord& site, DescriptionHeap& heap,
+                           const PackedCampsiteRecord* replacing = nullptr );
+CampsiteRecord       unpack( const PackedCampsiteRecord& packed, DescriptionHeap& heap );
+
+#endif
@@ -0,0 +1,230 @@
+/**
+ * @file PageCache.cpp
+ *
+ * Implementation for the PageCache class
+ */
+#include "PageCache.h"
+#include "OperationStats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+/**
+ * Construct a cache over an existing file of fixed-size records.
+ *
+ * @param filename          file holding the records
+ * @param base_offset       file position of the first record
+ * @param record_size       size of one record in bytes
+ * @param records_per_page  number of records loaded and written together
+ * @param max_pages         most pages held in memory at once
+ */
+PageCache::PageCache( const std::string& filename, std::streamoff base_offset, std::size_t record_size,
+                      std::size_t records_per_page, std::size_t max_pages )
+: _base_offset{base_offset},
+  _record_size{record_size},
+  _records_per_page{records_per_page > 0 ? records_per_page : 1},
+  _max_pages{max_pages > 0 ? max_pages : 1} {
+    _file.open( filename, std::ios::out | std::ios::in | std::ios::binary );
+    if ( !_file.good() )
+        throw std::runtime_error{"Unable to open " + filename + " for caching."};
+}
+
+
+
+/**
+ * Writes back any dirty pages before the cache goes away.
+ */
+PageCache::~PageCache( ){
+    try {
+        flush();
+    } catch ( ... ) {
+        // nothing sensible to do from a destructor
+    }
+}
+
+
+
+/**
+ * Copies the record at the given index out of the cache.
+ *
+ * @param        index   index of the record to read
+ * @param[out]   out     buffer of at least one record to copy into
+ */
+void PageCache::read( int index, char* out ){
+    Page& page = _fetch( index / _records_per_page, 1 );
+    std::size_t slot = index % _records_per_page;
+    std::memcpy( out, page.data.data() + slot * _record_size, _record_size );
+}
+
+
+
+/**
+ * Copies count consecutive records out of the cache, one page-sized
+ * piece at a time.
+ *
+ * @param        first_index    index of the first record to read
+ * @param        count          number of records to read
+ * @param[out]   out            buffer of at least count records
+ */
+void PageCache::read( int first_index, int count, char* out ){
+    while ( count > 0 ){
+        int slot = first_index % _records_per_page;
+        int n = static_cast<int>( _records_per_page ) - slot;
+        if ( n > count )
+            n = count;
+        Page& page = _fetch( first_index / _records_per_page, n );
+        std::memcpy( out, page.data.data() + slot * _record_size, n * _record_size );
+        out += n * _record_size;
+        first_index += n;
+        count -= n;
+    }
+}
+
+
+
+/**
+ * Replaces the record at the given index in the cache; the file is
+ * updated when the page is written back.
+ *
+ * @param        index   index of the record to write
+ * @param        in      one record to copy into the cache
+ */
+void PageCache::write( int index, const char* in ){
+    Page& page = _fetch( index / _records_per_page, 1 );
+    std::size_t slot = index % _records_per_page;
+    std::memcpy( page.data.data() + slot * _record_size, in, _record_size );
+    page.dirty = true;
+    if ( slot + 1 > page.used )
+        page.used = slot + 1;
+}
+
+
+
+/**
+ * Writes every dirty page back to the file.
+ */
+void PageCache::flush( ){
+    for ( auto& entry : _pages )
+        _write_back( entry.first, entry.second );
+    _file.flush();
+}
+
+
+
+/**
+ * Forgets every record from count on, after the owner has cut them off
+ * the end of the file, so that writing a page back cannot bring them
+ * back.  Pages wholly past the end are dropped without being written.
+ *
+ * @param        count      number of records the file still holds
+ */
+void PageCache::truncate( int count ){
+    for ( auto it = _pages.begin(); it != _pages.end(); ){
+        std::size_t first = it->first * _records_per_page;
+        if ( first >= static_cast<std::size_t>(count) ){
+            _lru.erase( it->second.lru );
+            it = _pages.erase( it );
+            continue;
+        }
+        it->second.used = std::min( it->second.used, count - first );
+        ++it;
+    }
+}
+
+
+
+/**
+ * @return  a copy of the hit, miss and eviction counters
+ */
+PageCacheStats PageCache::stats( ) const {
+    return _stats;
+}
+
+
+
+/**
+ * Zeroes the hit, miss and eviction counters.
+ */
+void PageCache::reset_stats( ){
+    _stats = PageCacheStats{};
+}
+
+
+
+/**
+ * Finds a page in the cache, loading it from the file (and evicting
+ * the least recently used page) if it is not there.  The records the
+ * caller is after count as hits or misses, so the counters compare
+ * with per-record reads whatever the page size.
+ *
+ * @param        page_number    which page is needed
+ * @param        records        records of the page being accessed
+ *
+ * @return  the cached page, marked most recently used
+ */
+PageCache::Page& PageCache::_fetch( int page_number, std::size_t records ){
+    auto found = _pages.find( page_number );
+    if ( found != _pages.end() ){
+        _stats.hits += records;
+        _lru.splice( _lru.begin(), _lru, found->second.lru );
+        return found->second;
+    }
+
+    _stats.misses += records;
+    if ( _pages.size() >= _max_pages )
+        _evict();
+
+    std::size_t page_bytes = _record_size * _records_per_page;
+    Page page{ std::vector<char>(page_bytes, 0), 0, false, _lru.end() };
+    _file.clear();
+    _file.seekg( _base_offset + static_cast<std::streamoff>(page_number) * page_bytes, std::ios::beg );
+    _file.read( page.data.data(), page_bytes );
+    page.used = _file.gcount() / _record_size;
+    stats_seek();
+    stats_read( page_bytes );
+    _file.clear();
+
+    _lru.push_front( page_number );
+    page.lru = _lru.begin();
+    return _pages.emplace( page_number, std::move(page) ).first->second;
+}
+
+
+
+/**
+ * Writes a page's records to the file if the page is dirty.
+ *
+ * @param        page_number    which page this is
+ * @param        page           the cached page
+ */
+void PageCache::_write_back( int page_number, Page& page ){
+    if ( !page.dirty )
+        return;
+
+    std::size_t page_bytes = _record_size * _records_per_page;
+    _file.clear();
+    _file.seekp( _base_offset + static_cast<std::streamoff>(page_number) * page_bytes, std::ios::beg );
+    _file.write( page.data.data(), page.used * _record_size );
+    stats_seek();
+    stats_write( page.used * _record_size );
+    if ( !_file.good() )
+        throw std::runtime_error{"Unable to write a cached page back to the file."};
+    page.dirty = false;
+    ++_stats.write_backs;
+}
+
+
+
+/**
+ * Drops the least recently used page, writing it back first if dirty.
+ */
+void PageCache::_evict( ){
+    int victim = _lru.back();
+    auto found = _pages.find( victim );
+    _write_back( victim, found->second );
+    _lru.pop_back();
+    _pages.erase( found );
+    ++_stats.evictions;
+}
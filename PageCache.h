@@ -0,0 +1,80 @@
+/**
+ * @file PageCache.h
+ *
+ * Block-level LRU cache of fixed-size records in a file.
+ *
+ * @remarks
+ *     Used by CampsiteDB so that hot records are served from memory
+ *     instead of going back through the file stream every time.
+ */
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <cstddef>
+#include <fstream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Counters describing how well a PageCache is doing.
+ */
+struct PageCacheStats {
+    std::size_t hits        = 0;  /// records read or written from a cached page
+    std::size_t misses      = 0;  /// records read or written by loading their page
+    std::size_t evictions   = 0;  /// pages dropped to make room
+    std::size_t write_backs = 0;  /// dirty pages written to the file
+};
+
+/**
+ * Caches whole pages of records (records_per_page records each) and
+ * evicts the least recently used page when full.  Writes only dirty
+ * the cached page; dirty pages are written back when evicted, when
+ * flush() is called, and when the cache is destroyed.
+ *
+ * The cache has its own handle on the file, so it never disturbs the
+ * read and write markers of the owner's stream.
+ */
+class PageCache {
+public:
+    PageCache( const std::string& filename, std::streamoff base_offset, std::size_t record_size,
+               std::size_t records_per_page, std::size_t max_pages );
+    ~PageCache( );
+
+    void read( int index, char* out );
+    void read( int first_index, int count, char* out );
+    void write( int index, const char* in );
+    void flush( );
+    void truncate( int count );
+
+    PageCacheStats stats( ) const;
+    void           reset_stats( );
+
+    // This object is non-copyable
+    PageCache(const PageCache&)            = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+private:
+    struct Page {
+        std::vector<char>        data;   /// the records themselves
+        std::size_t              used;   /// records in data that exist in the file
+        bool                     dirty;  /// data differs from the file
+        std::list<int>::iterator lru;    /// position in the recency list
+    };
+
+    Page& _fetch( int page_number, std::size_t records );
+    void  _write_back( int page_number, Page& page );
+    void  _evict( );
+
+    std::fstream                  _file;
+    std::streamoff                _base_offset;  /// file position of record 0
+    std::size_t                   _record_size;
+    std::size_t                   _records_per_page;
+    std::size_t                   _max_pages;
+    std::unordered_map<int, Page> _pages;
+    std::list<int>                _lru;  /// page numbers, most recently used first
+    PageCacheStats                _stats;
+};
+
+#endif
@@ -0,0 +1,364 @@
+/**
+ * @file RecordFile.h
+ *
+ * A random-access file of fixed-size records of any plain type.
+ *
+ * @remarks
+ *     Templates, so defined here: the record size and alignment are
+ *     compile-time constants of each instantiation, so offsets and
+ *     buffer sizes are computed with constants instead of a stored
+ *     record size.  Links against CampsiteFileHeader and OperationStats.
+ */
+#ifndef RECORDFILE_H
+#define RECORDFILE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ios>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CampsiteFileHeader.h"
+#include "OperationStats.h"
+
+/**
+ * The records of type T stored back to back from a base offset in an
+ * open file, read and written with positional I/O, so any number of
+ * threads may use them at once.  Does not own the descriptor, and
+ * knows nothing of the record count; see RecordFile for that.
+ */
+template <typename T>
+class RecordSlots {
+    static_assert( std::is_trivially_copyable<T>::value, "Records are copied to and from the file as bytes" );
+    static_assert( std::is_standard_layout<T>::value, "Records must have the same layout in every build" );
+
+public:
+    static constexpr std::size_t record_size      = sizeof(T);
+    static constexpr std::size_t record_alignment = alignof(T);
+
+    RecordSlots( ) = default;
+
+    /**
+     * @param fd    an open descriptor, left open when done with
+     * @param base  file position of record 0
+     */
+    RecordSlots( int fd, std::streamoff base )
+    : _fd{fd}, _base{base} {
+    }
+
+    /**
+     * @return  true if the slots are over an open file
+     */
+    bool is_open( ) const {
+        return _fd >= 0;
+    }
+
+    /**
+     * @param        index      logical record index
+     *
+     * @return  file position where the record at index starts
+     */
+    std::streamoff offset( int index ) const {
+        return _base + static_cast<std::streamoff>( index ) * record_size;
+    }
+
+    /**
+     * Copies count consecutive records into out with a single read.
+     *
+     * @param        first_index    index of the first record, already bounds checked
+     * @param        count          number of records to copy
+     * @param[out]   out            buffer of at least count records
+     */
+    void read( int first_index, int count, T* out ) const {
+        char* bytes = reinterpret_cast<char*>( out );
+        std::size_t size = count * record_size, done = 0;
+        while ( done < size ){
+            ssize_t got = pread( _fd, bytes + done, size - done, offset(first_index) + done );
+            if ( got <= 0 )
+                throw std::runtime_error{"Unable to read records from the database."};
+            stats_read( got );
+            done += got;
+        }
+    }
+
+    /**
+     * Writes count consecutive records with a single write.
+     *
+     * @param        first_index    index of the first record
+     * @param        count          number of records to write
+     * @param        in             count records
+     */
+    void write( int first_index, int count, const T* in ) const {
+        const char* bytes = reinterpret_cast<const char*>( in );
+        std::size_t size = count * record_size, done = 0;
+        while ( done < size ){
+            ssize_t put = pwrite( _fd, bytes + done, size - done, offset(first_index) + done );
+            if ( put <= 0 )
+                throw std::runtime_error{"Unable to write records to the database."};
+            stats_write( put );
+            done += put;
+        }
+    }
+
+private:
+    int            _fd   = -1;
+    std::streamoff _base = 0;
+};
+
+
+
+/**
+ * A file of records of type T behind a CampsiteFileHeader, addressed
+ * by index, with the bounds checks, range reads, block scans, appends
+ * and swaps of CampsiteDB for any plain record type.  A RecordFile of
+ * CampsiteRecord reads and writes the raw CampsiteDB format (deleted
+ * records show up as their tombstones); other types are told apart by
+ * T::record_type, a tag stored in the header, and by the record size.
+ *
+ * Reads may run on many threads at once, alongside each other and
+ * appends; writes and swaps need the caller's own locking.
+ */
+template <typename T>
+class RecordFile {
+public:
+    // receives consecutive records [first_index, first_index + count)
+    using BlockVisitor = std::function<void( int first_index, const T* records, int count )>;
+
+    static constexpr std::size_t    record_size      = RecordSlots<T>::record_size;
+    static constexpr std::size_t    record_alignment = RecordSlots<T>::record_alignment;
+    static constexpr std::streamoff data_offset      = sizeof(CampsiteFileHeader);
+    static constexpr std::size_t    block_bytes      = 1 << 20;  /// bytes per bulk read
+    static constexpr int default_chunk_records = static_cast<int>( std::max<std::size_t>(1, block_bytes / record_size) );
+
+    static_assert( data_offset % record_alignment == 0, "Records in a mapping of the file must be aligned" );
+
+    /**
+     * Opens a record file, creating it if it does not exist.
+     *
+     * @param filename  file's name
+     */
+    explicit RecordFile( const std::string& filename ){
+        _fd = ::open( filename.c_str(), O_RDWR | O_CREAT, 0644 );
+        if ( _fd < 0 )
+            throw std::runtime_error{"Unable to open " + filename + "."};
+        try {
+            _load_header();
+        } catch ( ... ) {
+            ::close( _fd );
+            throw;
+        }
+        _slots = RecordSlots<T>{ _fd, data_offset };
+    }
+
+    /**
+     * Stores the header before closing.
+     */
+    ~RecordFile( ){
+        try {
+            flush();
+        } catch ( ... ) {
+            // nothing sensible to do from a destructor
+        }
+        ::close( _fd );
+    }
+
+    /**
+     * @return  true if opening found records past the stored count,
+     *          appended before a crash kept the header from being stored
+     */
+    bool recovered( ) const {
+        return _recovered;
+    }
+
+    /**
+     * @return  the number of records in the file
+     */
+    int get_record_count( ) const {
+        return _count.load( std::memory_order_acquire );
+    }
+
+    /**
+     * @param   index  a record index
+     * @param   write  true if index may also be one past the last record
+     *
+     * @return  true if index can be read (or written)
+     */
+    bool bounds_check( int index, bool write = false ) const {
+        return index >= 0 && ( index < get_record_count() || ( write && index == get_record_count() ) );
+    }
+
+    /**
+     * @param   index  a index of a value to be read
+     *
+     * @return  a copy of the record at the given index
+     */
+    T get_at_index( int index ) const {
+        if ( !bounds_check(index) )
+            throw std::length_error{"Index out of bounds."};
+        T record;
+        _slots.read( index, 1, &record );
+        return record;
+    }
+
+    /**
+     * Writes a record at the given index; at the record count, appends it.
+     *
+     * @param        index   a index where a record is written
+     * @param        record  a record to be written
+     */
+    void write_at_index( int index, const T& record ){
+        if ( !bounds_check(index, true) )
+            throw std::length_error{"Index out of bounds."};
+        if ( index == get_record_count() )
+            append( &record, 1 );
+        else
+            _slots.write( index, 1, &record );
+    }
+
+    /**
+     * @param        record  a record to be added after the last one
+     *
+     * @return  the index it was written at
+     */
+    int append( const T& record ){
+        return append( &record, 1 );
+    }
+
+    /**
+     * Adds records after the last one with a single write.
+     *
+     * @param        records    records to append, in order
+     * @param        count      number of records
+     *
+     * @return  index of the first appended record
+     */
+    int append( const T* records, int count ){
+        int first_index = get_record_count();
+        _slots.write( first_index, count, records );
+        _count.store( first_index + count, std::memory_order_release );
+        _header_dirty = true;
+        return first_index;
+    }
+
+    /**
+     * Swaps the record at index_1 with the record at index_2.
+     *
+     * @param        index_1     a index of value to be swapped
+     * @param        index_2     another index of value to be swapped
+     */
+    void swap_records( int index_1, int index_2 ){
+        T record_1 = get_at_index( index_1 );
+        T record_2 = get_at_index( index_2 );
+        _slots.write( index_1, 1, &record_2 );
+        _slots.write( index_2, 1, &record_1 );
+    }
+
+    /**
+     * Reads the records between the given indices with a few large
+     * reads rather than one read per record.
+     *
+     * @param        first_index     a index to begin reading
+     * @param        last_index      one past the last index to read
+     *
+     * @return  the records, in index order
+     */
+    std::vector<T> get_range( int first_index, int last_index ) const {
+        if ( first_index < 0 || first_index > last_index || last_index > get_record_count() )
+            throw std::length_error{"Index out of bounds."};
+        std::vector<T> records( last_index - first_index );
+        for ( int i = first_index; i < last_index; i += default_chunk_records ){
+            int count = std::min( default_chunk_records, last_index - i );
+            _slots.read( i, count, records.data() + ( i - first_index ) );
+        }
+        return records;
+    }
+
+    /**
+     * Streams the records in [first_index, last_index) to a visitor in
+     * blocks of at most chunk_records, so ranges larger than memory can
+     * be scanned with a bounded buffer.
+     *
+     * @param        first_index     a index to begin reading
+     * @param        last_index      one past the last index to read
+     * @param        visit           called once per block, in index order
+     * @param        chunk_records   most records handed to one visit call
+     */
+    void for_each_block( int first_index, int last_index, const BlockVisitor& visit,
+                         int chunk_records = default_chunk_records ) const {
+        if ( first_index < 0 || first_index > last_index || last_index > get_record_count() )
+            throw std::length_error{"Index out of bounds."};
+        if ( chunk_records <= 0 )
+            chunk_records = default_chunk_records;
+        std::vector<T> buffer( std::min(chunk_records, last_index - first_index) );
+        for ( int i = first_index; i < last_index; i += chunk_records ){
+            int count = std::min( chunk_records, last_index - i );
+            _slots.read( i, count, buffer.data() );
+            visit( i, buffer.data(), count );
+        }
+    }
+
+    /**
+     * Writes the header, with the record count, if it has changed.
+     */
+    void flush( ){
+        if ( !_header_dirty )
+            return;
+        _header.record_count = get_record_count();
+        stats_write( sizeof(CampsiteFileHeader) );
+        if ( pwrite(_fd, &_header, sizeof(CampsiteFileHeader), 0) != sizeof(CampsiteFileHeader) )
+            throw std::runtime_error{"Unable to write the database header."};
+        _header_dirty = false;
+    }
+
+    // This object is non-copyable
+    RecordFile(const RecordFile&)            = delete;
+    RecordFile& operator=(const RecordFile&) = delete;
+
+private:
+    /**
+     * Reads and validates the file header, or writes a fresh one if
+     * the file is empty.  A stored count that disagrees with the file
+     * size is corrected as CampsiteDB corrects its own.
+     */
+    void _load_header( ){
+        struct stat info;
+        if ( fstat(_fd, &info) != 0 )
+            throw std::runtime_error{"Unable to read the database header."};
+        if ( info.st_size == 0 ){  //brand new file
+            _header = CampsiteFileHeader{ CampsiteFileHeader::raw_version, record_size, T::record_type };
+            _header_dirty = true;
+            flush();
+            return;
+        }
+
+        if ( pread(_fd, &_header, sizeof(CampsiteFileHeader), 0) != sizeof(CampsiteFileHeader) || !_header.has_magic() )
+            throw std::runtime_error{"Not a record file."};
+        stats_read( sizeof(CampsiteFileHeader) );
+        if ( _header.version != CampsiteFileHeader::raw_version || !_header.holds(T::record_type, record_size) )
+            throw std::runtime_error{"Record file does not hold records of this type."};
+        std::int64_t gained = _header.fit_count( info.st_size, data_offset );
+        if ( gained != 0 ){
+            _recovered = gained > 0;
+            _header_dirty = true;
+        }
+        _count = static_cast<int>( _header.record_count );
+    }
+
+    int                _fd = -1;
+    RecordSlots<T>     _slots;
+    CampsiteFileHeader _header;             /// in-memory copy of the file header
+    std::atomic<int>   _count{0};           /// records in the file
+    bool               _header_dirty = false;
+    bool               _recovered = false;  /// records were found past the stored count
+};
+
+#endif
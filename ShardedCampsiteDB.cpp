@@ -0,0 +1,592 @@
+/**
+ * @file ShardedCampsiteDB.cpp
+ *
+ * Global index translation and the scatter-gather operations of the
+ * sharded database.
+ */
+#include "ShardedCampsiteDB.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <stdexcept>
+
+
+/**
+ * Opens (creating where missing) every shard file.
+ *
+ * @param shard_files       one file per shard, in shard order
+ * @param policy            how records are dealt to the shards
+ * @param options           settings every shard is opened with
+ * @param stripe_records    consecutive indices per stripe under index_range
+ */
+ShardedCampsiteDB::ShardedCampsiteDB( const std::vector<std::string>& shard_files, ShardPolicy policy,
+                                      CampsiteDBOptions options, int stripe_records )
+: _policy{policy}, _stripe_records{stripe_records} {
+    if ( shard_files.empty() )
+        throw std::invalid_argument{"A sharded database needs at least one shard."};
+    if ( stripe_records <= 0 )
+        throw std::invalid_argument{"Stripes must hold at least one record."};
+    for ( const std::string& file : shard_files )
+        _shards.push_back( std::make_unique<CampsiteDB>(file, options) );
+
+    if ( _policy == ShardPolicy::index_range ){
+        int count = get_record_count();
+        for ( int s = 0; s < get_shard_count(); s++ )
+            if ( _shards[s]->get_record_count() != _count_below(s, count) )
+                throw std::runtime_error{"Shard files do not match the index_range layout."};
+    }
+}
+
+
+
+/**
+ * @param filename  base name of the shards
+ * @param shards    number of shards
+ *
+ * @return  "<filename>.0" through "<filename>.<shards - 1>"
+ */
+std::vector<std::string> ShardedCampsiteDB::shard_names( const std::string& filename, int shards ){
+    std::vector<std::string> names;
+    for ( int s = 0; s < shards; s++ )
+        names.push_back( filename + "." + std::to_string(s) );
+    return names;
+}
+
+
+
+/**
+ * @return  the number of shard files
+ */
+int ShardedCampsiteDB::get_shard_count( ) const {
+    return static_cast<int>( _shards.size() );
+}
+
+
+
+/**
+ * @return  how records are dealt to the shards
+ */
+ShardPolicy ShardedCampsiteDB::get_policy( ) const {
+    return _policy;
+}
+
+
+
+/**
+ * @return  the number of slots over all shards, deleted ones included
+ */
+int ShardedCampsiteDB::get_record_count( ){
+    int count = 0;
+    for ( std::unique_ptr<CampsiteDB>& shard : _shards )
+        count += shard->get_record_count();
+    return count;
+}
+
+
+
+/**
+ * @return  the number of records over all shards that are not deleted
+ */
+int ShardedCampsiteDB::get_live_count( ){
+    int count = 0;
+    for ( std::unique_ptr<CampsiteDB>& shard : _shards )
+        count += shard->get_live_count();
+    return count;
+}
+
+
+
+/**
+ * Gets a record at the given global index.
+ *
+ * @param   index  a index of a value to be read
+ *
+ * @return  a record at the given index
+ */
+Campsite ShardedCampsiteDB::get_at_index( int index ){
+    int local;
+    int shard = _locate( index, local );
+    return _shards[shard]->get_at_index( local );
+}
+
+
+
+/**
+ * Gets the live records in [first_index, last_index).  Every shard
+ * holding part of the range reads its part at the same time.
+ *
+ * @param   first_index     a index to begin reading
+ * @param   last_index      one past the last index to read
+ *
+ * @return  the sites, in index order
+ */
+std::vector<Campsite> ShardedCampsiteDB::get_range( int first_index, int last_index ){
+    std::vector<CampsiteRecord> records;
+    _gather( first_index, last_index, records );
+
+    std::vector<Campsite> sites;
+    sites.reserve( records.size() );
+    for ( const CampsiteRecord& record : records )
+        if ( !is_tombstone(record) )
+            sites.emplace_back( record );
+    return sites;
+}
+
+
+
+/**
+ * Looks a site up by its site number through the shards' number
+ * indexes.  Under hash_number only the shard the number hashes to is
+ * asked; under index_range every shard is asked at once, and the
+ * lowest shard holding the number wins.
+ *
+ * @param        number     site number to find
+ *
+ * @return  the matching site
+ */
+Campsite ShardedCampsiteDB::get_by_number( int number ){
+    if ( _policy == ShardPolicy::hash_number )
+        return _shards[_shard_of_number(number)]->get_by_number( number );
+
+    std::vector<Campsite> sites( _shards.size() );
+    std::vector<char> found( _shards.size(), false );
+    _parallel( [this, number, &sites, &found]( int shard ){
+        try {
+            sites[shard] = _shards[shard]->get_by_number( number );
+            found[shard] = true;
+        } catch ( const std::out_of_range& ) {
+            // not in this shard
+        }
+    } );
+    for ( int s = 0; s < get_shard_count(); s++ )
+        if ( found[s] )
+            return sites[s];
+    throw std::out_of_range{"No campsite with that number."};
+}
+
+
+
+/**
+ * Adds a site at the end of the shard it belongs to: the shard of the
+ * next stripe under index_range, or the shard its number hashes to
+ * under hash_number.  A shard that reuses free slots may put it in a
+ * deleted slot instead.
+ *
+ * @param   site    the record to add
+ *
+ * @return  the global index it was stored at
+ */
+int ShardedCampsiteDB::append( const Campsite& site ){
+    if ( _policy == ShardPolicy::hash_number ){
+        int shard = _shard_of_number( site.get_number() );
+        int local = _shards[shard]->append( site );
+        return _global_index( shard, local, _offsets() );
+    }
+
+    std::lock_guard<std::mutex> guard( _append_mutex );
+    int shard = ( get_record_count() / _stripe_records ) % get_shard_count();
+    int local = _shards[shard]->append( site );
+    return _global_index( shard, local, _offsets() );
+}
+
+
+
+/**
+ * Overwrites the record at an existing global index.  Under
+ * hash_number the new site number must hash to the same shard.
+ *
+ * @param   index   a index of the record to replace
+ * @param   site    the new record
+ */
+void ShardedCampsiteDB::write_at_index( int index, const Campsite& site ){
+    int local;
+    int shard = _locate( index, local );
+    if ( _policy == ShardPolicy::hash_number && _shard_of_number(site.get_number()) != shard )
+        throw std::invalid_argument{"Site number belongs to another shard."};
+    _shards[shard]->write_at_index( local, site );
+}
+
+
+
+/**
+ * Deletes the record at a global index, leaving a tombstone so no
+ * other index moves.
+ *
+ * @param   index   a index of the record to delete
+ */
+void ShardedCampsiteDB::erase_at_index( int index ){
+    int local;
+    int shard = _locate( index, local );
+    _shards[shard]->erase_at_index( local );
+}
+
+
+
+/**
+ * @param   index   a global index
+ *
+ * @return  true if the record there was deleted
+ */
+bool ShardedCampsiteDB::is_deleted( int index ){
+    int local;
+    int shard = _locate( index, local );
+    return _shards[shard]->is_deleted( local );
+}
+
+
+
+/**
+ * Scans every shard at once, each on its own thread, then hands the
+ * matches to the visitor in global index order.  The matches are held
+ * in memory until every shard is done.
+ *
+ * @param        query      predicates the records must satisfy
+ * @param        visit      called once per matching record
+ */
+void ShardedCampsiteDB::scan( const CampsiteQuery& query, const MatchVisitor& visit ){
+    using Match = std::pair<int, CampsiteRecord>;
+    std::vector<int> offsets = _offsets();
+    std::vector<std::vector<Match>> matches( _shards.size() );
+    _parallel( [this, &query, &offsets, &matches]( int shard ){
+        _shards[shard]->scan( query, [this, shard, &offsets, &matches]( int local, const CampsiteRecord& record ){
+            matches[shard].emplace_back( _global_index(shard, local, offsets), record );
+        } );
+    } );
+
+    //each shard's matches ascend already, so merge them
+    std::vector<std::size_t> next( _shards.size(), 0 );
+    while ( true ){
+        int best = -1;
+        for ( int s = 0; s < get_shard_count(); s++ )
+            if ( next[s] < matches[s].size() &&
+                 ( best < 0 || matches[s][next[s]].first < matches[best][next[best]].first ) )
+                best = s;
+        if ( best < 0 )
+            break;
+        const Match& match = matches[best][next[best]++];
+        visit( match.first, match.second );
+    }
+}
+
+
+
+/**
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  the global indices of every matching record, ascending
+ */
+std::vector<int> ShardedCampsiteDB::find_indices( const CampsiteQuery& query ){
+    std::vector<int> indices;
+    scan( query, [&indices]( int index, const CampsiteRecord& ){
+        indices.push_back( index );
+    } );
+    return indices;
+}
+
+
+
+/**
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  every matching site, in global index order
+ */
+std::vector<Campsite> ShardedCampsiteDB::find( const CampsiteQuery& query ){
+    std::vector<Campsite> sites;
+    scan( query, [&sites]( int, const CampsiteRecord& record ){
+        sites.push_back( Campsite{record} );
+    } );
+    return sites;
+}
+
+
+
+/**
+ * Summarizes each shard at once, then combines the summaries.
+ *
+ * @param        query      predicates the records must satisfy
+ *
+ * @return  count, extremes and total of the matching rates
+ */
+RateSummary ShardedCampsiteDB::summarize_rate( const CampsiteQuery& query ){
+    std::vector<RateSummary> parts( _shards.size() );
+    _parallel( [this, &query, &parts]( int shard ){
+        parts[shard] = _shards[shard]->summarize_rate( query );
+    } );
+
+    RateSummary summary;
+    for ( const RateSummary& part : parts ){
+        if ( part.count == 0 )
+            continue;
+        if ( summary.count == 0 || part.min < summary.min )
+            summary.min = part.min;
+        if ( summary.count == 0 || part.max > summary.max )
+            summary.max = part.max;
+        summary.sum += part.sum;
+        summary.count += part.count;
+    }
+    return summary;
+}
+
+
+
+/**
+ * Sends each live record, in global index order, to the given stream.
+ *
+ * @param[out]   strm    the output stream object where the records
+ *                       are sent.
+ */
+void ShardedCampsiteDB::list_records( std::ostream& strm ){
+    export_text( strm, TextFormat::listing );
+}
+
+
+
+/**
+ * Writes each live record, in global index order, to the given stream
+ * as a line of text.
+ *
+ * @param[out]   strm    the stream the text is written to
+ * @param        format  layout of each line
+ *
+ * @return  the number of records written
+ */
+std::size_t ShardedCampsiteDB::export_text( std::ostream& strm, TextFormat format ){
+    TextWriter writer{strm, format};
+    return _export_text( writer );
+}
+
+
+
+/**
+ * Writes each live record, in global index order, to the given file
+ * descriptor as a line of text.
+ *
+ * @param   fd      an open descriptor, left open
+ * @param   format  layout of each line
+ *
+ * @return  the number of records written
+ */
+std::size_t ShardedCampsiteDB::export_text( int fd, TextFormat format ){
+    TextWriter writer{fd, format};
+    return _export_text( writer );
+}
+
+
+
+/**
+ * Persists every shard, all at once.
+ */
+void ShardedCampsiteDB::flush( ){
+    _parallel( [this]( int shard ){
+        _shards[shard]->flush();
+    } );
+}
+
+
+
+/**
+ * Checkpoints every shard, all at once.
+ */
+void ShardedCampsiteDB::checkpoint( ){
+    _parallel( [this]( int shard ){
+        _shards[shard]->checkpoint();
+    } );
+}
+
+
+
+/**
+ * Counts the slots of a shard that come before a global index under
+ * index_range, which is also the shard's size when the database holds
+ * index records.
+ *
+ * @param   shard   a shard number
+ * @param   index   a global index
+ *
+ * @return  the number of the shard's slots below index
+ */
+int ShardedCampsiteDB::_count_below( int shard, int index ) const {
+    std::int64_t cycle = static_cast<std::int64_t>( _stripe_records ) * get_shard_count();
+    std::int64_t rest = index % cycle - static_cast<std::int64_t>( shard ) * _stripe_records;
+    return static_cast<int>( index / cycle * _stripe_records + std::clamp<std::int64_t>(rest, 0, _stripe_records) );
+}
+
+
+
+/**
+ * @return  under hash_number, the global index of each shard's first
+ *          record followed by the total; under index_range, nothing
+ */
+std::vector<int> ShardedCampsiteDB::_offsets( ){
+    std::vector<int> offsets;
+    if ( _policy == ShardPolicy::hash_number ){
+        offsets.push_back( 0 );
+        for ( std::unique_ptr<CampsiteDB>& shard : _shards )
+            offsets.push_back( offsets.back() + shard->get_record_count() );
+    }
+    return offsets;
+}
+
+
+
+/**
+ * @param   shard   a shard number
+ * @param   local   an index within that shard
+ * @param   offsets what _offsets returned
+ *
+ * @return  the global index of the record
+ */
+int ShardedCampsiteDB::_global_index( int shard, int local, const std::vector<int>& offsets ) const {
+    if ( _policy == ShardPolicy::hash_number )
+        return offsets[shard] + local;
+    int stripe = local / _stripe_records * get_shard_count() + shard;
+    return stripe * _stripe_records + local % _stripe_records;
+}
+
+
+
+/**
+ * Finds where a global index lives.
+ *
+ * @param        index  a global index
+ * @param[out]   local  the index within its shard
+ *
+ * @return  the shard number
+ */
+int ShardedCampsiteDB::_locate( int index, int& local ){
+    if ( _policy == ShardPolicy::hash_number ){
+        std::vector<int> offsets = _offsets();
+        if ( index < 0 || index >= offsets.back() )
+            throw std::length_error{"Index out of bounds"};
+        int shard = static_cast<int>( std::upper_bound(offsets.begin(), offsets.end(), index) - offsets.begin() ) - 1;
+        local = index - offsets[shard];
+        return shard;
+    }
+
+    if ( index < 0 || index >= get_record_count() )
+        throw std::length_error{"Index out of bounds"};
+    int stripe = index / _stripe_records;
+    local = stripe / get_shard_count() * _stripe_records + index % _stripe_records;
+    return stripe % get_shard_count();
+}
+
+
+
+/**
+ * @param   number  a site number
+ *
+ * @return  the shard a site with that number belongs to under hash_number
+ */
+int ShardedCampsiteDB::_shard_of_number( int number ) const {
+    std::uint32_t hash = static_cast<std::uint32_t>( number ) * 0x9E3779B1u;
+    return static_cast<int>( ( static_cast<std::uint64_t>(hash) * _shards.size() ) >> 32 );
+}
+
+
+
+/**
+ * Runs work once per shard, each on its own thread (shard 0 on the
+ * calling one), and waits for all of them.  The first exception thrown
+ * is rethrown once every thread is done.
+ *
+ * @param   work    called with each shard number
+ */
+void ShardedCampsiteDB::_parallel( const std::function<void( int shard )>& work ){
+    std::vector<std::future<void>> tasks;
+    for ( int s = 1; s < get_shard_count(); s++ )
+        tasks.push_back( std::async(std::launch::async, work, s) );
+
+    std::exception_ptr failure;
+    try {
+        work( 0 );
+    } catch ( ... ) {
+        failure = std::current_exception();
+    }
+    for ( std::future<void>& task : tasks ){
+        try {
+            task.get();
+        } catch ( ... ) {
+            if ( !failure )
+                failure = std::current_exception();
+        }
+    }
+    if ( failure )
+        std::rethrow_exception( failure );
+}
+
+
+
+/**
+ * Reads the slots in [first_index, last_index), tombstones included.
+ * The part of the range each shard holds is one run of its own
+ * indices, so every shard reads its run with one for_each_block, all
+ * shards at once.
+ *
+ * @param        first_index    a index to begin reading
+ * @param        last_index     one past the last index to read
+ * @param[out]   records        the slots, in index order
+ */
+void ShardedCampsiteDB::_gather( int first_index, int last_index, std::vector<CampsiteRecord>& records ){
+    std::vector<int> offsets = _offsets();
+    int count = _policy == ShardPolicy::hash_number ? offsets.back() : get_record_count();
+    if ( first_index < 0 || first_index > last_index || last_index > count )
+        throw std::length_error{"Index out of bounds."};
+    records.resize( last_index - first_index );
+
+    _parallel( [this, first_index, last_index, &offsets, &records]( int shard ){
+        int first, last;
+        if ( _policy == ShardPolicy::hash_number ){
+            first = std::clamp( first_index - offsets[shard], 0, offsets[shard + 1] - offsets[shard] );
+            last = std::clamp( last_index - offsets[shard], 0, offsets[shard + 1] - offsets[shard] );
+        }
+        else{
+            first = _count_below( shard, first_index );
+            last = _count_below( shard, last_index );
+        }
+        if ( first == last )
+            return;
+        _shards[shard]->for_each_block( first, last,
+            [this, shard, first_index, &offsets, &records]( int local, const CampsiteRecord* block, int n ){
+                for ( int i = 0; i < n; i++ )
+                    records[_global_index(shard, local + i, offsets) - first_index] = block[i];
+            } );
+    } );
+}
+
+
+
+/**
+ * Feeds every live record to the writer in global index order.  The
+ * records are gathered a window at a time, and the next window is read
+ * while the current one is formatted.
+ *
+ * @param   writer  where the text goes
+ *
+ * @return  the number of records written
+ */
+std::size_t ShardedCampsiteDB::_export_text( TextWriter& writer ){
+    int count = get_record_count();
+    int stripe = std::min( _stripe_records, CampsiteDB::default_chunk_records );
+    int window = stripe * get_shard_count();
+    std::vector<CampsiteRecord> current, next;
+    _gather( 0, std::min(window, count), current );
+
+    for ( int first = 0; first < count; first += window ){
+        int last = std::min( first + window, count );
+        std::future<void> reading;
+        if ( last < count )
+            reading = std::async( std::launch::async, [this, last, count, window, &next]( ){
+                _gather( last, std::min(last + window, count), next );
+            } );
+        for ( const CampsiteRecord& record : current )
+            if ( !is_tombstone(record) )
+                writer.write( record );
+        if ( reading.valid() )
+            reading.get();
+        std::swap( current, next );
+    }
+    writer.flush();
+    return writer.records();
+}
@@ -0,0 +1,111 @@
+/**
+ * @file ShardedCampsiteDB.h
+ *
+ * A database spread over several CampsiteDB files.
+ *
+ * @remarks
+ *     Each shard is an ordinary CampsiteDB file, so shards can sit on
+ *     different disks and be backed up one at a time.  Scans, exports
+ *     and range reads work on every shard at once, one thread each.
+ */
+#ifndef SHARDEDCAMPSITEDB_H
+#define SHARDEDCAMPSITEDB_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CampsiteDB.h"
+
+/**
+ * How records are dealt to the shards.
+ */
+enum class ShardPolicy {
+    index_range,  /// stripes of consecutive indices go to the shards in turn
+    hash_number   /// each record lives in the shard its site number hashes to
+};
+
+/**
+ * Records spread over N CampsiteDB shard files, addressed by one
+ * global index.
+ *
+ * Under index_range, global index g lives in stripe g / stripe_records,
+ * and stripe k lives in shard k % N, so sequential work touches every
+ * shard evenly and global indices never move.  Under hash_number, the
+ * global order is shard 0's records, then shard 1's, and so on; a
+ * global index shifts when an earlier shard grows, so site numbers
+ * are the stable key.  The shard files must always be opened with the
+ * same policy, stripe size and order.
+ *
+ * The object may be shared between threads when the shards are opened
+ * concurrent; the parallel operations use one thread per shard either way.
+ */
+class ShardedCampsiteDB {
+public:
+    using MatchVisitor = CampsiteDB::MatchVisitor;
+
+    static constexpr int default_stripe_records = CampsiteDB::default_chunk_records;
+
+    //constructor
+    ShardedCampsiteDB( const std::vector<std::string>& shard_files,
+                       ShardPolicy policy = ShardPolicy::index_range,
+                       CampsiteDBOptions options = CampsiteDBOptions{},
+                       int stripe_records = default_stripe_records );
+
+    // "<filename>.0", "<filename>.1", ... for keeping every shard in one place
+    static std::vector<std::string> shard_names( const std::string& filename, int shards );
+
+    //member methods
+    int         get_shard_count( ) const;
+    ShardPolicy get_policy( ) const;
+    int         get_record_count( );  // slots, deleted ones included
+    int         get_live_count( );
+
+    Campsite get_at_index( int index );
+    // gathered from every shard holding part of the range, in index order
+    std::vector<Campsite> get_range( int first_index, int last_index );
+    Campsite get_by_number( int number );
+
+    int  append( const Campsite& site );
+    void write_at_index( int index, const Campsite& site );
+    void erase_at_index( int index );
+    bool is_deleted( int index );
+
+    // every shard is scanned at once; matches are visited in global index order
+    void scan( const CampsiteQuery& query, const MatchVisitor& visit );
+    std::vector<int> find_indices( const CampsiteQuery& query );
+    std::vector<Campsite> find( const CampsiteQuery& query );
+    RateSummary summarize_rate( const CampsiteQuery& query );
+
+    void list_records( std::ostream& strm = std::cout );
+    std::size_t export_text( std::ostream& strm, TextFormat format = TextFormat::listing );
+    std::size_t export_text( int fd, TextFormat format = TextFormat::listing );
+
+    void flush( );
+    void checkpoint( );
+
+    // This object is non-copyable
+    ShardedCampsiteDB(const ShardedCampsiteDB&)            = delete;
+    ShardedCampsiteDB& operator=(const ShardedCampsiteDB&) = delete;
+
+private:
+    // private methods:
+    int  _count_below( int shard, int index ) const;
+    std::vector<int> _offsets( );
+    int  _global_index( int shard, int local, const std::vector<int>& offsets ) const;
+    int  _locate( int index, int& local );
+    int  _shard_of_number( int number ) const;
+    void _parallel( const std::function<void( int shard )>& work );
+    void _gather( int first_index, int last_index, std::vector<CampsiteRecord>& records );
+    std::size_t _export_text( TextWriter& writer );
+
+    // private fields:
+    std::vector<std::unique_ptr<CampsiteDB>> _shards;
+    ShardPolicy _policy;
+    int         _stripe_records;  /// consecutive indices per stripe under index_range
+    std::mutex  _append_mutex;    /// keeps index_range appends in stripe order
+};
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file StripedLock.cpp
+ *
+ * Implementation for the StripedLock class
+ */
+#include "StripedLock.h"
+
+#include <utility>
+
+
+/**
+ * @param index   record index
+ *
+ * @return  the lock guarding that record
+ */
+std::shared_mutex& StripedLock::stripe( int index ){
+    return _stripes[index % stripes];
+}
+
+
+
+/**
+ * @param indices   record indices
+ * @param count     number of indices
+ *
+ * @return  the stripes guarding those records
+ */
+StripedLock::StripeSet StripedLock::stripes_of( const int* indices, std::size_t count ){
+    StripeSet set = 0;
+    for ( std::size_t i = 0; i < count; i++ )
+        set |= StripeSet{1} << ( indices[i] % stripes );
+    return set;
+}
+
+
+
+/**
+ * @param first_index   first record index
+ * @param count         number of consecutive records
+ *
+ * @return  the stripes guarding records [first_index, first_index + count)
+ */
+StripedLock::StripeSet StripedLock::stripes_of_range( int first_index, int count ){
+    if ( count >= stripes )
+        return ~StripeSet{0};
+    StripeSet set = 0;
+    for ( int i = 0; i < count; i++ )
+        set |= StripeSet{1} << ( (first_index + i) % stripes );
+    return set;
+}
+
+
+
+/**
+ * Takes the given stripes shared, in ascending order, so a read of the
+ * records they guard sees no half-applied write while writers to other
+ * stripes carry on.
+ *
+ * @param set   stripes to take
+ */
+void StripedLock::lock_shared( StripeSet set ){
+    for ( int i = 0; i < stripes; i++ )
+        if ( set & (StripeSet{1} << i) )
+            _stripes[i].lock_shared();
+}
+
+
+
+/**
+ * Releases the stripes taken by lock_shared.
+ *
+ * @param set   stripes taken
+ */
+void StripedLock::unlock_shared( StripeSet set ){
+    for ( int i = stripes - 1; i >= 0; i-- )
+        if ( set & (StripeSet{1} << i) )
+            _stripes[i].unlock_shared();
+}
+
+
+
+/**
+ * Takes the stripes of two records exclusively (once, if they share
+ * a stripe), lowest stripe first.
+ *
+ * @param index_1   first record index
+ * @param index_2   second record index
+ */
+void StripedLock::lock_pair( int index_1, int index_2 ){
+    int a = index_1 % stripes, b = index_2 % stripes;
+    if ( a > b )
+        std::swap( a, b );
+    _stripes[a].lock();
+    if ( b != a )
+        _stripes[b].lock();
+}
+
+
+
+/**
+ * Releases the stripes taken by lock_pair.
+ *
+ * @param index_1   first record index
+ * @param index_2   second record index
+ */
+void StripedLock::unlock_pair( int index_1, int index_2 ){
+    int a = index_1 % stripes, b = index_2 % stripes;
+    if ( b != a )
+        _stripes[b].unlock();
+    _stripes[a].unlock();
+}
+
+
+
+/**
+ * Takes every stripe shared, in ascending order, so a multi-record
+ * read sees no half-applied write.
+ */
+void StripedLock::lock_all_shared( ){
+    for ( std::shared_mutex& lock : _stripes )
+        lock.lock_shared();
+}
+
+
+
+/**
+ * Releases the stripes taken by lock_all_shared.
+ */
+void StripedLock::unlock_all_shared( ){
+    for ( int i = stripes - 1; i >= 0; i-- )
+        _stripes[i].unlock_shared();
+}
+
+
+
+/**
+ * Takes every stripe exclusively, in ascending order, so nothing else
+ * can read or write any record until unlock_all.
+ */
+void StripedLock::lock_all( ){
+    for ( std::shared_mutex& lock : _stripes )
+        lock.lock();
+}
+
+
+
+/**
+ * Releases the stripes taken by lock_all.
+ */
+void StripedLock::unlock_all( ){
+    for ( int i = stripes - 1; i >= 0; i-- )
+        _stripes[i].unlock();
+}
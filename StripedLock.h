@@ -0,0 +1,44 @@
+/**
+ * @file StripedLock.h
+ *
+ * A fixed set of reader-writer locks shared out by record index.
+ */
+#ifndef STRIPEDLOCK_H
+#define STRIPEDLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+
+/**
+ * Record index i is guarded by stripe i % stripes.  Readers take a
+ * stripe shared, writers take it exclusive.  Operations that need
+ * several stripes always take them in ascending stripe order, so
+ * they cannot deadlock with each other.
+ */
+class StripedLock {
+public:
+    static constexpr int stripes = 64;
+    using StripeSet = std::uint64_t;  /// bit s set for stripe s
+
+    std::shared_mutex& stripe( int index );
+
+    static StripeSet stripes_of( const int* indices, std::size_t count );
+    static StripeSet stripes_of_range( int first_index, int count );
+    void lock_shared( StripeSet set );
+    void unlock_shared( StripeSet set );
+
+    void lock_pair( int index_1, int index_2 );
+    void unlock_pair( int index_1, int index_2 );
+    void lock_all_shared( );
+    void unlock_all_shared( );
+    void lock_all( );
+    void unlock_all( );
+
+private:
+    std::shared_mutex _stripes[stripes];
+};
+
+static_assert( StripedLock::stripes <= 64, "a StripeSet holds one bit per stripe" );
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file TextExport.cpp
+ *
+ * Record formatting with std::to_chars, and the buffered TextWriter.
+ */
+#include "TextExport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+
+namespace {
+
+/**
+ * Copies a string literal's characters to out.
+ *
+ * @return  one past the last character written
+ */
+template <std::size_t N>
+char* put( char* out, const char (&text)[N] ){
+    std::memcpy( out, text, N - 1 );
+    return out + N - 1;
+}
+
+/**
+ * Writes a description as one CSV field, quoted (with its quotes
+ * doubled) only if it holds a comma, a quote or a line break.
+ *
+ * @return  one past the last character written
+ */
+char* put_csv_field( char* out, const char* text, std::size_t length ){
+    if ( std::find_if(text, text + length, []( char c ){
+             return c == ',' || c == '"' || c == '\n' || c == '\r'; }) == text + length ){
+        std::memcpy( out, text, length );
+        return out + length;
+    }
+    *out++ = '"';
+    for ( std::size_t i = 0; i < length; i++ ){
+        if ( text[i] == '"' )
+            *out++ = '"';
+        *out++ = text[i];
+    }
+    *out++ = '"';
+    return out;
+}
+
+}
+
+
+/**
+ * Formats one record as a line of text (newline included).  Rates are
+ * written with two decimals in the listing format, like operator<<,
+ * and in their shortest exact form otherwise, so they read back
+ * unchanged.  A description holding '|' or a line break cannot be read
+ * back from the pipe format.
+ *
+ * @param        record     record to format
+ * @param        format     layout of the line
+ * @param[out]   out        buffer of at least TextWriter::max_record_bytes
+ *
+ * @return  number of characters written
+ */
+std::size_t format_record( const CampsiteRecord& record, TextFormat format, char* out ){
+    char* const start = out;
+    char* const limit = out + TextWriter::max_record_bytes;
+    std::size_t length = strnlen( record.description, CampsiteRecord::desc_size );
+    out = std::to_chars( out, limit, record.number ).ptr;
+
+    switch ( format ){
+    case TextFormat::listing:
+        out = record.has_electric ? put( out, " [E]" ) : put( out, " [ ]" );
+        std::memcpy( out, record.description, length );
+        out = put( out + length, " \t($" );
+        out = std::to_chars( out, limit, record.rate, std::chars_format::fixed, 2 ).ptr;
+        *out++ = ')';
+        break;
+    case TextFormat::pipe:
+        *out++ = '|';
+        std::memcpy( out, record.description, length );
+        out = record.has_electric ? put( out + length, "|true|" ) : put( out + length, "|false|" );
+        out = std::to_chars( out, limit, record.rate ).ptr;
+        break;
+    case TextFormat::csv:
+        *out++ = ',';
+        out = put_csv_field( out, record.description, length );
+        out = record.has_electric ? put( out, ",true," ) : put( out, ",false," );
+        out = std::to_chars( out, limit, record.rate ).ptr;
+        break;
+    }
+    *out++ = '\n';
+    return out - start;
+}
+
+
+
+/**
+ * Sets up a writer whose output goes to a stream.
+ *
+ * @param strm          stream to write to
+ * @param format        layout of each line
+ * @param buffer_bytes  bytes gathered before each write
+ */
+TextWriter::TextWriter( std::ostream& strm, TextFormat format, std::size_t buffer_bytes )
+: _strm{&strm}, _format{format}, _buffer( std::max(buffer_bytes, 2 * max_record_bytes) ) {
+}
+
+
+
+/**
+ * Sets up a writer whose output goes to a file descriptor, which the
+ * writer does not close.
+ *
+ * @param fd            descriptor to write to
+ * @param format        layout of each line
+ * @param buffer_bytes  bytes gathered before each write
+ */
+TextWriter::TextWriter( int fd, TextFormat format, std::size_t buffer_bytes )
+: _fd{fd}, _format{format}, _buffer( std::max(buffer_bytes, 2 * max_record_bytes) ) {
+}
+
+
+
+/**
+ * Writes out whatever is still buffered.
+ */
+TextWriter::~TextWriter( ){
+    try {
+        flush();
+    } catch ( ... ) {
+        // nothing sensible to do from a destructor
+    }
+}
+
+
+
+/**
+ * Formats a record into the buffer, writing the buffer out first if
+ * the record might not fit.
+ *
+ * @param record    record to write
+ */
+void TextWriter::write( const CampsiteRecord& record ){
+    if ( _buffer.size() - _used < max_record_bytes )
+        flush();
+    _used += format_record( record, _format, _buffer.data() + _used );
+    _records++;
+}
+
+
+
+/**
+ * Writes the buffered text to the destination.
+ */
+void TextWriter::flush( ){
+    if ( _used == 0 )
+        return;
+    if ( _strm != nullptr ){
+        _strm->write( _buffer.data(), _used );
+        if ( !_strm->good() )
+            throw std::runtime_error{"Unable to write exported records."};
+    }
+    else{
+        std::size_t done = 0;
+        while ( done < _used ){
+            ssize_t put = ::write( _fd, _buffer.data() + done, _used - done );
+            if ( put < 0 && errno == EINTR )
+                continue;
+            if ( put <= 0 )
+                throw std::runtime_error{"Unable to write exported records."};
+            done += put;
+        }
+    }
+    _used = 0;
+}
+
+
+
+/**
+ * @return  the number of records written so far
+ */
+std::size_t TextWriter::records( ) const {
+    return _records;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file TextExport.h
+ *
+ * Fast formatting of records as text for CampsiteDB::export_text.
+ *
+ * @remarks
+ *     Records are formatted with std::to_chars into one large buffer,
+ *     which is written out in big chunks, so no stream state is touched
+ *     and nothing is flushed per record.
+ */
+#ifndef TEXTEXPORT_H
+#define TEXTEXPORT_H
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include "CampsiteRecord.h"
+
+/**
+ * How records are written as text, one record per line.
+ */
+enum class TextFormat {
+    listing,  /// as operator<<: 12 [E]description \t($12.50)
+    pipe,     /// number|description|true/false|rate, read back by from_ascii_file and bulk_load
+    csv       /// number,description,true/false,rate, quoted as RFC 4180 asks
+};
+
+/**
+ * Formats records into a reusable buffer and writes the buffer to a
+ * file descriptor or a stream whenever it fills, and when flushed or
+ * destroyed.
+ */
+class TextWriter {
+public:
+    static const std::size_t default_buffer_bytes = 1 << 20;
+    static const std::size_t max_record_bytes = 1024;  /// longest line one record formats to
+
+    TextWriter( std::ostream& strm, TextFormat format, std::size_t buffer_bytes = default_buffer_bytes );
+    TextWriter( int fd, TextFormat format, std::size_t buffer_bytes = default_buffer_bytes );
+    ~TextWriter( );
+
+    void        write( const CampsiteRecord& record );
+    void        flush( );
+    std::size_t records( ) const;
+
+    // This object is non-copyable
+    TextWriter(const TextWriter&)            = delete;
+    TextWriter& operator=(const TextWriter&) = delete;
+
+private:
+    std::ostream*     _strm = nullptr;  /// destination, when writing to a stream
+    int               _fd = -1;         /// destination, when writing to a descriptor
+    TextFormat        _format;
+    std::vector<char> _buffer;
+    std::size_t       _used = 0;        /// bytes of _buffer waiting to be written
+    std::size_t       _records = 0;     /// records formatted so far
+};
+
+std::size_t format_record( const CampsiteRecord& record, TextFormat format, char* out );
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * @file Tombstone.cpp
+ *
+ * Building and reading tombstone records
+ */
+#include "Tombstone.h"
+
+namespace {
+
+const int next_offset = 16;  /// where the links sit in the description
+const int prev_offset = 24;
+
+}
+
+
+/**
+ * Builds the tombstone of a deleted slot.  Its description is empty
+ * to anyone printing it; the tag and the links follow the terminator.
+ *
+ * @param next  next free slot, or -1
+ * @param prev  previous free slot, or -1
+ *
+ * @return  the tombstone
+ */
+CampsiteRecord make_tombstone( std::int64_t next, std::int64_t prev ){
+    CampsiteRecord record;
+    record.number = tombstone_number;
+    std::memcpy( record.description + 1, tombstone_tag, sizeof(tombstone_tag) );
+    std::memcpy( record.description + next_offset, &next, sizeof(next) );
+    std::memcpy( record.description + prev_offset, &prev, sizeof(prev) );
+    return record;
+}
+
+
+
+/**
+ * @param record  a tombstone
+ *
+ * @return  the free-list links it carries
+ */
+TombstoneLinks tombstone_links( const CampsiteRecord& record ){
+    TombstoneLinks links;
+    std::memcpy( &links.next, record.description + next_offset, sizeof(links.next) );
+    std::memcpy( &links.prev, record.description + prev_offset, sizeof(links.prev) );
+    return links;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file Tombstone.h
+ *
+ * Marker records left in the slots of deleted records.
+ *
+ * @remarks
+ *     A deleted slot keeps its place in the file (so indices of the
+ *     other records do not move) and holds a tombstone instead, which
+ *     also carries the slot's links in the database's free list.
+ */
+#ifndef TOMBSTONE_H
+#define TOMBSTONE_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "CampsiteRecord.h"
+
+/**
+ * Neighbours of a free slot in the free list; -1 where there is none.
+ */
+struct TombstoneLinks {
+    std::int64_t next;
+    std::int64_t prev;
+};
+
+const std::int32_t tombstone_number = INT32_MIN;  /// number of every tombstone
+const char tombstone_tag[8] = { 'T', 'O', 'M', 'B', 'S', 'T', 'O', 'N' };
+
+CampsiteRecord make_tombstone( std::int64_t next, std::int64_t prev );
+TombstoneLinks tombstone_links( const CampsiteRecord& record );
+
+/**
+ * @return  true if the record marks a deleted slot
+ */
+inline bool is_tombstone( const CampsiteRecord& record ){
+    //the number alone almost always decides it
+    return record.number == tombstone_number
+        && std::memcmp( record.description + 1, tombstone_tag, sizeof(tombstone_tag) ) == 0;
+}
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * @file WriteAheadLog.cpp
+ *
+ * Implementation for the WriteAheadLog class
+ */
+#include "WriteAheadLog.h"
+#include "OperationStats.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const std::uint32_t txn_magic = 0x5457414c;  /// "LAWT" on disk
+
+/**
+ * Fixed part of a logged transaction; count entries follow it.
+ */
+struct TxnHeader {
+    std::uint32_t magic;
+    std::uint32_t count;     /// number of WalEntry records that follow
+    std::uint32_t checksum;  /// FNV-1a of the entries
+    std::uint32_t unused;
+};
+
+/**
+ * @return  32-bit FNV-1a hash of the given bytes
+ */
+std::uint32_t checksum( const char* data, std::size_t length ){
+    std::uint32_t hash = 2166136261u;
+    for ( std::size_t i = 0; i < length; i++ ){
+        hash ^= static_cast<unsigned char>( data[i] );
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Writes all of the given bytes at the end of the file.
+ */
+void write_fully( int fd, const char* data, std::size_t length ){
+    while ( length > 0 ){
+        ssize_t put = ::write( fd, data, length );
+        if ( put <= 0 )
+            throw std::runtime_error{"Unable to write the write-ahead log."};
+        stats_write( put );
+        data += put;
+        length -= put;
+    }
+}
+
+}
+
+
+/**
+ * Opens (or creates) the log file.
+ *
+ * @param filename  file holding the log
+ */
+WriteAheadLog::WriteAheadLog( const std::string& filename ){
+    _fd = ::open( filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644 );
+    if ( _fd < 0 )
+        throw std::runtime_error{"Unable to open write-ahead log " + filename + "."};
+    struct stat info;
+    if ( fstat(_fd, &info) == 0 )
+        _size = _written = info.st_size;
+}
+
+
+
+/**
+ * Closes the log.  Anything committed is already on disk.
+ */
+WriteAheadLog::~WriteAheadLog( ){
+    ::close( _fd );
+}
+
+
+
+/**
+ * Logs a group of record writes as one transaction and waits until it
+ * is durable.  Safe to call from many threads at once.  Throws if the
+ * batch the transaction was written in failed to reach the disk; the
+ * log is then as if the transaction had never been committed.
+ *
+ * @param entries   after-images of the records written
+ * @param count     number of entries
+ */
+void WriteAheadLog::commit( const WalEntry* entries, int count ){
+    const char* bytes = reinterpret_cast<const char*>( entries );
+    std::size_t length = count * sizeof(WalEntry);
+    TxnHeader header{ txn_magic, static_cast<std::uint32_t>(count), checksum(bytes, length), 0 };
+
+    std::unique_lock<std::mutex> guard( _mutex );
+    const char* h = reinterpret_cast<const char*>( &header );
+    _pending.insert( _pending.end(), h, h + sizeof(TxnHeader) );
+    _pending.insert( _pending.end(), bytes, bytes + length );
+    _size += sizeof(TxnHeader) + length;
+    std::uint64_t lsn = ++_next_lsn;
+    _stats.transactions++;
+
+    for ( ;; ){
+        if ( _failed(lsn) )  //a leader's write or sync covering us failed
+            throw std::runtime_error{"Unable to sync the write-ahead log."};
+        if ( _durable_lsn >= lsn )
+            return;
+        if ( _unusable )
+            throw std::runtime_error{"The write-ahead log holds a torn transaction."};
+        if ( _syncing ){  //someone else is syncing; the next sync will cover us
+            _synced.wait( guard );
+            continue;
+        }
+
+        //become the leader: write and sync everything queued so far
+        _syncing = true;
+        std::vector<char> batch;
+        batch.swap( _pending );
+        std::uint64_t after = _batched_lsn;
+        std::uint64_t upto  = _batched_lsn = _next_lsn;
+        std::uint64_t start = _written;
+        guard.unlock();
+        bool ok = true;
+        try {
+            write_fully( _fd, batch.data(), batch.size() );
+            ok = fdatasync( _fd ) == 0;
+            stats_sync();
+        } catch ( ... ) {
+            ok = false;
+        }
+        bool cut = ok || ftruncate( _fd, start ) == 0;  //drop whatever part of the batch got out
+        guard.lock();
+        _syncing = false;
+        if ( ok ){
+            _durable_lsn = upto;
+            _written = start + batch.size();
+            _stats.syncs++;
+        }
+        else {
+            _failed_lsns.emplace_back( after, upto );
+            _size -= batch.size();
+            _unusable = !cut;
+        }
+        _synced.notify_all();
+    }
+}
+
+
+
+/**
+ * @param lsn   a transaction number
+ *
+ * @return  true if the transaction was in a batch whose write failed
+ */
+bool WriteAheadLog::_failed( std::uint64_t lsn ) const {
+    for ( const std::pair<std::uint64_t, std::uint64_t>& range : _failed_lsns )
+        if ( lsn > range.first && lsn <= range.second )
+            return true;
+    return false;
+}
+
+
+
+/**
+ * Reads back every complete transaction in the log, in commit order.
+ * A torn or corrupt transaction at the end (from a crash mid-write)
+ * ends the log; it and anything after it are ignored.
+ *
+ * @return  the entries of each committed transaction
+ */
+std::vector<std::vector<WalEntry>> WriteAheadLog::recover( ){
+    std::lock_guard<std::mutex> guard( _mutex );
+    std::vector<std::vector<WalEntry>> transactions;
+    std::vector<char> log( _size );
+    std::size_t got = 0;
+    while ( got < log.size() ){
+        ssize_t n = pread( _fd, log.data() + got, log.size() - got, got );
+        if ( n <= 0 )
+            break;
+        got += n;
+    }
+
+    std::size_t at = 0;
+    while ( at + sizeof(TxnHeader) <= got ){
+        TxnHeader header;
+        std::memcpy( &header, log.data() + at, sizeof(TxnHeader) );
+        std::size_t length = header.count * sizeof(WalEntry);
+        if ( header.magic != txn_magic || at + sizeof(TxnHeader) + length > got )
+            break;
+        const char* body = log.data() + at + sizeof(TxnHeader);
+        if ( checksum(body, length) != header.checksum )
+            break;
+        const WalEntry* first = reinterpret_cast<const WalEntry*>( body );
+        transactions.emplace_back( first, first + header.count );
+        at += sizeof(TxnHeader) + length;
+    }
+    return transactions;
+}
+
+
+
+/**
+ * Empties the log, once everything in it has reached the database.
+ */
+void WriteAheadLog::truncate( ){
+    std::lock_guard<std::mutex> guard( _mutex );
+    stats_sync();
+    if ( ftruncate(_fd, 0) != 0 || fsync(_fd) != 0 )
+        throw std::runtime_error{"Unable to truncate the write-ahead log."};
+    _size = _pending.size();
+    _written = 0;
+    _unusable = false;
+}
+
+
+
+/**
+ * @return  bytes in the log, including transactions still being written
+ */
+std::uint64_t WriteAheadLog::size( ){
+    std::lock_guard<std::mutex> guard( _mutex );
+    return _size;
+}
+
+
+
+/**
+ * @return  transaction and sync counts since the log was opened
+ */
+WalStats WriteAheadLog::stats( ){
+    std::lock_guard<std::mutex> guard( _mutex );
+    return _stats;
+}
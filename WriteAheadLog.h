@@ -0,0 +1,83 @@
+/**
+ * @file WriteAheadLog.h
+ *
+ * Redo log of record writes with group commit.
+ *
+ * @remarks
+ *     Used by CampsiteDB so that every mutation is durable and atomic
+ *     without an fsync of the database file per write.
+ */
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CampsiteRecord.h"
+
+/**
+ * The after-image of one record written by a transaction.
+ */
+struct WalEntry {
+    std::int32_t   index;    /// where the record goes
+    std::int32_t   unused;
+    CampsiteRecord record;   /// what goes there
+};
+
+/**
+ * How much work the log has done, and how well commits were grouped.
+ */
+struct WalStats {
+    std::uint64_t transactions = 0;  /// transactions committed
+    std::uint64_t syncs        = 0;  /// fdatasync calls that made them durable
+};
+
+/**
+ * An append-only file of transactions, each a checksummed group of
+ * WalEntry after-images.  commit() returns once its transaction is on
+ * stable storage.  Callers that commit while another caller's sync is
+ * in flight queue up behind it, and the next sync covers all of them
+ * at once (group commit).  If a write or sync fails, every transaction
+ * in it fails too: the file is cut back to where the batch began, so
+ * later transactions are not stranded behind torn bytes, and each of
+ * the batch's callers gets the exception.
+ */
+class WriteAheadLog {
+public:
+    WriteAheadLog( const std::string& filename );
+    ~WriteAheadLog( );
+
+    void commit( const WalEntry* entries, int count );
+    std::vector<std::vector<WalEntry>> recover( );
+    void truncate( );
+
+    std::uint64_t size( );
+    WalStats      stats( );
+
+    // This object is non-copyable
+    WriteAheadLog(const WriteAheadLog&)            = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+private:
+    bool _failed( std::uint64_t lsn ) const;
+
+    int                     _fd;
+    std::mutex              _mutex;
+    std::condition_variable _synced;
+    std::vector<char>       _pending;           /// transactions not yet written
+    std::uint64_t           _next_lsn    = 0;   /// last transaction number handed out
+    std::uint64_t           _batched_lsn = 0;   /// last transaction number taken for writing
+    std::uint64_t           _durable_lsn = 0;   /// last transaction number on disk
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> _failed_lsns;  /// (first, last] of each batch that failed
+    bool                    _syncing     = false;
+    bool                    _unusable    = false;  /// a failed write could not be cut off
+    std::uint64_t           _size        = 0;   /// bytes in the file, pending included
+    std::uint64_t           _written     = 0;   /// bytes in the file known to be whole
+    WalStats                _stats;
+};
+
+#endif
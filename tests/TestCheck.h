@@ -0,0 +1,90 @@
+/**
+ * @file TestCheck.h
+ *
+ * The little the behaviour tests need: a check that stays on in release
+ * builds, simulated crashes, and scratch databases that are removed with
+ * their side files.
+ */
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Stops the test with the failing expression and its line unless
+ * the condition holds.  Unlike assert it is not compiled out by NDEBUG.
+ */
+#define CHECK( condition )                                                  \
+    do {                                                                    \
+        if ( !(condition) ){                                                \
+            std::fprintf( stderr, "%s:%d: check failed: %s\n",              \
+                          __FILE__, __LINE__, #condition );                 \
+            std::exit( 1 );                                                 \
+        }                                                                   \
+    } while ( 0 )
+
+/**
+ * Checks that an expression throws the given exception type.
+ */
+#define CHECK_THROWS( expression, exception )                               \
+    do {                                                                    \
+        bool threw = false;                                                 \
+        try { (void)(expression); } catch ( const exception& ) { threw = true; } \
+        CHECK( threw && #expression " throws " #exception );                \
+    } while ( 0 )
+
+/**
+ * Runs the given writes in a child process that leaves with _exit, so
+ * nothing the writes left in memory or unsynced gets tidied up, and
+ * waits for it: a crash, as far as the files are concerned.
+ */
+template <typename Writes>
+void crash_after( Writes writes ){
+    pid_t pid = fork();
+    CHECK( pid >= 0 );
+    if ( pid == 0 ){
+        writes();
+        _exit( 0 );
+    }
+    int status = 0;
+    waitpid( pid, &status, 0 );
+    CHECK( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+}
+
+/**
+ * A database file in the working directory, removed with everything
+ * stored beside it when the test starts and again when it is done.
+ */
+class ScratchDB {
+public:
+    explicit ScratchDB( std::string name ) : _name{ name + ".db" } {
+        remove_files();
+    }
+
+    ~ScratchDB( ){
+        remove_files();
+    }
+
+    const std::string& name( ) const {
+        return _name;
+    }
+
+    void remove_files( ) const {
+        for ( const char* suffix : { "", ".wal", ".heap", ".crc", ".number.idx", ".terms.idx", ".rate.idx" } )
+            std::remove( (_name + suffix).c_str() );
+    }
+
+    // This object is non-copyable
+    ScratchDB(const ScratchDB&)            = delete;
+    ScratchDB& operator=(const ScratchDB&) = delete;
+
+private:
+    std::string _name;
+};
+
+#endif
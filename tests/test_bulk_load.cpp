@@ -0,0 +1,137 @@
+/**
+ * @file test_bulk_load.cpp
+ *
+ * A bulk load leaves the same records as appending each parsed line
+ * in turn, and reports every line it could not parse.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+
+/**
+ * A malformed line, and what the load should say about it.
+ */
+struct BadLine {
+    const char* text;
+    const char* message;
+};
+
+static const BadLine bad_lines[] = {
+    { "abc|site|true|1",       "bad site number" },
+    { "12 site|true|1",        "missing '|' after site number" },
+    { "13|no more bars",       "missing '|' after description" },
+    { "14|site|true",          "missing '|' after electric flag" },
+    { "15|site|true|cheap",    "bad rate" },
+    { "16|site|true|1.5 more", "unexpected text after rate" },
+};
+
+
+
+/**
+ * The text of a load big enough to be cut into several chunks: good
+ * lines with long descriptions, blank lines, CRLF endings and
+ * malformed lines mixed in, and no newline at the end.
+ */
+struct LoadFile {
+    LoadFile( const std::string& name, int lines ) : name{name} {
+        std::ofstream out{ name, std::ios::binary };
+        for ( int line = 1; line <= lines; line++ ){
+            if ( line > 1 )
+                out << ( line % 7 == 0 ? "\r\n" : "\n" );
+            if ( line % 500 == 0 ){
+                out << ( line % 1000 == 0 ? "" : "  \t" );
+            }
+            else if ( line % 997 == 0 ){
+                const BadLine& bad = bad_lines[ line / 997 % 6 ];
+                out << bad.text;
+                errors.push_back( BulkLoadError{ static_cast<std::size_t>(line), bad.message } );
+            }
+            else{
+                std::string description = line % 101 == 0 ? std::string( 200, 'd' )
+                                                           : "site " + std::to_string(line);
+                CampsiteRecord record{ line, description.c_str(), line % 3 == 0, ( line % 10000 ) / 4.0 };
+                out << record.number << '|' << description << '|' << ( record.has_electric ? "true" : "false" )
+                    << '|' << record.rate;
+                records.push_back( record );
+            }
+        }
+    }
+
+    ~LoadFile( ){
+        std::remove( name.c_str() );
+    }
+
+    std::string                 name;
+    std::vector<CampsiteRecord> records;  /// what the good lines hold, in order
+    std::vector<BulkLoadError>  errors;   /// the malformed lines
+};
+
+
+
+/**
+ * Loads the file into a database that already holds a few records and
+ * compares it, byte for byte, with one that appended the same records
+ * one at a time.
+ */
+static void test_matches_appends( const std::string& name, CampsiteDBOptions options, int threads ){
+    LoadFile text{ "bulk_load_" + name + ".txt", 90001 };
+    ScratchDB loaded_scratch{ "bulk_load_" + name };
+    ScratchDB appended_scratch{ "bulk_append_" + name };
+    options.number_index = true;
+    CampsiteDB loaded{ loaded_scratch.name(), options };
+    CampsiteDB appended{ appended_scratch.name(), options };
+    for ( int i = 0; i < 3; i++ ){
+        loaded.append( Campsite{ -i, "before", false, 1.0 } );
+        appended.append( Campsite{ -i, "before", false, 1.0 } );
+    }
+
+    BulkLoadReport report = loaded.bulk_load( text.name, threads );
+    for ( const CampsiteRecord& record : text.records )
+        appended.append( Campsite{record} );
+
+    CHECK( report.bytes > 2u << 20 );  //several chunks, whatever the thread count
+    CHECK( report.lines == 90001 );
+    CHECK( report.records == text.records.size() );
+    CHECK( report.error_count == text.errors.size() );
+    CHECK( report.errors.size() == text.errors.size() );
+    for ( std::size_t i = 0; i < text.errors.size(); i++ ){
+        CHECK( report.errors[i].line == text.errors[i].line );
+        CHECK( report.errors[i].message == text.errors[i].message );
+    }
+
+    CHECK( loaded.get_record_count() == appended.get_record_count() );
+    CHECK( loaded.get_record_count() == 3 + static_cast<int>(text.records.size()) );
+    int checked = 0;
+    loaded.for_each_block( 0, loaded.get_record_count(),
+        [&appended, &checked]( int first_index, const CampsiteRecord* records, int count ){
+            std::vector<Campsite> expected = appended.get_range( first_index, first_index + count );
+            for ( int i = 0; i < count; i++ ){
+                CampsiteRecord record = expected[i].get_record();
+                CHECK( std::memcmp(&records[i], &record, sizeof(CampsiteRecord)) == 0 );
+            }
+            checked += count;
+        } );
+    CHECK( checked == loaded.get_record_count() );
+
+    //the loaded records went through the index too
+    CHECK( loaded.get_by_number(101).get_description() == std::string(CampsiteRecord::desc_size - 1, 'd') );
+    CHECK( loaded.get_by_number(89999).get_number() == 89999 );
+}
+
+
+
+int main( ){
+    test_matches_appends( "plain", CampsiteDBOptions{}, 4 );
+    test_matches_appends( "one_thread", CampsiteDBOptions{}, 1 );
+
+    CampsiteDBOptions packed;
+    packed.packed_format = true;
+    test_matches_appends( "packed", packed, 3 );
+    return 0;
+}
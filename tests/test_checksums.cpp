@@ -0,0 +1,140 @@
+/**
+ * @file test_checksums.cpp
+ *
+ * Record checksums: damage is caught on read and by verify, and
+ * restore_from_copy repairs it from a backup.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+
+static Campsite site( int number ){
+    return Campsite{ number, "site " + std::to_string(number), number % 2 == 0, 10.0 + number };
+}
+
+
+
+static void copy_file( const std::string& from, const std::string& to ){
+    std::ifstream in( from, std::ios::binary );
+    std::ofstream out( to, std::ios::binary );
+    out << in.rdbuf();
+}
+
+
+
+/**
+ * Flips the bits of one byte of a file.
+ */
+static void damage( const std::string& filename, std::streamoff offset ){
+    std::fstream file( filename, std::ios::in | std::ios::out | std::ios::binary );
+    file.seekg( offset );
+    char c = static_cast<char>( file.get() );
+    file.seekp( offset );
+    file.put( static_cast<char>(c ^ 0x5a) );
+}
+
+
+
+/**
+ * @return  where the first copy of text starts in a file
+ */
+static std::streamoff find( const std::string& filename, const std::string& text ){
+    std::ifstream in( filename, std::ios::binary );
+    std::string bytes{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    std::size_t at = bytes.find( text );
+    CHECK( at != std::string::npos );
+    return static_cast<std::streamoff>( at );
+}
+
+
+
+/**
+ * Damaged raw slots fail their reads and verify, and come back from a
+ * backup.
+ */
+static void test_raw( ){
+    ScratchDB scratch{"checksums_raw"};
+    ScratchDB backup{"checksums_raw_backup"};
+    CampsiteDBOptions options;
+    options.checksums = true;
+    {
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 0; i < 1000; i++ )
+            db.append( site(i) );
+        CHECK( db.verify().empty() );
+    }
+    copy_file( scratch.name(), backup.name() );
+    for ( int index : { 17, 900 } )
+        damage( scratch.name(), sizeof(CampsiteFileHeader) + index * sizeof(CampsiteRecord)
+                                + offsetof(CampsiteRecord, description) );
+
+    CampsiteDB db{ scratch.name(), options };
+    CHECK_THROWS( db.get_at_index(17), std::runtime_error );
+    CHECK( db.get_at_index(16).get_number() == 16 );
+    std::vector<int> damaged = db.verify( 4 );
+    CHECK( (damaged == std::vector<int>{17, 900}) );
+    CHECK( db.restore_from_copy(backup.name(), damaged) == 2 );
+    CHECK( db.verify().empty() );
+    CHECK( db.get_at_index(17).get_description() == "site 17" );
+    CHECK( db.get_at_index(900).get_description() == "site 900" );
+}
+
+
+
+/**
+ * A packed record's checksum covers its description in the heap, so
+ * damage there is caught too, and repaired from the backup's heap.
+ * Descriptions rewritten in place keep their records checking out.
+ */
+static void test_packed( ){
+    ScratchDB scratch{"checksums_packed"};
+    ScratchDB backup{"checksums_packed_backup"};
+    CampsiteDBOptions options;
+    options.checksums     = true;
+    options.packed_format = true;
+    {
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 0; i < 1000; i++ )
+            db.append( site(i) );
+        db.write_at_index( 5, Campsite{ 5, "site", true, 15.0 } );  //fits in the old room
+        db.erase_at_index( 9 );
+        CHECK( db.verify().empty() );
+    }
+    {
+        CampsiteDB db{ scratch.name(), options };
+        CHECK( db.verify().empty() );
+        CHECK( db.get_at_index(5).get_description() == "site" );
+    }
+    copy_file( scratch.name(), backup.name() );
+    copy_file( scratch.name() + ".heap", backup.name() + ".heap" );
+    damage( scratch.name() + ".heap", find(scratch.name() + ".heap", "site 17site") + 5 );
+    damage( scratch.name() + ".heap", find(scratch.name() + ".heap", "site 900site") + 6 );
+    damage( scratch.name(), sizeof(CampsiteFileHeader) + 400 * sizeof(PackedCampsiteRecord) );
+
+    CampsiteDB db{ scratch.name(), options };
+    CHECK_THROWS( db.get_at_index(17), std::runtime_error );
+    CHECK( db.get_at_index(18).get_description() == "site 18" );
+    std::vector<int> damaged = db.verify( 3 );
+    CHECK( (damaged == std::vector<int>{17, 400, 900}) );
+    CHECK( db.restore_from_copy(backup.name(), damaged) == 3 );
+    CHECK( db.verify().empty() );
+    CHECK( db.get_at_index(17).get_description() == "site 17" );
+    CHECK( db.get_at_index(400).get_number() == 400 );
+    CHECK( db.get_at_index(900).get_description() == "site 900" );
+}
+
+
+
+int main( ){
+    test_raw();
+    test_packed();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file test_compaction.cpp
+ *
+ * Deleting records: tombstones, reuse of their slots by append(), and
+ * compaction, across reopens.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <set>
+#include <string>
+
+
+
+static Campsite site( int number ){
+    return Campsite{ number, "site " + std::to_string(number), number % 2 == 0, 10.0 + number };
+}
+
+
+
+/**
+ * Compaction drops the deleted slots for good, and the deleted slots
+ * of a reopened file are still found for reuse.
+ */
+static void test_compact( ){
+    ScratchDB scratch{"compaction_compact"};
+    std::set<int> kept;
+    {
+        CampsiteDB db{ scratch.name() };
+        for ( int i = 0; i < 100; i++ )
+            db.append( site(i) );
+        for ( int i = 0; i < 100; i++ ){
+            if ( i % 3 == 0 )
+                db.erase_at_index( i );
+            else
+                kept.insert( i );
+        }
+        CHECK( db.get_live_count() == static_cast<int>(kept.size()) );
+    }
+    {
+        CampsiteDB db{ scratch.name() };
+        CHECK( db.get_record_count() == 100 );
+        CHECK( db.is_deleted(0) && db.is_deleted(99) );
+        db.compact();
+        CHECK( db.get_record_count() == static_cast<int>(kept.size()) );
+    }
+
+    CampsiteDBOptions options;
+    options.reuse_free_slots = true;
+    CampsiteDB db{ scratch.name(), options };
+    CHECK( db.get_record_count() == static_cast<int>(kept.size()) );
+    std::set<int> found;
+    for ( const Campsite& s : db.get_range(0, db.get_record_count()) )
+        found.insert( s.get_number() );
+    CHECK( found == kept );
+
+    db.erase_at_index( 5 );
+    db.erase_at_index( 20 );
+    int count = db.get_record_count();
+    CHECK( db.append(site(1000)) < count );
+    CHECK( db.append(site(1001)) < count );
+    CHECK( db.get_record_count() == count );
+    CHECK( db.get_live_count() == count );
+}
+
+
+
+/**
+ * With reuse_free_slots set, only append() fills deleted slots: a write
+ * at an explicit index, single or batched, lands at that index.
+ */
+static void test_explicit_writes( bool logged ){
+    ScratchDB scratch{ logged ? "compaction_explicit_logged" : "compaction_explicit" };
+    CampsiteDBOptions options;
+    options.reuse_free_slots = true;
+    options.write_ahead_log  = logged;
+    {
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 0; i < 5; i++ )
+            db.append( site(i) );
+        db.erase_at_index( 1 );
+        db.erase_at_index( 3 );
+
+        db.write_at_index( 5, site(55) );
+        CHECK( db.get_record_count() == 6 );
+        CHECK( db.get_at_index(5).get_number() == 55 );
+        CHECK( db.is_deleted(1) );
+
+        db.move_to_index( 6 );
+        db.write_next_sequential( site(66) );
+        CHECK( db.get_record_count() == 7 );
+        CHECK( db.get_at_index(6).get_number() == 66 );
+
+        db.write_batch( { {7, site(77)}, {8, site(88)}, {0, site(100)} } );
+        CHECK( db.get_record_count() == 9 );
+        CHECK( db.get_at_index(7).get_number() == 77 );
+        CHECK( db.get_at_index(8).get_number() == 88 );
+        CHECK( db.is_deleted(1) && db.is_deleted(3) );
+
+        int reused = db.append( site(11) );
+        CHECK( reused == 1 || reused == 3 );
+        CHECK( db.get_live_count() == 8 );
+    }
+
+    CampsiteDB db{ scratch.name(), options };
+    CHECK( db.get_record_count() == 9 );
+    CHECK( db.get_at_index(0).get_number() == 100 );
+    CHECK( db.get_at_index(8).get_number() == 88 );
+    CHECK( db.get_live_count() == 8 );
+}
+
+
+
+int main( ){
+    test_compact();
+    test_explicit_writes( false );
+    test_explicit_writes( true );
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file test_concurrent.cpp
+ *
+ * Concurrent mode: many threads writing, appending and reading batches
+ * at once.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+static Campsite site( int number, int round ){
+    return Campsite{ number, "site " + std::to_string(number) + " round " + std::to_string(round),
+                     number % 2 == 0, static_cast<double>(number) };
+}
+
+
+
+/**
+ * @return  true if every field of the site was written by the same write
+ */
+static bool whole( const Campsite& s ){
+    std::string prefix = "site " + std::to_string(s.get_number()) + " round ";
+    return s.get_description().compare( 0, prefix.size(), prefix ) == 0
+        && s.get_record().rate == s.get_number()
+        && s.has_electric() == ( s.get_number() % 2 == 0 );
+}
+
+
+
+/**
+ * Writers rewrite the first records in place, appenders add more, and
+ * readers fetch random batches meanwhile.  No read sees a record half
+ * written, and at the end every write and append is in the file.
+ */
+static void test_mixed( const std::string& name, CampsiteDBOptions options ){
+    ScratchDB scratch{ "concurrent_" + name };
+    options.concurrent = true;
+    const int initial = 1000, writers = 4, rounds = 5, appenders = 4, appends = 250, readers = 3;
+    CampsiteDB db{ scratch.name(), options };
+    for ( int i = 0; i < initial; i++ )
+        db.append( site(i, 0) );
+
+    std::atomic<int> writing{ writers + appenders };
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < writers; t++ )
+        threads.emplace_back( [&, t]( ){
+            for ( int round = 1; round <= rounds; round++ )
+                for ( int i = t; i < initial; i += writers )
+                    db.write_at_index( i, site(i, round) );
+            writing--;
+        } );
+    for ( int t = 0; t < appenders; t++ )
+        threads.emplace_back( [&, t]( ){
+            for ( int j = 0; j < appends; j++ )
+                CHECK( db.append(site(100000 + t * appends + j, 0)) >= initial );
+            writing--;
+        } );
+    for ( int t = 0; t < readers; t++ )
+        threads.emplace_back( [&, t]( ){
+            std::mt19937 generator( t );
+            do {
+                std::uniform_int_distribution<int> any{ 0, db.get_record_count() - 1 };
+                std::vector<int> indices( 64 );
+                for ( int& index : indices )
+                    index = any( generator );
+                std::vector<Campsite> sites = db.get_many( indices );
+                CHECK( sites.size() == indices.size() );
+                for ( std::size_t i = 0; i < sites.size(); i++ ){
+                    CHECK( whole(sites[i]) );
+                    CHECK( indices[i] >= initial || sites[i].get_number() == indices[i] );
+                }
+            } while ( writing > 0 );
+        } );
+    for ( std::thread& thread : threads )
+        thread.join();
+
+    CHECK( db.get_record_count() == initial + appenders * appends );
+    std::set<int> appended;
+    int index = 0;
+    for ( const Campsite& s : db.get_range(0, db.get_record_count()) ){
+        CHECK( whole(s) );
+        if ( index < initial ){
+            CHECK( s.get_number() == index );
+            CHECK( s.get_description() == site(index, rounds).get_description() );
+        }
+        else{
+            appended.insert( s.get_number() );
+        }
+        index++;
+    }
+    CHECK( appended.size() == static_cast<std::size_t>(appenders * appends) );
+    CHECK( *appended.begin() == 100000 && *appended.rbegin() == 100000 + appenders * appends - 1 );
+}
+
+
+
+int main( ){
+    test_mixed( "plain", CampsiteDBOptions{} );
+
+    CampsiteDBOptions checked;
+    checked.checksums = true;
+    test_mixed( "checksums", checked );
+
+    CampsiteDBOptions logged;
+    logged.write_ahead_log = true;
+    test_mixed( "logged", logged );
+    return 0;
+}
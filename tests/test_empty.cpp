@@ -0,0 +1,90 @@
+/**
+ * @file test_empty.cpp
+ *
+ * Empty batches, empty ranges and empty databases, in each of the ways
+ * a database can be opened.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+
+/**
+ * Operations on nothing do nothing, on an empty database and on one
+ * with records.
+ */
+static void test_empty( const std::string& name, CampsiteDBOptions options ){
+    ScratchDB scratch{ "empty_" + name };
+    options.number_index = true;
+    options.rate_index   = true;
+    options.checksums    = true;
+    CampsiteDB db{ scratch.name(), options };
+
+    CHECK( db.get_record_count() == 0 );
+    CHECK( db.get_many({}).empty() );
+    CHECK( db.get_range(0, 0).empty() );
+    CHECK( db.records().begin() == db.records().end() );
+    CHECK( db.range_by_number(0, 100).empty() );
+    CHECK( db.range_by_rate(0.0, 100.0).empty() );
+    CHECK( db.find(CampsiteQuery{}).empty() );
+    CHECK( db.summarize_rate(CampsiteQuery{}).count == 0 );
+    CHECK( db.verify().empty() );
+    std::ostringstream listing;
+    CHECK( db.export_text(listing) == 0 );
+    db.write_batch( {} );
+    db.compact();
+    CHECK( db.get_record_count() == 0 );
+    CHECK_THROWS( db.get_at_index(0), std::length_error );
+
+    for ( int i = 0; i < 20; i++ )
+        db.append( Campsite{ i, "site", true, 10.0 + i } );
+    CHECK( db.get_many({}).empty() );
+    CHECK( db.get_range(5, 5).empty() );
+    CHECK( db.records(7, 7).begin() == db.records(7, 7).end() );
+    CHECK( db.range_by_rate(500.0, 600.0).empty() );
+    CHECK( db.range_by_number(100, 200).empty() );
+    db.write_batch( {} );
+    CHECK( db.get_record_count() == 20 );
+    CHECK( db.get_many({19, 0}).size() == 2 );
+
+    for ( int i = 0; i < 20; i++ )
+        db.erase_at_index( i );
+    CHECK( db.get_live_count() == 0 );
+    CHECK( db.get_range(0, 20).empty() );
+    CHECK( db.records().begin() == db.records().end() );
+    db.compact();
+    CHECK( db.get_record_count() == 0 );
+    CHECK( db.verify().empty() );
+}
+
+
+
+int main( ){
+    test_empty( "plain", CampsiteDBOptions{} );
+
+    CampsiteDBOptions packed;
+    packed.packed_format = true;
+    test_empty( "packed", packed );
+
+    CampsiteDBOptions cached;
+    cached.cache_pages        = 4;
+    cached.cache_page_records = 8;
+    test_empty( "cached", cached );
+
+    CampsiteDBOptions mapped;
+    mapped.memory_mapped = true;
+    test_empty( "mapped", mapped );
+
+    CampsiteDBOptions concurrent;
+    concurrent.concurrent = true;
+    test_empty( "concurrent", concurrent );
+
+    CampsiteDBOptions logged;
+    logged.write_ahead_log = true;
+    test_empty( "logged", logged );
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file test_export.cpp
+ *
+ * Exporting records as text: the pipe format read back by bulk_load,
+ * CSV quoting, the listing beside operator<<, and a writer whose buffer
+ * fills many times over.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+
+/**
+ * Records with awkward descriptions and rates that only read back
+ * unchanged if they are written exactly.
+ */
+static std::vector<CampsiteRecord> awkward_records( ){
+    std::string longest( CampsiteRecord::desc_size - 1, 'w' );
+    return {
+        CampsiteRecord{ 1, "plain", true, 12.5 },
+        CampsiteRecord{ 2, "", false, 0.1 },
+        CampsiteRecord{ 3, "with, comma", true, 1e-7 },
+        CampsiteRecord{ -4, "say \"hi\"", false, 123456.789 },
+        CampsiteRecord{ 5, "\"", true, 2.0 / 3.0 },
+        CampsiteRecord{ 6, longest.c_str(), false, 99.99 },
+        CampsiteRecord{ 7, "tab\there", true, 0.0 },
+    };
+}
+
+
+
+static bool same( const CampsiteRecord& a, const CampsiteRecord& b ){
+    return a.number == b.number && std::strcmp( a.description, b.description ) == 0
+        && a.has_electric == b.has_electric && a.rate == b.rate;
+}
+
+
+
+static std::string formatted( const CampsiteRecord& record, TextFormat format ){
+    char line[TextWriter::max_record_bytes];
+    return std::string( line, format_record(record, format, line) );
+}
+
+
+
+/**
+ * Reads one line of the CSV export back into a record.
+ */
+static CampsiteRecord parse_csv( const std::string& line ){
+    std::vector<std::string> fields( 1 );
+    bool quoted = false;
+    for ( std::size_t i = 0; i < line.size(); i++ ){
+        char c = line[i];
+        if ( quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"' )
+            fields.back() += line[++i];
+        else if ( c == '"' )
+            quoted = !quoted;
+        else if ( c == ',' && !quoted )
+            fields.emplace_back();
+        else
+            fields.back() += c;
+    }
+    CHECK( !quoted );
+    CHECK( fields.size() == 4 );
+    CHECK( fields[2] == "true" || fields[2] == "false" );
+    return CampsiteRecord{ std::stoi(fields[0]), fields[1].c_str(), fields[2] == "true", std::stod(fields[3]) };
+}
+
+
+
+/**
+ * Quoting is left off fields that do not need it, and quotes inside a
+ * quoted field are doubled; '|' means nothing to CSV.
+ */
+static void test_csv( ){
+    CHECK( formatted(CampsiteRecord{ 1, "plain", true, 12.5 }, TextFormat::csv) == "1,plain,true,12.5\n" );
+    CHECK( formatted(CampsiteRecord{ 2, "a|b", false, 3 }, TextFormat::csv) == "2,a|b,false,3\n" );
+    CHECK( formatted(CampsiteRecord{ 3, "with, comma", true, 1 }, TextFormat::csv) == "3,\"with, comma\",true,1\n" );
+    CHECK( formatted(CampsiteRecord{ 4, "say \"hi\"", false, 2 }, TextFormat::csv) == "4,\"say \"\"hi\"\"\",false,2\n" );
+    CHECK( formatted(CampsiteRecord{ 5, "", true, 0.25 }, TextFormat::csv) == "5,,true,0.25\n" );
+
+    std::vector<CampsiteRecord> records = awkward_records();
+    records.push_back( CampsiteRecord{ 8, "a|b, \"c\"", false, 7.0 } );
+    for ( const CampsiteRecord& record : records ){
+        std::string line = formatted( record, TextFormat::csv );
+        CHECK( line.back() == '\n' );
+        CHECK( same(parse_csv(line.substr(0, line.size() - 1)), record) );
+    }
+}
+
+
+
+/**
+ * The listing format matches operator<<.
+ */
+static void test_listing( ){
+    for ( const CampsiteRecord& record : awkward_records() ){
+        std::ostringstream expected;
+        expected << record << '\n';
+        CHECK( formatted(record, TextFormat::listing) == expected.str() );
+    }
+}
+
+
+
+/**
+ * What export_text writes in the pipe format, to a stream or to a
+ * descriptor, bulk_load reads back as the same records.  Deleted
+ * records are left out.
+ */
+static void test_pipe_round_trip( ){
+    ScratchDB from_scratch{"export_from"};
+    ScratchDB to_scratch{"export_to"};
+    const std::string text = "export_round_trip.txt";
+    const std::string text_fd = "export_round_trip_fd.txt";
+    std::vector<CampsiteRecord> records = awkward_records();
+    for ( int i = 0; i < 300; i++ )
+        records.push_back( CampsiteRecord{ 100 + i, ("site " + std::to_string(i)).c_str(), i % 3 == 0, i * 1.1 } );
+
+    CampsiteDB from{ from_scratch.name() };
+    for ( const CampsiteRecord& record : records )
+        from.append( Campsite{record} );
+    from.erase_at_index( 1 );
+    records.erase( records.begin() + 1 );
+    {
+        std::ofstream out{ text };
+        CHECK( from.export_text(out, TextFormat::pipe) == records.size() );
+    }
+    int fd = ::open( text_fd.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    CHECK( fd >= 0 );
+    CHECK( from.export_text(fd, TextFormat::pipe) == records.size() );
+    ::close( fd );
+
+    std::ifstream a{ text }, b{ text_fd };
+    std::stringstream a_text, b_text;
+    a_text << a.rdbuf();
+    b_text << b.rdbuf();
+    CHECK( a_text.str() == b_text.str() );
+
+    CampsiteDB to{ to_scratch.name() };
+    BulkLoadReport report = to.bulk_load( text );
+    CHECK( report.error_count == 0 );
+    CHECK( report.records == records.size() );
+    CHECK( to.get_record_count() == static_cast<int>(records.size()) );
+    for ( std::size_t i = 0; i < records.size(); i++ )
+        CHECK( same(to.get_at_index(static_cast<int>(i)).get_record(), records[i]) );
+
+    std::remove( text.c_str() );
+    std::remove( text_fd.c_str() );
+}
+
+
+
+/**
+ * A writer with a small buffer writes the same text as the lines
+ * formatted one by one, and counts every record.
+ */
+static void test_small_buffer( ){
+    std::ostringstream out;
+    std::string expected;
+    {
+        TextWriter writer{ out, TextFormat::csv, 0 };
+        for ( int i = 0; i < 500; i++ ){
+            CampsiteRecord record{ i, i % 7 == 0 ? "quote \" and, comma" : "site", i % 2 == 0, i / 8.0 };
+            writer.write( record );
+            expected += formatted( record, TextFormat::csv );
+        }
+        CHECK( writer.records() == 500 );
+    }
+    CHECK( out.str() == expected );
+}
+
+
+
+int main( ){
+    test_csv();
+    test_listing();
+    test_pipe_round_trip();
+    test_small_buffer();
+    return 0;
+}
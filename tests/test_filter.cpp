@@ -0,0 +1,124 @@
+/**
+ * @file test_filter.cpp
+ *
+ * filter_records, vectorised or not, picks exactly the records that
+ * matches() accepts one at a time, whatever the block length.
+ */
+#include "../CampsiteQuery.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+
+
+/**
+ * Records whose fields sit on and around the query bounds, with odd
+ * rates among them, and whose padding is not zeroed, as it need not be
+ * in a block read from a file.
+ */
+static std::vector<CampsiteRecord> awkward_records( int count ){
+    const double rates[] = { 0.0, -0.0, 10.0, 10.5, 20.0, -5.0, 1e300,
+                             std::numeric_limits<double>::quiet_NaN(),
+                             std::numeric_limits<double>::infinity(),
+                             -std::numeric_limits<double>::infinity() };
+    const int numbers[] = { 0, 1, -1, 99, 100, 101, std::numeric_limits<int>::min(), std::numeric_limits<int>::max() };
+    std::mt19937 generator{ 2024 };
+    std::vector<CampsiteRecord> records( count );
+    for ( CampsiteRecord& record : records ){
+        std::memset( static_cast<void*>(&record), 0xA5, sizeof(CampsiteRecord) );
+        record.number = generator() % 3 == 0 ? numbers[generator() % 8] : static_cast<int>( generator() % 300 ) - 50;
+        std::string description = generator() % 4 == 0 ? "lake view" : "forest";
+        std::strncpy( record.description, description.c_str(), CampsiteRecord::desc_size );
+        record.has_electric = generator() % 2 == 0;
+        record.rate = generator() % 3 == 0 ? rates[generator() % 10] : ( generator() % 400 ) / 10.0 - 5.0;
+    }
+    return records;
+}
+
+
+
+/**
+ * Queries exercising each predicate alone and together, with bounds
+ * that land exactly on stored values and bounds that match nothing.
+ */
+static std::vector<CampsiteQuery> queries( ){
+    std::vector<CampsiteQuery> all( 1 );  //matches everything but NaN rates
+    CampsiteQuery q;
+    q.number_min = 0;
+    q.number_max = 100;
+    all.push_back( q );
+    q = CampsiteQuery{};
+    q.number_min = std::numeric_limits<int>::min();
+    q.number_max = -1;
+    all.push_back( q );
+    q = CampsiteQuery{};
+    q.rate_min = 10.0;
+    q.rate_max = 20.0;
+    all.push_back( q );
+    q = CampsiteQuery{};
+    q.rate_min = -0.0;
+    q.rate_max = 0.0;
+    all.push_back( q );
+    q = CampsiteQuery{};
+    q.rate_min = std::numeric_limits<double>::quiet_NaN();
+    all.push_back( q );
+    q = CampsiteQuery{};
+    q.rate_min = std::numeric_limits<double>::infinity();
+    all.push_back( q );
+    for ( int electric : { 0, 1 } ){
+        q = CampsiteQuery{};
+        q.electric = electric;
+        all.push_back( q );
+        q.number_min = 1;
+        q.number_max = 99;
+        q.rate_max = 10.5;
+        all.push_back( q );
+        q.description_contains = "lake";
+        all.push_back( q );
+    }
+    q = CampsiteQuery{};
+    q.number_min = 200;
+    q.number_max = 100;
+    all.push_back( q );
+    return all;
+}
+
+
+
+/**
+ * Compares filter_records over records [first, first + count) with
+ * matches() on each record.
+ */
+static void check_block( const CampsiteQuery& query, const std::vector<CampsiteRecord>& records,
+                         int first, int count ){
+    std::vector<int> expected;
+    for ( int i = 0; i < count; i++ )
+        if ( matches(query, records[first + i]) )
+            expected.push_back( i );
+
+    std::vector<int> found( count + 1, -1 );
+    int n = filter_records( query, records.data() + first, count, found.data() );
+    CHECK( n == static_cast<int>(expected.size()) );
+    for ( int i = 0; i < n; i++ )
+        CHECK( found[i] == expected[i] );
+}
+
+
+
+int main( ){
+    std::vector<CampsiteRecord> records = awkward_records( 1024 );
+    for ( const CampsiteQuery& query : queries() ){
+        //a length that is not a whole number of vectors, from aligned and unaligned starts
+        check_block( query, records, 0, 1003 );
+        check_block( query, records, 3, 1003 );
+        //every tail length, and blocks shorter than one vector
+        for ( int count = 0; count <= 17; count++ )
+            check_block( query, records, 5, count );
+    }
+    return 0;
+}
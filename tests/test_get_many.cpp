@@ -0,0 +1,134 @@
+/**
+ * @file test_get_many.cpp
+ *
+ * Batched reads: io_uring and the pread pool fill the same bytes, and
+ * get_many and get_many_async return the same records either way.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <cstring>
+#include <future>
+#include <random>
+#include <string>
+#include <vector>
+
+
+
+static const int total = 5000;
+
+static Campsite site( int number ){
+    return Campsite{ number, "site " + std::to_string(number), number % 2 == 0, 10.0 + number };
+}
+
+
+
+/**
+ * Indices to ask for: scattered, repeated, and not in order.
+ */
+static std::vector<int> wanted( std::uint32_t seed, int count ){
+    std::mt19937 generator{ seed };
+    std::vector<int> indices;
+    for ( int i = 0; i < count; i++ ){
+        int index = static_cast<int>( generator() % total );
+        indices.push_back( index % 10 == 3 ? index + 1 : index );  //never a deleted slot
+    }
+    indices.push_back( indices.front() );
+    return indices;
+}
+
+
+
+/**
+ * The same ranges read through a ring and through the pool come back
+ * byte for byte the same, however many more there are than the ring
+ * holds at once.
+ */
+static void test_reader( const std::string& filename ){
+    AsyncReader ring{ filename, true, 8 };
+    AsyncReader pool{ filename, false };
+    CHECK( !pool.uses_io_uring() );
+
+    const std::size_t length = sizeof(CampsiteRecord);
+    std::vector<int> indices = wanted( 7, 700 );
+    std::vector<char> from_ring( indices.size() * length, 0 ), from_pool( indices.size() * length, 1 );
+    std::vector<ReadRequest> ring_requests, pool_requests;
+    for ( std::size_t i = 0; i < indices.size(); i++ ){
+        std::uint64_t offset = sizeof(CampsiteFileHeader) + static_cast<std::uint64_t>( indices[i] ) * length;
+        ring_requests.push_back( ReadRequest{ offset, length, from_ring.data() + i * length } );
+        pool_requests.push_back( ReadRequest{ offset, length, from_pool.data() + i * length } );
+    }
+    ring.read( ring_requests );
+    pool.read( pool_requests );
+    CHECK( from_ring == from_pool );
+    for ( std::size_t i = 0; i < indices.size(); i++ ){
+        CampsiteRecord record;
+        std::memcpy( static_cast<void*>(&record), from_ring.data() + i * length, length );
+        CHECK( record.number == indices[i] );
+    }
+}
+
+
+
+/**
+ * get_many and many get_many_async calls in flight at once return the
+ * records get_at_index does, and their errors arrive through the future.
+ */
+static std::vector<std::vector<int>> test_database( const std::string& filename, CampsiteDBOptions options ){
+    CampsiteDB db{ filename, options };
+    std::vector<std::vector<int>> numbers;
+
+    std::vector<int> indices = wanted( 11, 2000 );
+    std::vector<Campsite> records = db.get_many( indices );
+    CHECK( records.size() == indices.size() );
+    numbers.emplace_back();
+    for ( std::size_t i = 0; i < indices.size(); i++ ){
+        CHECK( records[i].get_number() == db.get_at_index(indices[i]).get_number() );
+        numbers.back().push_back( records[i].get_number() );
+    }
+
+    std::vector<std::future<std::vector<Campsite>>> pending;
+    for ( int call = 0; call < 40; call++ )
+        pending.push_back( db.get_many_async(wanted(100 + call, 50 + call)) );
+    for ( int call = 0; call < 40; call++ ){
+        std::vector<int> asked = wanted( 100 + call, 50 + call );
+        std::vector<Campsite> got = pending[call].get();
+        CHECK( got.size() == asked.size() );
+        numbers.emplace_back();
+        for ( std::size_t i = 0; i < asked.size(); i++ ){
+            CHECK( got[i].get_number() == asked[i] );
+            numbers.back().push_back( got[i].get_number() );
+        }
+    }
+
+    CHECK_THROWS( db.get_many_async({ 1, total }).get(), std::length_error );
+    CHECK_THROWS( db.get_many_async({ 1, 3 }).get(), std::out_of_range );
+
+    //calls still queued when the database closes are finished first
+    for ( int call = 0; call < 20; call++ )
+        db.get_many_async( wanted(200 + call, 500) );
+    return numbers;
+}
+
+
+
+int main( ){
+    ScratchDB scratch{"get_many"};
+    {
+        CampsiteDB db{ scratch.name() };
+        for ( int i = 0; i < total; i++ )
+            db.append( site(i) );
+        for ( int i = 3; i < total; i += 10 )
+            db.erase_at_index( i );
+    }
+    test_reader( scratch.name() );
+
+    CampsiteDBOptions ring, pool;
+    pool.io_uring = false;
+    CHECK( test_database(scratch.name(), ring) == test_database(scratch.name(), pool) );
+
+    ring.concurrent = true;
+    pool.concurrent = true;
+    CHECK( test_database(scratch.name(), ring) == test_database(scratch.name(), pool) );
+    return 0;
+}
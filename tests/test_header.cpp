@@ -0,0 +1,73 @@
+/**
+ * @file test_header.cpp
+ *
+ * The record count kept in the file header, across reopens and after
+ * a crash left it behind the records in the file.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <string>
+
+
+
+static Campsite site( int number ){
+    return Campsite{ number, "site " + std::to_string(number), number % 2 == 0, 10.0 + number };
+}
+
+
+
+/**
+ * The count survives a clean close, and bounds follow it.
+ */
+static void test_reopen( ){
+    ScratchDB scratch{"header_reopen"};
+    {
+        CampsiteDB db{ scratch.name() };
+        for ( int i = 0; i < 10; i++ )
+            db.write_next_sequential( site(i) );
+    }
+
+    CampsiteDB db{ scratch.name() };
+    CHECK( db.get_record_count() == 10 );
+    CHECK( db.bounds_check(9) );
+    CHECK( !db.bounds_check(10) );
+    CHECK( db.bounds_check(10, true) );
+    CHECK( db.get_at_index(9).get_number() == 9 );
+}
+
+
+
+/**
+ * Appends that reached the file but not its header are found again
+ * on reopen, even without a write-ahead log.
+ */
+static void test_header_behind( ){
+    ScratchDB scratch{"header_behind"};
+    {
+        CampsiteDB db{ scratch.name() };
+        for ( int i = 0; i < 10; i++ )
+            db.write_next_sequential( site(i) );
+    }
+    crash_after( [&scratch]( ){
+        CampsiteDBOptions options;
+        options.concurrent = true;
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 10; i < 15; i++ )
+            db.write_next_sequential( site(i) );
+    } );
+
+    CampsiteDB db{ scratch.name() };
+    CHECK( db.get_record_count() == 15 );
+    CHECK( db.get_at_index(14).get_number() == 14 );
+    db.append( site(15) );
+    CHECK( db.get_at_index(15).get_number() == 15 );
+}
+
+
+
+int main( ){
+    test_reopen();
+    test_header_behind();
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file test_indexes.cpp
+ *
+ * The number, keyword and rate indexes across reopens, including a
+ * reopen without them in between.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <stdexcept>
+
+
+
+static CampsiteDBOptions indexed( ){
+    CampsiteDBOptions options;
+    options.number_index  = true;
+    options.keyword_index = true;
+    options.rate_index    = true;
+    return options;
+}
+
+
+
+/**
+ * Indexes written in one session answer queries in the next.
+ */
+static void test_reopen( bool packed ){
+    ScratchDB scratch{ packed ? "indexes_reopen_packed" : "indexes_reopen" };
+    CampsiteDBOptions options = indexed();
+    options.packed_format = packed;
+    {
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 0; i < 50; i++ )
+            db.append( Campsite{ i, i % 5 == 0 ? "lakeside cabin" : "tent pad", i % 2 == 0, 10.0 + i } );
+        db.erase_at_index( 10 );
+    }
+
+    CampsiteDB db{ scratch.name(), options };
+    CHECK( db.get_by_number(42).get_number() == 42 );
+    CHECK_THROWS( db.get_by_number(10), std::exception );
+    CHECK( db.range_by_number(20, 29).size() == 10 );
+    CHECK( db.search_all("lakeside cabin").size() == 9 );
+    CHECK( db.search_prefix("lake").size() == 9 );
+    CHECK( db.range_by_rate(50.0, 59.0).size() == 10 );
+    CHECK( db.range_by_rate(50.0, 59.0, 1).size() == 5 );
+}
+
+
+
+/**
+ * Writes made while the database was open without its indexes are
+ * picked up the next time the indexes are asked for, even when the
+ * record count did not change.
+ */
+static void test_skipped_indexes( ){
+    ScratchDB scratch{"indexes_skipped"};
+    {
+        CampsiteDB db{ scratch.name(), indexed() };
+        for ( int i = 0; i < 10; i++ )
+            db.write_next_sequential( Campsite{ i, "lake view", true, 10.0 + i } );
+    }
+    {
+        CampsiteDB db{ scratch.name() };
+        db.write_at_index( 3, Campsite{ 333, "cabin riverfront", true, 99.0 } );
+    }
+
+    CampsiteDB db{ scratch.name(), indexed() };
+    CHECK( db.get_by_number(333).get_number() == 333 );
+    CHECK_THROWS( db.get_by_number(3), std::exception );
+    CHECK( db.search_all("cabin").size() == 1 );
+    CHECK( db.search_all("lake").size() == 9 );
+    CHECK( db.range_by_rate(98.0, 100.0).size() == 1 );
+    CHECK( db.range_by_rate(13.0, 13.0).empty() );
+}
+
+
+
+int main( ){
+    test_reopen( false );
+    test_reopen( true );
+    test_skipped_indexes();
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file test_range.cpp
+ *
+ * Iterating a database with records(): block boundaries, deleted
+ * slots, sub-ranges and the standard algorithms.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+
+/**
+ * Every live record is visited once, in index order, whatever the
+ * block size.
+ */
+static void test_range( const std::string& name, CampsiteDBOptions options ){
+    ScratchDB scratch{ "range_" + name };
+    CampsiteDB db{ scratch.name(), options };
+    const int count = 1000;
+    for ( int i = 0; i < count; i++ )
+        db.append( Campsite{ i, "site " + std::to_string(i), i % 2 == 0, 10.0 + i } );
+    for ( int i = 0; i < count; i += 7 )
+        db.erase_at_index( i );
+    db.erase_at_index( count - 1 );
+
+    for ( int chunk : { 1, 3, 64, CampsiteDB::default_chunk_records } ){
+        std::vector<int> expected;
+        for ( int i = 100; i < 900; i++ )
+            if ( i % 7 != 0 )
+                expected.push_back( i );
+
+        std::vector<int> seen;
+        CampsiteRange range = db.records( 100, 900, chunk );
+        for ( CampsiteRange::iterator it = range.begin(); it != range.end(); ++it ){
+            CHECK( it.index() == it->number );
+            seen.push_back( it->number );
+        }
+        CHECK( seen == expected );
+    }
+
+    int live = 0;
+    int last = -1;
+    for ( const CampsiteRecord& record : db.records() ){
+        CHECK( record.number > last );
+        CHECK( std::string{record.description} == "site " + std::to_string(record.number) );
+        last = record.number;
+        live++;
+    }
+    CHECK( live == db.get_live_count() );
+    CHECK( last == count - 2 );
+
+    CampsiteRange all = db.records();
+    CHECK( std::count_if(all.begin(), all.end(), []( const CampsiteRecord& r ){ return r.has_electric; })
+           == std::count_if(all.begin(), all.end(), []( const CampsiteRecord& r ){ return r.number % 2 == 0; }) );
+    CampsiteRange::iterator it = db.records( 0, 10 ).begin();
+    CHECK( (*it++).number == 1 );
+    CHECK( it->number == 2 );
+    CHECK( std::distance(db.records(0, 15).begin(), db.records(0, 15).end()) == 12 );
+    CHECK_THROWS( db.records(10, count + 1), std::length_error );
+}
+
+
+
+int main( ){
+    test_range( "plain", CampsiteDBOptions{} );
+
+    CampsiteDBOptions packed;
+    packed.packed_format = true;
+    test_range( "packed", packed );
+
+    CampsiteDBOptions cached;
+    cached.cache_pages        = 4;
+    cached.cache_page_records = 16;
+    test_range( "cached", cached );
+
+    CampsiteDBOptions mapped;
+    mapped.memory_mapped = true;
+    test_range( "mapped", mapped );
+
+    CampsiteDBOptions concurrent;
+    concurrent.concurrent = true;
+    test_range( "concurrent", concurrent );
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file test_record.cpp
+ *
+ * Building a CampsiteRecord from its fields.
+ */
+#include "../CampsiteRecord.h"
+#include "TestCheck.h"
+
+#include <cstring>
+#include <string>
+
+
+
+/**
+ * Descriptions that fit are copied whole, and the rest of the field
+ * stays zeroed.
+ */
+static void test_short_description( ){
+    CampsiteRecord record{ 7, "lakeside", true, 25.5 };
+    CHECK( record.number == 7 );
+    CHECK( std::string{record.description} == "lakeside" );
+    CHECK( record.has_electric );
+    CHECK( record.rate == 25.5 );
+    for ( int i = 8; i < CampsiteRecord::desc_size; i++ )
+        CHECK( record.description[i] == '\0' );
+}
+
+
+
+/**
+ * Descriptions too long for the field are cut to fit with their
+ * terminator, leaving the fields after it alone.
+ */
+static void test_long_description( ){
+    std::string text( 3 * CampsiteRecord::desc_size, 'x' );
+    CampsiteRecord record{ 9, text.c_str(), false, 12.0 };
+    CHECK( std::strlen(record.description) == CampsiteRecord::desc_size - 1 );
+    CHECK( record.number == 9 );
+    CHECK( !record.has_electric );
+    CHECK( record.rate == 12.0 );
+
+    std::string exact( CampsiteRecord::desc_size, 'y' );
+    CampsiteRecord full{ 1, exact.c_str(), true, 1.0 };
+    CHECK( std::strlen(full.description) == CampsiteRecord::desc_size - 1 );
+    CHECK( full.has_electric );
+}
+
+
+
+int main( ){
+    test_short_description();
+    test_long_description();
+    return 0;
+}
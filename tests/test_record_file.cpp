@@ -0,0 +1,169 @@
+/**
+ * @file test_record_file.cpp
+ *
+ * RecordFile over a record type other than CampsiteRecord: reads and
+ * writes, the count found again after a crash, and files of another
+ * type turned away.
+ */
+#include "../CampsiteDB.h"
+#include "../RecordFile.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+
+
+/**
+ * A sensor reading, the second record type.
+ */
+struct Reading {
+    static constexpr std::uint32_t record_type = 100;
+
+    std::int64_t time;
+    double       value;
+};
+
+/**
+ * The same size as a Reading, but a different type.
+ */
+struct Position {
+    static constexpr std::uint32_t record_type = 101;
+
+    double latitude;
+    double longitude;
+};
+
+
+
+static Reading reading( int i ){
+    return Reading{ 1000 + i, 0.5 * i };
+}
+
+
+
+/**
+ * Records written survive a reopen, and every way of reading them
+ * agrees.
+ */
+static void test_round_trip( ){
+    ScratchDB scratch{"record_file_round_trip"};
+    {
+        RecordFile<Reading> file{ scratch.name() };
+        CHECK( file.get_record_count() == 0 );
+        for ( int i = 0; i < 90; i++ )
+            file.append( reading(i) );
+        std::vector<Reading> more;
+        for ( int i = 90; i < 100; i++ )
+            more.push_back( reading(i) );
+        CHECK( file.append(more.data(), 10) == 90 );
+        file.write_at_index( 100, reading(100) );
+        file.write_at_index( 3, Reading{ 7, 7.5 } );
+        file.swap_records( 0, 1 );
+    }
+
+    RecordFile<Reading> file{ scratch.name() };
+    CHECK( !file.recovered() );
+    CHECK( file.get_record_count() == 101 );
+    CHECK( file.get_at_index(0).time == 1001 );
+    CHECK( file.get_at_index(1).time == 1000 );
+    CHECK( file.get_at_index(3).value == 7.5 );
+    CHECK( file.get_at_index(100).time == 1100 );
+    CHECK_THROWS( file.get_at_index(101), std::length_error );
+
+    std::vector<Reading> range = file.get_range( 10, 60 );
+    CHECK( range.size() == 50 );
+    for ( int i = 0; i < 50; i++ )
+        CHECK( range[i].time == 1010 + i );
+
+    int seen = 0;
+    file.for_each_block( 0, 101, [&seen, &file]( int first_index, const Reading* records, int count ){
+        CHECK( first_index == seen );
+        CHECK( count <= 8 );
+        for ( int i = 0; i < count; i++ )
+            CHECK( records[i].time == file.get_at_index(first_index + i).time );
+        seen += count;
+    }, 8 );
+    CHECK( seen == 101 );
+}
+
+
+
+/**
+ * Appends that reached the file but not its header are found again,
+ * and a truncated file keeps only the records still in it.
+ */
+static void test_recovery( ){
+    ScratchDB scratch{"record_file_recovery"};
+    {
+        RecordFile<Reading> file{ scratch.name() };
+        for ( int i = 0; i < 10; i++ )
+            file.append( reading(i) );
+    }
+    crash_after( [&scratch]( ){
+        RecordFile<Reading> file{ scratch.name() };
+        for ( int i = 10; i < 25; i++ )
+            file.append( reading(i) );
+        _exit( 0 );  //before the destructor stores the header
+    } );
+
+    {
+        RecordFile<Reading> file{ scratch.name() };
+        CHECK( file.recovered() );
+        CHECK( file.get_record_count() == 25 );
+        CHECK( file.get_at_index(24).time == 1024 );
+    }
+    {
+        RecordFile<Reading> file{ scratch.name() };
+        CHECK( !file.recovered() );
+        CHECK( file.get_record_count() == 25 );
+    }
+
+    //cut the last record in half
+    off_t size = sizeof(CampsiteFileHeader) + 24 * sizeof(Reading) + sizeof(Reading) / 2;
+    CHECK( truncate(scratch.name().c_str(), size) == 0 );
+    RecordFile<Reading> file{ scratch.name() };
+    CHECK( !file.recovered() );
+    CHECK( file.get_record_count() == 24 );
+    CHECK( file.append(reading(99)) == 24 );
+    CHECK( file.get_at_index(24).time == 1099 );
+}
+
+
+
+/**
+ * A file of one record type does not open as another, even one of the
+ * same size, and a CampsiteDB file opens only as CampsiteRecord.
+ */
+static void test_wrong_type( ){
+    ScratchDB readings{"record_file_readings"};
+    {
+        RecordFile<Reading> file{ readings.name() };
+        file.append( reading(1) );
+    }
+    CHECK_THROWS( RecordFile<Position>{ readings.name() }, std::runtime_error );
+    CHECK_THROWS( RecordFile<CampsiteRecord>{ readings.name() }, std::runtime_error );
+    CHECK_THROWS( CampsiteDB{ readings.name() }, std::runtime_error );
+
+    ScratchDB sites{"record_file_sites"};
+    {
+        CampsiteDB db{ sites.name() };
+        db.append( Campsite{ 4, "meadow", true, 20.0 } );
+    }
+    CHECK_THROWS( RecordFile<Reading>{ sites.name() }, std::runtime_error );
+    RecordFile<CampsiteRecord> file{ sites.name() };
+    CHECK( file.get_record_count() == 1 );
+    CHECK( file.get_at_index(0).number == 4 );
+}
+
+
+
+int main( ){
+    test_round_trip();
+    test_recovery();
+    test_wrong_type();
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file test_sample.cpp
+ *
+ * Random samples: only live records, none twice without replacement,
+ * the same sample for the same seed, and the errors for samples that
+ * cannot be drawn.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <string>
+#include <vector>
+
+
+
+/**
+ * Checks that every sampled record is a live one and returns how many
+ * times each site number was drawn.
+ */
+static std::vector<int> tally( const std::vector<Campsite>& sample, int total ){
+    std::vector<int> drawn( total );
+    for ( const Campsite& site : sample ){
+        int number = site.get_number();
+        CHECK( number >= 0 && number < total );
+        CHECK( number % 7 != 0 );  //deleted
+        CHECK( site.get_description() == "site " + std::to_string(number) );
+        drawn[number]++;
+    }
+    return drawn;
+}
+
+
+
+static void test_sample( const std::string& name, CampsiteDBOptions options ){
+    ScratchDB scratch{ "sample_" + name };
+    CampsiteDB db{ scratch.name(), options };
+    CHECK_THROWS( db.get_random_sample(1), std::length_error );
+    CHECK( db.get_random_sample(0).empty() );
+
+    const int total = 1000;
+    for ( int i = 0; i < total; i++ )
+        db.append( Campsite{ i, "site " + std::to_string(i), i % 2 == 0, 10.0 + i } );
+    for ( int i = 0; i < total; i += 7 )
+        db.erase_at_index( i );
+    const int live = db.get_live_count();
+
+    //without replacement: never the same record twice, up to every live one
+    for ( int k : { 1, 50, 500, live } ){
+        std::vector<int> drawn = tally( db.get_random_sample(k, false), total );
+        int distinct = 0;
+        for ( int times : drawn ){
+            CHECK( times <= 1 );
+            distinct += times;
+        }
+        CHECK( distinct == k );
+    }
+    CHECK_THROWS( db.get_random_sample(live + 1, false), std::invalid_argument );
+
+    //with replacement: repeats, and every live record about as likely
+    std::vector<int> drawn = tally( db.get_random_sample(100 * live, true, 17), total );
+    for ( int number = 0; number < total; number++ )
+        if ( number % 7 != 0 )
+            CHECK( drawn[number] > 50 && drawn[number] < 150 );
+
+    //a seed gives the same sample in the same order; another seed does not
+    std::vector<Campsite> first = db.get_random_sample( 200, false, 42 );
+    std::vector<Campsite> again = db.get_random_sample( 200, false, 42 );
+    std::vector<Campsite> other = db.get_random_sample( 200, false, 43 );
+    bool differs = false;
+    for ( int i = 0; i < 200; i++ ){
+        CHECK( first[i].get_number() == again[i].get_number() );
+        differs = differs || first[i].get_number() != other[i].get_number();
+    }
+    CHECK( differs );
+}
+
+
+
+int main( ){
+    test_sample( "plain", CampsiteDBOptions{} );
+
+    CampsiteDBOptions packed;
+    packed.packed_format = true;
+    test_sample( "packed", packed );
+
+    CampsiteDBOptions concurrent;
+    concurrent.concurrent = true;
+    test_sample( "concurrent", concurrent );
+    return 0;
+}
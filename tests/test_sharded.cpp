@@ -0,0 +1,146 @@
+/**
+ * @file test_sharded.cpp
+ *
+ * Global indices over sharded files: where each record lands under
+ * both policies, reads and scans that cross shards, and the same
+ * answers after the shards are reopened.
+ */
+#include "../ShardedCampsiteDB.h"
+#include "TestCheck.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+
+static Campsite site( int number ){
+    return Campsite{ number, "site " + std::to_string(number), number % 2 == 0, 10.0 + number };
+}
+
+
+
+/**
+ * Scratch files for one database's shards.
+ */
+struct ScratchShards {
+    ScratchShards( const std::string& name, int shards ){
+        for ( int s = 0; s < shards; s++ ){
+            scratch.emplace_back( new ScratchDB{ name + "_" + std::to_string(s) } );
+            files.push_back( scratch.back()->name() );
+        }
+    }
+
+    std::vector<std::unique_ptr<ScratchDB>> scratch;
+    std::vector<std::string>                files;
+};
+
+
+
+/**
+ * Under index_range, global index g is in stripe g / stripe_records,
+ * which is in shard stripe % N, and stays there across a reopen.
+ */
+static void test_index_range( ){
+    const int shards = 3, stripe = 4, total = 50;
+    ScratchShards files{ "sharded_range", shards };
+    {
+        ShardedCampsiteDB db{ files.files, ShardPolicy::index_range, CampsiteDBOptions{}, stripe };
+        for ( int g = 0; g < total; g++ )
+            CHECK( db.append(site(g)) == g );
+        db.erase_at_index( 13 );
+        db.write_at_index( 21, site(1021) );
+    }
+
+    //each shard file holds its stripes back to back
+    for ( int s = 0; s < shards; s++ ){
+        CampsiteDB shard{ files.files[s] };
+        int local = 0;
+        for ( int g = 0; g < total; g++ ){
+            if ( g / stripe % shards != s )
+                continue;
+            if ( g != 13 )
+                CHECK( shard.get_at_index(local).get_number() == ( g == 21 ? 1021 : g ) );
+            local++;
+        }
+        CHECK( shard.get_record_count() == local );
+    }
+
+    ShardedCampsiteDB db{ files.files, ShardPolicy::index_range, CampsiteDBOptions{}, stripe };
+    CHECK( db.get_record_count() == total );
+    CHECK( db.get_live_count() == total - 1 );
+    CHECK( db.is_deleted(13) );
+    for ( int g = 0; g < total; g++ )
+        if ( g != 13 )
+            CHECK( db.get_at_index(g).get_number() == ( g == 21 ? 1021 : g ) );
+    CHECK_THROWS( db.get_at_index(total), std::length_error );
+
+    std::vector<Campsite> range = db.get_range( 2, 31 );
+    CHECK( range.size() == 28 );  //the deleted record is left out
+    for ( int g = 2, i = 0; g < 31; g++ )
+        if ( g != 13 )
+            CHECK( range[i++].get_number() == ( g == 21 ? 1021 : g ) );
+
+    CampsiteQuery even;
+    even.electric = 1;
+    even.number_max = 40;
+    std::vector<int> found = db.find_indices( even );
+    CHECK( found.size() == 21 );
+    for ( std::size_t i = 0; i < found.size(); i++ )
+        CHECK( found[i] == 2 * static_cast<int>(i) );
+
+    //appends carry on in stripe order after the reopen
+    CHECK( db.append(site(total)) == total );
+    CHECK( db.get_at_index(total).get_number() == total );
+}
+
+
+
+/**
+ * Under hash_number, a record's shard follows its site number, the
+ * global order is shard by shard, and lookups by number survive a
+ * reopen.
+ */
+static void test_hash_number( ){
+    const int shards = 4, total = 200;
+    ScratchShards files{ "sharded_hash", shards };
+    std::vector<std::vector<int>> numbers( shards );
+    CampsiteDBOptions options;
+    options.number_index = true;
+    {
+        ShardedCampsiteDB db{ files.files, ShardPolicy::hash_number, options };
+        for ( int n = 0; n < total; n++ )
+            db.append( site(n * 3) );
+    }
+    for ( int s = 0; s < shards; s++ ){
+        CampsiteDB shard{ files.files[s] };
+        for ( int local = 0; local < shard.get_record_count(); local++ )
+            numbers[s].push_back( shard.get_at_index(local).get_number() );
+        CHECK( !numbers[s].empty() );  //the hash spreads 200 numbers over every shard
+    }
+
+    ShardedCampsiteDB db{ files.files, ShardPolicy::hash_number, options };
+    CHECK( db.get_record_count() == total );
+    for ( int n = 0; n < total; n++ )
+        CHECK( db.get_by_number(n * 3).get_number() == n * 3 );
+
+    //the global order is shard 0's records, then shard 1's, ...
+    int g = 0;
+    for ( int s = 0; s < shards; s++ )
+        for ( int number : numbers[s] )
+            CHECK( db.get_at_index(g++).get_number() == number );
+    CHECK( g == total );
+
+    std::vector<int> found = db.find_indices( CampsiteQuery{} );
+    CHECK( static_cast<int>(found.size()) == total );
+    for ( int i = 0; i < total; i++ )
+        CHECK( found[i] == i );
+}
+
+
+
+int main( ){
+    test_index_range();
+    test_hash_number();
+    return 0;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file test_snapshot.cpp
+ *
+ * A snapshot keeps showing the records as they were when it was taken
+ * while writers overwrite, delete, append and compact the same indices.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+static const int total = 200;
+
+static Campsite site( int index, int version ){
+    return Campsite{ index, "site " + std::to_string(index) + " v" + std::to_string(version),
+                     index % 2 == 0, 1000.0 * version + index };
+}
+
+
+
+/**
+ * Checks every way of reading a snapshot taken over version 0 of the
+ * first total records.
+ */
+static void check_view( CampsiteSnapshot& view ){
+    CHECK( view.get_record_count() == total );
+    for ( int i = 0; i < total; i += 37 ){
+        CampsiteRecord record = view.get_at_index( i ).get_record();
+        CHECK( record.number == i && record.rate == i );
+    }
+
+    std::vector<Campsite> range = view.get_range( 0, total );
+    CHECK( range.size() == static_cast<std::size_t>(total) );
+    for ( int i = 0; i < total; i++ )
+        CHECK( range[i].get_description() == site(i, 0).get_description() );
+
+    int seen = 0;
+    view.for_each_block( 0, total, [&seen]( int first_index, const CampsiteRecord* records, int count ){
+        for ( int i = 0; i < count; i++ )
+            CHECK( records[i].number == first_index + i && records[i].rate == first_index + i );
+        seen += count;
+    }, 16 );
+    CHECK( seen == total );
+
+    CampsiteQuery electric;
+    electric.electric = 1;
+    std::vector<int> found = view.find_indices( electric );
+    CHECK( found.size() == static_cast<std::size_t>(total / 2) );
+    for ( std::size_t i = 0; i < found.size(); i++ )
+        CHECK( found[i] == 2 * static_cast<int>(i) );
+}
+
+
+
+/**
+ * Writes every index a few times over, deletes some, appends more and
+ * compacts, checking the snapshot between each step.
+ */
+static void test_sequential( const std::string& name, CampsiteDBOptions options ){
+    ScratchDB scratch{ "snapshot_" + name };
+    CampsiteDB db{ scratch.name(), options };
+    for ( int i = 0; i < total; i++ )
+        db.append( site(i, 0) );
+
+    CampsiteSnapshot view = db.snapshot();
+    for ( int version = 1; version <= 3; version++ ){
+        for ( int i = 0; i < total; i++ )
+            db.write_at_index( i, Campsite{ i + 5000, "changed", i % 2 != 0, -1.0 * version } );
+        check_view( view );
+    }
+    for ( int i = 0; i < total; i += 3 )
+        db.erase_at_index( i );
+    check_view( view );
+    for ( int i = 0; i < 50; i++ )
+        db.append( site(total + i, 1) );
+    check_view( view );
+    db.compact();
+    check_view( view );
+
+    //a later snapshot sees the later records
+    CampsiteSnapshot later = db.snapshot();
+    int first = db.get_at_index( 0 ).get_number();
+    CHECK( later.get_record_count() == db.get_record_count() );
+    CHECK( later.get_at_index(0).get_number() == first );
+    view.release();
+    db.write_at_index( 0, site(0, 9) );
+    CHECK( db.get_at_index(0).get_number() == 0 );
+    CHECK( later.get_at_index(0).get_number() == first );
+}
+
+
+
+/**
+ * Readers check the snapshot over and over while writers rewrite the
+ * same indices and appenders grow the file.
+ */
+static void test_concurrent( const std::string& name, CampsiteDBOptions options ){
+    ScratchDB scratch{ "snapshot_" + name };
+    options.concurrent = true;
+    CampsiteDB db{ scratch.name(), options };
+    for ( int i = 0; i < total; i++ )
+        db.append( site(i, 0) );
+
+    CampsiteSnapshot view = db.snapshot();
+    std::atomic<int> writing{ 4 };
+    std::vector<std::thread> threads;
+    for ( int w = 0; w < 3; w++ )
+        threads.emplace_back( [&db, &writing, w]( ){
+            for ( int version = 1; version <= 20; version++ )
+                for ( int i = w; i < total; i += 3 )
+                    db.write_at_index( i, site(i, version) );
+            for ( int i = w; i < total; i += 30 )
+                db.erase_at_index( i );
+            writing--;
+        } );
+    threads.emplace_back( [&db, &writing]( ){
+        for ( int i = 0; i < 300; i++ )
+            db.append( site(total + i, 0) );
+        writing--;
+    } );
+    for ( int r = 0; r < 2; r++ )
+        threads.emplace_back( [&view, &writing]( ){
+            do
+                check_view( view );
+            while ( writing > 0 );
+        } );
+    for ( std::thread& thread : threads )
+        thread.join();
+
+    check_view( view );
+    CHECK( db.get_record_count() == total + 300 );
+    CHECK( db.get_at_index(4).get_record().rate == 20004.0 );
+}
+
+
+
+int main( ){
+    test_sequential( "plain", CampsiteDBOptions{} );
+
+    CampsiteDBOptions packed;
+    packed.packed_format = true;
+    test_sequential( "packed", packed );
+
+    CampsiteDBOptions cached;
+    cached.cache_pages        = 4;
+    cached.cache_page_records = 8;
+    test_sequential( "cached", cached );
+
+    CampsiteDBOptions concurrent;
+    concurrent.concurrent = true;
+    test_sequential( "concurrent_sequential", concurrent );
+    test_concurrent( "concurrent", CampsiteDBOptions{} );
+
+    CampsiteDBOptions logged;
+    logged.write_ahead_log = true;
+    test_concurrent( "concurrent_logged", logged );
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file test_sort.cpp
+ *
+ * Sorting a database file larger than the sort's memory budget, in
+ * both formats: the order, the stability, and the deleted records
+ * left behind.
+ */
+#include "../CampsiteDB.h"
+#include "TestCheck.h"
+
+#include <string>
+
+
+
+/**
+ * Sorts by number, which many records share, with a budget of a few
+ * hundred records, so the sort has to merge many runs.  Records that
+ * tie keep their order, which the rate records.
+ */
+static void test_sort( const std::string& name, bool packed ){
+    ScratchDB scratch{ "sort_" + name };
+    const int total = 3000;
+    {
+        CampsiteDBOptions options;
+        options.packed_format = packed;
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 0; i < total; i++ )
+            db.append( Campsite{ (i * 7919) % 50, "site " + std::to_string(i), i % 2 == 0, double(i) } );
+        for ( int i = 0; i < total; i += 10 )
+            db.erase_at_index( i );
+    }
+
+    CampsiteDB::sort_file( scratch.name(), SortKey::number, 64 << 10, 3 );
+
+    CampsiteDBOptions options;
+    options.packed_format = packed;
+    {
+        CampsiteDB db{ scratch.name(), options };
+        CHECK( db.get_record_count() == total - total / 10 );
+        CHECK( db.get_live_count() == db.get_record_count() );
+        CampsiteRecord previous;
+        for ( int index = 0; index < db.get_record_count(); index++ ){
+            CampsiteRecord record = db.get_at_index( index ).get_record();
+            int original = static_cast<int>( record.rate );
+            CHECK( original % 10 != 0 );
+            CHECK( record.number == (original * 7919) % 50 );
+            CHECK( std::string{record.description} == "site " + std::to_string(original) );
+            CHECK( record.has_electric == ( original % 2 == 0 ) );
+            if ( index > 0 ){
+                CHECK( previous.number <= record.number );
+                if ( previous.number == record.number )
+                    CHECK( previous.rate < record.rate );
+            }
+            previous = record;
+        }
+    }
+
+    //a caller's own ordering, through the same merge
+    CampsiteDB::sort_file( scratch.name(),
+        []( const CampsiteRecord& a, const CampsiteRecord& b ){ return a.rate > b.rate; }, 64 << 10, 2 );
+    CampsiteDB resorted{ scratch.name(), options };
+    for ( int index = 1; index < resorted.get_record_count(); index++ )
+        CHECK( resorted.get_at_index(index - 1).get_record().rate > resorted.get_at_index(index).get_record().rate );
+}
+
+
+
+int main( ){
+    test_sort( "raw", false );
+    test_sort( "packed", true );
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file test_wal.cpp
+ *
+ * The write-ahead log: replay after a crash, and commits whose write
+ * fails partway.
+ */
+#include "../CampsiteDB.h"
+#include "../WriteAheadLog.h"
+#include "TestCheck.h"
+
+#include <csignal>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+
+
+static Campsite site( int number ){
+    return Campsite{ number, "site " + std::to_string(number), number % 2 == 0, 10.0 + number };
+}
+
+
+
+/**
+ * Writes logged before a crash are replayed on reopen, and a torn
+ * entry at the end of the log is ignored.
+ */
+static void test_replay( bool packed ){
+    ScratchDB scratch{ packed ? "wal_replay_packed" : "wal_replay" };
+    CampsiteDBOptions options;
+    options.write_ahead_log = true;
+    options.packed_format   = packed;
+    {
+        CampsiteDB db{ scratch.name(), options };
+        for ( int i = 0; i < 10; i++ )
+            db.append( site(i) );
+    }
+    crash_after( [&scratch, &options]( ){
+        CampsiteDB db{ scratch.name(), options };
+        db.swap_records( 0, 9 );
+        db.write_at_index( 3, site(333) );
+        db.write_batch( { {10, site(10)}, {11, site(11)}, {2, site(222)} } );
+        db.append( site(12) );
+    } );
+    {
+        std::ofstream log( scratch.name() + ".wal", std::ios::app | std::ios::binary );
+        log << "torn entry";
+    }
+
+    CampsiteDB db{ scratch.name(), options };
+    CHECK( db.get_record_count() == 13 );
+    CHECK( db.get_at_index(0).get_number() == 9 );
+    CHECK( db.get_at_index(9).get_number() == 0 );
+    CHECK( db.get_at_index(2).get_number() == 222 );
+    CHECK( db.get_at_index(3).get_description() == "site 333" );
+    CHECK( db.get_at_index(12).get_number() == 12 );
+    std::ifstream log( scratch.name() + ".wal", std::ios::ate | std::ios::binary );
+    CHECK( log.tellg() == 0 );
+}
+
+
+
+/**
+ * Commits from many threads while the log's writes start failing
+ * partway (the file size limit is hit).  Every commit that returned
+ * is recovered, none that threw is, and the log takes commits again
+ * once writes succeed.
+ */
+static void test_failed_writes( ){
+    ScratchDB scratch{"wal_failure"};
+    std::string filename = scratch.name() + ".wal";
+    const int threads = 8;
+    const int commits = 40;
+    std::signal( SIGXFSZ, SIG_IGN );  //exceeding the limit fails the write instead
+
+    WriteAheadLog log{ filename };
+    std::set<int> durable;
+    for ( int i = 0; i < 4; i++ ){
+        WalEntry entry{ -1 - i, 0, CampsiteRecord{} };
+        log.commit( &entry, 1 );
+        durable.insert( entry.index );
+    }
+
+    rlimit unlimited;
+    CHECK( getrlimit(RLIMIT_FSIZE, &unlimited) == 0 );
+    rlimit limited = unlimited;
+    limited.rlim_cur = log.size() + 5 * sizeof(WalEntry) / 2;  //room for about two more
+    CHECK( setrlimit(RLIMIT_FSIZE, &limited) == 0 );
+
+    std::vector<std::vector<int>> committed( threads );
+    int failures = 0;
+    std::mutex failures_mutex;
+    std::vector<std::thread> committers;
+    for ( int t = 0; t < threads; t++ )
+        committers.emplace_back( [&, t]( ){
+            for ( int i = 0; i < commits; i++ ){
+                WalEntry entry{ t * commits + i, 0, CampsiteRecord{} };
+                try {
+                    log.commit( &entry, 1 );
+                    committed[t].push_back( entry.index );
+                } catch ( const std::runtime_error& ) {
+                    std::lock_guard<std::mutex> guard( failures_mutex );
+                    failures++;
+                }
+            }
+        } );
+    for ( std::thread& committer : committers )
+        committer.join();
+    CHECK( setrlimit(RLIMIT_FSIZE, &unlimited) == 0 );
+    CHECK( failures > 0 );
+
+    for ( const std::vector<int>& indices : committed )
+        durable.insert( indices.begin(), indices.end() );
+    WalEntry last{ 100000, 0, CampsiteRecord{} };
+    log.commit( &last, 1 );
+    durable.insert( last.index );
+
+    std::set<int> recovered;
+    std::size_t transactions = 0;
+    for ( const std::vector<WalEntry>& transaction : log.recover() ){
+        for ( const WalEntry& entry : transaction )
+            recovered.insert( entry.index );
+        transactions++;
+    }
+    CHECK( recovered == durable );
+    CHECK( transactions == durable.size() );
+    std::ifstream file( filename, std::ios::ate | std::ios::binary );
+    CHECK( static_cast<std::uint64_t>(file.tellg()) == log.size() );
+}
+
+
+
+int main( ){
+    test_replay( false );
+    test_replay( true );
+    test_failed_writes();
+    return 0;
+}
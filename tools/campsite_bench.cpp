@@ -0,0 +1,382 @@
+/**
+ * @file campsite_bench.cpp
+ *
+ * Throughput and latency benchmarks for every CampsiteDB operation.
+ *
+ * Usage:
+ *     campsite_bench [--sizes n,n,...] [--ops n] [--dir path]
+ *                    [--mmap | --cache pages] [--packed] [--cold] [--json]
+ *                    [--buffer records] [--preallocate MB] [--stats]
+ *
+ * For each size a synthetic database of that many records is built in
+ * <dir>/bench_<size>.db (kept and reused by later runs), then each
+ * operation is timed call by call.  Results give calls per second,
+ * records per second and the p50/p99/p999 call latency.
+ *
+ * Sizes default to 1K through 100M records in steps of ten; the 100M
+ * database takes about 14 GB (raw) of disk.  --cold asks the kernel to
+ * drop the database file from its page cache before every benchmark,
+ * and reopens the database so its own page cache and mapping are empty
+ * too; otherwise the file is read once first so every benchmark starts
+ * warm.  overwrite_sequential rewrites the existing records from index
+ * 0; append_sequential grows a fresh file.
+ * --json writes one JSON document to stdout for regression tracking.
+ * --buffer and --preallocate turn on write-behind appends and file
+ * preallocation, which the append_sequential benchmark exercises.
+ * --stats turns on the per-operation counters and writes each size's
+ * snapshot to stderr as JSON, to see the I/O behind the timings.
+ */
+#include "../CampsiteDB.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * Stream buffer that throws away everything written to it.
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow( int c ) override { return c; }
+    std::streamsize xsputn( const char*, std::streamsize n ) override { return n; }
+};
+
+/**
+ * What was measured for one operation at one database size.
+ */
+struct Result {
+    std::string name;
+    int         size;
+    long        calls;
+    long        records;   /// records touched by all calls together
+    double      seconds;
+    double      p50_ns;
+    double      p99_ns;
+    double      p999_ns;
+};
+
+/**
+ * Settings taken from the command line.
+ */
+struct Settings {
+    std::vector<int>  sizes{ 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    long              ops  = 100000;  /// calls per benchmark (fewer for whole-file ones)
+    std::string       dir  = ".";
+    CampsiteDBOptions options;
+    bool              cold = false;
+    bool              json = false;
+};
+
+/**
+ * @return  the value at fraction q of the sorted latencies
+ */
+double percentile( const std::vector<double>& sorted, double q ){
+    if ( sorted.empty() )
+        return 0;
+    std::size_t at = static_cast<std::size_t>( q * (sorted.size() - 1) + 0.5 );
+    return sorted[at];
+}
+
+/**
+ * Times calls of op one at a time.
+ *
+ * @param name              benchmark name
+ * @param size              records in the database
+ * @param calls             how many times to call op
+ * @param records_per_call  records each call touches
+ * @param op                the operation; receives the call number
+ */
+Result measure( const std::string& name, int size, long calls, long records_per_call,
+                const std::function<void( long )>& op ){
+    using clock = std::chrono::steady_clock;
+    std::vector<double> latencies( calls );
+    clock::time_point start = clock::now();
+    for ( long i = 0; i < calls; i++ ){
+        clock::time_point before = clock::now();
+        op( i );
+        latencies[i] = std::chrono::duration<double, std::nano>( clock::now() - before ).count();
+    }
+    double seconds = std::chrono::duration<double>( clock::now() - start ).count();
+    std::sort( latencies.begin(), latencies.end() );
+    return Result{ name, size, calls, calls * records_per_call, seconds,
+                   percentile(latencies, 0.50), percentile(latencies, 0.99), percentile(latencies, 0.999) };
+}
+
+/**
+ * Makes a reproducible synthetic site for the given index.
+ */
+Campsite make_site( long index ){
+    static const char* kinds[] = { "tent site", "RV site, covered table", "cabin, riverfront",
+                                   "tent site, large, riverfront", "group site, pavilion" };
+    std::string description = kinds[index % 5];
+    description += " #" + std::to_string( index );
+    return Campsite{ static_cast<int>(index), description, index % 3 == 0, 10.0 + index % 40 };
+}
+
+/**
+ * Opens the benchmark database for a size, building it first if it
+ * does not exist or holds the wrong number of records.
+ */
+std::string prepare( const Settings& settings, int size ){
+    std::string name = settings.dir + "/bench_" + std::to_string( size ) + ".db";
+    {
+        CampsiteDB db{ name, settings.options };
+        if ( db.get_record_count() == size )
+            return name;
+    }
+    std::remove( name.c_str() );
+    std::remove( (name + ".heap").c_str() );
+    CampsiteDB db{ name, settings.options };
+    for ( long i = 0; i < size; i++ )
+        db.write_next_sequential( make_site(i) );
+    db.checkpoint();
+    return name;
+}
+
+/**
+ * Gets the database out of (or into) the caches before a benchmark,
+ * as asked.  A cold start closes and reopens the database, so its own
+ * page cache and mapping start empty along with the OS page cache.
+ */
+void set_temperature( const Settings& settings, std::unique_ptr<CampsiteDB>& db, const std::string& name ){
+    if ( !settings.cold ){
+        db->for_each_block( 0, db->get_record_count(), []( int, const CampsiteRecord*, int ){} );
+        return;
+    }
+    db->checkpoint();  //only clean pages can be dropped
+    db.reset();
+    for ( const std::string& file : { name, name + ".heap" } ){
+        int fd = ::open( file.c_str(), O_RDONLY );
+        if ( fd < 0 )
+            continue;
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        ::close( fd );
+    }
+    db.reset( new CampsiteDB{name, settings.options} );
+}
+
+/**
+ * Runs every benchmark against one database size.
+ */
+void run_size( const Settings& settings, int size, std::vector<Result>& results ){
+    std::string name = prepare( settings, size );
+    std::unique_ptr<CampsiteDB> db{ new CampsiteDB{name, settings.options} };
+    std::mt19937_64 random{ 2018 };
+    std::uniform_int_distribution<int> any_index{ 0, size - 1 };
+    long ops = settings.ops;
+    long sequential = std::min<long>( ops, size );
+    NullBuffer null;
+    std::ostream sink{ &null };
+
+    //setup runs after the temperature is set, since warming moves the markers
+    auto run = [&]( const std::string& benchmark, long calls, long records_per_call,
+                    const std::function<void( long )>& op, const std::function<void( )>& setup = nullptr ){
+        set_temperature( settings, db, name );
+        if ( setup )
+            setup();
+        results.push_back( measure(benchmark, size, calls, records_per_call, op) );
+    };
+
+    run( "get_at_index_sequential", sequential, 1, [&db]( long i ){
+        db->get_at_index( static_cast<int>(i) );
+    } );
+    std::vector<int> indices( ops );
+    for ( int& index : indices )
+        index = any_index( random );
+    run( "get_at_index_random", ops, 1, [&db, &indices]( long i ){
+        db->get_at_index( indices[i] );
+    } );
+    run( "get_random", ops, 1, [&db]( long ){
+        db->get_random();
+    } );
+    if ( ops >= 1000 )
+        run( "get_random_sample_1000", ops / 1000, 1000, [&db]( long i ){
+            db->get_random_sample( 1000, true, static_cast<std::uint32_t>(i) );
+        } );
+    const long batch = 256;
+    if ( ops >= batch )
+        run( "get_many_" + std::to_string(batch), ops / batch, batch, [&db, &indices]( long i ){
+            auto first = indices.begin() + i * batch;
+            db->get_many( std::vector<int>(first, first + batch) );
+        } );
+    for ( int width : { 10, 100, 1000, 10000 } ){
+        if ( width > size )
+            continue;
+        std::uniform_int_distribution<int> any_start{ 0, size - width };
+        std::vector<int> starts( std::max<long>(1, ops / width) );
+        for ( int& start : starts )
+            start = any_start( random );
+        run( "get_range_" + std::to_string(width), starts.size(), width, [&db, &starts, width]( long i ){
+            db->get_range( starts[i], starts[i] + width );
+        } );
+    }
+    CampsiteQuery electric_under_40;
+    electric_under_40.electric = 1;
+    electric_under_40.rate_max = 39.99;
+    run( "summarize_rate", 1, size, [&db, &electric_under_40]( long ){
+        db->summarize_rate( electric_under_40 );
+    } );
+    run( "list_records", 1, size, [&db, &sink]( long ){
+        db->list_records( sink );
+    } );
+    run( "export_pipe", 1, size, [&db, &sink]( long ){
+        db->export_text( sink, TextFormat::pipe );
+    } );
+
+    run( "overwrite_sequential", sequential, 1, [&db]( long i ){
+        db->write_next_sequential( make_site(i) );
+    }, [&db]( ){
+        db->move_to_index( 0 );
+    } );
+    {
+        //appends go to a scratch database, so the benchmark database keeps its size
+        std::string scratch = settings.dir + "/bench_append.db";
+        std::remove( scratch.c_str() );
+        std::remove( (scratch + ".heap").c_str() );
+        CampsiteDB appended{ scratch, settings.options };
+        results.push_back( measure("append_sequential", size, sequential, 1, [&appended]( long i ){
+            appended.write_next_sequential( make_site(i) );
+        }) );
+        appended.flush();
+    }
+    std::remove( (settings.dir + "/bench_append.db").c_str() );
+    std::remove( (settings.dir + "/bench_append.db.heap").c_str() );
+    run( "write_at_index", ops, 1, [&db, &indices]( long i ){
+        db->write_at_index( indices[i], make_site(indices[i]) );
+    } );
+    run( "swap_records", ops, 2, [&db, &indices]( long i ){
+        db->swap_records( indices[i], indices[(i + 1) % indices.size()] );
+    } );
+    db->checkpoint();
+    if ( settings.options.collect_stats )
+        std::cerr << "stats " << size << ": " << db->stats().to_json() << "\n";
+}
+
+/**
+ * Prints the results as a table for people.
+ */
+void print_table( const std::vector<Result>& results ){
+    cout << std::left << std::setw(26) << "benchmark" << std::right
+         << std::setw(11) << "records" << std::setw(14) << "calls/s" << std::setw(14) << "records/s"
+         << std::setw(11) << "p50 ns" << std::setw(11) << "p99 ns" << std::setw(12) << "p999 ns" << "\n";
+    cout << std::fixed << std::setprecision(0);
+    for ( const Result& r : results ){
+        cout << std::left << std::setw(26) << r.name << std::right
+             << std::setw(11) << r.size
+             << std::setw(14) << r.calls / r.seconds << std::setw(14) << r.records / r.seconds
+             << std::setw(11) << r.p50_ns << std::setw(11) << r.p99_ns << std::setw(12) << r.p999_ns << "\n";
+    }
+}
+
+/**
+ * Prints the results as one JSON document.
+ */
+void print_json( const Settings& settings, const std::vector<Result>& results ){
+    const CampsiteDBOptions& o = settings.options;
+    cout << "{\n  \"config\": {\"mmap\": " << ( o.memory_mapped ? "true" : "false" )
+         << ", \"cache_pages\": " << o.cache_pages
+         << ", \"packed\": " << ( o.packed_format ? "true" : "false" )
+         << ", \"append_buffer\": " << o.append_buffer_records
+         << ", \"preallocate\": " << o.preallocate_bytes
+         << ", \"cold\": " << ( settings.cold ? "true" : "false" )
+         << ", \"ops\": " << settings.ops << "},\n  \"results\": [\n";
+    cout << std::fixed << std::setprecision(1);
+    for ( std::size_t i = 0; i < results.size(); i++ ){
+        const Result& r = results[i];
+        cout << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+             << ", \"calls\": " << r.calls << ", \"seconds\": " << std::setprecision(6) << r.seconds
+             << std::setprecision(1)
+             << ", \"calls_per_sec\": " << r.calls / r.seconds
+             << ", \"records_per_sec\": " << r.records / r.seconds
+             << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns
+             << ", \"p999_ns\": " << r.p999_ns << "}" << ( i + 1 < results.size() ? "," : "" ) << "\n";
+    }
+    cout << "  ]\n}\n";
+}
+
+/**
+ * @return  the comma-separated sizes in text
+ */
+std::vector<int> parse_sizes( const std::string& text ){
+    std::vector<int> sizes;
+    std::stringstream in{ text };
+    std::string item;
+    while ( std::getline(in, item, ',') )
+        if ( !item.empty() )
+            sizes.push_back( std::stoi(item) );
+    return sizes;
+}
+
+}
+
+
+int main( int argc, char* argv[] ){
+    Settings settings;
+    try {
+        for ( int i = 1; i < argc; i++ ){
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if ( arg == "--sizes" && has_value )
+                settings.sizes = parse_sizes( argv[++i] );
+            else if ( arg == "--ops" && has_value )
+                settings.ops = std::stol( argv[++i] );
+            else if ( arg == "--dir" && has_value )
+                settings.dir = argv[++i];
+            else if ( arg == "--cache" && has_value )
+                settings.options.cache_pages = std::stoi( argv[++i] );
+            else if ( arg == "--mmap" )
+                settings.options.memory_mapped = true;
+            else if ( arg == "--packed" )
+                settings.options.packed_format = true;
+            else if ( arg == "--buffer" && has_value )
+                settings.options.append_buffer_records = std::stoi( argv[++i] );
+            else if ( arg == "--preallocate" && has_value )
+                settings.options.preallocate_bytes = std::stoul( argv[++i] ) << 20;
+            else if ( arg == "--stats" )
+                settings.options.collect_stats = true;
+            else if ( arg == "--cold" )
+                settings.cold = true;
+            else if ( arg == "--json" )
+                settings.json = true;
+            else
+                throw std::invalid_argument{ arg };
+        }
+    } catch ( const std::exception& ) {
+        std::cerr << "usage: " << argv[0] << " [--sizes n,n,...] [--ops n] [--dir path]\n"
+                  << "       [--mmap | --cache pages] [--packed] [--cold] [--json]\n"
+                  << "       [--buffer records] [--preallocate MB] [--stats]\n";
+        return 2;
+    }
+
+    std::vector<Result> results;
+    try {
+        for ( int size : settings.sizes ){
+            if ( size <= 0 )
+                continue;
+            if ( !settings.json )
+                std::cerr << "benchmarking " << size << " records...\n";
+            run_size( settings, size, results );
+        }
+    } catch ( const std::exception& e ) {
+        std::cerr << "benchmark failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    if ( settings.json )
+        print_json( settings, results );
+    else
+        print_table( results );
+    return 0;
+}
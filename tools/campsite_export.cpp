@@ -0,0 +1,49 @@
+/**
+ * @file campsite_export.cpp
+ *
+ * Writes the records of a CampsiteDB file to standard output as text.
+ *
+ * Usage:
+ *     campsite_export [--format listing|pipe|csv] <database.db>
+ *
+ * The pipe format can be read back with bulk_load or from_ascii_file;
+ * the listing format matches list_records.
+ */
+#include "../CampsiteDB.h"
+
+#include <string>
+
+#include <unistd.h>
+
+
+int main( int argc, char* argv[] ){
+    TextFormat format = TextFormat::listing;
+    int i = 1;
+    for ( ; i + 1 < argc; i += 2 ){
+        std::string option = argv[i], value = argv[i + 1];
+        if ( option != "--format" )
+            break;
+        if ( value == "listing" )
+            format = TextFormat::listing;
+        else if ( value == "pipe" )
+            format = TextFormat::pipe;
+        else if ( value == "csv" )
+            format = TextFormat::csv;
+        else
+            break;
+    }
+    if ( i != argc - 1 ){
+        std::cerr << "usage: " << argv[0] << " [--format listing|pipe|csv] <database.db>\n";
+        return 2;
+    }
+
+    try {
+        CampsiteDB db{ argv[i] };
+        std::size_t written = db.export_text( STDOUT_FILENO, format );
+        std::cerr << "Exported " << written << " records\n";
+    } catch ( const std::exception& e ) {
+        std::cerr << "export failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
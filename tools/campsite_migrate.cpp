@@ -0,0 +1,41 @@
+/**
+ * @file campsite_migrate.cpp
+ *
+ * One-shot conversion of a CampsiteDB file to another format.
+ *
+ * Usage:
+ *     campsite_migrate [--raw] <source.db> <destination.db>
+ *
+ * By default the destination is written in the packed format (fixed
+ * fields packed densely, descriptions in <destination.db>.heap).  Any
+ * readable database can be the source: a headerless legacy file, a
+ * raw file or a packed file.
+ */
+#include "../CampsiteDB.h"
+
+#include <cstring>
+
+
+int main( int argc, char* argv[] ){
+    bool packed = true;
+    int  first_arg = 1;
+    if ( argc > 1 && std::strcmp(argv[1], "--raw") == 0 ){
+        packed = false;
+        first_arg = 2;
+    }
+    if ( argc - first_arg != 2 ){
+        std::cerr << "usage: " << argv[0] << " [--raw] <source.db> <destination.db>\n";
+        return 2;
+    }
+
+    try {
+        CampsiteDB::migrate( argv[first_arg], argv[first_arg + 1], packed );
+        CampsiteDB result{ argv[first_arg + 1] };
+        cout << "Migrated " << result.get_record_count() << " records to "
+             << argv[first_arg + 1] << ( packed ? " (packed)" : " (raw)" ) << "\n";
+    } catch ( const std::exception& e ) {
+        std::cerr << "migration failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
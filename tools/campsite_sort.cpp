@@ -0,0 +1,44 @@
+/**
+ * @file campsite_sort.cpp
+ *
+ * Physically reorders a CampsiteDB file by site number or rate.
+ *
+ * Usage:
+ *     campsite_sort [--key number|rate] [--memory megabytes] <database.db>
+ *
+ * The database must not be open elsewhere.  It is sorted out of core
+ * in bounded memory (256 MB unless --memory says otherwise) and then
+ * atomically replaced by its sorted copy.
+ */
+#include "../CampsiteDB.h"
+
+#include <string>
+
+
+int main( int argc, char* argv[] ){
+    SortKey key = SortKey::number;
+    std::size_t memory = CampsiteDB::default_sort_memory;
+    int i = 1;
+    for ( ; i + 1 < argc; i += 2 ){
+        std::string option = argv[i], value = argv[i + 1];
+        if ( option == "--key" && ( value == "number" || value == "rate" ) )
+            key = value == "rate" ? SortKey::rate : SortKey::number;
+        else if ( option == "--memory" && std::atol(value.c_str()) > 0 )
+            memory = static_cast<std::size_t>( std::atol(value.c_str()) ) << 20;
+        else
+            break;
+    }
+    if ( i != argc - 1 ){
+        std::cerr << "usage: " << argv[0] << " [--key number|rate] [--memory megabytes] <database.db>\n";
+        return 2;
+    }
+
+    try {
+        CampsiteDB::sort_file( argv[i], key, memory );
+        cout << "Sorted " << argv[i] << " by " << ( key == SortKey::rate ? "rate" : "number" ) << "\n";
+    } catch ( const std::exception& e ) {
+        std::cerr << "sort failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file campsite_verify.cpp
+ *
+ * Checks every record of a CampsiteDB file against its checksum, and
+ * repairs the records that fail.
+ *
+ * Usage:
+ *     campsite_verify [--threads n] [--backup <copy.db>] [--accept] <database.db>
+ *
+ * The database must not be open elsewhere, and should have been kept
+ * with checksums (<database.db>.crc); one without them is checksummed
+ * as it stands, which finds nothing.  Records are checked on every
+ * core (or n threads) with large reads.  Failing records are repaired,
+ * in order:
+ *
+ *   - from the write-ahead log: if <database.db>.wal holds writes a
+ *     crash left behind, they are replayed first, rewriting every
+ *     record they touch along with its checksum.  The log is emptied
+ *     at every checkpoint, so it only holds writes since the last one;
+ *     a record damaged after its write was checkpointed is not in it,
+ *     and can only be restored from a backup;
+ *   - from --backup, a copy of the database file: a record is copied
+ *     back if the copy holds exactly what its checksum expects.  A
+ *     packed file's checksums cover the descriptions too, and a
+ *     damaged description is copied back from <copy.db>.heap;
+ *   - with --accept, records that still fail are taken as they stand.
+ *
+ * Exits with 0 if no record fails in the end, 1 if some do.
+ */
+#include "../CampsiteDB.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include <sys/stat.h>
+
+
+int main( int argc, char* argv[] ){
+    int threads = 0;
+    std::string backup;
+    bool accept = false;
+    int i = 1;
+    for ( ; i < argc - 1; i++ ){
+        std::string option = argv[i];
+        if ( option == "--threads" && i + 1 < argc - 1 && std::atoi(argv[i + 1]) > 0 )
+            threads = std::atoi( argv[++i] );
+        else if ( option == "--backup" && i + 1 < argc - 1 )
+            backup = argv[++i];
+        else if ( option == "--accept" )
+            accept = true;
+        else
+            break;
+    }
+    if ( i != argc - 1 ){
+        std::cerr << "usage: " << argv[0] << " [--threads n] [--backup <copy.db>] [--accept] <database.db>\n";
+        return 2;
+    }
+
+    std::string filename = argv[i];
+    struct stat info;
+    CampsiteDBOptions options;
+    options.checksums = true;
+    options.write_ahead_log = stat( (filename + ".wal").c_str(), &info ) == 0 && info.st_size > 0;
+    if ( stat((filename + ".crc").c_str(), &info) != 0 )
+        std::cerr << "warning: " << filename << " has no checksums yet; they are taken from the records as they stand\n";
+
+    try {
+        CampsiteDB db{ filename, options };
+        if ( options.write_ahead_log )
+            cout << "Replayed the write-ahead log\n";
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<int> failed = db.verify( threads );
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        double megabytes = stat( filename.c_str(), &info ) == 0 ? info.st_size / 1e6 : 0;
+        cout << "Checked " << db.get_record_count() << " records in " << seconds << " s";
+        if ( seconds > 0 )
+            cout << " (" << megabytes / seconds << " MB/s)";
+        cout << " with " << ( crc32c_uses_sse42() ? "SSE4.2" : "table-driven" ) << " CRC32C\n";
+        for ( int index : failed )
+            cout << "record " << index << " failed its checksum\n";
+
+        if ( !failed.empty() && !backup.empty() ){
+            int restored = db.restore_from_copy( backup, failed );
+            cout << "Restored " << restored << " records from " << backup << "\n";
+            failed = db.verify( threads );
+        }
+        if ( !failed.empty() && accept ){
+            db.accept_records( failed );
+            cout << "Accepted " << failed.size() << " records as they stand\n";
+            failed = db.verify( threads );
+        }
+
+        cout << failed.size() << " records fail their checksums\n";
+        return failed.empty() ? 0 : 1;
+    } catch ( const std::exception& e ) {
+        std::cerr << "verify failed: " << e.what() << "\n";
+        return 1;
+    }
+}